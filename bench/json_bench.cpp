@@ -0,0 +1,178 @@
+// Compares the ways JSON input is decoded: POST /transit bodies through the nlohmann::json DOM,
+// the fixed-schema pull parser in transit_parser.hpp and the JSON backend in json_backend.hpp, and
+// emission-factor files through the DOM and the backend; and how the lifetime-footprint response is
+// encoded, by dump() and by the JsonWriter in json_writer.hpp. Usage:
+//
+//   charizard_json_bench [iterations=1000000] [factors=20000]
+//
+// The backend is nlohmann::json unless built with -DCHARIZARD_WITH_SIMDJSON=ON; build both ways to
+// compare them. Each row reports throughput and the heap allocations made per document, counted by
+// the replaced global operator new below.
+#include "emission_data_loader.hpp"
+#include "json_backend.hpp"
+#include "json_writer.hpp"
+#include "transit_logic.hpp"
+#include "transit_parser.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::atomic<std::size_t> g_allocations{ 0 };
+
+// Kept out of line so GCC doesn't pair the inlined malloc/free with new/delete expressions and
+// warn (-Wmismatched-new-delete).
+
+__attribute__((noinline)) void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string& op, std::size_t n, std::size_t bytes, std::size_t allocs, double secs)
+{
+    std::cout << std::left << std::setw(36) << op << std::right << std::setw(12)
+              << static_cast<long long>(static_cast<double>(n) / secs) << " ops/s" << std::setw(10)
+              << std::fixed << std::setprecision(1) << static_cast<double>(bytes) / secs / 1e6 << " MB/s"
+              << std::setw(12) << std::setprecision(2) << static_cast<double>(allocs) / static_cast<double>(n)
+              << " allocs/op\n";
+}
+
+// Runs `fn` over the bodies round-robin; `sink` keeps the work from being optimised away.
+template <typename Fn>
+void run(const std::string& op, const std::vector<std::string>& bodies, std::size_t iterations, Fn fn)
+{
+    std::size_t bytes  = 0;
+    double      sink   = 0.0;
+    const auto  before = g_allocations.load();
+    const auto  start  = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        const auto& body = bodies[i % bodies.size()];
+        bytes += body.size();
+        sink += fn(body);
+    }
+    const double secs = seconds_since(start);
+    report(op, iterations, bytes, g_allocations.load() - before, secs);
+    if (sink < 0.0)
+        std::cerr << sink << '\n';
+}
+
+// A factor file of `n` entries in the shape load_from_json() expects.
+std::string factor_file(std::size_t n)
+{
+    const char*        modes[] = { "car", "taxi", "bus", "train", "subway" };
+    const char*        fuels[] = { "petrol", "diesel", "hybrid", "electric" };
+    const char*        sizes[] = { "small", "medium", "large" };
+    std::ostringstream out;
+    out << '[';
+    for (std::size_t i = 0; i < n; ++i)
+        out << (i == 0 ? "" : ",\n") << R"({"mode":")" << modes[i % 5] << R"(","fuel_type":")" << fuels[i % 4]
+            << R"(","vehicle_size":")" << sizes[i % 3]
+            << R"(","kg_co2_per_km":)" << 0.01 * static_cast<double>(i % 97)
+            << R"(,"source":"BENCH","updated_at":)" << 1700000000 + i << '}';
+    out << ']';
+    return out.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    const std::size_t n_factors  = argc > 2 ? std::stoul(argv[2]) : 20000;
+    const std::string user       = "bench_user";
+    const std::string backend    = json_backend_name();
+
+    const std::vector<std::string> bodies = {
+        R"({"mode":"bus","distance_km":4.2})",
+        R"({"mode":"car","distance_km":18.75,"ts":1700000000})",
+        R"({"mode":"taxi","distance_km":7.3,"ts":1700003600,"fuel_type":"hybrid","vehicle_size":"medium",)"
+        R"("occupancy":2})",
+        R"({ "mode": "train", "distance_km": 42, "ts": 1700007200 })",
+    };
+
+    run("nlohmann::json::parse", bodies, iterations,
+        [](const std::string& body) { return nlohmann::json::parse(body)["distance_km"].get<double>(); });
+    run("parse_transit_payload", bodies, iterations,
+        [](const std::string& body)
+        {
+            TransitPayload p;
+            return parse_transit_payload(body, p) ? p.distance_km : -1.0;
+        });
+    run("nlohmann -> TransitEvent", bodies, iterations,
+        [&](const std::string& body)
+        { return make_transit_event_from_json(user, nlohmann::json::parse(body), 1).distance_km; });
+    run("pull parser -> TransitEvent", bodies, iterations,
+        [&](const std::string& body)
+        {
+            TransitPayload p;
+            parse_transit_payload(body, p);
+            return make_transit_event(user, p, 1).distance_km;
+        });
+    run("decode_transit_body [" + backend + "]", bodies, iterations,
+        [](const std::string& body) { return decode_transit_body(body).distance_km; });
+
+    // Documents of about 2 MB, so these rows show sustained parsing speed
+    const std::vector<std::string> files      = { factor_file(n_factors) };
+    const std::size_t              file_iters = std::max<std::size_t>(1, iterations / n_factors);
+    run("nlohmann::json::parse (factors)", files, file_iters,
+        [](const std::string& text) { return static_cast<double>(nlohmann::json::parse(text).size()); });
+    run("load_from_json [" + backend + "]", files, file_iters,
+        [](const std::string& text)
+        { return static_cast<double>(EmissionDataLoader::load_from_json(text).size()); });
+
+    // The inputs here are user ids; MB/s counts those, so compare the ops/s and allocs/op columns
+    const std::vector<std::string> users = { "u_0001", "u_1234abcd", "user_with_a_longer_id_42" };
+    run("json{...}.dump() (footprint)", users, iterations,
+        [](const std::string& id)
+        {
+            const nlohmann::json j = { { "user_id", id },
+                                       { "lifetime_kg_co2", 1234.5678 },
+                                       { "last_7d_kg_co2", 12.3 },
+                                       { "last_30d_kg_co2", 55.59009 } };
+            return static_cast<double>(j.dump().size());
+        });
+    run("JsonWriter (footprint)", users, iterations,
+        [](const std::string& id)
+        {
+            auto& out = response_buffer();
+            JsonWriter(out)
+                .begin_object()
+                .field("last_30d_kg_co2", 55.59009)
+                .field("last_7d_kg_co2", 12.3)
+                .field("lifetime_kg_co2", 1234.5678)
+                .field("user_id", id)
+                .end_object();
+            return static_cast<double>(out.size());
+        });
+    return 0;
+}
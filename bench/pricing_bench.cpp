@@ -0,0 +1,106 @@
+// Compares pricing trips one at a time, as calculate_co2_emissions(ev) does, with pricing them in
+// batches through BatchPricer (batch_pricer.hpp), which resolves each trip's factor once and then
+// prices columnar arrays in one loop. Usage:
+//
+//   charizard_pricing_bench [events=1000000] [batch=256]
+//
+// The batch rows include resolving the ids and building the columns; the last row times the
+// pricing loop alone, with the columns already built, as recomputing a user's rollups does.
+#include "batch_pricer.hpp"
+#include "storage.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string& op, std::size_t n, double secs)
+{
+    std::cout << std::left << std::setw(36) << op << std::right << std::setw(14)
+              << static_cast<long long>(static_cast<double>(n) / secs) << " events/s" << std::setw(12)
+              << std::fixed << std::setprecision(2) << secs * 1e9 / static_cast<double>(n) << " ns/event\n";
+}
+
+// A mix of transit and private trips, with fuel types and sizes the default table knows.
+std::vector<TransitEvent> make_trips(std::size_t n)
+{
+    const char* modes[] = { "car", "bus", "taxi", "train", "subway", "car", "bike" };
+    const char* fuels[] = { "petrol", "diesel", "hybrid", "electric" };
+    const char* sizes[] = { "small", "medium", "large" };
+
+    std::vector<TransitEvent> evs;
+    evs.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        TransitEvent ev("bench_user", modes[i % 7], 0.5 + static_cast<double>(i % 400) * 0.1,
+                        1700000000 + static_cast<std::int64_t>(i));
+        ev.fuel_type    = fuels[i % 4];
+        ev.vehicle_size = sizes[i % 3];
+        ev.occupancy    = 1.0 + static_cast<double>(i % 3);
+        evs.push_back(std::move(ev));
+    }
+    return evs;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t n     = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    const std::size_t batch = std::max<std::size_t>(1, argc > 2 ? std::stoul(argv[2]) : 256);
+    const auto        evs   = make_trips(n);
+    double            sink  = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& ev : evs)
+        sink += calculate_co2_emissions(ev);
+    report("calculate_co2_emissions(ev)", n, seconds_since(start));
+
+    // Split up front, so the row doesn't time copying the events
+    std::vector<std::vector<TransitEvent>> chunks;
+    for (std::size_t i = 0; i < n; i += batch)
+        chunks.emplace_back(evs.begin() + static_cast<std::ptrdiff_t>(i),
+                            evs.begin() + static_cast<std::ptrdiff_t>(std::min(n, i + batch)));
+    start = std::chrono::steady_clock::now();
+    for (const auto& chunk : chunks)
+        for (double kg : calculate_co2_emissions(chunk))
+            sink += kg;
+    report("calculate_co2_emissions(evs) x" + std::to_string(batch), n, seconds_since(start));
+
+    BatchPricer                pricer;
+    std::vector<std::uint32_t> ids(n);
+    std::vector<double>        distance(n);
+    std::vector<double>        occupancy(n);
+    std::vector<double>        kg(n);
+    start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        ids[i]       = pricer.id_of(evs[i]);
+        distance[i]  = evs[i].distance_km;
+        occupancy[i] = evs[i].occupancy;
+    }
+    report("BatchPricer::id_of + columns", n, seconds_since(start));
+
+    start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < n; i += batch)
+        pricer.price(ids.data() + i, distance.data() + i, occupancy.data() + i, kg.data() + i,
+                     std::min(batch, n - i));
+    report("BatchPricer::price x" + std::to_string(batch), n, seconds_since(start));
+    for (double v : kg)
+        sink += v;
+
+    if (sink < 0.0)
+        std::cerr << sink << '\n';
+    return 0;
+}
@@ -0,0 +1,108 @@
+// Compares IStore backends on the request path's hot operations: add_event (POST /transit),
+// get_events and summarize (GET /lifetime-footprint). Usage:
+//
+//   charizard_store_bench [events=200000] [users=1000] [dir=/tmp/charizard_bench]
+//
+// MongoStore is included when built with CHARIZARD_WITH_MONGO and MONGO_URI is set (it uses
+// the "charizard_bench" database and clears it).
+#include "kv_store.hpp"
+#include "storage.hpp"
+#ifdef CHARIZARD_WITH_MONGO
+#include "mongo_store.hpp"
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace
+{
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string& backend, const std::string& op, std::size_t n, double secs)
+{
+    std::cout << std::left << std::setw(22) << backend << std::setw(14) << op << std::right << std::setw(12)
+              << static_cast<long long>(static_cast<double>(n) / secs) << " ops/s" << std::setw(12)
+              << std::fixed << std::setprecision(2) << secs * 1e6 / static_cast<double>(n) << " us/op\n";
+}
+
+void run(const std::string& name, IStore& store, std::size_t events, std::size_t users)
+{
+    const char* modes[] = { "car", "bus", "train", "bike", "walk" };
+    const auto  now     = std::chrono::duration_cast<std::chrono::seconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < events; ++i)
+    {
+        TransitEvent ev("user" + std::to_string(i % users), modes[i % 5], 1.0 + static_cast<double>(i % 40),
+                        now - static_cast<std::int64_t>(i % (60 * 24 * 3600)));
+        store.add_event(ev);
+    }
+    report(name, "add_event", events, seconds_since(start));
+
+    start = std::chrono::steady_clock::now();
+    std::size_t seen = 0;
+    for (std::size_t u = 0; u < users; ++u)
+        seen += store.get_events("user" + std::to_string(u)).size();
+    report(name, "get_events", users, seconds_since(start));
+    if (seen != events)
+        std::cerr << name << ": expected " << events << " events, read " << seen << '\n';
+
+    start = std::chrono::steady_clock::now();
+    for (std::size_t u = 0; u < users; ++u)
+        store.summarize("user" + std::to_string(u));
+    report(name, "summarize", users, seconds_since(start));
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t events = argc > 1 ? std::stoul(argv[1]) : 200000;
+    const std::size_t users  = argc > 2 ? std::stoul(argv[2]) : 1000;
+    const std::string dir    = argc > 3 ? argv[3] : "/tmp/charizard_bench";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    {
+        InMemoryStore store;
+        run("InMemoryStore", store, events, users);
+    }
+    {
+        InMemoryStore store;
+        store.open_wal(dir + "/inmemory.wal");
+        run("InMemoryStore+WAL", store, events, users);
+    }
+    {
+        KvStore store(dir + "/kv");
+        run("KvStore", store, events, users);
+    }
+    {
+        KvOptions opts;
+        opts.wal.sync = false;
+        KvStore store(dir + "/kv_nosync", opts);
+        run("KvStore (WAL_SYNC=0)", store, events, users);
+    }
+#ifdef CHARIZARD_WITH_MONGO
+    if (const char* uri = std::getenv("MONGO_URI"))
+    {
+        MongoStore store(uri, "charizard_bench");
+        store.clear_db();
+        run("MongoStore", store, events, users);
+        store.clear_db();
+    }
+#endif
+    std::filesystem::remove_all(dir);
+    return 0;
+}
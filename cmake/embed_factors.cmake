@@ -0,0 +1,124 @@
+# Turns emission-factor CSV files into a header of constexpr tables, so the default factors are
+# compiled into the binary instead of being built at runtime. Run in script mode:
+#
+#   cmake -DINPUTS=a.csv,b.csv -DOUTPUT=embedded_factor_data.hpp -P embed_factors.cmake
+#
+# Each input becomes `k_<file stem>_factors`. The files use the loader's positional layout
+# (mode,fuel_type,vehicle_size,kg_co2_per_km,source, with a header line) and no quoting, so they can
+# also be given to EMISSION_FACTORS_PATH as they are. Modes, fuel types and vehicle sizes become
+# enumerators of FactorMode, FactorFuel and FactorSize, in order of first appearance; an empty fuel
+# type or vehicle size is `none`.
+
+cmake_minimum_required(VERSION 3.16)
+
+if(NOT INPUTS OR NOT OUTPUT)
+  message(FATAL_ERROR "usage: cmake -DINPUTS=<csv>[,<csv>...] -DOUTPUT=<header> -P embed_factors.cmake")
+endif()
+
+string(REPLACE "," ";" inputs "${INPUTS}")
+set(input_names "")
+set(modes "")
+set(fuels "none")
+set(sizes "none")
+set(tables "")
+
+foreach(input IN LISTS inputs)
+  get_filename_component(stem "${input}" NAME_WE)
+  get_filename_component(name "${input}" NAME)
+  list(APPEND input_names "${name}")
+  if(NOT stem MATCHES "^[a-z][a-z0-9_]*$")
+    message(FATAL_ERROR "${input}: file name must be a lower-case identifier")
+  endif()
+  file(STRINGS "${input}" lines)
+  list(POP_FRONT lines header)
+  if(NOT header STREQUAL "mode,fuel_type,vehicle_size,kg_co2_per_km,source")
+    message(FATAL_ERROR "${input}: expected header mode,fuel_type,vehicle_size,kg_co2_per_km,source")
+  endif()
+
+  set(rows "")
+  set(line_no 1)
+  foreach(line IN LISTS lines)
+    math(EXPR line_no "${line_no} + 1")
+    string(STRIP "${line}" line)
+    if(line STREQUAL "")
+      continue()
+    endif()
+    if(line MATCHES "[\"\\\\]")
+      message(FATAL_ERROR "${input}:${line_no}: quotes and backslashes are not supported here")
+    endif()
+    string(REPLACE "," ";" fields "${line}")
+    list(LENGTH fields n)
+    if(NOT n EQUAL 5)
+      message(FATAL_ERROR "${input}:${line_no}: expected 5 fields, found ${n}")
+    endif()
+    list(GET fields 0 mode)
+    list(GET fields 1 fuel)
+    list(GET fields 2 size)
+    list(GET fields 3 kg)
+    list(GET fields 4 source)
+    if(fuel STREQUAL "")
+      set(fuel none)
+    endif()
+    if(size STREQUAL "")
+      set(size none)
+    endif()
+    foreach(name IN ITEMS "${mode}" "${fuel}" "${size}")
+      if(NOT name MATCHES "^[a-z][a-z0-9_]*$")
+        message(FATAL_ERROR "${input}:${line_no}: '${name}' is not a lower-case identifier")
+      endif()
+    endforeach()
+    if(NOT kg MATCHES "^[0-9]+(\\.[0-9]+)?([eE][-+]?[0-9]+)?$")
+      message(FATAL_ERROR "${input}:${line_no}: '${kg}' is not a non-negative number")
+    endif()
+    foreach(kind IN ITEMS mode fuel size)
+      list(FIND ${kind}s "${${kind}}" found)
+      if(found EQUAL -1)
+        list(APPEND ${kind}s "${${kind}}")
+      endif()
+    endforeach()
+    string(APPEND rows "    { FactorMode::${mode}, FactorFuel::${fuel}, FactorSize::${size}, "
+                       "${kg}, \"${source}\" },\n")
+  endforeach()
+  if(rows STREQUAL "")
+    message(FATAL_ERROR "${input}: no factors")
+  endif()
+  string(APPEND tables "\ninline constexpr EmbeddedFactor k_${stem}_factors[] = {\n${rows}};\n")
+endforeach()
+
+# enum class <type> plus k_<prefix>_names; `none` is spelled as the empty string
+function(emit_enum type prefix names_var out_var)
+  string(JOIN ", " enumerators ${${names_var}})
+  set(spelled "")
+  foreach(name IN LISTS ${names_var})
+    if(name STREQUAL "none")
+      list(APPEND spelled "\"\"")
+    else()
+      list(APPEND spelled "\"${name}\"")
+    endif()
+  endforeach()
+  string(JOIN ", " spelled ${spelled})
+  set(${out_var} "enum class ${type} : unsigned char\n{\n    ${enumerators}\n};\n\n")
+  string(APPEND ${out_var} "inline constexpr std::string_view k_${prefix}_names[] = { ${spelled} };\n")
+  set(${out_var} "${${out_var}}" PARENT_SCOPE)
+endfunction()
+emit_enum(FactorMode factor_mode modes mode_enum)
+emit_enum(FactorFuel factor_fuel fuels fuel_enum)
+emit_enum(FactorSize factor_size sizes size_enum)
+
+string(JOIN ", " input_names ${input_names})
+file(WRITE "${OUTPUT}" "// Generated by cmake/embed_factors.cmake from ${input_names}. Do not edit.
+#pragma once
+#include <string_view>
+
+${mode_enum}
+${fuel_enum}
+${size_enum}
+struct EmbeddedFactor
+{
+    FactorMode       mode;
+    FactorFuel       fuel_type;
+    FactorSize       vehicle_size;
+    double           kg_co2_per_km;
+    std::string_view source;
+};
+${tables}")
@@ -0,0 +1,60 @@
+#pragma once
+#include "hyperloglog.hpp"
+#include "storage.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ActiveUserCounts
+{
+    std::uint64_t daily   = 0; // the UTC day of `now`
+    std::uint64_t weekly  = 0; // the 7 days ending on it
+    std::uint64_t monthly = 0; // the 30 days ending on it
+};
+
+/**
+ * Approximate distinct active users per UTC day: one HyperLogLog per day for the last k_days
+ * days, in a ring reused as days roll over, so memory stays at k_days sketches however many users
+ * there are. Weekly and monthly counts merge the days they cover. Fed by record() for every
+ * event the store ingests (see attach()); the sketches live in memory only, so seed() rebuilds them from the stores'
+ * daily rollups at startup. Thread-safe.
+ */
+class ActiveUsers
+{
+  public:
+    static constexpr std::int64_t k_days = 30;
+
+    explicit ActiveUsers(unsigned precision = 12);
+
+    // Counts `user` as active on the UTC day of `ts`. Events older than the ring are ignored.
+    void record(const std::string& user, std::int64_t ts);
+    // Records every user with trips in the k_days days ending on the day of `now`.
+    void seed(const IStore& store, std::int64_t now);
+    // Records every event `store` ingests from now on, through any path (see
+    // IStore::set_ingest_listener). This must outlive the store's writes.
+    void attach(IStore& store);
+
+    ActiveUserCounts counts(std::int64_t now) const;
+    // Distinct users over [from_day, to_day], limited to the days still in the ring.
+    std::uint64_t estimate(std::int64_t from_day, std::int64_t to_day) const;
+    // (day, distinct users) for each of the `days` days ending on the day of `now`, oldest first.
+    std::vector<std::pair<std::int64_t, std::uint64_t>> daily(std::int64_t now, std::int64_t days) const;
+
+    std::size_t memory_bytes() const;
+    double      relative_error() const;
+
+  private:
+    struct Day
+    {
+        std::int64_t day = std::numeric_limits<std::int64_t>::min();
+        HyperLogLog  users;
+    };
+
+    mutable std::mutex mu_;
+    std::vector<Day>   ring_; // slot = day mod k_days
+};
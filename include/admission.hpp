@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+ * Cost classes for routes. Each class gets its own concurrency limit so that bursts of
+ * expensive calls (analytics, admin exports) cannot occupy every worker and starve ingestion.
+ */
+enum class RouteClass : std::uint8_t
+{
+    Health,    // GET /health; never limited
+    Ingest,    // POST /users/register, POST /users/{id}/transit
+    Read,      // per-user footprint and suggestions
+    Analytics, // GET /users/{id}/analytics (scans every user's week)
+    Admin,     // /admin/* (log and data dumps)
+};
+
+inline constexpr std::size_t k_route_class_count = 5;
+
+// Maps a request to its cost class using only the method and path (no regex).
+RouteClass classify_route(const std::string& method, const std::string& path);
+
+const char* route_class_name(RouteClass cls);
+
+struct AdmissionLimit
+{
+    std::size_t max_concurrent  = 0; // 0 means unlimited
+    std::size_t queue_budget_ms = 0; // how long a request may wait for a slot before being rejected
+};
+
+/**
+ * Per-class limits. Ingestion and reads are unlimited by default (bounded only by the worker
+ * pool); analytics and admin dumps are capped so they always leave workers for ingestion.
+ */
+struct AdmissionLimits
+{
+    AdmissionLimit ingest{};
+    AdmissionLimit read{};
+    AdmissionLimit analytics{ 4, 50 };
+    AdmissionLimit admin{ 2, 100 };
+
+    const AdmissionLimit& for_class(RouteClass cls) const;
+};
+
+struct AdmissionClassStats
+{
+    std::size_t   max_concurrent = 0;
+    std::size_t   in_flight      = 0;
+    std::uint64_t admitted       = 0;
+    std::uint64_t rejected       = 0;
+};
+
+class AdmissionController;
+
+// RAII slot in a route class; releases on destruction or reassignment.
+class AdmissionTicket
+{
+  public:
+    AdmissionTicket() = default;
+    ~AdmissionTicket();
+    AdmissionTicket(AdmissionTicket&& other) noexcept;
+    AdmissionTicket& operator=(AdmissionTicket&& other) noexcept;
+    AdmissionTicket(const AdmissionTicket&)            = delete;
+    AdmissionTicket& operator=(const AdmissionTicket&) = delete;
+
+    explicit operator bool() const
+    {
+        return owner_ != nullptr;
+    }
+
+  private:
+    friend class AdmissionController;
+    AdmissionTicket(AdmissionController* owner, RouteClass cls) : owner_(owner), cls_(cls) {}
+    void release();
+
+    AdmissionController* owner_ = nullptr;
+    RouteClass           cls_   = RouteClass::Health;
+};
+
+class AdmissionController
+{
+  public:
+    explicit AdmissionController(const AdmissionLimits& limits = {});
+
+    // Waits up to the class's queue budget for a slot. Returns an empty ticket if none freed up.
+    AdmissionTicket try_acquire(RouteClass cls);
+
+    AdmissionClassStats stats(RouteClass cls) const;
+
+  private:
+    friend class AdmissionTicket;
+    void release(RouteClass cls);
+
+    struct ClassState
+    {
+        mutable std::mutex         mu;
+        std::condition_variable    cv;
+        std::size_t                in_flight = 0;
+        AdmissionLimit             limit;
+        std::atomic<std::uint64_t> admitted{ 0 };
+        std::atomic<std::uint64_t> rejected{ 0 };
+    };
+
+    std::array<ClassState, k_route_class_count> classes_;
+};
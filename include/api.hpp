@@ -1,7 +1,25 @@
 #pragma once
+#include "active_users.hpp"
+#include "admission.hpp"
+#include "peer_stats.hpp"
+#include "rate_limiter.hpp"
+#include "repricing.hpp"
 #include "storage.hpp"
+#include "write_behind_store.hpp"
 
 #include <httplib.h>
 
+// Optional server-wide services used by the routes. Null members are disabled.
+struct ApiServices
+{
+    AdmissionController* admission    = nullptr;
+    RateLimiter*         user_limiter = nullptr; // keyed by the {id} in /users/{id}/...
+    RateLimiter*         ip_limiter   = nullptr; // keyed by the client address
+    WriteBehindStore*    store_cache  = nullptr; // set when the store is wrapped in the read cache
+    PeerStats*           peers        = nullptr; // peer percentiles in /analytics
+    ActiveUsers*         active_users = nullptr; // fed by the store (attach()), read by /admin/stats
+    RecomputeJob*        recompute    = nullptr; // started by /admin/emission-factors/load
+};
+
 // Adds all endpoints to `svr` using the given store.
-void configure_routes(httplib::Server& svr, IStore& store);
\ No newline at end of file
+void configure_routes(httplib::Server& svr, IStore& store, const ApiServices& services = {});
@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// The form API keys are stored in: the SHA-256 digest (FIPS 180-4) of the key as 64 lowercase hex
+// digits. It is part of the WAL, snapshot and table formats, so unlike std::hash it must give the
+// same result on every toolchain. Implemented in src/api_key_hash.cpp
+std::string hash_api_key(std::string_view key);
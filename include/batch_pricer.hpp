@@ -0,0 +1,75 @@
+#pragma once
+#include "factor_table.hpp"
+#include "storage.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Pricing rules shared by calculate_co2_emissions() and BatchPricer.
+
+// Throws std::runtime_error for a negative distance, an occupancy below 1, or either not finite.
+void validate_trip(double occupancy, double distance_km);
+
+// Simplified defaults for trips the active table has no factor for.
+double default_kg_per_km(std::string_view mode);
+
+// For private vehicles (car, taxi) the factor is per vehicle, shared by its occupants; for public
+// transit, occupancy is already factored into the per-passenger factor.
+bool priced_per_vehicle(std::string_view mode);
+
+/**
+ * Prices trips in bulk, as calculate_co2_emissions() prices one. Each trip is first resolved by
+ * id_of() to a rate id: the factor the table has for it at its time and region, or the
+ * simplified default for its mode. price() then turns columnar arrays of ids, distances and
+ * occupancies into kg CO2e in one loop with no lookups, string comparisons or branches, which
+ * compilers vectorise; the whole batch is validated in a pass before it, so the loop can't fail.
+ *
+ * A pricer holds one table for its lifetime, even if another is published meanwhile. Ids are
+ * dense from 0 and only mean something to the pricer that handed them out. Not thread-safe.
+ */
+class BatchPricer
+{
+  public:
+    explicit BatchPricer(std::shared_ptr<const FactorTable> table = active_factor_table());
+
+    std::uint32_t id_of(std::string_view mode, std::string_view fuel_type, std::string_view vehicle_size,
+                        std::string_view region, std::int64_t ts);
+
+    std::uint32_t id_of(const TransitEvent& ev)
+    {
+        return id_of(ev.mode, ev.fuel_type, ev.vehicle_size, ev.region, ev.ts);
+    }
+
+    // kg_co2[i] = the rate of ids[i] x distance_km[i], divided by occupancy[i] for car and taxi,
+    // whose factors are per vehicle. Throws std::runtime_error, having written nothing, if a trip
+    // fails validate_trip() or an id is unknown.
+    void price(const std::uint32_t* ids, const double* distance_km, const double* occupancy, double* kg_co2,
+               std::size_t n) const;
+
+    // Rates handed out so far.
+    std::size_t rate_count() const
+    {
+        return kg_per_km_.size();
+    }
+
+    const FactorTable& table() const
+    {
+        return *table_;
+    }
+
+  private:
+    static constexpr std::uint32_t k_no_id = static_cast<std::uint32_t>(-1);
+
+    std::uint32_t add_rate(double kg_per_km, std::string_view mode);
+
+    std::shared_ptr<const FactorTable>             table_;
+    std::vector<double>                            kg_per_km_;   // by id
+    std::vector<double>                            per_vehicle_; // by id: 1 if / occupancy, else 0
+    std::vector<std::uint32_t>                     factor_ids_;  // by table_->factors() index, or k_no_id
+    std::unordered_map<std::string, std::uint32_t> default_ids_; // by mode
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+
+// Proleptic Gregorian calendar dates, converted to and from days since 1970-01-01
+// (H. Hinnant's civil-date algorithms).
+struct CivilDate
+{
+    std::int64_t year  = 1970;
+    unsigned     month = 1; // 1-12
+    unsigned     day   = 1; // 1-31
+};
+
+inline std::int64_t days_from_civil(const CivilDate& date)
+{
+    const std::int64_t y   = date.year - (date.month <= 2 ? 1 : 0);
+    const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const auto         yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned     mp  = date.month > 2 ? date.month - 3 : date.month + 9; // March = 0
+    const unsigned     doy = (153 * mp + 2) / 5 + date.day - 1;
+    const unsigned     doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+}
+
+inline CivilDate civil_from_days(std::int64_t days)
+{
+    days += 719468;
+    const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const auto         doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned     yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned     doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned     mp  = (5 * doy + 2) / 153;
+    CivilDate          date;
+    date.day   = doy - (153 * mp + 2) / 5 + 1;
+    date.month = mp < 10 ? mp + 3 : mp - 9;
+    date.year  = static_cast<std::int64_t>(yoe) + era * 400 + (date.month <= 2 ? 1 : 0);
+    return date;
+}
+
+inline unsigned days_in_month(std::int64_t year, unsigned month)
+{
+    static constexpr unsigned k_days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    const bool                leap     = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap ? 29 : k_days[month - 1];
+}
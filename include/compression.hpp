@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * Response body compression negotiated from the request's Accept-Encoding header.
+ * gzip is available when built with zlib (CHARIZARD_WITH_ZLIB), brotli when built with
+ * libbrotlienc (CHARIZARD_WITH_BROTLI). Without either, everything is sent as identity.
+ */
+enum class ContentEncoding
+{
+    Identity,
+    Gzip,
+    Brotli,
+};
+
+// Bodies smaller than this are sent uncompressed; the header and CPU overhead isn't worth it.
+inline constexpr std::size_t k_min_compress_bytes = 1024;
+
+// Picks the best encoding this build supports that the client accepts (q > 0), preferring
+// brotli over gzip on equal q-values. Returns Identity if nothing suitable is offered.
+ContentEncoding negotiate_encoding(const std::string& accept_encoding);
+
+// Value for the Content-Encoding header ("gzip", "br"); empty for Identity.
+const char* encoding_name(ContentEncoding enc);
+
+/**
+ * Incremental compressor for streamed (chunked) responses. Each call appends whatever
+ * compressed bytes are ready to `out`; finish() flushes the remainder and the trailer.
+ */
+class StreamCompressor
+{
+  public:
+    virtual ~StreamCompressor()                                           = default;
+    virtual void write(const char* data, std::size_t n, std::string& out) = 0;
+    virtual void finish(std::string& out)                                 = 0;
+
+    // Returns nullptr for Identity or an encoding this build doesn't support.
+    static std::unique_ptr<StreamCompressor> create(ContentEncoding enc);
+};
+
+// One-shot compression of a whole body. Returns `body` unchanged for Identity.
+std::string compress_body(ContentEncoding enc, const std::string& body);
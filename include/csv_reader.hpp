@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Streaming RFC 4180 reader over text already in memory (a request body or an mmap'd file).
+ * Records are read one at a time and fields are views, so memory use is bounded by the longest
+ * record however large the input is:
+ *
+ *   CsvReader reader(text);
+ *   std::vector<std::string_view> fields;
+ *   while (reader.next(fields))
+ *       ...
+ *
+ * Fields may be quoted, with "" for a quote and commas or line breaks inside. Records end at \n or
+ * \r\n. Spaces and tabs around a field (and around the quotes of a quoted one) are dropped, as
+ * hand-edited factor files often have them. A quote inside an unquoted field is kept as is.
+ */
+class CsvReader
+{
+  public:
+    explicit CsvReader(std::string_view text) : in_(text) {}
+
+    // Reads the next record into `fields`; false at the end of the input. The views stay valid until
+    // the next call. An empty line reads as one empty field. Throws std::runtime_error on a quoted
+    // field that is never closed or is followed by something other than a comma.
+    bool next(std::vector<std::string_view>& fields);
+
+    // 1-based line on which the record last returned by next() starts.
+    std::size_t line() const
+    {
+        return line_;
+    }
+
+  private:
+    void split(std::string_view record, std::vector<std::string_view>& fields);
+
+    std::string_view in_;
+    std::size_t      pos_       = 0;
+    std::size_t      line_      = 0;
+    std::size_t      next_line_ = 1;
+    std::string      scratch_; // unescaped quoted fields of the current record
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include "embedded_factor_data.hpp" // generated from data/emission_factors/*.csv by cmake/embed_factors.cmake
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+// Lookups over the compiled-in factor tables (k_defra_2024_factors, k_basic_defaults_factors).
+// Everything here is constexpr, so tables can be checked with static_assert, and nothing allocates.
+
+template <typename Enum, std::size_t N>
+constexpr std::optional<Enum> enum_from_name(const std::string_view (&names)[N], std::string_view name)
+{
+    for (std::size_t i = 0; i < N; ++i)
+    {
+        if (names[i] == name)
+            return static_cast<Enum>(i);
+    }
+    return std::nullopt;
+}
+
+constexpr std::string_view name_of(FactorMode mode)
+{
+    return k_factor_mode_names[static_cast<std::size_t>(mode)];
+}
+
+constexpr std::string_view name_of(FactorFuel fuel)
+{
+    return k_factor_fuel_names[static_cast<std::size_t>(fuel)];
+}
+
+constexpr std::string_view name_of(FactorSize size)
+{
+    return k_factor_size_names[static_cast<std::size_t>(size)];
+}
+
+// nullptr if `table` has no factor for exactly this key.
+template <std::size_t N>
+constexpr const EmbeddedFactor* find_embedded_factor(const EmbeddedFactor (&table)[N], FactorMode mode,
+                                                     FactorFuel fuel_type, FactorSize vehicle_size)
+{
+    for (const auto& f : table)
+    {
+        if (f.mode == mode && f.fuel_type == fuel_type && f.vehicle_size == vehicle_size)
+            return &f;
+    }
+    return nullptr;
+}
+
+// As above, by name; names no table uses ("" for no fuel type or size) find nothing.
+template <std::size_t N>
+constexpr const EmbeddedFactor* find_embedded_factor(const EmbeddedFactor (&table)[N], std::string_view mode,
+                                                     std::string_view fuel_type,
+                                                     std::string_view vehicle_size)
+{
+    const auto m = enum_from_name<FactorMode>(k_factor_mode_names, mode);
+    const auto f = enum_from_name<FactorFuel>(k_factor_fuel_names, fuel_type);
+    const auto s = enum_from_name<FactorSize>(k_factor_size_names, vehicle_size);
+    if (!m || !f || !s)
+        return nullptr;
+    return find_embedded_factor(table, *m, *f, *s);
+}
@@ -1,7 +1,10 @@
 #pragma once
 #include "emission_factors.hpp"
 
+#include <cstddef>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 /**
@@ -16,6 +19,9 @@
 class EmissionDataLoader
 {
   public:
+    // Receives each factor as it is parsed, so large files need not be held as one vector.
+    using FactorSink = std::function<void(EmissionFactor&&)>;
+
     /**
      * Load DEFRA 2024 factors (currently from hardcoded defaults).
      * In production, this could fetch from the official DEFRA API or CSV download.
@@ -41,4 +47,27 @@ class EmissionDataLoader
      * @return Vector of EmissionFactor structs parsed from CSV
      */
     static std::vector<EmissionFactor> load_from_csv(const std::string& csv_str);
+
+    /**
+     * Parse CSV factors one row at a time (RFC 4180 quoting, see csv_reader.hpp).
+     * If the header names `mode` and `kg_co2_per_km`, columns are found by name, in any order, and
+     * `fuel_type`, `vehicle_size`, `source`, `updated_at`, `region`, `valid_from` and
+     * `valid_until` are optional (other columns are ignored; the validity bounds are YYYY-MM-DD UTC
+     * dates, empty for unbounded). Otherwise the columns are positional as in load_from_csv().
+     * Empty lines are skipped.
+     *
+     * @param csv CSV text, first line headers
+     * @param sink Called with each factor in file order
+     * @return Number of factors parsed
+     * @throws std::runtime_error naming the line of the first malformed row
+     */
+    static std::size_t parse_csv(std::string_view csv, const FactorSink& sink);
+
+    /**
+     * Parse a CSV factor file of any size. The file is mmap'd and read through parse_csv(), so
+     * memory use does not grow with it beyond what `sink` keeps.
+     *
+     * @throws std::runtime_error if the file is missing, unreadable or malformed
+     */
+    static std::size_t load_csv_file(const std::string& path, const FactorSink& sink);
 };
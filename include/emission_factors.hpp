@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdint>
+#include <limits>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -6,7 +8,7 @@
 
 /**
  * Represents a single emission factor entry.
- * Stores CO2 emissions data indexed by mode, fuel type, and vehicle size.
+ * Stores CO2 emissions data indexed by mode, fuel type, and vehicle size, for a region and period.
  */
 struct EmissionFactor
 {
@@ -16,6 +18,10 @@ struct EmissionFactor
     double       kg_co2_per_km;  // per-passenger kg CO2e per km
     std::string  source;         // e.g., "DEFRA-2024", "EPA-2023"
     std::int64_t updated_at = 0; // epoch seconds when this was last updated
+    std::string  region;         // e.g., "GB", "US-CA"; empty for factors that apply everywhere
+    // Epoch seconds: the factor prices trips with valid_from <= ts < valid_until
+    std::int64_t valid_from  = std::numeric_limits<std::int64_t>::min();
+    std::int64_t valid_until = std::numeric_limits<std::int64_t>::max();
 };
 
 /**
@@ -0,0 +1,177 @@
+#pragma once
+#include "emission_factors.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * An immutable set of emission factors from any number of sources, regions and validity periods,
+ * indexed by (mode, fuel_type, vehicle_size). Tables are built off to the side and published
+ * whole with set_active_factor_table(), so a reader holding one never sees a half-loaded set.
+ *
+ * A lookup for a region at a time resolves in this order: the factors of that region valid then,
+ * then those of each parent region ("US-CA", then "US"), then the global ones (region ""); within
+ * a region the source listed first in `source_priority` wins, and sources it doesn't list rank
+ * after those it does. The whole chain is resolved when the table is built, into a flat
+ * region x key array of sorted periods in each of which one factor applies, so find() costs two
+ * hash lookups and a binary search however many sources, regions and years the table holds.
+ */
+class FactorTable
+{
+  public:
+    // Later entries replace earlier ones with the same key, region, source and valid_from, so
+    // files loaded in order can override; among unranked sources the one loaded last wins. Throws
+    // std::runtime_error for a region normalize_region() rejects or an empty validity period.
+    explicit FactorTable(std::vector<EmissionFactor> factors, std::string origin = "",
+                         std::vector<std::string> source_priority = {});
+
+    // The factor for exactly this key in effect at `as_of` (epoch seconds), resolved for `region`
+    // (spelled as normalize_region() does); nullptr if no region in its chain has one then. A
+    // region the table doesn't know resolves as its nearest known parent.
+    const EmissionFactor* find(std::string_view mode, std::string_view fuel_type,
+                               std::string_view vehicle_size, std::string_view region,
+                               std::int64_t as_of) const;
+
+    // The same, in effect now.
+    const EmissionFactor* find(std::string_view mode, std::string_view fuel_type,
+                               std::string_view vehicle_size, std::string_view region = {}) const;
+
+    // The factor every key resolves to now for `region`, in the order the keys were first seen.
+    std::vector<EmissionFactor> resolved(std::string_view region = {}) const;
+
+    // The periods into which find() divides time for this key and region, ascending: each starts
+    // at `first` and lasts until the next, and has `second` (or nullptr) in effect. The first
+    // starts at the minimum int64; empty if the key is unknown.
+    std::vector<std::pair<std::int64_t, const EmissionFactor*>>
+    timeline(std::string_view mode, std::string_view fuel_type, std::string_view vehicle_size,
+             std::string_view region) const;
+
+    // One entry per key, region, source and valid_from, in the order they were first seen.
+    const std::vector<EmissionFactor>& factors() const
+    {
+        return factors_;
+    }
+
+    // The regions with factors of their own, plus "" first.
+    const std::vector<std::string>& regions() const
+    {
+        return region_names_;
+    }
+
+    // Where the factors came from: a path, or "built-in" for the compiled-in DEFRA set.
+    const std::string& origin() const
+    {
+        return origin_;
+    }
+
+    // Numbers the tables built by this process in order, from 1, to tell which one priced what.
+    std::uint64_t version() const
+    {
+        return version_;
+    }
+
+  private:
+    static constexpr std::uint32_t k_unresolved = static_cast<std::uint32_t>(-1);
+
+    // A (region, key) pair's periods: starts_[begin, end) and slots_[begin, end)
+    struct Span
+    {
+        std::uint32_t begin = 0;
+        std::uint32_t end   = 0;
+    };
+
+    // Index of `region` or of its nearest known parent; 0 (global) if there is none.
+    std::uint32_t region_index(std::string_view region) const;
+    // spans_ index of a key and region; spans_.size() if the key is unknown.
+    std::size_t span_index(std::string_view mode, std::string_view fuel_type, std::string_view vehicle_size,
+                           std::string_view region) const;
+
+    std::vector<EmissionFactor>                    factors_;
+    std::unordered_map<std::string, std::uint32_t> keys_;    // "mode\0fuel_type\0vehicle_size" -> key index
+    std::unordered_map<std::string, std::uint32_t> regions_; // normalized region -> region index; "" is 0
+    std::vector<std::string>                       region_names_; // by region index
+    std::vector<Span>                              spans_;        // [region * keys_.size() + key]
+    std::vector<std::int64_t>                      starts_;       // period start times, ascending per span
+    std::vector<std::uint32_t>                     slots_;        // factors_ index or k_unresolved
+    std::string                                    origin_;
+    std::uint64_t                                  version_ = 0;
+};
+
+/**
+ * Which keys are priced differently by one table than by another, and when. Built when a
+ * corrected table replaces the active one, so that only the events it re-prices (and the rollups
+ * holding them) need recomputing; see reprice_store() in repricing.hpp. Regions are folded
+ * together: a change in any region marks the key for that period everywhere.
+ */
+class FactorChangeSet
+{
+  public:
+    FactorChangeSet(const FactorTable& before, const FactorTable& after);
+
+    // Every key at every time, to rebuild all rollups when what they were priced with is unknown.
+    static FactorChangeSet all()
+    {
+        FactorChangeSet changes;
+        changes.all_ = true;
+        return changes;
+    }
+
+    bool empty() const
+    {
+        return !all_ && periods_.empty();
+    }
+
+    // Keys with at least one changed period; 0 for all().
+    std::size_t key_count() const
+    {
+        return periods_.size();
+    }
+
+    // Whether a trip with this key at `ts` may be priced differently.
+    bool affects(std::string_view mode, std::string_view fuel_type, std::string_view vehicle_size,
+                 std::int64_t ts) const;
+
+  private:
+    FactorChangeSet() = default;
+
+    // "mode\0fuel_type\0vehicle_size" -> disjoint [from, until) periods, ascending
+    std::unordered_map<std::string, std::vector<std::pair<std::int64_t, std::int64_t>>> periods_;
+    bool                                                                                all_ = false;
+};
+
+/**
+ * The canonical spelling of a region code: ISO 3166 style, upper case, with sub-regions after a
+ * hyphen ("gb" -> "GB", "us-ca" -> "US-CA"). The empty string is the global region. Throws
+ * std::runtime_error for anything but ASCII letters, digits and inner hyphens, or more than 16
+ * characters.
+ */
+std::string normalize_region(std::string_view region);
+
+// The table calculate_co2_emissions() prices events with. Until something else is published it
+// holds DefaultEmissionFactors::defra_2024_factors(). Safe to call from any thread; the returned
+// table stays valid for as long as the caller holds it, even if another one is published.
+std::shared_ptr<const FactorTable> active_factor_table();
+
+// Atomically replaces the active table. Requests already holding the old one finish with it.
+void set_active_factor_table(std::shared_ptr<const FactorTable> table);
+
+/**
+ * Reads factors from `path`: a .csv file (see EmissionDataLoader::parse_csv), a .json file (see
+ * EmissionDataLoader::load_from_json), or a directory, whose .csv and .json files are read in name
+ * order with later files overriding earlier ones. Other files, and hidden ones, are skipped, so the
+ * temporaries of editors and atomic writers are not read half-written. Files are read into memory
+ * rather than mmap'd, so one truncated while it is read fails to parse instead of crashing.
+ *
+ * Throws std::runtime_error naming the file if anything cannot be read or parsed, or if no factors
+ * were found, so a bad update never replaces a working table.
+ */
+std::vector<EmissionFactor> load_factor_path(const std::string& path);
+
+// Whether load_factor_path() reads a file of this name from a directory.
+bool is_factor_file_name(std::string_view name);
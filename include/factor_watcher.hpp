@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class FactorTable;
+
+/**
+ * Reloads the active factor table (factor_table.hpp) when the file or directory it was loaded
+ * from changes. The watch is on the directory, so a file replaced by rename is seen as well as
+ * one rewritten in place; a burst of changes (an editor save, a copy of several files) is let
+ * settle for `debounce` and then read once. The new table is parsed on the watcher's thread and
+ * published with set_active_factor_table(), so requests never wait for a reload. If the new
+ * contents don't parse, the error is logged and the current table stays active. Every table is
+ * built with the same `source_priority` (see FactorTable). After each publish the hook, if one
+ * is set, runs on the watcher's thread with the replaced and the new table.
+ *
+ * Uses inotify on Linux; elsewhere the path's modification times are polled every `debounce`.
+ */
+class FactorFileWatcher
+{
+  public:
+    using PublishHook = std::function<void(const FactorTable& before, const FactorTable& after)>;
+
+    explicit FactorFileWatcher(std::string path,
+                               std::chrono::milliseconds debounce = std::chrono::milliseconds(200),
+                               std::vector<std::string>  source_priority = {});
+    ~FactorFileWatcher();
+
+    FactorFileWatcher(const FactorFileWatcher&)            = delete;
+    FactorFileWatcher& operator=(const FactorFileWatcher&) = delete;
+    FactorFileWatcher(FactorFileWatcher&&)                 = delete;
+    FactorFileWatcher& operator=(FactorFileWatcher&&)      = delete;
+
+    // Set before start(). Exceptions it throws are logged; the new table stays active.
+    void on_publish(PublishHook hook)
+    {
+        on_publish_ = std::move(hook);
+    }
+
+    // Starts watching. Throws std::runtime_error if the watch can't be set up.
+    void start();
+
+    // Loads and publishes the table now, as a change would. Returns false (and logs) on failure.
+    bool reload();
+
+    std::uint64_t reloads() const
+    {
+        return reloads_.load();
+    }
+    std::uint64_t failed_reloads() const
+    {
+        return failed_.load();
+    }
+
+  private:
+    void loop();
+    // Modification times and sizes of what load_factor_path() would read, to detect changes
+    // without inotify.
+    std::string fingerprint() const;
+
+    std::string                path_;
+    std::string                watched_dir_;
+    std::string                watched_name_; // the file within watched_dir_; empty for a directory
+    std::chrono::milliseconds  debounce_;
+    std::vector<std::string>   source_priority_;
+    PublishHook                on_publish_;
+    int                        inotify_fd_  = -1;
+    int                        stop_fds_[2] = { -1, -1 }; // pipe written to on shutdown to wake loop()
+    std::thread                thread_;
+    std::atomic<std::uint64_t> reloads_{ 0 };
+    std::atomic<std::uint64_t> failed_{ 0 };
+};
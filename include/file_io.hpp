@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Read-only mmap of a whole file. Used for snapshots and on-disk tables, which are read once at
+// startup or randomly by key and never modified in place.
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&&)                 = delete;
+    MappedFile& operator=(MappedFile&&)      = delete;
+
+    // Maps `path`. Returns false if it does not exist; throws std::runtime_error on other errors.
+    bool open(const std::string& path);
+
+    std::string_view bytes() const
+    {
+        return { static_cast<const char*>(data_), size_ };
+    }
+
+  private:
+    void*       data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// Writes a file under "<path>.tmp" through a buffer and moves it into place on commit(), so
+// readers only ever see a complete file. The temp file is removed if commit() is never reached.
+class AtomicFileWriter
+{
+  public:
+    explicit AtomicFileWriter(std::string path);
+    ~AtomicFileWriter();
+
+    AtomicFileWriter(const AtomicFileWriter&)            = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+    AtomicFileWriter(AtomicFileWriter&&)                 = delete;
+    AtomicFileWriter& operator=(AtomicFileWriter&&)      = delete;
+
+    void write(std::string_view data);
+
+    // Bytes written so far.
+    std::uint64_t offset() const
+    {
+        return offset_;
+    }
+
+    // Flushes, fsyncs, renames over `path` and syncs the directory.
+    void commit();
+
+  private:
+    void drain();
+
+    std::string   path_;
+    std::string   tmp_path_;
+    int           fd_ = -1;
+    std::string   buf_;
+    std::uint64_t offset_ = 0;
+};
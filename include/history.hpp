@@ -0,0 +1,44 @@
+#pragma once
+#include "storage.hpp"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Bucket size for a user's footprint history. Weeks start on Monday and months on the 1st (UTC).
+enum class HistoryGranularity
+{
+    Day,
+    Week,
+    Month
+};
+
+// "day", "week" or "month"; nullopt for anything else.
+std::optional<HistoryGranularity> parse_granularity(const std::string& name);
+const char*                       granularity_name(HistoryGranularity g);
+
+// "YYYY-MM-DD" to days since 1970-01-01 and back; parse_iso_day rejects impossible dates.
+std::optional<std::int64_t> parse_iso_day(const std::string& text);
+std::string                 format_iso_day(std::int64_t day);
+
+// First day of the bucket that contains `day`.
+std::int64_t bucket_start(std::int64_t day, HistoryGranularity g);
+
+struct HistoryTotals
+{
+    std::int64_t trips       = 0;
+    double       distance_km = 0.0;
+    double       kg_co2      = 0.0;
+};
+
+struct HistoryBucket
+{
+    std::int64_t                         start_day = 0;
+    HistoryTotals                        total;
+    std::map<std::string, HistoryTotals> modes;
+};
+
+// Sums daily rollups (in any order) into buckets, oldest first. Buckets without trips are omitted.
+std::vector<HistoryBucket> bucket_rollups(const std::vector<DailyRollup>& rollups, HistoryGranularity g);
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * HyperLogLog distinct counter (Flajolet et al., with the small-range linear-counting
+ * correction): 2^precision one-byte registers, a relative standard error of about
+ * 1.04 / sqrt(2^precision), and the same memory whether it has seen ten keys or ten million.
+ * Sketches of the same precision merge by taking the register-wise maximum, which estimates the
+ * size of the union. Keys are hashed with a fixed function, so sketches built in different
+ * processes are mergeable too. Not thread-safe.
+ */
+class HyperLogLog
+{
+  public:
+    explicit HyperLogLog(unsigned precision = 12); // clamped to 4..18
+
+    void add(std::string_view key);
+    void merge(const HyperLogLog& other); // throws std::runtime_error if the precisions differ
+    void clear();
+
+    std::uint64_t estimate() const;
+
+    unsigned precision() const
+    {
+        return precision_;
+    }
+    std::size_t memory_bytes() const
+    {
+        return registers_.size();
+    }
+    double relative_error() const;
+
+    // 64-bit FNV-1a with a splitmix64 finaliser, stable across processes and platforms.
+    static std::uint64_t hash(std::string_view key);
+
+  private:
+    unsigned                  precision_;
+    std::vector<std::uint8_t> registers_;
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include "emission_factors.hpp"
+#include "transit_parser.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Typed decoders for the JSON documents the service reads: request bodies and emission-factor
+// files. They are backed by nlohmann::json or, when built with CHARIZARD_WITH_SIMDJSON, by
+// simdjson's On-Demand parser, which skips the DOM and scans the text with SIMD instructions.
+// Callers get the same values and exceptions from either backend.
+//
+// simdjson only validates what it reads: a malformed value under a key that isn't used may be
+// accepted where nlohmann::json rejects the whole document.
+
+// "nlohmann" or "simdjson".
+const char* json_backend_name();
+
+// Text that isn't JSON.
+class JsonSyntaxError : public std::runtime_error
+{
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+// JSON whose fields have the wrong type.
+class JsonShapeError : public std::runtime_error
+{
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+// POST /users/{id}/transit body, for the bodies parse_transit_payload() leaves to the generic path.
+struct TransitBody
+{
+    std::string  mode;
+    std::string  fuel_type;
+    std::string  vehicle_size;
+    double       distance_km  = 0.0;
+    double       occupancy    = 1.0;
+    std::int64_t ts           = 0;
+    std::string  region;
+    bool         has_mode     = false;
+    bool         has_distance = false;
+
+    // Views into this body, for make_transit_event().
+    TransitPayload payload() const
+    {
+        return { mode, fuel_type, vehicle_size, distance_km, occupancy, ts, region };
+    }
+};
+
+// Throws JsonSyntaxError for text that isn't JSON, and JsonShapeError when a field has the wrong
+// type and both mode and distance_km are present (a missing field is reported first, through
+// has_mode/has_distance). A document that isn't an object has neither.
+TransitBody decode_transit_body(std::string_view text);
+
+// POST /users/register body: the app_name, or nullopt if it is missing or not a string.
+// Throws JsonSyntaxError for text that isn't JSON.
+std::optional<std::string> decode_register_body(std::string_view text);
+
+// An array of factor objects (mode and kg_co2_per_km required; fuel_type, vehicle_size, source,
+// updated_at, region, and valid_from/valid_until as "YYYY-MM-DD" UTC dates optional). Throws
+// std::runtime_error describing the first problem.
+std::vector<EmissionFactor> decode_factors(std::string_view text);
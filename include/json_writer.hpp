@@ -0,0 +1,68 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * Writes JSON straight into a string, for responses of a fixed shape on hot endpoints. The bytes
+ * are the ones nlohmann::json::dump() produces for the same document, without building it:
+ *
+ *   JsonWriter w(out);
+ *   w.begin_object().field("error", "bad_path").end_object();   // {"error":"bad_path"}
+ *
+ * dump() orders object members by key (objects are std::maps), so members must be written in
+ * that order, e.g. "last_30d_kg_co2" before "last_7d_kg_co2". Integers are formatted with
+ * std::to_chars. Doubles take the shortest std::to_chars digits in dump()'s layout (12.0, 0.001,
+ * 1e+21). dump()'s Grisu2 is not always shortest or closest, so about 0.1% of values differ from
+ * dump() in the trailing digits (55.59009 against 55.590089999999996); both parse back to the same
+ * double. Non-finite doubles are written as null.
+ */
+class JsonWriter
+{
+  public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    JsonWriter& begin_object();
+    JsonWriter& end_object();
+    JsonWriter& begin_array();
+    JsonWriter& end_array();
+    JsonWriter& key(std::string_view k);
+
+    JsonWriter& value(std::string_view s);
+    JsonWriter& value(const char* s)
+    {
+        return value(std::string_view(s));
+    }
+    JsonWriter& value(double d);
+    JsonWriter& value(bool b);
+    JsonWriter& null();
+    template <typename Int, std::enable_if_t<std::is_integral_v<Int> && !std::is_same_v<Int, bool>, int> = 0>
+    JsonWriter& value(Int i)
+    {
+        separate();
+        char       buf[24];
+        const auto res = std::to_chars(buf, buf + sizeof(buf), i);
+        out_.append(buf, res.ptr);
+        return *this;
+    }
+
+    template <typename T>
+    JsonWriter& field(std::string_view k, const T& v)
+    {
+        return key(k).value(v);
+    }
+
+  private:
+    // Writes the comma before an array element or object member, unless it is the first one.
+    void separate();
+    void write_string(std::string_view s);
+
+    std::string& out_;
+    bool         first_     = true;  // nothing written yet in the current container
+    bool         after_key_ = false; // the next value belongs to the key just written
+};
+
+// A per-thread buffer to write a response into: empty, but keeping the capacity of earlier uses.
+std::string& response_buffer();
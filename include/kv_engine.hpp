@@ -0,0 +1,116 @@
+#pragma once
+#include "wal.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct KvOptions
+{
+    WalOptions  wal;
+    std::size_t memtable_bytes = 4U << 20; // flush the memtable to a table beyond this size
+    std::size_t max_tables     = 6;        // merge all tables into one beyond this count
+};
+
+// Puts and deletes applied atomically by KvEngine::write().
+class KvBatch
+{
+  public:
+    void put(std::string_view key, std::string_view value);
+    void erase(std::string_view key);
+
+    bool empty() const
+    {
+        return ops_.empty();
+    }
+
+  private:
+    friend class KvEngine;
+    std::vector<std::pair<std::string, std::optional<std::string>>> ops_; // nullopt = delete
+};
+
+class SortedTable;
+
+/**
+ * Small embedded log-structured key-value engine.
+ *
+ * Writes go to a WriteAheadLog and a sorted memtable. A full memtable is sealed into an
+ * immutable slot, and the write that filled it writes the slot out as an immutable,
+ * checksummed table file (sorted entries, sparse index, bloom filter) without holding the
+ * engine's lock, then deletes the log segment it covered. Reads merge the memtable, the sealed
+ * memtable and the tables from newest to oldest. Once there are more than max_tables tables, a
+ * background thread merges all of them into one, dropping overwritten values and deletes.
+ *
+ * Everything lives in one directory: "wal" (live log), "wal.<n>" (sealed segments) and
+ * "<n>.sst" (tables; a higher number is newer).
+ */
+class KvEngine
+{
+  public:
+    using Visitor = std::function<bool(std::string_view key, std::string_view value)>; // false stops
+
+    explicit KvEngine(std::string dir, const KvOptions& opts = {});
+    ~KvEngine();
+
+    KvEngine(const KvEngine&)            = delete;
+    KvEngine& operator=(const KvEngine&) = delete;
+    KvEngine(KvEngine&&)                 = delete;
+    KvEngine& operator=(KvEngine&&)      = delete;
+
+    void write(const KvBatch& batch);
+    void put(std::string_view key, std::string_view value);
+    void erase(std::string_view key);
+
+    std::optional<std::string> get(std::string_view key) const;
+
+    // Visits live keys in [start, end) in order. An empty `end` means no upper bound.
+    void scan(std::string_view start, std::string_view end, const Visitor& visit) const;
+    void scan_prefix(std::string_view prefix, const Visitor& visit) const;
+
+    // Writes the memtable out as a table now, after any flush already in progress.
+    void flush();
+    // Merges all tables into one now (normally done in the background).
+    void compact();
+
+    std::size_t table_count() const;
+
+  private:
+    using Memtable = std::map<std::string, std::optional<std::string>, std::less<>>;
+    using Tables   = std::vector<std::shared_ptr<const SortedTable>>; // oldest first
+
+    void recover();
+    // With mu_ held: moves a non-empty memtable into the sealed slot and rotates its log
+    // segment. Returns the id of the table to write, or 0 if there was nothing to seal.
+    std::uint64_t seal_memtable_locked();
+    // Without mu_: writes the sealed memtable out as table `id` and publishes it.
+    void write_sealed(std::uint64_t id);
+    void compaction_loop();
+    std::string table_path(std::uint64_t id) const;
+
+    std::string dir_;
+    KvOptions   opts_;
+
+    mutable std::mutex             mu_;
+    Memtable                        memtable_;
+    std::size_t                     memtable_bytes_ = 0;
+    std::shared_ptr<const Memtable> sealed_;    // being written out; newer than every table
+    std::condition_variable         sealed_cv_; // signalled once sealed_ is published
+    Tables                          tables_;
+    std::uint64_t                   next_id_ = 1;
+    std::unique_ptr<WriteAheadLog>  wal_;
+
+    std::mutex              compact_mu_; // one merge at a time
+    std::condition_variable compact_cv_;
+    bool                    compact_requested_ = false;
+    bool                    stopping_          = false;
+    std::thread             compactor_;
+};
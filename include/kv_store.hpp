@@ -0,0 +1,88 @@
+#pragma once
+#include "kv_engine.hpp"
+#include "storage.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * IStore on top of the embedded KvEngine, for single-node deployments that need persistence
+ * without running MongoDB. Data lives in one directory; key layout (fields separated by NUL,
+ * integers big-endian so byte order is numeric order):
+ *
+ *   e\0<user_id>\0<ts><seq>   event        (a user's events are one contiguous range, by time)
+ *   k\0<user_id>              API key hash
+ *   a\0<user_id>              app name
+ *   l\0<ts><seq>              request log
+ *   f\0<mode>\0<fuel>\0<size> emission factor
+ *   r\0<user_id>\0<day><mode> daily rollup, updated in the same batch as each event
+ *   m\0seq                    high-water mark of reserved sequence numbers
+ *   m\0horizon                retention horizon (events before it have been deleted)
+ *   m\0rollups                present once rollups cover every event
+ */
+class KvStore : public IStore
+{
+  public:
+    explicit KvStore(const std::string& dir, const KvOptions& opts = {});
+
+    void set_api_key(const std::string& user, const std::string& key,
+                     const std::string& app_name = "") override;
+    bool check_api_key(const std::string& user, const std::string& key) const override;
+    bool has_api_keys() const override;
+
+    void                      append_log(const ApiLogRecord& rec) override;
+    std::vector<ApiLogRecord> get_logs(std::size_t limit = 100) const override;
+    void                      clear_logs() override;
+    std::vector<std::string>  get_clients() const override;
+    std::vector<TransitEvent> get_client_data(const std::string& client_id) const override;
+    void                      clear_db_events() override;
+    void                      clear_db() override;
+
+    void                      add_event(const TransitEvent& ev) override;
+    void                      add_events(const std::vector<TransitEvent>& evs) override;
+    std::vector<TransitEvent> get_events(const std::string& user) const override;
+    FootprintSummary          summarize(const std::string& user) override;
+    double                    global_average_weekly() override;
+
+    void                          store_emission_factor(const EmissionFactor& factor) override;
+    std::optional<EmissionFactor> get_emission_factor(const std::string& mode, const std::string& fuel_type,
+                                                      const std::string& vehicle_size) const override;
+    std::vector<EmissionFactor>   get_all_emission_factors() const override;
+    void                          clear_emission_factors() override;
+
+    RetentionResult          apply_retention(std::int64_t event_cutoff, std::int64_t log_cutoff) override;
+    std::int64_t             retention_horizon() const override;
+    std::vector<DailyRollup> get_rollups(const std::string& user, std::int64_t from_day,
+                                         std::int64_t to_day) const override;
+    std::size_t              reprice_rollups(const std::string& user,
+                                             const FactorChangeSet& changes) override;
+
+    KvEngine& engine()
+    {
+        return engine_;
+    }
+
+  private:
+    std::uint64_t next_seq();
+    // Puts the event under a new key of its user in `batch`.
+    void          put_event(KvBatch& batch, const TransitEvent& ev);
+    void          erase_prefix(const std::string& prefix);
+    // Users with at least one key under `kind`, in key order.
+    std::vector<std::string> users_with(char kind) const;
+    // Builds the rollups of a store written before they were maintained on ingestion.
+    void build_rollups();
+    std::mutex& rollup_lock(const std::string& user);
+
+    KvEngine                   engine_;
+    std::atomic<std::uint64_t> seq_{ 0 };
+    std::atomic<std::uint64_t> seq_reserved_{ 0 }; // seq_ may go up to this without a write
+    std::mutex                 seq_mu_;            // serializes reserving a new block
+    std::mutex                 retention_mu_;      // one retention run at a time
+    std::atomic<std::int64_t>  horizon_{ 0 };
+    // A rollup is read, updated and written back per event; writers of the same user serialize
+    std::array<std::mutex, 64> rollup_mu_;
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include "api_key_hash.hpp"
 #include "storage.hpp"
 
 #include <bsoncxx/builder/basic/document.hpp>
@@ -6,11 +7,21 @@
 #include <bsoncxx/json.hpp>
 #include <bsoncxx/types.hpp>
 #include <chrono>
+#include <limits>
+#include <map>
 #include <mongocxx/client.hpp>
+#include <mongocxx/exception/operation_exception.hpp>
 #include <mongocxx/instance.hpp>
+#include <mongocxx/model/replace_one.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <mongocxx/model/write.hpp>
 #include <mongocxx/options/find.hpp>
+#include <mongocxx/options/index.hpp>
 #include <mongocxx/uri.hpp>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -21,6 +32,37 @@ class MongoStore : public IStore
     explicit MongoStore(std::string uri, std::string dbname = "charizard")
         : instance_{}, client_{ mongocxx::uri{ uri } }, db_{ client_[dbname] }
     {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        // Per-user reads and retention's range scans stay index-only as the collection grows
+        db_["events"].create_index(make_document(kvp("user_id", 1), kvp("ts", 1)));
+        db_["events"].create_index(make_document(kvp("ts", 1)));
+        db_["event_rollups"].create_index(make_document(kvp("user_id", 1), kvp("day", 1)));
+        if (!db_["retention"].find_one(make_document(kvp("_id", "rollups"))))
+            build_rollups();
+    }
+
+    // Lets MongoDB delete request logs on its own once they are `ttl` old, through a TTL index
+    // on the log's "at" date. Records written before the field existed are left to
+    // apply_retention(). Calling it again with a different ttl updates the index.
+    void enable_log_ttl(std::chrono::seconds ttl)
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        mongocxx::options::index opts;
+        opts.expire_after(ttl);
+        try
+        {
+            db_["api_logs"].create_index(make_document(kvp("at", 1)), opts);
+        }
+        catch (const mongocxx::operation_exception&)
+        {
+            // The index exists with another expiry
+            db_.run_command(make_document(
+                kvp("collMod", "api_logs"),
+                kvp("index", make_document(kvp("keyPattern", make_document(kvp("at", 1))),
+                                           kvp("expireAfterSeconds", static_cast<long long>(ttl.count()))))));
+        }
     }
 
     // API key management
@@ -31,13 +73,7 @@ class MongoStore : public IStore
         using bsoncxx::builder::basic::kvp;
         using bsoncxx::builder::basic::make_document;
         // Store a hashed API key.
-        std::hash<std::string> hsh;
-        auto                   h = [&hsh](const std::string& k)
-        {
-            std::ostringstream oss;
-            oss << std::hex << hsh(k);
-            return oss.str();
-        }(key);
+        const auto h = hash_api_key(key);
 
         auto coll = db_["api_keys"];
         // Persist the hash and optional app_name metadata.
@@ -61,24 +97,39 @@ class MongoStore : public IStore
         auto it_hash = view.find("api_key_hash");
         if (it_hash == view.end())
             return false;
-        const auto             stored_hash = std::string{ it_hash->get_string().value };
+        const auto stored_hash = std::string{ it_hash->get_string().value };
+        if (hash_api_key(key) == stored_hash)
+            return true;
+        // Keys set by earlier releases were stored as a std::hash value in hex
         std::hash<std::string> h;
         std::ostringstream     oss;
         oss << std::hex << h(key);
         return oss.str() == stored_hash;
     }
 
+    bool has_api_keys() const override
+    {
+        return static_cast<bool>(db_["api_keys"].find_one({}));
+    }
+
     // Logging and admin operations
 
     void append_log(const ApiLogRecord& rec) override
     {
-        using bsoncxx::builder::basic::kvp;
-        using bsoncxx::builder::basic::make_document;
         auto coll = db_["api_logs"];
-        coll.insert_one(make_document(kvp("ts", static_cast<long long>(rec.ts)), kvp("method", rec.method),
-                                      kvp("path", rec.path), kvp("status", rec.status),
-                                      kvp("duration_ms", rec.duration_ms), kvp("client_ip", rec.client_ip),
-                                      kvp("user_id", rec.user_id)));
+        coll.insert_one(log_document(rec));
+    }
+
+    void append_logs(const std::vector<ApiLogRecord>& recs) override
+    {
+        if (recs.empty())
+            return;
+        std::vector<bsoncxx::document::value> docs;
+        docs.reserve(recs.size());
+        for (const auto& rec : recs)
+            docs.push_back(log_document(rec));
+        auto coll = db_["api_logs"];
+        coll.insert_many(docs);
     }
 
     std::vector<ApiLogRecord> get_logs(std::size_t limit = 100) const override
@@ -125,6 +176,13 @@ class MongoStore : public IStore
             if (seen.insert(uid).second)
                 out.push_back(uid);
         }
+        // Users whose events have all been rolled up
+        for (auto&& d : db_["event_rollups"].find({}))
+        {
+            const auto uid = std::string{ d["user_id"].get_string().value };
+            if (seen.insert(uid).second)
+                out.push_back(uid);
+        }
         return out;
     }
 
@@ -137,11 +195,15 @@ class MongoStore : public IStore
     {
         auto coll = db_["events"];
         coll.delete_many({});
+        db_["event_rollups"].delete_many({});
+        // The "rollups" marker stays: the (now empty) rollups still cover every event
+        db_["retention"].delete_one(
+            bsoncxx::builder::basic::make_document(bsoncxx::builder::basic::kvp("_id", "horizon")));
     }
 
     void clear_db() override
     {
-        db_["events"].delete_many({});
+        clear_db_events();
         db_["api_keys"].delete_many({});
         db_["api_logs"].delete_many({});
         db_["emission_factors"].delete_many({});
@@ -151,13 +213,27 @@ class MongoStore : public IStore
 
     void add_event(const TransitEvent& ev) override
     {
-        using bsoncxx::builder::basic::kvp;
-        using bsoncxx::builder::basic::make_document;
+        add_events({ ev });
+    }
 
+    void add_events(const std::vector<TransitEvent>& evs) override
+    {
+        if (evs.empty())
+            return;
+        // Priced first, so an invalid event is rejected before anything is written
+        const auto                            kg = calculate_co2_emissions(evs);
+        std::vector<bsoncxx::document::value> docs;
+        docs.reserve(evs.size());
+        for (const auto& ev : evs)
+            docs.push_back(event_document(ev));
         auto coll = db_["events"];
-        coll.insert_one(make_document(kvp("user_id", ev.user_id), kvp("mode", ev.mode),
-                                      kvp("distance_km", ev.distance_km),
-                                      kvp("ts", static_cast<long long>(ev.ts))));
+        if (docs.size() == 1)
+            coll.insert_one(docs.front().view());
+        else
+            coll.insert_many(docs);
+        add_to_rollups(evs, kg);
+        for (const auto& ev : evs)
+            notify_ingested(ev);
     }
 
     std::vector<TransitEvent> get_events(const std::string& user) const override
@@ -179,6 +255,15 @@ class MongoStore : public IStore
             e.mode        = std::string{ d["mode"].get_string().value };
             e.distance_km = d["distance_km"].get_double();
             e.ts          = static_cast<std::int64_t>(d["ts"].get_int64().value);
+            // Documents written before these fields were stored keep the defaults
+            if (auto fuel = d["fuel_type"])
+                e.fuel_type = std::string{ fuel.get_string().value };
+            if (auto size = d["vehicle_size"])
+                e.vehicle_size = std::string{ size.get_string().value };
+            if (auto occupancy = d["occupancy"])
+                e.occupancy = occupancy.get_double();
+            if (auto region = d["region"])
+                e.region = std::string{ region.get_string().value };
             out.push_back(std::move(e));
         }
         return out;
@@ -192,10 +277,24 @@ class MongoStore : public IStore
         const auto week_start  = now - 7 * 24 * 3600;
         const auto month_start = now - 30 * 24 * 3600;
 
+        // Days before the horizon only exist as rollups; later ones are summed from their events
+        const auto       horizon = retention_horizon();
         FootprintSummary s{};
-        for (const auto& ev : get_events(user))
+        if (horizon > 0)
         {
-            const double kg = emission_factor_for(ev.mode) * ev.distance_km;
+            const auto retired =
+                get_rollups(user, std::numeric_limits<std::int64_t>::min(), epoch_day(horizon) - 1);
+            for (const auto& r : retired)
+                add_to_summary(s, r, week_start, month_start);
+        }
+        const auto evs = get_events(user);
+        const auto kgs = calculate_co2_emissions(evs);
+        for (std::size_t i = 0; i < evs.size(); ++i)
+        {
+            const auto& ev = evs[i];
+            if (ev.ts < horizon)
+                continue; // already counted in its rollup, deleted on the next retention pass
+            const double kg = kgs[i];
             s.lifetime_kg_co2 += kg;
             if (ev.ts >= week_start)
                 s.week_kg_co2 += kg;
@@ -222,10 +321,8 @@ class MongoStore : public IStore
             make_document(kvp("ts", make_document(kvp("$gte", static_cast<long long>(week_start))))));
         for (auto&& d : cursor)
         {
-            const auto user = std::string{ d["user_id"].get_string().value };
-            const auto mode = std::string{ d["mode"].get_string().value };
-            const auto dist = d["distance_km"].get_double();
-            user_week[user] += emission_factor_for(mode) * dist;
+            const auto ev = event_from_document(d);
+            user_week[ev.user_id] += calculate_co2_emissions(ev);
         }
 
         if (user_week.empty())
@@ -312,8 +409,248 @@ class MongoStore : public IStore
         coll.delete_many({});
     }
 
+    // Retention
+
+    RetentionResult apply_retention(std::int64_t event_cutoff, std::int64_t log_cutoff) override
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        std::scoped_lock lk(retention_mu_);
+        RetentionResult  res;
+        if (log_cutoff > 0)
+        {
+            auto deleted = db_["api_logs"].delete_many(
+                make_document(kvp("ts", make_document(kvp("$lt", static_cast<long long>(log_cutoff))))));
+            if (deleted)
+                res.logs_deleted = static_cast<std::size_t>(deleted->deleted_count());
+        }
+        if (event_cutoff > 0)
+        {
+            // The horizon is stored before anything is deleted, so summaries never count a day twice
+            set_horizon(std::max(retention_horizon(), epoch_day(event_cutoff) * 86400));
+            auto deleted = db_["events"].delete_many(make_document(
+                kvp("ts", make_document(kvp("$lt", static_cast<long long>(retention_horizon()))))));
+            if (deleted)
+                res.events_rolled_up = static_cast<std::size_t>(deleted->deleted_count());
+        }
+        return res;
+    }
+
+    std::int64_t retention_horizon() const override
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        auto doc = db_["retention"].find_one(make_document(kvp("_id", "horizon")));
+        return doc ? static_cast<std::int64_t>(doc->view()["ts"].get_int64().value) : 0;
+    }
+
+    std::vector<DailyRollup> get_rollups(const std::string& user, std::int64_t from_day,
+                                         std::int64_t to_day) const override
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        std::vector<DailyRollup> out;
+        mongocxx::options::find  opts;
+        opts.sort(make_document(kvp("day", 1), kvp("mode", 1)));
+        auto cursor = db_["event_rollups"].find(
+            make_document(kvp("user_id", user),
+                          kvp("day", make_document(kvp("$gte", static_cast<long long>(from_day)),
+                                                   kvp("$lte", static_cast<long long>(to_day))))),
+            opts);
+        for (auto&& d : cursor)
+        {
+            DailyRollup r;
+            r.user_id     = user;
+            r.day         = static_cast<std::int64_t>(d["day"].get_int64().value);
+            r.mode        = std::string{ d["mode"].get_string().value };
+            r.trips       = static_cast<std::int64_t>(d["trips"].get_int64().value);
+            r.distance_km = d["distance_km"].get_double();
+            r.kg_co2      = d["kg_co2"].get_double();
+            out.push_back(std::move(r));
+        }
+        return out;
+    }
+
+    // Rebuilt rollups are written whole, each only if its trip count still matches the events that
+    // were priced: an event added meanwhile has $inc'd its rollup (or is about to), so the user's
+    // events are read and priced again. Throws once the rollups keep changing after a few tries,
+    // or when a day's rollup is missing because a crash cut add_to_rollups() short.
+    std::size_t reprice_rollups(const std::string& user, const FactorChangeSet& changes) override
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        constexpr int attempts = 5;
+        for (int attempt = 1; attempt <= attempts; ++attempt)
+        {
+            const auto rebuilt = repriced_rollups(get_events(user), changes, retention_horizon());
+            std::vector<mongocxx::model::write> writes;
+            writes.reserve(rebuilt.size());
+            for (const auto& r : rebuilt)
+            {
+                const auto                   id    = rollup_id(r.user_id, r.day, r.mode);
+                const auto                   trips = static_cast<long long>(r.trips);
+                mongocxx::model::replace_one replace(
+                    make_document(kvp("_id", id), kvp("trips", trips)),
+                    make_document(kvp("_id", id), kvp("user_id", r.user_id),
+                                  kvp("day", static_cast<long long>(r.day)), kvp("mode", r.mode),
+                                  kvp("trips", trips), kvp("distance_km", r.distance_km),
+                                  kvp("kg_co2", r.kg_co2)));
+                writes.emplace_back(std::move(replace));
+            }
+            if (writes.empty())
+                return 0;
+            // Days written on an earlier try match again, as they hold the same trip count
+            auto result = db_["event_rollups"].bulk_write(writes);
+            if (result && static_cast<std::size_t>(result->matched_count()) == writes.size())
+                return rebuilt.size();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10 * attempt));
+        }
+        throw std::runtime_error("rollups of " + user + " kept changing while they were re-priced");
+    }
+
   private:
+    static std::string rollup_id(const std::string& user, std::int64_t day, const std::string& mode)
+    {
+        return user + "|" + std::to_string(day) + "|" + mode;
+    }
+
+    static TransitEvent event_from_document(const bsoncxx::document::view& d)
+    {
+        TransitEvent ev;
+        ev.user_id     = std::string{ d["user_id"].get_string().value };
+        ev.mode        = std::string{ d["mode"].get_string().value };
+        ev.distance_km = d["distance_km"].get_double();
+        ev.ts          = static_cast<std::int64_t>(d["ts"].get_int64().value);
+        if (auto el = d["fuel_type"])
+            ev.fuel_type = std::string{ el.get_string().value };
+        if (auto el = d["vehicle_size"])
+            ev.vehicle_size = std::string{ el.get_string().value };
+        if (auto el = d["occupancy"])
+            ev.occupancy = el.get_double();
+        if (auto el = d["region"])
+            ev.region = std::string{ el.get_string().value };
+        return ev;
+    }
+
+    // Adds the events, priced at `kg`, to their daily rollups, one upsert per (user, day, mode) in
+    // a single bulk write. This follows the event insert rather than sharing a transaction with
+    // it, so a crash in between leaves those events out of their rollups.
+    void add_to_rollups(const std::vector<TransitEvent>& evs, const std::vector<double>& kg)
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        std::map<std::string, DailyRollup> days;
+        for (std::size_t i = 0; i < evs.size(); ++i)
+        {
+            const auto& ev = evs[i];
+            add_to_rollup(days[rollup_id(ev.user_id, epoch_day(ev.ts), ev.mode)], ev, kg[i]);
+        }
+
+        std::vector<mongocxx::model::write> writes;
+        writes.reserve(days.size());
+        for (const auto& [id, r] : days)
+        {
+            auto inc = make_document(kvp("trips", static_cast<long long>(r.trips)),
+                                     kvp("distance_km", r.distance_km), kvp("kg_co2", r.kg_co2));
+            auto set = make_document(kvp("user_id", r.user_id), kvp("day", static_cast<long long>(r.day)),
+                                     kvp("mode", r.mode));
+            mongocxx::model::update_one upsert(
+                make_document(kvp("_id", id)),
+                make_document(kvp("$inc", std::move(inc)), kvp("$set", std::move(set))));
+            upsert.upsert(true);
+            writes.emplace_back(std::move(upsert));
+        }
+        if (!writes.empty())
+            db_["event_rollups"].bulk_write(writes);
+    }
+
+    void set_horizon(std::int64_t horizon)
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        auto max = make_document(kvp("ts", static_cast<long long>(horizon)));
+        db_["retention"].update_one(make_document(kvp("_id", "horizon")),
+                                    make_document(kvp("$max", std::move(max))),
+                                    mongocxx::options::update{}.upsert(true));
+    }
+
+    // For databases written before rollups were maintained on ingestion. Rollups left by earlier
+    // retention passes only cover deleted days, so the horizon starts after the last of them and
+    // the days from there on are rebuilt from their events. The rebuilt rollups are written whole
+    // (not incremented), so a rebuild cut short is simply redone on the next start.
+    void build_rollups()
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        auto rollups = db_["event_rollups"];
+        if (retention_horizon() == 0)
+        {
+            std::int64_t horizon = 0;
+            for (auto&& d : rollups.find({}))
+            {
+                const auto day = static_cast<std::int64_t>(d["day"].get_int64().value);
+                horizon        = std::max(horizon, (day + 1) * 86400);
+            }
+            if (horizon > 0)
+                set_horizon(horizon);
+        }
+        const auto horizon = retention_horizon();
+
+        std::map<std::string, DailyRollup> days;
+        for (auto&& d : db_["events"].find(
+                 make_document(kvp("ts", make_document(kvp("$gte", static_cast<long long>(horizon)))))))
+        {
+            const auto ev = event_from_document(d);
+            add_to_rollup(days[rollup_id(ev.user_id, epoch_day(ev.ts), ev.mode)], ev);
+        }
+
+        std::vector<mongocxx::model::write> writes;
+        for (const auto& [id, r] : days)
+        {
+            mongocxx::model::replace_one replace(
+                make_document(kvp("_id", id)),
+                make_document(kvp("_id", id), kvp("user_id", r.user_id),
+                              kvp("day", static_cast<long long>(r.day)), kvp("mode", r.mode),
+                              kvp("trips", static_cast<long long>(r.trips)),
+                              kvp("distance_km", r.distance_km), kvp("kg_co2", r.kg_co2)));
+            replace.upsert(true);
+            writes.emplace_back(std::move(replace));
+            if (writes.size() == 1000)
+            {
+                rollups.bulk_write(writes);
+                writes.clear();
+            }
+        }
+        if (!writes.empty())
+            rollups.bulk_write(writes);
+        db_["retention"].insert_one(make_document(kvp("_id", "rollups")));
+    }
+
+    static bsoncxx::document::value event_document(const TransitEvent& ev)
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        return make_document(kvp("user_id", ev.user_id), kvp("mode", ev.mode), kvp("fuel_type", ev.fuel_type),
+                             kvp("vehicle_size", ev.vehicle_size), kvp("occupancy", ev.occupancy),
+                             kvp("distance_km", ev.distance_km), kvp("ts", static_cast<long long>(ev.ts)),
+                             kvp("region", ev.region));
+    }
+
+    static bsoncxx::document::value log_document(const ApiLogRecord& rec)
+    {
+        using bsoncxx::builder::basic::kvp;
+        using bsoncxx::builder::basic::make_document;
+        // "at" mirrors ts as a BSON date for the TTL index (see enable_log_ttl)
+        const bsoncxx::types::b_date at{ std::chrono::system_clock::time_point{
+            std::chrono::seconds{ rec.ts } } };
+        return make_document(kvp("ts", static_cast<long long>(rec.ts)), kvp("method", rec.method),
+                             kvp("path", rec.path), kvp("status", rec.status),
+                             kvp("duration_ms", rec.duration_ms), kvp("client_ip", rec.client_ip),
+                             kvp("user_id", rec.user_id), kvp("at", at));
+    }
+
     mutable mongocxx::instance instance_;
     mongocxx::client           client_;
     mongocxx::database         db_;
+    std::mutex                 retention_mu_; // one retention run per process
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+#include "quantile_sketch.hpp"
+#include "storage.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Distribution of users' kg CO2e over the 7 UTC days ending on the day it was built, counting
+// only users who travelled in that window (as global_average_weekly does).
+struct PeerSnapshot
+{
+    TDigest      weekly_kg_co2;
+    double       total_kg_co2 = 0.0; // of every user's weekly total
+    std::size_t  users        = 0;
+    std::int64_t built_at     = 0; // epoch seconds
+
+    // The users' mean weekly total; 0 with no users.
+    double mean_kg_co2() const
+    {
+        return users != 0 ? total_kg_co2 / static_cast<double>(users) : 0.0;
+    }
+};
+
+/**
+ * Serves peer percentiles (/analytics) from a TDigest of every user's weekly total, so a request
+ * costs O(log centroids) instead of a pass over all users. A rebuild reads 7 days of rollups per
+ * user; once start() has been called, a background thread does that every max_age and requests
+ * only ever read the last snapshot. Without it, the request that finds the snapshot older than
+ * max_age rebuilds it while concurrent requests keep using the previous one. Rolling weekly
+ * totals can't be retracted from a digest, which is why it is rebuilt rather than updated per
+ * event.
+ */
+class PeerStats
+{
+  public:
+    explicit PeerStats(const IStore& store, std::chrono::seconds max_age = std::chrono::seconds(60));
+    ~PeerStats();
+
+    PeerStats(const PeerStats&)            = delete;
+    PeerStats& operator=(const PeerStats&) = delete;
+    PeerStats(PeerStats&&)                 = delete;
+    PeerStats& operator=(PeerStats&&)      = delete;
+
+    // Rebuilds on a background thread, at once and then every max_age.
+    void start();
+
+    // With the background thread running, its last snapshot (null until the first one is
+    // built). Otherwise a snapshot built at most max_age before `now` (epoch seconds) if this
+    // caller had to build it, or possibly the previous one while another caller rebuilds.
+    std::shared_ptr<const PeerSnapshot> snapshot(std::int64_t now);
+    // Builds a fresh snapshot and makes it current.
+    std::shared_ptr<const PeerSnapshot> rebuild(std::int64_t now);
+
+  private:
+    void loop();
+
+    const IStore&                       store_;
+    std::chrono::seconds                max_age_;
+    std::mutex                          mu_;
+    std::shared_ptr<const PeerSnapshot> current_;
+    bool                                rebuilding_ = false;
+    bool                                background_ = false;
+    bool                                stopping_   = false;
+    std::condition_variable             cv_;
+    std::thread                         thread_;
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Merging t-digest (Dunning & Ertl): an approximate, mergeable summary of a distribution of
+ * doubles in O(compression) memory. Centroids near the tails hold few points and those in the
+ * middle many, so extreme quantiles stay accurate; with fewer points than about `compression`
+ * every point keeps its own centroid and answers are exact up to interpolation.
+ *
+ * add() buffers points and folds them in when the buffer fills. quantile() and cdf() see buffered
+ * points too, but are O(log centroids) only after compress(); call it before sharing a digest
+ * between threads, after which the const methods are safe to use concurrently.
+ *
+ * Digests built on different shards or processes combine with merge(); encode()/decode() give a
+ * portable byte form for shipping them.
+ */
+class TDigest
+{
+  public:
+    explicit TDigest(double compression = 100.0);
+
+    void add(double x, double weight = 1.0);
+    void merge(const TDigest& other);
+    void compress();
+
+    // Value below which a fraction `q` (0..1) of the weight lies; 0 when empty.
+    double quantile(double q) const;
+    // Fraction of the weight at or below `x`, counting ties as half (mid-rank); 0 when empty.
+    double cdf(double x) const;
+
+    double total_weight() const;
+    bool   empty() const
+    {
+        return total_weight() == 0.0;
+    }
+    double min() const
+    {
+        return min_;
+    }
+    double max() const
+    {
+        return max_;
+    }
+    std::size_t centroid_count() const
+    {
+        return centroids_.size();
+    }
+
+    std::string    encode() const;
+    static TDigest decode(std::string_view bytes); // throws std::runtime_error if malformed
+
+  private:
+    struct Centroid
+    {
+        double mean   = 0.0;
+        double weight = 0.0;
+    };
+
+    // Weight of the centroids before centroids_[i] plus half of its own, i.e. its centre rank.
+    double centre(std::size_t i) const
+    {
+        return cumulative_[i] + centroids_[i].weight / 2;
+    }
+
+    double                compression_;
+    std::vector<Centroid> centroids_; // sorted by mean
+    std::vector<double>   cumulative_;
+    std::vector<Centroid> buffer_;
+    double                weight_ = 0.0; // of centroids_ only
+    double                min_    = 0.0;
+    double                max_    = 0.0;
+};
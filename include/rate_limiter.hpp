@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TokenBucketConfig
+{
+    double rate_per_sec = 0.0; // sustained requests per second; 0 disables limiting
+    double burst        = 0.0; // bucket capacity (max requests in a burst)
+};
+
+/**
+ * Token-bucket rate limiter keyed by an arbitrary string (user id, client IP, ...).
+ *
+ * Keys are spread over independently locked shards so concurrent requests for different
+ * clients rarely contend. Each shard keeps its buckets in LRU order and holds at most
+ * max_keys / shards entries; when full, the least recently seen bucket is evicted. An evicted
+ * client simply starts again from a full bucket, which is where an idle client would be anyway.
+ */
+class RateLimiter
+{
+  public:
+    using clock = std::chrono::steady_clock;
+
+    explicit RateLimiter(const TokenBucketConfig& cfg, std::size_t max_keys = 100000,
+                         std::size_t shards = 64);
+
+    bool enabled() const
+    {
+        return cfg_.rate_per_sec > 0.0;
+    }
+
+    // Takes one token for `key`. On rejection, `retry_after_sec` (if given) receives the number of
+    // whole seconds until a token will be available.
+    bool allow(const std::string& key, long* retry_after_sec = nullptr);
+    bool allow(const std::string& key, clock::time_point now, long* retry_after_sec = nullptr);
+
+    // Returns a token taken by allow() for a request that a later check rejected, so that check
+    // doesn't also drain this bucket. A no-op if the bucket has since been evicted.
+    void refund(const std::string& key);
+
+    std::size_t   tracked_keys() const;
+    std::uint64_t rejected() const
+    {
+        return rejected_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Bucket
+    {
+        std::string       key;
+        double            tokens = 0.0;
+        clock::time_point last;
+    };
+
+    struct alignas(64) Shard
+    {
+        mutable std::mutex                                           mu;
+        std::list<Bucket>                                            lru; // most recent first
+        std::unordered_map<std::string, std::list<Bucket>::iterator> index;
+    };
+
+    Shard& shard_for(const std::string& key);
+
+    TokenBucketConfig                   cfg_;
+    std::size_t                         per_shard_capacity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<std::uint64_t>          rejected_{ 0 };
+};
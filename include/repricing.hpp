@@ -0,0 +1,102 @@
+#pragma once
+#include "factor_table.hpp"
+#include "storage.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct RepriceResult
+{
+    std::size_t users   = 0; // users whose events were checked
+    std::size_t rollups = 0; // rollups rebuilt
+};
+
+/**
+ * Brings a store's rollups in line with a corrected factor table once it is active: each user's
+ * events are checked against `changes`, and only the (day, mode) rollups holding a re-priced
+ * event are rebuilt (IStore::reprice_rollups). Summaries need nothing, as they price retained
+ * events with the table in effect when asked; days before the retention horizon keep the prices
+ * they were retired with. Runs on the calling thread and returns at once if `changes` is empty.
+ */
+RepriceResult reprice_store(IStore& store, const FactorChangeSet& changes);
+
+// What a RecomputeJob is doing, or last did.
+struct RecomputeStatus
+{
+    bool          running               = false;
+    bool          rerun_pending         = false; // start() was called while running; runs again after
+    std::uint64_t runs                  = 0;     // jobs started
+    std::uint64_t factor_version        = 0;     // FactorTable::version() active when the job started
+    std::uint64_t latest_factor_version = 0;     // newest a user has been priced with so far
+    std::string   factor_origin;
+    std::size_t   users_total = 0;
+    std::size_t   users_done  = 0;
+    std::size_t   rollups     = 0;   // rollups rewritten
+    double        seconds     = 0.0; // time taken so far, or by the whole job
+    std::string   error;             // why the last job stopped short; empty if it didn't
+
+    double users_per_second() const
+    {
+        return seconds > 0.0 ? static_cast<double>(users_done) / seconds : 0.0;
+    }
+};
+
+/**
+ * Rebuilds every user's rollups from their retained events with the active factor table, on a
+ * background thread. Started when factors are loaded through /admin/emission-factors/load: which
+ * table priced each stored rollup isn't known, so all of them are rebuilt (FactorChangeSet::all()).
+ *
+ * Users are handed out in chunks of `chunk` to `threads` workers (0 = one per core). Each user's
+ * rollups are rebuilt and swapped in by one IStore::reprice_rollups() call, so a reader sees a
+ * user's old rollups or new ones, never a mix, and never waits for the job to finish. status()
+ * reports progress and throughput meanwhile.
+ *
+ * Factors loaded while a job runs reach only the users it has yet to visit, so start() then
+ * queues one more job, started as soon as the running one finishes.
+ */
+class RecomputeJob
+{
+  public:
+    explicit RecomputeJob(IStore& store, unsigned threads = 0, std::size_t chunk = 64);
+    ~RecomputeJob(); // stops a running job once the chunks in hand are done
+
+    RecomputeJob(const RecomputeJob&)            = delete;
+    RecomputeJob& operator=(const RecomputeJob&) = delete;
+    RecomputeJob(RecomputeJob&&)                 = delete;
+    RecomputeJob& operator=(RecomputeJob&&)      = delete;
+
+    // Starts a job, or queues a rerun if one is running; returns whether it started one now.
+    bool start();
+
+    // Blocks until no job is running.
+    void wait();
+
+    RecomputeStatus status() const;
+
+  private:
+    // With mu_ held: resets the status for a new job.
+    void begin_locked();
+    void run();
+    // One job over every user; returns whether another was queued meanwhile and has begun.
+    bool run_once();
+
+    IStore&                               store_;
+    unsigned                              threads_;
+    std::size_t                           chunk_;
+    mutable std::mutex                    mu_;
+    std::condition_variable               idle_cv_;
+    RecomputeStatus                       status_; // users_done and rollups: see below while running
+    std::chrono::steady_clock::time_point started_;
+    std::atomic<std::size_t>              users_done_{ 0 };
+    std::atomic<std::size_t>              rollups_{ 0 };
+    std::atomic<std::uint64_t>            latest_version_{ 0 }; // see RecomputeStatus
+    bool                                  rerun_ = false;
+    std::atomic<bool>                     stopping_{ false };
+    std::thread                           thread_;
+};
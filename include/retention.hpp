@@ -0,0 +1,55 @@
+#pragma once
+#include "storage.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+struct RetentionPolicy
+{
+    int                  event_months = 0; // roll up events older than this many months (0 = keep)
+    int                  log_days     = 0; // delete request logs older than this many days (0 = keep)
+    std::chrono::minutes interval{ 60 };   // how often the background job runs
+};
+
+// Start of the UTC day `months` calendar months before `now` (epoch seconds). The day of the
+// month is clamped to the target month's length, so 31 March minus one month is 28/29 February.
+std::int64_t months_before(std::int64_t now, int months);
+
+/**
+ * Applies a RetentionPolicy to a store: raw events older than event_months are deleted, leaving
+ * the per-user daily rollups the store keeps for every event (IStore::apply_retention), and
+ * request logs older than log_days are deleted. Summaries keep counting retired days from their
+ * rollups, so lifetime totals are unchanged; only per-event detail past the horizon is lost.
+ *
+ * start() runs the policy once and then every `interval` on a background thread until the job
+ * is destroyed. A failed pass is logged and retried on the next tick.
+ */
+class RetentionJob
+{
+  public:
+    RetentionJob(IStore& store, const RetentionPolicy& policy);
+    ~RetentionJob();
+
+    RetentionJob(const RetentionJob&)            = delete;
+    RetentionJob& operator=(const RetentionJob&) = delete;
+    RetentionJob(RetentionJob&&)                 = delete;
+    RetentionJob& operator=(RetentionJob&&)      = delete;
+
+    void start();
+
+    // One pass with `now` as the current time (epoch seconds).
+    RetentionResult run_once(std::int64_t now);
+
+  private:
+    void loop();
+
+    IStore&                 store_;
+    RetentionPolicy         policy_;
+    std::mutex              mu_;
+    std::condition_variable cv_;
+    bool                    stopping_ = false;
+    std::thread             thread_;
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include "admission.hpp"
+#include "rate_limiter.hpp"
+
+#include <httplib.h>
+
+#include <cstddef>
+#include <ctime>
+#include <limits>
+#include <string>
+
+/**
+ * Runtime tuning for the HTTP server.
+ * Defaults match cpp-httplib's compile-time defaults, except the worker count which
+ * follows the host's hardware concurrency instead of a fixed CPPHTTPLIB_THREAD_POOL_COUNT.
+ */
+struct ServerConfig
+{
+    std::string host = "0.0.0.0";
+    int         port = 8080;
+
+    std::size_t worker_threads         = 0;    // 0 means std::thread::hardware_concurrency()
+    std::size_t max_queued_requests    = 1024; // 0 means unbounded; see WorkStealingTaskQueue
+    std::size_t keep_alive_max_count   = 5;
+    std::time_t keep_alive_timeout_sec = 5;
+    std::time_t read_timeout_sec       = 5;
+    std::time_t write_timeout_sec      = 5;
+    std::size_t payload_max_bytes      = (std::numeric_limits<std::size_t>::max)();
+
+    // Per-route-class concurrency limits and queue budgets (see AdmissionController)
+    AdmissionLimits admission;
+
+    // Per-client token buckets applied before auth and body parsing (see RateLimiter)
+    TokenBucketConfig per_user_rate{ 20.0, 40.0 };
+    TokenBucketConfig per_ip_rate{ 100.0, 200.0 };
+    std::size_t       rate_limit_max_keys = 100000; // buckets kept per limiter
+
+    // Worker count with the hardware-concurrency default resolved (always >= 1).
+    std::size_t effective_worker_threads() const;
+};
+
+// Parses a whole non-negative decimal number set as `name`. Throws std::runtime_error naming
+// `name` and the value if it is empty, signed, out of range or has trailing characters.
+unsigned long long parse_unsigned(const std::string& name, const std::string& value);
+
+/**
+ * Builds a config from the process environment.
+ * Recognized variables: HOST, PORT, HTTP_WORKER_THREADS, HTTP_MAX_QUEUED_REQUESTS,
+ * HTTP_KEEP_ALIVE_MAX_COUNT,
+ * HTTP_KEEP_ALIVE_TIMEOUT_SEC, HTTP_READ_TIMEOUT_SEC, HTTP_WRITE_TIMEOUT_SEC, HTTP_PAYLOAD_MAX_BYTES,
+ * ADMISSION_<CLASS>_MAX_CONCURRENT / ADMISSION_<CLASS>_QUEUE_MS for CLASS in
+ * INGEST, READ, ANALYTICS, ADMIN, and RATE_LIMIT_USER_RPS, RATE_LIMIT_USER_BURST, RATE_LIMIT_IP_RPS,
+ * RATE_LIMIT_IP_BURST, RATE_LIMIT_MAX_KEYS.
+ * Throws std::runtime_error if a variable is set but not a valid number.
+ */
+ServerConfig server_config_from_env();
+
+/**
+ * Applies command-line overrides of the form --name=value on top of `cfg`.
+ * Recognized flags: --host, --port, --workers, --max-queued, --keep-alive-max-count,
+ * --keep-alive-timeout,
+ * --read-timeout, --write-timeout, --payload-max-bytes, --<class>-max-concurrent /
+ * --<class>-queue-ms for class in ingest, read, analytics, admin, and --user-rate, --user-burst,
+ * --ip-rate, --ip-burst, --rate-limit-max-keys.
+ * Throws std::runtime_error on unknown flags or invalid values.
+ */
+void apply_cli_overrides(ServerConfig& cfg, int argc, const char* const* argv);
+
+// Installs timeouts, keep-alive limits, payload limit and the work-stealing worker pool on `svr`.
+void apply_server_config(httplib::Server& svr, const ServerConfig& cfg);
@@ -1,12 +1,23 @@
 #pragma once
+#include "api_key_hash.hpp"
 #include "emission_factors.hpp"
+#include "wal.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <filesystem>
 #include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -19,6 +30,7 @@ struct TransitEvent
     double       occupancy   = 1.0; // number of passengers
     double       distance_km = 0.0;
     std::int64_t ts          = 0;
+    std::string  region;            // where the trip was made, e.g. "GB", "US-CA"; empty if unknown
     // Default and validating constructor. Implemented in src/transit_validator.cpp
     TransitEvent() = default;
     TransitEvent(const std::string& user_id_, const std::string& mode_,
@@ -45,10 +57,84 @@ struct FootprintSummary
     double month_kg_co2    = 0.0;
 };
 
-// DEFRA-based emission calculation (kg CO2e per passenger·km)
-// Implemented in src/emission_calculator.cpp
+// Totals of one user's trips in one mode on one UTC day. Stores keep these up to date as events
+// arrive, so long-range history never reads raw events, and they are all that is left of a day
+// once retention has deleted its events (see IStore::apply_retention).
+struct DailyRollup
+{
+    std::string  user_id;
+    std::int64_t day = 0; // days since 1970-01-01 (UTC)
+    std::string  mode;
+    std::int64_t trips       = 0;
+    double       distance_km = 0.0;
+    double       kg_co2      = 0.0;
+};
+
+struct RetentionResult
+{
+    std::size_t events_rolled_up = 0; // raw events deleted; their rollups remain
+    std::size_t logs_deleted     = 0;
+};
+
+// UTC day number of an epoch-seconds timestamp (rounds towards negative infinity).
+inline std::int64_t epoch_day(std::int64_t ts)
+{
+    return ts >= 0 ? ts / 86400 : -((-ts + 86399) / 86400);
+}
+
+// DEFRA-based emission calculation (kg CO2e per passenger·km), with the factors of `region` in
+// effect now where the active table has them. Implemented in src/emission_calculator.cpp
 double calculate_co2_emissions(const std::string& mode, const std::string& fuel_type,
-                               const std::string& vehicle_size, double occupancy, double distance_km);
+                               const std::string& vehicle_size, double occupancy, double distance_km,
+                               std::string_view region = {});
+
+// The same for a recorded trip, with the factors in effect at its ts, so a later correction or a
+// new year's table doesn't silently re-price old trips.
+double calculate_co2_emissions(const TransitEvent& ev);
+
+// The same for many trips: kg CO2e of each event, priced in one batch with one table (see
+// BatchPricer). Throws std::runtime_error before pricing any if one of them is invalid.
+std::vector<double> calculate_co2_emissions(const std::vector<TransitEvent>& evs);
+
+class FactorChangeSet;
+
+// The rollups of the (day, mode) pairs among one user's events that `changes` re-prices, rebuilt
+// from all of those days' events with the active factors, ordered by day, then mode. Events
+// before `horizon` were retired into rollups that can no longer be re-priced, so their days are
+// left alone. Implemented in src/repricing.cpp
+std::vector<DailyRollup> repriced_rollups(const std::vector<TransitEvent>& evs,
+                                          const FactorChangeSet& changes, std::int64_t horizon);
+
+// Adds one trip, priced at `kg_co2`, to the rollup of its day and mode.
+inline void add_to_rollup(DailyRollup& r, const TransitEvent& ev, double kg_co2)
+{
+    if (r.trips == 0)
+    {
+        r.user_id = ev.user_id;
+        r.day     = epoch_day(ev.ts);
+        r.mode    = ev.mode;
+    }
+    ++r.trips;
+    r.distance_km += ev.distance_km;
+    r.kg_co2 += kg_co2;
+}
+
+// The same, priced with the active table.
+inline void add_to_rollup(DailyRollup& r, const TransitEvent& ev)
+{
+    add_to_rollup(r, ev, calculate_co2_emissions(ev));
+}
+
+// Adds a whole day to a summary's lifetime, 7-day and 30-day totals.
+inline void add_to_summary(FootprintSummary& s, const DailyRollup& r, std::int64_t week_start,
+                           std::int64_t month_start)
+{
+    s.lifetime_kg_co2 += r.kg_co2;
+    if (r.day * 86400 >= week_start)
+        s.week_kg_co2 += r.kg_co2;
+    if (r.day * 86400 >= month_start)
+        s.month_kg_co2 += r.kg_co2;
+}
 
 // Legacy helper: deprecated but kept for backward compat (used in some aggregation code paths)
 inline double emission_factor_for(const std::string& mode)
@@ -73,6 +159,8 @@ struct IStore
     virtual void set_api_key(const std::string& user, const std::string& key,
                              const std::string& app_name = "")                        = 0;
     virtual bool check_api_key(const std::string& user, const std::string& key) const = 0;
+    // True once any user has an API key, e.g. to seed a demo key only into a fresh store.
+    virtual bool has_api_keys() const = 0;
     // Logging and admin operations
     virtual void                      append_log(const ApiLogRecord& rec)                 = 0;
     virtual std::vector<ApiLogRecord> get_logs(std::size_t limit = 100) const             = 0;
@@ -92,31 +180,333 @@ struct IStore
                                                               const std::string& vehicle_size) const = 0;
     virtual std::vector<EmissionFactor>   get_all_emission_factors() const                           = 0;
     virtual void                          clear_emission_factors()                                   = 0;
+    // Retention: moves the retention horizon up to event_cutoff (rounded down to a UTC day) and
+    // deletes the raw events before it, and deletes request logs with ts < log_cutoff. A cutoff of
+    // 0 skips that half. Events before the horizon live on in their rollups, which summaries use
+    // for those days, so lifetime totals do not change.
+    virtual RetentionResult          apply_retention(std::int64_t event_cutoff, std::int64_t log_cutoff) = 0;
+    // Start of the first UTC day whose raw events are kept (epoch seconds); 0 if none were deleted.
+    virtual std::int64_t             retention_horizon() const = 0;
+    // A user's rollups for days in [from_day, to_day], ordered by day, then mode. Rollups are
+    // maintained on ingestion, so they cover every event, retained or not.
+    virtual std::vector<DailyRollup> get_rollups(const std::string& user, std::int64_t from_day,
+                                                 std::int64_t to_day) const                       = 0;
+    // After a factor correction: replaces the user's rollups that repriced_rollups() rebuilds, so
+    // they agree with the active table again, and returns how many were rewritten. See
+    // reprice_store() in repricing.hpp.
+    virtual std::size_t reprice_rollups(const std::string& user, const FactorChangeSet& changes) = 0;
+    // Bulk writes. The defaults write one at a time; stores with a cheaper bulk path override them.
+    virtual void add_events(const std::vector<TransitEvent>& evs)
+    {
+        for (const auto& ev : evs)
+            add_event(ev);
+    }
+    virtual void append_logs(const std::vector<ApiLogRecord>& recs)
+    {
+        for (const auto& rec : recs)
+            append_log(rec);
+    }
+
+    // Called with every event add_event()/add_events() accept, whichever caller ingested it
+    // (e.g. to feed ActiveUsers). Set it before the store is shared between threads.
+    void set_ingest_listener(std::function<void(const TransitEvent&)> listener)
+    {
+        ingest_listener_ = std::move(listener);
+    }
+
+  protected:
+    void notify_ingested(const TransitEvent& ev) const
+    {
+        if (ingest_listener_)
+            ingest_listener_(ev);
+    }
+
+  private:
+    std::function<void(const TransitEvent&)> ingest_listener_;
+};
+
+// Point-in-time copy of InMemoryStore's durable state. `generation` names the newest sealed WAL
+// segment whose records the snapshot already contains.
+struct InMemorySnapshot
+{
+    std::uint64_t                                              generation = 0;
+    std::unordered_map<std::string, std::vector<TransitEvent>> events;
+    std::unordered_map<std::string, std::string>               api_keys;
+    std::unordered_map<std::string, std::string>               app_names;
+    std::vector<EmissionFactor>                                emission_factors;
+    std::vector<DailyRollup>                                   rollups; // days before the horizon
+    std::int64_t                                               retention_horizon = 0;
+};
+
+// The same state as InMemoryStore::snapshot_now() holds it while writing: the store's segments
+// are shared rather than copied, so they can be encoded after its lock is released. As above,
+// `rollups` holds only the days before the horizon.
+struct InMemorySnapshotView
+{
+    std::uint64_t                                                                     generation = 0;
+    std::unordered_map<std::string, std::shared_ptr<const std::vector<TransitEvent>>> events;
+    std::shared_ptr<const std::unordered_map<std::string, std::string>>               api_keys;
+    std::shared_ptr<const std::unordered_map<std::string, std::string>>               app_names;
+    std::shared_ptr<const std::vector<EmissionFactor>>                                emission_factors;
+    std::vector<DailyRollup>                                                          rollups;
+    std::int64_t                                                                      retention_horizon = 0;
+};
+
+// Writes `snap` to `path` atomically (temp file, fsync, rename). Implemented in src/snapshot.cpp
+void write_store_snapshot(const std::string& path, const InMemorySnapshot& snap);
+void write_store_snapshot(const std::string& path, const InMemorySnapshotView& snap);
+
+// Maps `path` and decodes it into `out`, rebuilding per-user event vectors on `threads` threads
+// (0 = hardware concurrency). Returns false if the file does not exist; throws if it is corrupt.
+bool read_store_snapshot(const std::string& path, InMemorySnapshot& out, unsigned threads = 0);
+
+struct SnapshotOptions
+{
+    std::string               path;                        // empty disables snapshots
+    std::chrono::milliseconds check_interval{ 60000 };     // how often the WAL size is checked
+    std::uint64_t             min_wal_bytes = 64ULL << 20; // snapshot once the live WAL is this big
+    unsigned                  load_threads  = 0;           // 0 = hardware concurrency
+};
+
+// What open_wal() restored, for startup logging.
+struct InMemoryRecovery
+{
+    std::uint64_t snapshot_generation = 0;
+    std::size_t   snapshot_events     = 0;
+    std::uint64_t wal_records         = 0; // from sealed segments and the live log
+    double        elapsed_ms          = 0.0;
+};
+
+// A value InMemoryStore shares with the snapshot being written. snapshot_now() takes a reference
+// and starts a new epoch; the first write in the new epoch copies the value instead of changing
+// the one the snapshot is reading.
+template <typename T>
+class CowSegment
+{
+  public:
+    CowSegment() = default;
+    explicit CowSegment(T value) : data_(std::make_shared<T>(std::move(value))) {}
+
+    const T& get() const
+    {
+        return *data_;
+    }
+
+    std::shared_ptr<const T> share() const
+    {
+        return data_;
+    }
+
+    T& mut(std::uint64_t epoch)
+    {
+        if (epoch_ != epoch)
+        {
+            data_  = std::make_shared<T>(*data_);
+            epoch_ = epoch;
+        }
+        return *data_;
+    }
+
+  private:
+    std::shared_ptr<T> data_  = std::make_shared<T>();
+    std::uint64_t      epoch_ = 0;
+};
+
+// Record types written to InMemoryStore's write-ahead log. Values are part of the file format.
+enum class StoreWalRecord : std::uint8_t
+{
+    AddEvent             = 1,
+    SetApiKey            = 2,
+    StoreEmissionFactor  = 3,
+    ClearEvents          = 4,
+    ClearAll             = 5,
+    ClearEmissionFactors = 6,
+    ApplyRetention       = 7,
 };
 
 class InMemoryStore : public IStore
 {
   public:
+    InMemoryStore() = default;
+
+    InMemoryStore(const InMemoryStore&)            = delete;
+    InMemoryStore& operator=(const InMemoryStore&) = delete;
+    InMemoryStore(InMemoryStore&&)                 = delete;
+    InMemoryStore& operator=(InMemoryStore&&)      = delete;
+
+    ~InMemoryStore() override
+    {
+        {
+            std::scoped_lock lk(snapshot_thread_mu_);
+            snapshot_stopping_ = true;
+        }
+        snapshot_thread_cv_.notify_all();
+        if (snapshot_thread_.joinable())
+            snapshot_thread_.join();
+    }
+
+    // Durability
+
+    // Restores the store from the snapshot in `snap.path` (if any), then replays the sealed WAL
+    // segments newer than it and the live log at `path`, and logs every later mutation (events,
+    // API keys, emission factors, clears; request logs stay memory-only). With a snapshot path
+    // set, a background thread snapshots and compacts the log once it reaches
+    // snap.min_wal_bytes. Call once, before serving.
+    void open_wal(const std::string& path, const WalOptions& opts = {}, const SnapshotOptions& snap = {})
+    {
+        const auto start = std::chrono::steady_clock::now();
+        {
+            std::scoped_lock lk(mu_);
+            wal_path_      = path;
+            snapshot_opts_ = snap;
+
+            InMemorySnapshot loaded;
+            if (!snap.path.empty() && read_store_snapshot(snap.path, loaded, snap.load_threads))
+            {
+                recovery_.snapshot_generation = loaded.generation;
+                for (const auto& [user, evs] : loaded.events)
+                    recovery_.snapshot_events += evs.size();
+                for (auto& [user, evs] : loaded.events)
+                    events_.emplace(user, CowSegment(std::move(evs)));
+                api_keys_         = CowSegment(std::move(loaded.api_keys));
+                app_names_        = CowSegment(std::move(loaded.app_names));
+                emission_factors_ = CowSegment(std::move(loaded.emission_factors));
+                horizon_          = loaded.retention_horizon;
+                // Days before the horizon come from the snapshot, later ones from their events
+                for (const auto& r : loaded.rollups)
+                    rollups_[r.user_id].mut(cow_epoch_)[{ r.day, r.mode }] = r;
+                for (const auto& [user, seg] : events_)
+                {
+                    const auto& evs = seg.get();
+                    const auto  kg  = calculate_co2_emissions(evs);
+                    for (std::size_t i = 0; i < evs.size(); ++i)
+                        if (evs[i].ts >= horizon_)
+                            add_to_rollups(evs[i], kg[i]);
+                }
+                cache_.clear();
+            }
+
+            auto apply = [this](std::uint8_t type, std::string_view payload)
+            {
+                apply_wal_record(type, payload);
+            };
+            std::uint64_t newest = recovery_.snapshot_generation;
+            for (const auto& [generation, segment] : list_wal_segments(path))
+            {
+                if (generation <= recovery_.snapshot_generation)
+                {
+                    std::filesystem::remove(segment); // left over from a compaction cut short
+                    continue;
+                }
+                recovery_.wal_records += WriteAheadLog::replay_file(segment, apply);
+                newest = generation;
+            }
+            next_generation_ = newest + 1;
+
+            wal_ = std::make_unique<WriteAheadLog>(path, opts, apply);
+            recovery_.wal_records += wal_->replayed_records();
+        }
+        recovery_.elapsed_ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (!snap.path.empty())
+            snapshot_thread_ = std::thread([this] { snapshot_loop(); });
+    }
+
+    // Writes a snapshot and deletes the WAL segments it covers. Writers are paused only while the
+    // log is rotated and a reference to each segment is taken (see CowSegment); copying, encoding
+    // and disk I/O happen after the lock is released. Returns the snapshot's generation, or 0 when
+    // snapshots are not configured.
+    std::uint64_t snapshot_now()
+    {
+        std::scoped_lock                                snap_lk(snapshot_mu_);
+        InMemorySnapshotView                            snap;
+        std::vector<std::shared_ptr<const UserRollups>> rollups;
+        {
+            std::scoped_lock lk(mu_);
+            if (!wal_ || snapshot_opts_.path.empty())
+                return 0;
+            snap.generation = next_generation_++;
+            wal_->rotate(wal_segment_path(wal_path_, snap.generation));
+            snap.events.reserve(events_.size());
+            for (const auto& [user, evs] : events_)
+                snap.events.emplace(user, evs.share());
+            snap.api_keys         = api_keys_.share();
+            snap.app_names        = app_names_.share();
+            snap.emission_factors = emission_factors_.share();
+            rollups.reserve(rollups_.size());
+            for (const auto& [user, days] : rollups_)
+                rollups.push_back(days.share());
+            snap.retention_horizon = horizon_;
+            ++cow_epoch_;
+        }
+        // Later days are rebuilt from their events on load
+        for (const auto& days : rollups)
+        {
+            for (const auto& [key, r] : *days)
+            {
+                if (r.day * 86400 >= snap.retention_horizon)
+                    break;
+                snap.rollups.push_back(r);
+            }
+        }
+        write_store_snapshot(snapshot_opts_.path, snap);
+        for (const auto& [generation, segment] : list_wal_segments(wal_path_))
+        {
+            if (generation <= snap.generation)
+                std::filesystem::remove(segment);
+        }
+        sync_parent_dir(wal_path_);
+        return snap.generation;
+    }
+
+    WriteAheadLog* wal() const
+    {
+        return wal_.get();
+    }
+
+    const InMemoryRecovery& recovery() const
+    {
+        return recovery_;
+    }
+
     // API key management
 
     void set_api_key(const std::string& user, const std::string& key,
                      const std::string& app_name = "") override
     {
-        std::scoped_lock lk(mu_);
-        const auto       h = hash_plain(key);
-        api_keys_[user]    = h;
-        if (!app_name.empty())
-            app_names_[user] = app_name;
+        std::uint64_t seq = 0;
+        {
+            std::scoped_lock lk(mu_);
+            const auto       h = hash_api_key(key);
+            set_api_key_hash(user, h, app_name);
+            if (wal_)
+            {
+                WalEncoder enc;
+                enc.put_str(user);
+                enc.put_str(h);
+                enc.put_str(app_name);
+                seq = wal_append(StoreWalRecord::SetApiKey, enc);
+            }
+        }
+        wal_wait(seq);
     }
 
     bool check_api_key(const std::string& user, const std::string& key) const override
     {
         std::scoped_lock lk(mu_);
-        auto             it = api_keys_.find(user);
-        if (it == api_keys_.end())
+        const auto&      keys = api_keys_.get();
+        auto             it   = keys.find(user);
+        if (it == keys.end())
             return false;
         const auto& h = it->second;
-        return hash_plain(key) == h;
+        return hash_api_key(key) == h;
+    }
+
+    bool has_api_keys() const override
+    {
+        std::scoped_lock lk(mu_);
+        return !api_keys_.get().empty();
     }
 
     // Logging and admin operations
@@ -145,24 +535,30 @@ class InMemoryStore : public IStore
     // Emission factor persistence
     void store_emission_factor(const EmissionFactor& factor) override
     {
-        std::scoped_lock lk(mu_);
-        for (auto& f : emission_factors_)
+        std::uint64_t seq = 0;
         {
-            if (f.mode == factor.mode && f.fuel_type == factor.fuel_type &&
-                f.vehicle_size == factor.vehicle_size)
+            std::scoped_lock lk(mu_);
+            upsert_emission_factor(factor);
+            if (wal_)
             {
-                f = factor;
-                return;
+                WalEncoder enc;
+                enc.put_str(factor.mode);
+                enc.put_str(factor.fuel_type);
+                enc.put_str(factor.vehicle_size);
+                enc.put_f64(factor.kg_co2_per_km);
+                enc.put_str(factor.source);
+                enc.put_i64(factor.updated_at);
+                seq = wal_append(StoreWalRecord::StoreEmissionFactor, enc);
             }
         }
-        emission_factors_.push_back(factor);
+        wal_wait(seq);
     }
 
     std::optional<EmissionFactor> get_emission_factor(const std::string& mode, const std::string& fuel_type,
                                                       const std::string& vehicle_size) const override
     {
         std::scoped_lock lk(mu_);
-        for (const auto& f : emission_factors_)
+        for (const auto& f : emission_factors_.get())
         {
             if (f.mode == mode && f.fuel_type == fuel_type && f.vehicle_size == vehicle_size)
                 return f;
@@ -173,13 +569,106 @@ class InMemoryStore : public IStore
     std::vector<EmissionFactor> get_all_emission_factors() const override
     {
         std::scoped_lock lk(mu_);
-        return emission_factors_;
+        return emission_factors_.get();
     }
 
     void clear_emission_factors() override
+    {
+        std::uint64_t seq = 0;
+        {
+            std::scoped_lock lk(mu_);
+            emission_factors_ = {};
+            if (wal_)
+                seq = wal_append(StoreWalRecord::ClearEmissionFactors, WalEncoder{});
+        }
+        wal_wait(seq);
+    }
+
+    // Retention
+
+    RetentionResult apply_retention(std::int64_t event_cutoff, std::int64_t log_cutoff) override
+    {
+        RetentionResult res;
+        std::uint64_t   seq = 0;
+        {
+            std::scoped_lock lk(mu_);
+            if (log_cutoff > 0)
+            {
+                const auto before = logs_.size();
+                logs_.erase(std::remove_if(logs_.begin(), logs_.end(),
+                                           [&](const ApiLogRecord& r) { return r.ts < log_cutoff; }),
+                            logs_.end());
+                res.logs_deleted = before - logs_.size();
+            }
+            if (event_cutoff > 0)
+            {
+                const auto old_horizon = horizon_;
+                res.events_rolled_up   = retire_before(event_cutoff);
+                if (wal_ && (res.events_rolled_up > 0 || horizon_ != old_horizon))
+                {
+                    WalEncoder enc;
+                    enc.put_i64(event_cutoff);
+                    seq = wal_append(StoreWalRecord::ApplyRetention, enc);
+                }
+            }
+        }
+        wal_wait(seq);
+        return res;
+    }
+
+    std::int64_t retention_horizon() const override
     {
         std::scoped_lock lk(mu_);
-        emission_factors_.clear();
+        return horizon_;
+    }
+
+    std::vector<DailyRollup> get_rollups(const std::string& user, std::int64_t from_day,
+                                         std::int64_t to_day) const override
+    {
+        std::scoped_lock         lk(mu_);
+        std::vector<DailyRollup> out;
+        const auto               it = rollups_.find(user);
+        if (it == rollups_.end() || from_day > to_day)
+            return out;
+        const auto& days = it->second.get();
+        for (auto r = days.lower_bound({ from_day, std::string() });
+             r != days.end() && r->first.first <= to_day; ++r)
+            out.push_back(r->second);
+        return out;
+    }
+
+    std::size_t reprice_rollups(const std::string& user, const FactorChangeSet& changes) override
+    {
+        // Priced from a copy, so other users' reads and writes aren't held up; if the user's
+        // events changed meanwhile (see events_version_), they are priced again under the lock
+        std::vector<TransitEvent> evs;
+        std::int64_t              horizon = 0;
+        std::uint64_t             version = 0;
+        {
+            std::scoped_lock lk(mu_);
+            const auto       it = events_.find(user);
+            if (it == events_.end())
+                return 0;
+            evs     = it->second.get();
+            horizon = horizon_;
+            version = events_version(user);
+        }
+        auto rebuilt = repriced_rollups(evs, changes, horizon);
+
+        std::scoped_lock lk(mu_);
+        const auto       it = events_.find(user);
+        if (it == events_.end())
+            return 0;
+        if (events_version(user) != version)
+            rebuilt = repriced_rollups(it->second.get(), changes, horizon_);
+        if (rebuilt.empty())
+            return 0;
+        // Nothing is logged: replaying the events rebuilds the rollups with the active table
+        auto& days = rollups_[user].mut(cow_epoch_);
+        for (const auto& r : rebuilt)
+            days[{ r.day, r.mode }] = r;
+        cache_.erase(user);
+        return rebuilt.size();
     }
 
     std::vector<std::string> get_clients() const override
@@ -199,29 +688,73 @@ class InMemoryStore : public IStore
 
     void clear_db_events() override
     {
-        std::scoped_lock lk(mu_);
-        events_.clear();
+        std::uint64_t seq = 0;
+        {
+            std::scoped_lock lk(mu_);
+            events_.clear();
+            events_version_.clear();
+            rollups_.clear();
+            horizon_ = 0;
+            cache_.clear();
+            if (wal_)
+                seq = wal_append(StoreWalRecord::ClearEvents, WalEncoder{});
+        }
+        wal_wait(seq);
     }
 
     void clear_db() override
     {
-        std::scoped_lock lk(mu_);
-        events_.clear();
-        api_keys_.clear();
-        app_names_.clear();
-        cache_.clear();
-        logs_.clear();
-        emission_factors_.clear();
+        std::uint64_t seq = 0;
+        {
+            std::scoped_lock lk(mu_);
+            clear_all();
+            if (wal_)
+                seq = wal_append(StoreWalRecord::ClearAll, WalEncoder{});
+        }
+        wal_wait(seq);
     }
 
     // Helpers for client API calls
 
     void add_event(const TransitEvent& ev) override
     {
-        std::scoped_lock lk(mu_);
-        events_[ev.user_id].push_back(ev);
-        // invalidate tiny cache
-        cache_.erase(ev.user_id);
+        std::uint64_t seq = 0;
+        {
+            std::scoped_lock lk(mu_);
+            events_[ev.user_id].mut(cow_epoch_).push_back(ev);
+            events_changed(ev.user_id);
+            add_to_rollups(ev);
+            // invalidate tiny cache
+            cache_.erase(ev.user_id);
+            if (wal_)
+                seq = wal_append(StoreWalRecord::AddEvent, encode_event(ev));
+        }
+        wal_wait(seq);
+        notify_ingested(ev);
+    }
+
+    // Priced in one batch before the lock is taken, added under one lock, made durable by one
+    // group commit. An invalid event rejects the batch before anything is added.
+    void add_events(const std::vector<TransitEvent>& evs) override
+    {
+        const auto    kg  = calculate_co2_emissions(evs);
+        std::uint64_t seq = 0;
+        {
+            std::scoped_lock lk(mu_);
+            for (std::size_t i = 0; i < evs.size(); ++i)
+            {
+                const auto& ev = evs[i];
+                events_[ev.user_id].mut(cow_epoch_).push_back(ev);
+                events_changed(ev.user_id);
+                add_to_rollups(ev, kg[i]);
+                cache_.erase(ev.user_id);
+                if (wal_)
+                    seq = wal_append(StoreWalRecord::AddEvent, encode_event(ev));
+            }
+        }
+        wal_wait(seq);
+        for (const auto& ev : evs)
+            notify_ingested(ev);
     }
 
     std::vector<TransitEvent> get_events(const std::string& user) const override
@@ -230,7 +763,7 @@ class InMemoryStore : public IStore
         auto             it = events_.find(user);
         if (it == events_.end())
             return {};
-        return it->second;
+        return it->second.get();
     }
 
     FootprintSummary summarize(const std::string& user) override
@@ -253,10 +786,26 @@ class InMemoryStore : public IStore
         auto week_start  = now - (7 * 24 * 3600);
         auto month_start = now - (30 * 24 * 3600);
 
-        for (const auto& ev : it->second)
+        // Days before the horizon only exist as rollups; later ones are summed from their events
+        const auto rolled = rollups_.find(user);
+        if (rolled != rollups_.end())
         {
-            double kg =
-                calculate_co2_emissions(ev.mode, ev.fuel_type, ev.vehicle_size, ev.occupancy, ev.distance_km);
+            for (const auto& [key, r] : rolled->second.get())
+            {
+                if (r.day * 86400 >= horizon_)
+                    break;
+                add_to_summary(s, r, week_start, month_start);
+            }
+        }
+
+        const auto& evs = it->second.get();
+        const auto  kgs = calculate_co2_emissions(evs);
+        for (std::size_t i = 0; i < evs.size(); ++i)
+        {
+            const auto& ev = evs[i];
+            if (ev.ts < horizon_)
+                continue; // already counted in its rollup, deleted on the next retention pass
+            const double kg = kgs[i];
             s.lifetime_kg_co2 += kg;
             if (ev.ts >= week_start)
                 s.week_kg_co2 += kg;
@@ -283,12 +832,11 @@ class InMemoryStore : public IStore
         {
             double u_week = 0.0;
             bool   has    = false;
-            for (auto& ev : vec)
+            for (const auto& ev : vec.get())
             {
                 if (ev.ts >= week_start)
                 {
-                    u_week += calculate_co2_emissions(ev.mode, ev.fuel_type, ev.vehicle_size, ev.occupancy,
-                                                      ev.distance_km);
+                    u_week += calculate_co2_emissions(ev);
                     has = true;
                 }
             }
@@ -304,21 +852,225 @@ class InMemoryStore : public IStore
     }
 
   private:
-    mutable std::mutex                                         mu_;
-    std::unordered_map<std::string, std::string>               api_keys_;
-    std::unordered_map<std::string, std::string>               app_names_;
-    std::unordered_map<std::string, std::vector<TransitEvent>> events_;
-    std::unordered_map<std::string, FootprintSummary>          cache_;
-    std::vector<ApiLogRecord>                                  logs_;
-    std::vector<EmissionFactor>                                emission_factors_;
-
-    static std::string hash_plain(const std::string& key)
-    {
-        // TO-DO: replace std::hash with something stronger later (eg. Argon2/bcrypt)
-        std::hash<std::string> h;
-        auto                   v = h(key);
-        std::ostringstream     oss;
-        oss << std::hex << v;
-        return oss.str();
+    using UserRollups = std::map<std::pair<std::int64_t, std::string>, DailyRollup>; // (day, mode)
+
+    mutable std::mutex                                                     mu_;
+    CowSegment<std::unordered_map<std::string, std::string>>               api_keys_;
+    CowSegment<std::unordered_map<std::string, std::string>>               app_names_;
+    std::unordered_map<std::string, CowSegment<std::vector<TransitEvent>>> events_;
+    std::unordered_map<std::string, FootprintSummary>                      cache_;
+    std::vector<ApiLogRecord>                                              logs_;
+    CowSegment<std::vector<EmissionFactor>>                                emission_factors_;
+    std::unordered_map<std::string, CowSegment<UserRollups>>               rollups_;
+    std::unordered_map<std::string, std::uint64_t>                         events_version_;
+    std::int64_t                   horizon_    = 0; // see retention_horizon()
+    std::uint64_t                  cow_epoch_  = 0; // bumped by every snapshot, see CowSegment
+    std::uint64_t                  events_seq_ = 0; // last events version handed out, never reset
+    std::unique_ptr<WriteAheadLog> wal_;
+    std::string                    wal_path_;
+    std::uint64_t                  next_generation_ = 1;
+    InMemoryRecovery               recovery_;
+
+    SnapshotOptions         snapshot_opts_;
+    std::mutex              snapshot_mu_; // one snapshot at a time
+    std::mutex              snapshot_thread_mu_;
+    std::condition_variable snapshot_thread_cv_;
+    bool                    snapshot_stopping_ = false;
+    std::thread             snapshot_thread_;
+
+    void snapshot_loop()
+    {
+        std::unique_lock<std::mutex> lk(snapshot_thread_mu_);
+        const auto                   stopping = [this] { return snapshot_stopping_; };
+        while (!snapshot_thread_cv_.wait_for(lk, snapshot_opts_.check_interval, stopping))
+        {
+            lk.unlock();
+            try
+            {
+                if (wal_->size_bytes() >= snapshot_opts_.min_wal_bytes)
+                    snapshot_now();
+            }
+            catch (const std::exception& e)
+            {
+                // The sealed segments stay on disk, so the next attempt still covers them
+                std::cerr << "[charizard] snapshot failed: " << e.what() << '\n';
+            }
+            lk.lock();
+        }
+    }
+
+    // The helpers below expect mu_ to be held.
+
+    void set_api_key_hash(const std::string& user, const std::string& hash, const std::string& app_name)
+    {
+        api_keys_.mut(cow_epoch_)[user] = hash;
+        if (!app_name.empty())
+            app_names_.mut(cow_epoch_)[user] = app_name;
+    }
+
+    void upsert_emission_factor(const EmissionFactor& factor)
+    {
+        auto& factors = emission_factors_.mut(cow_epoch_);
+        for (auto& f : factors)
+        {
+            if (f.mode == factor.mode && f.fuel_type == factor.fuel_type &&
+                f.vehicle_size == factor.vehicle_size)
+            {
+                f = factor;
+                return;
+            }
+        }
+        factors.push_back(factor);
+    }
+
+    void clear_all()
+    {
+        events_.clear();
+        events_version_.clear();
+        api_keys_  = {};
+        app_names_ = {};
+        cache_.clear();
+        logs_.clear();
+        emission_factors_ = {};
+        rollups_.clear();
+        horizon_ = 0;
+    }
+
+    // Called on every change to a user's events; reprice_rollups() compares versions to tell
+    // whether the events it priced are still current
+    void events_changed(const std::string& user) { events_version_[user] = ++events_seq_; }
+
+    std::uint64_t events_version(const std::string& user) const
+    {
+        const auto it = events_version_.find(user);
+        return it == events_version_.end() ? 0 : it->second;
+    }
+
+    void add_to_rollups(const TransitEvent& ev)
+    {
+        add_to_rollup(rollups_[ev.user_id].mut(cow_epoch_)[{ epoch_day(ev.ts), ev.mode }], ev);
+    }
+
+    void add_to_rollups(const TransitEvent& ev, double kg_co2)
+    {
+        add_to_rollup(rollups_[ev.user_id].mut(cow_epoch_)[{ epoch_day(ev.ts), ev.mode }], ev, kg_co2);
+    }
+
+    static WalEncoder encode_event(const TransitEvent& ev)
+    {
+        WalEncoder enc;
+        enc.put_str(ev.user_id);
+        enc.put_str(ev.mode);
+        enc.put_str(ev.fuel_type);
+        enc.put_str(ev.vehicle_size);
+        enc.put_f64(ev.occupancy);
+        enc.put_f64(ev.distance_km);
+        enc.put_i64(ev.ts);
+        enc.put_str(ev.region);
+        return enc;
+    }
+
+    // Moves the horizon up to `cutoff` (rounded down to a day) and deletes the events before it.
+    // Users keep their (possibly empty) event list so they are still listed by get_clients().
+    // Returns the events deleted.
+    std::size_t retire_before(std::int64_t cutoff)
+    {
+        const auto before_horizon = horizon_;
+        horizon_                  = std::max(horizon_, epoch_day(cutoff) * 86400);
+        std::size_t deleted       = 0;
+        const auto  retired       = [this](const TransitEvent& ev) { return ev.ts < horizon_; };
+        for (auto& [user, seg] : events_)
+        {
+            // A new horizon changes which days every user's rollups are rebuilt from
+            if (horizon_ != before_horizon)
+                events_changed(user);
+            // Users with nothing to delete keep sharing their events with a snapshot
+            if (std::none_of(seg.get().begin(), seg.get().end(), retired))
+                continue;
+            auto&      evs    = seg.mut(cow_epoch_);
+            const auto before = evs.size();
+            evs.erase(std::remove_if(evs.begin(), evs.end(), retired), evs.end());
+            deleted += before - evs.size();
+            cache_.erase(user);
+        }
+        return deleted;
+    }
+
+    std::uint64_t wal_append(StoreWalRecord type, const WalEncoder& enc)
+    {
+        return wal_->append(static_cast<std::uint8_t>(type), enc.bytes());
+    }
+
+    // Called after mu_ is released so concurrent writers share one group commit.
+    void wal_wait(std::uint64_t seq)
+    {
+        if (seq != 0)
+            wal_->wait_durable(seq);
+    }
+
+    // Applies one logged mutation during replay (no re-logging).
+    void apply_wal_record(std::uint8_t type, std::string_view payload)
+    {
+        WalDecoder dec(payload);
+        switch (static_cast<StoreWalRecord>(type))
+        {
+        case StoreWalRecord::AddEvent:
+        {
+            TransitEvent ev;
+            ev.user_id      = dec.str();
+            ev.mode         = dec.str();
+            ev.fuel_type    = dec.str();
+            ev.vehicle_size = dec.str();
+            ev.occupancy    = dec.f64();
+            ev.distance_km  = dec.f64();
+            ev.ts           = dec.i64();
+            // Records logged before events carried a region end here
+            if (!dec.at_end())
+                ev.region = dec.str();
+            cache_.erase(ev.user_id);
+            add_to_rollups(ev);
+            events_changed(ev.user_id);
+            events_[ev.user_id].mut(cow_epoch_).push_back(std::move(ev));
+            break;
+        }
+        case StoreWalRecord::SetApiKey:
+        {
+            auto user     = dec.str();
+            auto hash     = dec.str();
+            auto app_name = dec.str();
+            set_api_key_hash(user, hash, app_name);
+            break;
+        }
+        case StoreWalRecord::StoreEmissionFactor:
+        {
+            EmissionFactor f{};
+            f.mode          = dec.str();
+            f.fuel_type     = dec.str();
+            f.vehicle_size  = dec.str();
+            f.kg_co2_per_km = dec.f64();
+            f.source        = dec.str();
+            f.updated_at    = dec.i64();
+            upsert_emission_factor(f);
+            break;
+        }
+        case StoreWalRecord::ClearEvents:
+            events_.clear();
+            events_version_.clear();
+            rollups_.clear();
+            horizon_ = 0;
+            cache_.clear();
+            break;
+        case StoreWalRecord::ClearAll:
+            clear_all();
+            break;
+        case StoreWalRecord::ClearEmissionFactors:
+            emission_factors_ = {};
+            break;
+        case StoreWalRecord::ApplyRetention:
+            retire_before(dec.i64());
+            break;
+        default:
+            throw std::runtime_error("unknown WAL record type " + std::to_string(type));
+        }
     }
 };
\ No newline at end of file
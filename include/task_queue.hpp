@@ -0,0 +1,92 @@
+#pragma once
+#include <httplib.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * httplib::TaskQueue with per-worker deques and work stealing.
+ *
+ * cpp-httplib's built-in ThreadPool keeps every job in one list behind one mutex, and is sized
+ * by the CPPHTTPLIB_THREAD_POOL_COUNT macro. Here each worker owns a deque: new connections are
+ * spread round-robin, a worker drains its own deque first and steals from its peers' tails when
+ * it runs dry, so the only shared lock is the one idle workers sleep on.
+ *
+ * Queue depth is bounded by `max_queued` (0 = unbounded). Jobs admitted past the bound still run,
+ * but are flagged so the pre-routing handler installed by configure_routes answers the first
+ * request on the connection with a 503 and `Connection: close` instead of doing real work; past
+ * twice the bound enqueue() refuses the job and httplib closes the connection. A client that keeps
+ * the connection open anyway is served normally from then on, since it already holds the worker.
+ *
+ * enqueue() and shutdown() are called from the server's accept thread only.
+ */
+class WorkStealingTaskQueue : public httplib::TaskQueue
+{
+  public:
+    explicit WorkStealingTaskQueue(std::size_t n_workers, std::size_t max_queued = 0);
+    ~WorkStealingTaskQueue() override;
+
+    WorkStealingTaskQueue(const WorkStealingTaskQueue&)            = delete;
+    WorkStealingTaskQueue& operator=(const WorkStealingTaskQueue&) = delete;
+    WorkStealingTaskQueue(WorkStealingTaskQueue&&)                 = delete;
+    WorkStealingTaskQueue& operator=(WorkStealingTaskQueue&&)      = delete;
+
+    bool enqueue(std::function<void()> fn) override;
+    void shutdown() override;
+
+    std::size_t worker_count() const
+    {
+        return queues_.size();
+    }
+
+    // Jobs waiting in any worker deque (not counting jobs currently running).
+    std::size_t queued() const
+    {
+        return pending_.load(std::memory_order_relaxed);
+    }
+
+    // Jobs admitted past the queue bound (answered with 503) or refused outright.
+    std::uint64_t shed_count() const
+    {
+        return shed_.load(std::memory_order_relaxed);
+    }
+
+    // True the first time it is called by a job that was admitted past the queue bound, so only the
+    // first request on a shed connection is rejected; false otherwise.
+    static bool take_current_job_shed();
+
+  private:
+    struct Job
+    {
+        std::function<void()> fn;
+        bool                  shed = false;
+    };
+
+    // Padded so neighbouring workers' locks don't share a cache line.
+    struct alignas(64) WorkerDeque
+    {
+        std::mutex      mu;
+        std::deque<Job> jobs;
+    };
+
+    bool try_pop(std::size_t self, Job& out);
+    void worker_loop(std::size_t self);
+
+    std::vector<std::unique_ptr<WorkerDeque>> queues_;
+    std::vector<std::thread>                  workers_;
+    std::size_t                               max_queued_;
+    std::atomic<std::size_t>                  next_{ 0 };
+    std::atomic<std::size_t>                  pending_{ 0 };
+    std::atomic<std::uint64_t>                shed_{ 0 };
+    std::atomic<bool>                         stopping_{ false };
+    std::mutex                                idle_mu_;
+    std::condition_variable                   idle_cv_;
+};
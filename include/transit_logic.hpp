@@ -1,6 +1,7 @@
 #pragma once
 
 #include "storage.hpp"
+#include "transit_parser.hpp"
 
 #include <cstdint>
 #include <nlohmann/json.hpp>
@@ -10,3 +11,7 @@
 // Throws std::runtime_error on validation errors.
 TransitEvent make_transit_event_from_json(const std::string& user_id, const nlohmann::json& body,
                                           std::int64_t now_epoch = 0);
+
+// Same for a body already read by parse_transit_payload(); the two agree for any body it accepts.
+TransitEvent make_transit_event(const std::string& user_id, const TransitPayload& payload,
+                                std::int64_t now_epoch = 0);
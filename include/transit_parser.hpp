@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+// Fields of a POST /users/{id}/transit body. The string fields are views into the request body,
+// so filling this allocates nothing; it must not outlive the body it was parsed from.
+struct TransitPayload
+{
+    std::string_view mode;
+    std::string_view fuel_type;
+    std::string_view vehicle_size;
+    double           distance_km = 0.0;
+    double           occupancy   = 1.0;
+    std::int64_t     ts          = 0; // 0: not given, the event is stamped with the current time
+    std::string_view region;
+};
+
+// Single-pass pull parser for the common shape of a transit body: a flat JSON object whose known
+// keys (mode, distance_km, ts, fuel_type, vehicle_size, occupancy, region) carry values of the expected
+// type. Unknown keys with scalar values are skipped; duplicate keys keep the last value, as with
+// nlohmann::json.
+//
+// Returns false for anything outside that shape (malformed JSON, missing mode or distance_km,
+// escaped or non-ASCII strings, nested values, a fractional ts, wrong types). Callers then fall
+// back to the generic nlohmann::json path, which accepts or rejects the body with its usual errors,
+// so the two paths never disagree on a result.
+bool parse_transit_payload(std::string_view body, TransitPayload& out);
@@ -0,0 +1,54 @@
+#pragma once
+#include "history.hpp"
+#include "storage.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Week-over-week view of one user's travel, built from the daily rollups of the last 14 UTC days:
+// "this week" is the 7 days ending today, "last week" the 7 days before them. Rollups are kept up
+// to date on every write, so building it reads at most 14 days x modes rollups, never raw events.
+
+struct ModeTrend
+{
+    std::string   mode;
+    HistoryTotals this_week;
+    HistoryTotals last_week;
+};
+
+// Distance that moved from one mode to another between the two weeks, e.g. subway km now
+// travelled by taxi. kg_co2_delta is what the move changed emissions by; positive is worse.
+struct ModeShift
+{
+    std::string from_mode;
+    std::string to_mode;
+    double      distance_km  = 0.0;
+    double      kg_co2_delta = 0.0;
+};
+
+struct WeeklyTrends
+{
+    HistoryTotals          this_week;
+    HistoryTotals          last_week;
+    std::vector<ModeTrend> modes;  // ordered by mode
+    std::vector<ModeShift> shifts; // largest |kg_co2_delta| first
+
+    double kg_co2_delta() const
+    {
+        return this_week.kg_co2 - last_week.kg_co2;
+    }
+};
+
+// Shifts smaller than this, or than k_min_shift_share of last week's distance, are noise.
+constexpr double k_min_shift_km    = 1.0;
+constexpr double k_min_shift_share = 0.1;
+
+// `rollups` may cover any range; days outside the two weeks ending on `today` are ignored.
+WeeklyTrends weekly_trends(const std::vector<DailyRollup>& rollups, std::int64_t today);
+// Reads the two weeks ending on the UTC day of `now` (epoch seconds) from the store's rollups.
+WeeklyTrends weekly_trends(const IStore& store, const std::string& user, std::int64_t now);
+
+// Human-readable tips for the mode shifts and week-over-week rises in `t`; empty when there is
+// no previous week to compare with or nothing changed enough to mention.
+std::vector<std::string> trend_suggestions(const WeeklyTrends& t);
@@ -0,0 +1,84 @@
+#pragma once
+#include "storage.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Per-user event lists, daily rollups and last computed summary, with least-recently-used eviction
+ * under a memory budget. Sizes are estimates: the vector and string heap buffers plus a fixed
+ * per-entry overhead. Not thread-safe; the owner locks around it.
+ */
+class UserEventCache
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit UserEventCache(std::size_t budget_bytes = 0); // 0 = unbounded
+
+    // The user's events, marking them most recently used; nullptr if not cached.
+    const std::vector<TransitEvent>* find(const std::string& user);
+    bool                             contains(const std::string& user) const;
+    // The rollups stored with the user's events; empty if not cached.
+    const std::vector<DailyRollup>& rollups(const std::string& user) const;
+
+    // Adds (or replaces) a user's events, then evicts the least recently used users until the
+    // cache fits its budget again. The entry just inserted is never evicted by its own insert.
+    void insert(const std::string& user, std::vector<TransitEvent> events,
+                std::vector<DailyRollup> rollups = {});
+    // Appends to the user's list if it is cached and drops its summary; no-op otherwise.
+    void append(const TransitEvent& ev);
+    void erase(const std::string& user);
+    void clear();
+
+    // A summary stored with set_summary() at most `max_age` before `now`.
+    std::optional<FootprintSummary> summary(const std::string& user, Clock::time_point now,
+                                            Clock::duration max_age) const;
+    void set_summary(const std::string& user, const FootprintSummary& s, Clock::time_point now);
+    // Drops the user's summary, keeping its events, e.g. once the factors it was priced with change.
+    void drop_summary(const std::string& user);
+
+    std::size_t size() const
+    {
+        return index_.size();
+    }
+    std::size_t bytes() const
+    {
+        return bytes_;
+    }
+    std::size_t budget_bytes() const
+    {
+        return budget_;
+    }
+    std::uint64_t evictions() const
+    {
+        return evictions_;
+    }
+
+  private:
+    struct Entry
+    {
+        std::string                     user;
+        std::vector<TransitEvent>       events;
+        std::vector<DailyRollup>        rollups;
+        std::optional<FootprintSummary> summary;
+        Clock::time_point               summary_at;
+        std::size_t                     bytes = 0;
+    };
+    using Lru = std::list<Entry>; // most recently used first
+
+    void account(Entry& e);
+    void evict_to_budget(const Lru::iterator& keep);
+
+    std::size_t                                    budget_;
+    std::size_t                                    bytes_     = 0;
+    std::uint64_t                                  evictions_ = 0;
+    Lru                                            lru_;
+    std::unordered_map<std::string, Lru::iterator> index_;
+};
@@ -0,0 +1,163 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Little-endian encoder for WAL record payloads.
+ * Strings are length-prefixed (u32), numbers are fixed width.
+ */
+class WalEncoder
+{
+  public:
+    void put_u8(std::uint8_t v);
+    void put_u32(std::uint32_t v);
+    void put_i64(std::int64_t v);
+    void put_f64(double v);
+    void put_str(std::string_view s);
+
+    const std::string& bytes() const
+    {
+        return buf_;
+    }
+
+  private:
+    std::string buf_;
+};
+
+// Reads what WalEncoder wrote. Throws std::runtime_error if the payload is too short.
+class WalDecoder
+{
+  public:
+    explicit WalDecoder(std::string_view data) : data_(data) {}
+
+    std::uint8_t  u8();
+    std::uint32_t u32();
+    std::int64_t  i64();
+    double        f64();
+    std::string   str();
+
+    bool at_end() const
+    {
+        return pos_ == data_.size();
+    }
+
+  private:
+    std::string_view take(std::size_t n);
+
+    std::string_view data_;
+    std::size_t      pos_ = 0;
+};
+
+struct WalOptions
+{
+    // fsync each batch before acknowledging the writes in it. When false, batches are still
+    // written every group_commit_interval but writers never wait and the OS decides when to sync.
+    bool                      sync                  = true;
+    std::chrono::milliseconds group_commit_interval = std::chrono::milliseconds(2);
+};
+
+/**
+ * Append-only, checksummed write-ahead log of opaque typed records.
+ *
+ * File layout: an 8-byte magic followed by records of
+ *   [u32 payload length][u32 crc32 of type+payload][u8 type][payload]
+ *
+ * append() only copies the record into an in-memory batch, so callers can log while holding
+ * their own lock and keep log order identical to the order they applied changes in. A background
+ * thread writes each batch with one write() and one fsync (group commit); wait_durable() blocks
+ * until a given record has been covered by such a flush.
+ *
+ * On open, intact records are replayed through `apply` in order. A torn or corrupt tail (from a
+ * crash mid-write) ends the replay and is truncated away before new records are appended; a file
+ * holding only part of the magic is treated as an empty log the same way.
+ *
+ * rotate() seals the current file under a new name and starts an empty one at the same path;
+ * sealed segments are named by wal_segment_path() and are deleted once a snapshot covers them.
+ */
+class WriteAheadLog
+{
+  public:
+    using ApplyFn = std::function<void(std::uint8_t type, std::string_view payload)>;
+
+    WriteAheadLog(std::string path, const WalOptions& opts, const ApplyFn& apply);
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&)            = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    WriteAheadLog(WriteAheadLog&&)                 = delete;
+    WriteAheadLog& operator=(WriteAheadLog&&)      = delete;
+
+    // Buffers a record and returns its sequence number (1-based). No I/O happens here.
+    std::uint64_t append(std::uint8_t type, std::string_view payload);
+
+    // Blocks until record `seq` has been written (and fsynced, if opts.sync). Returns
+    // immediately when sync is off. Throws std::runtime_error if the log hit an I/O error.
+    void wait_durable(std::uint64_t seq);
+
+    // Writes and syncs everything appended so far.
+    void flush();
+
+    // Flushes, renames the current file to `sealed_path` and continues in a fresh file. Callers
+    // must stop appending for the duration (InMemoryStore holds its own lock).
+    void rotate(const std::string& sealed_path);
+
+    // Bytes in the current file, including records still waiting to be written.
+    std::uint64_t size_bytes();
+
+    // Replays a sealed segment without opening it for writing. Returns the number of records.
+    static std::uint64_t replay_file(const std::string& path, const ApplyFn& apply);
+
+    const std::string& path() const
+    {
+        return path_;
+    }
+
+    std::uint64_t replayed_records() const
+    {
+        return replayed_;
+    }
+
+  private:
+    void replay_and_open(const ApplyFn& apply);
+    void open_fresh();
+    void flusher_loop();
+    void write_batch(std::unique_lock<std::mutex>& lk);
+
+    std::string   path_;
+    WalOptions    opts_;
+    int           fd_         = -1;
+    std::uint64_t replayed_   = 0;
+    std::uint64_t file_bytes_ = 0; // guarded by mu_ once the flusher runs
+
+    std::mutex              mu_;
+    std::condition_variable work_cv_;    // flusher waits for records
+    std::condition_variable durable_cv_; // writers wait for their batch
+    std::string             batch_;
+    std::uint64_t           appended_seq_ = 0;
+    std::uint64_t           durable_seq_  = 0;
+    bool                    flushing_     = false;
+    bool                    stopping_     = false;
+    std::string             error_;
+    std::thread             flusher_;
+};
+
+// CRC-32 (IEEE 802.3 polynomial), exposed for the snapshot format and tests.
+std::uint32_t wal_crc32(std::string_view data, std::uint32_t crc = 0);
+
+// Sealed segment `generation` of the log at `wal_path` ("<wal_path>.<generation>").
+std::string wal_segment_path(const std::string& wal_path, std::uint64_t generation);
+
+// Sealed segments of `wal_path` that exist on disk, sorted by generation.
+std::vector<std::pair<std::uint64_t, std::string>> list_wal_segments(const std::string& wal_path);
+
+// Makes a rename or unlink in the directory containing `path` durable.
+void sync_parent_dir(const std::string& path);
@@ -0,0 +1,163 @@
+#pragma once
+#include "storage.hpp"
+#include "user_event_cache.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+enum class WriteMode
+{
+    WriteThrough, // add_event/append_log return once the wrapped store has the write
+    WriteBehind,  // they return once the write is buffered; a background thread flushes it
+};
+
+struct WriteBehindOptions
+{
+    WriteMode                 mode           = WriteMode::WriteBehind;
+    std::size_t               max_pending    = 10000; // writers block while this many are buffered
+    std::size_t               batch_size     = 500;   // writes handed to the wrapped store at once
+    std::chrono::milliseconds flush_interval{ 50 };   // longest a buffered write waits
+    std::size_t               cache_bytes = 256U << 20; // read cache budget (0 = unbounded)
+    std::chrono::seconds      summary_ttl{ 60 };        // how long a cached summary is reused
+};
+
+struct WriteBehindStats
+{
+    std::size_t   pending        = 0; // buffered events and log records
+    std::uint64_t flushed        = 0; // writes the wrapped store has accepted
+    std::uint64_t batches        = 0;
+    std::uint64_t failed_batches = 0; // retried on the next flush
+
+    // Read cache
+    std::uint64_t hits           = 0; // get_events/summarize answered without the wrapped store
+    std::uint64_t misses         = 0; // ... that had to load the user first
+    std::uint64_t summary_hits   = 0; // hits that also reused the cached summary
+    std::uint64_t evictions      = 0;
+    std::size_t   cached_users   = 0;
+    std::size_t   cache_bytes    = 0;
+    std::size_t   cache_budget   = 0;
+
+    double hit_ratio() const
+    {
+        const auto lookups = hits + misses;
+        return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+    }
+};
+
+/**
+ * IStore decorator that keeps a per-user copy of the events in memory and, in write-behind
+ * mode, buffers add_event/append_log and hands them to the wrapped store in batches
+ * (IStore::add_events/append_logs) from a background thread.
+ *
+ * A user's events, and the rollups of days before the retention horizon, are loaded from the
+ * wrapped store on first access and kept up to date from then on, so get_events and summarize
+ * don't go back to it until the user is evicted: the copies live in a UserEventCache bounded by
+ * cache_bytes, least recently read users first. A user's summary is cached too, for up to
+ * summary_ttl, and dropped when an event for that user arrives or its rollups are re-priced.
+ * Everything else (API keys, emission factors, clears, retention, cross-user queries) goes
+ * straight to the wrapped store; the cross-user reads flush the buffer first so they see every
+ * acknowledged write.
+ *
+ * The buffer is bounded: once max_pending writes are waiting, writers block until the flusher
+ * catches up. A batch the wrapped store rejects stays at the front of the buffer and is retried.
+ * The destructor flushes whatever is still buffered.
+ */
+class WriteBehindStore : public IStore
+{
+  public:
+    explicit WriteBehindStore(std::unique_ptr<IStore> inner, const WriteBehindOptions& opts = {});
+    ~WriteBehindStore() override;
+
+    WriteBehindStore(const WriteBehindStore&)            = delete;
+    WriteBehindStore& operator=(const WriteBehindStore&) = delete;
+    WriteBehindStore(WriteBehindStore&&)                 = delete;
+    WriteBehindStore& operator=(WriteBehindStore&&)      = delete;
+
+    void set_api_key(const std::string& user, const std::string& key,
+                     const std::string& app_name = "") override;
+    bool check_api_key(const std::string& user, const std::string& key) const override;
+    bool has_api_keys() const override;
+
+    void                      append_log(const ApiLogRecord& rec) override;
+    std::vector<ApiLogRecord> get_logs(std::size_t limit = 100) const override;
+    void                      clear_logs() override;
+    std::vector<std::string>  get_clients() const override;
+    std::vector<TransitEvent> get_client_data(const std::string& client_id) const override;
+    void                      clear_db_events() override;
+    void                      clear_db() override;
+
+    void                      add_event(const TransitEvent& ev) override;
+    std::vector<TransitEvent> get_events(const std::string& user) const override;
+    FootprintSummary          summarize(const std::string& user) override;
+    double                    global_average_weekly() override;
+
+    void                          store_emission_factor(const EmissionFactor& factor) override;
+    std::optional<EmissionFactor> get_emission_factor(const std::string& mode, const std::string& fuel_type,
+                                                      const std::string& vehicle_size) const override;
+    std::vector<EmissionFactor>   get_all_emission_factors() const override;
+    void                          clear_emission_factors() override;
+
+    // Flushes the buffer first so retention sees every acknowledged event, then drops the
+    // cached users, whose events may have just been deleted.
+    RetentionResult          apply_retention(std::int64_t event_cutoff, std::int64_t log_cutoff) override;
+    std::int64_t             retention_horizon() const override;
+    // The wrapped store's rollups plus the user's events that are still buffered.
+    std::vector<DailyRollup> get_rollups(const std::string& user, std::int64_t from_day,
+                                         std::int64_t to_day) const override;
+    // Re-prices the wrapped store's rollups. Buffered events are not in them yet, and are priced
+    // with the active table when they are flushed; cached rollups are all before the horizon.
+    std::size_t              reprice_rollups(const std::string& user,
+                                             const FactorChangeSet& changes) override;
+
+    // Blocks until every write buffered so far has reached the wrapped store. Throws if the
+    // wrapped store rejects a batch.
+    void flush() const;
+
+    WriteBehindStats stats() const;
+
+    IStore& inner()
+    {
+        return *inner_;
+    }
+
+  private:
+    // Both require flush_mu_ to be held.
+    void flush_batch_locked() const;
+    void drain_locked() const;
+
+    // Makes sure cache_ has `user`, reading the wrapped store if needed.
+    void load_user(const std::string& user) const;
+    // The user's cached events, loading them first if needed. `lk` holds mu_ on entry and on
+    // return; the reference is valid while it stays locked.
+    const std::vector<TransitEvent>& cached_events(const std::string&            user,
+                                                   std::unique_lock<std::mutex>& lk) const;
+    // Records a new event in the cache; requires mu_.
+    void cache_event(const TransitEvent& ev);
+    void flusher_loop();
+
+    std::unique_ptr<IStore> inner_;
+    WriteBehindOptions      opts_;
+
+    // flush_mu_ is held while a batch is taken from the buffer and written, and while a user is
+    // loaded, so a load never sees a batch half-written. Lock order: flush_mu_, then mu_.
+    mutable std::mutex               flush_mu_;
+    mutable std::mutex               mu_;
+    mutable std::condition_variable  work_cv_;  // flusher: there is something to write
+    mutable std::condition_variable  space_cv_; // writers: the buffer has room again
+    mutable UserEventCache           cache_;
+    mutable std::deque<TransitEvent> pending_events_;
+    mutable std::deque<ApiLogRecord> pending_logs_;
+    mutable WriteBehindStats         stats_;
+    std::int64_t                     horizon_ = 0; // the wrapped store's retention_horizon()
+    bool                             stopping_ = false;
+    std::thread                      flusher_;
+};
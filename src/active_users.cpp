@@ -0,0 +1,90 @@
+#include "active_users.hpp"
+
+#include <algorithm>
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::size_t ring_slot(std::int64_t day)
+{
+    constexpr auto n = ActiveUsers::k_days;
+    return static_cast<std::size_t>(((day % n) + n) % n);
+}
+
+ActiveUsers::ActiveUsers(unsigned precision)
+{
+    Day empty;
+    empty.users = HyperLogLog(precision);
+    ring_.assign(static_cast<std::size_t>(k_days), empty);
+}
+
+void ActiveUsers::record(const std::string& user, std::int64_t ts)
+{
+    const auto       day = epoch_day(ts);
+    std::scoped_lock lk(mu_);
+    auto&            slot = ring_[ring_slot(day)];
+    if (slot.day > day)
+        return; // the slot already holds a later day
+    if (slot.day < day)
+    {
+        slot.day = day;
+        slot.users.clear();
+    }
+    slot.users.add(user);
+}
+
+void ActiveUsers::seed(const IStore& store, std::int64_t now)
+{
+    const auto today = epoch_day(now);
+    for (const auto& user : store.get_clients())
+        for (const auto& r : store.get_rollups(user, today - (k_days - 1), today))
+            if (r.trips > 0)
+                record(user, r.day * 86400);
+}
+
+void ActiveUsers::attach(IStore& store)
+{
+    store.set_ingest_listener([this](const TransitEvent& ev) { record(ev.user_id, ev.ts); });
+}
+
+std::uint64_t ActiveUsers::estimate(std::int64_t from_day, std::int64_t to_day) const
+{
+    std::scoped_lock lk(mu_);
+    HyperLogLog      merged(ring_.front().users.precision());
+    for (const auto& slot : ring_)
+        if (slot.day >= from_day && slot.day <= to_day)
+            merged.merge(slot.users);
+    return merged.estimate();
+}
+
+ActiveUserCounts ActiveUsers::counts(std::int64_t now) const
+{
+    const auto       today = epoch_day(now);
+    ActiveUserCounts c;
+    c.daily   = estimate(today, today);
+    c.weekly  = estimate(today - 6, today);
+    c.monthly = estimate(today - 29, today);
+    return c;
+}
+
+std::vector<std::pair<std::int64_t, std::uint64_t>> ActiveUsers::daily(std::int64_t now,
+                                                                       std::int64_t days) const
+{
+    const auto                                          today = epoch_day(now);
+    std::vector<std::pair<std::int64_t, std::uint64_t>> out;
+    for (auto day = today - (std::min(days, k_days) - 1); day <= today; ++day)
+    {
+        std::scoped_lock lk(mu_);
+        const auto&      slot = ring_[ring_slot(day)];
+        out.emplace_back(day, slot.day == day ? slot.users.estimate() : 0);
+    }
+    return out;
+}
+
+std::size_t ActiveUsers::memory_bytes() const
+{
+    return ring_.size() * ring_.front().users.memory_bytes();
+}
+
+double ActiveUsers::relative_error() const
+{
+    return ring_.front().users.relative_error();
+}
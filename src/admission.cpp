@@ -0,0 +1,139 @@
+#include "admission.hpp"
+
+#include <utility>
+
+RouteClass classify_route(const std::string& method, const std::string& path)
+{
+    if (path == "/health")
+        return RouteClass::Health;
+    if (path.rfind("/admin/", 0) == 0)
+        return RouteClass::Admin;
+    if (method == "POST")
+        return RouteClass::Ingest;
+
+    const auto ends_with = [&path](const char* suffix)
+    {
+        const std::string s(suffix);
+        return path.size() >= s.size() && path.compare(path.size() - s.size(), s.size(), s) == 0;
+    };
+    if (ends_with("/analytics"))
+        return RouteClass::Analytics;
+    return RouteClass::Read;
+}
+
+const char* route_class_name(RouteClass cls)
+{
+    switch (cls)
+    {
+    case RouteClass::Health:
+        return "health";
+    case RouteClass::Ingest:
+        return "ingest";
+    case RouteClass::Read:
+        return "read";
+    case RouteClass::Analytics:
+        return "analytics";
+    case RouteClass::Admin:
+        return "admin";
+    }
+    return "unknown";
+}
+
+const AdmissionLimit& AdmissionLimits::for_class(RouteClass cls) const
+{
+    static const AdmissionLimit k_unlimited{};
+    switch (cls)
+    {
+    case RouteClass::Ingest:
+        return ingest;
+    case RouteClass::Read:
+        return read;
+    case RouteClass::Analytics:
+        return analytics;
+    case RouteClass::Admin:
+        return admin;
+    case RouteClass::Health:
+        break;
+    }
+    return k_unlimited;
+}
+
+// ===== AdmissionTicket =====
+
+AdmissionTicket::~AdmissionTicket()
+{
+    release();
+}
+
+AdmissionTicket::AdmissionTicket(AdmissionTicket&& other) noexcept
+    : owner_(std::exchange(other.owner_, nullptr)), cls_(other.cls_)
+{
+}
+
+AdmissionTicket& AdmissionTicket::operator=(AdmissionTicket&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        owner_ = std::exchange(other.owner_, nullptr);
+        cls_   = other.cls_;
+    }
+    return *this;
+}
+
+void AdmissionTicket::release()
+{
+    if (owner_ != nullptr)
+        std::exchange(owner_, nullptr)->release(cls_);
+}
+
+// ===== AdmissionController =====
+
+AdmissionController::AdmissionController(const AdmissionLimits& limits)
+{
+    for (std::size_t i = 0; i < k_route_class_count; ++i)
+        classes_[i].limit = limits.for_class(static_cast<RouteClass>(i));
+}
+
+AdmissionTicket AdmissionController::try_acquire(RouteClass cls)
+{
+    auto&                        c = classes_[static_cast<std::size_t>(cls)];
+    std::unique_lock<std::mutex> lk(c.mu);
+    const auto                   has_slot = [&c]
+    { return c.limit.max_concurrent == 0 || c.in_flight < c.limit.max_concurrent; };
+
+    if (!has_slot() &&
+        (c.limit.queue_budget_ms == 0 ||
+         !c.cv.wait_for(lk, std::chrono::milliseconds(c.limit.queue_budget_ms), has_slot)))
+    {
+        c.rejected.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+    c.in_flight++;
+    c.admitted.fetch_add(1, std::memory_order_relaxed);
+    return AdmissionTicket(this, cls);
+}
+
+void AdmissionController::release(RouteClass cls)
+{
+    auto& c = classes_[static_cast<std::size_t>(cls)];
+    {
+        std::scoped_lock lk(c.mu);
+        c.in_flight--;
+    }
+    c.cv.notify_one();
+}
+
+AdmissionClassStats AdmissionController::stats(RouteClass cls) const
+{
+    const auto&         c = classes_[static_cast<std::size_t>(cls)];
+    AdmissionClassStats s;
+    {
+        std::scoped_lock lk(c.mu);
+        s.max_concurrent = c.limit.max_concurrent;
+        s.in_flight      = c.in_flight;
+    }
+    s.admitted = c.admitted.load(std::memory_order_relaxed);
+    s.rejected = c.rejected.load(std::memory_order_relaxed);
+    return s;
+}
@@ -1,14 +1,26 @@
 #include "api.hpp"
 
-#include "emission_data_loader.hpp"
+#include "compression.hpp"
 #include "emission_factors.hpp"
+#include "factor_table.hpp"
+#include "history.hpp"
+#include "json_backend.hpp"
+#include "json_writer.hpp"
 #include "storage.hpp"
+#include "task_queue.hpp"
+#include "transit_logic.hpp"
+#include "trends.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
+#include <limits>
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <regex>
 #include <sstream>
+#include <vector>
 
 using nlohmann::json;
 
@@ -25,6 +37,178 @@ static void json_response(httplib::Response& res, const json& j, int status = 20
     res.set_content(j.dump(), "application/json");
 }
 
+// Sends a fixed-shape body that `write(JsonWriter&)` writes into the thread's response buffer. The
+// bytes match json_response() for the same document, without building it.
+template <typename Write>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void write_json_response(httplib::Response& res, Write write, int status = 200)
+{
+    auto&      body = response_buffer();
+    JsonWriter w(body);
+    write(w);
+    res.status = status;
+    res.set_content(body.data(), body.size(), "application/json");
+}
+
+// {"error": <error>}
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void error_response(httplib::Response& res, std::string_view error, int status)
+{
+    write_json_response(res, [&](JsonWriter& w) { w.begin_object().field("error", error).end_object(); },
+                        status);
+}
+
+// Like json_response, but compresses bodies of at least k_min_compress_bytes with the best
+// encoding the client accepts. Used for the admin exports, which can run to megabytes.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void json_response(const httplib::Request& req, httplib::Response& res, const json& j,
+                          int status = 200)
+{
+    res.status = status;
+    auto body  = j.dump();
+    res.set_header("Vary", "Accept-Encoding");
+    const auto enc = body.size() >= k_min_compress_bytes
+                         ? negotiate_encoding(req.get_header_value("Accept-Encoding"))
+                         : ContentEncoding::Identity;
+    if (enc != ContentEncoding::Identity)
+    {
+        body = compress_body(enc, body);
+        res.set_header("Content-Encoding", encoding_name(enc));
+    }
+    res.set_content(body, "application/json");
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static json totals_json(const HistoryTotals& t)
+{
+    return { { "trips", t.trips }, { "distance_km", t.distance_km }, { "kg_co2", t.kg_co2 } };
+}
+
+// A validity bound as the YYYY-MM-DD day it falls on, or null where the factor is unbounded
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static json validity_json(std::int64_t ts)
+{
+    if (ts == std::numeric_limits<std::int64_t>::min() || ts == std::numeric_limits<std::int64_t>::max())
+        return nullptr;
+    return format_iso_day(epoch_day(ts));
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static json recompute_json(const RecomputeStatus& s)
+{
+    return { { "running", s.running },
+             { "rerun_pending", s.rerun_pending },
+             { "runs", s.runs },
+             { "factor_version", s.factor_version },
+             { "latest_factor_version", s.latest_factor_version },
+             { "factor_origin", s.factor_origin },
+             { "users_total", s.users_total },
+             { "users_done", s.users_done },
+             { "rollups", s.rollups },
+             { "seconds", s.seconds },
+             { "users_per_second", s.users_per_second() },
+             { "error", s.error.empty() ? json(nullptr) : json(s.error) } };
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static json factor_json(const EmissionFactor& f)
+{
+    return { { "mode", f.mode },
+             { "fuel_type", f.fuel_type },
+             { "vehicle_size", f.vehicle_size },
+             { "kg_co2_per_km", f.kg_co2_per_km },
+             { "source", f.source },
+             { "region", f.region },
+             { "valid_from", validity_json(f.valid_from) },
+             { "valid_until", validity_json(f.valid_until) },
+             { "updated_at", f.updated_at } };
+}
+
+// Slot held by the request currently running on this worker thread. Acquired in the
+// pre-routing handler and released in the post-routing handler (or by the next request), unless a
+// streamed response has taken it over.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static thread_local AdmissionTicket tl_admission_ticket;
+
+// Array elements serialized per chunk when streaming an export
+static constexpr std::size_t k_stream_batch = 256;
+
+// /users/{id}/history: days covered when `from` is omitted, and the widest range accepted
+static constexpr std::int64_t k_default_history_days = 365;
+static constexpr std::int64_t k_max_history_days     = 3660;
+
+// Sends `items` as a JSON array. Large arrays are streamed with chunked transfer encoding,
+// serialized and compressed one batch at a time so the full document is never built in memory;
+// arrays of up to one batch take the buffered path, where the size threshold applies.
+template <typename T, typename ToJson>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void stream_json_array(const httplib::Request& req, httplib::Response& res, std::vector<T> items,
+                              ToJson to_json)
+{
+    if (items.size() <= k_stream_batch)
+    {
+        json arr = json::array();
+        for (const auto& item : items)
+            arr.push_back(to_json(item));
+        json_response(req, res, arr);
+        return;
+    }
+
+    struct StreamState
+    {
+        std::vector<T>                    items;
+        std::size_t                       next = 0;
+        std::unique_ptr<StreamCompressor> compressor;
+    };
+    auto       state = std::make_shared<StreamState>();
+    const auto enc   = negotiate_encoding(req.get_header_value("Accept-Encoding"));
+    state->items      = std::move(items);
+    state->compressor = StreamCompressor::create(enc);
+
+    // httplib writes the body after the post-routing handler has run, so the request's admission
+    // slot moves to the releaser and is held until the stream ends or the client goes away
+    auto ticket = std::make_shared<AdmissionTicket>(std::move(tl_admission_ticket));
+
+    res.status = 200;
+    res.set_header("Vary", "Accept-Encoding");
+    if (state->compressor)
+        res.set_header("Content-Encoding", encoding_name(enc));
+    res.set_chunked_content_provider(
+        "application/json",
+        [state, to_json](std::size_t /*offset*/, httplib::DataSink& sink)
+        {
+            std::string chunk = state->next == 0 ? "[" : "";
+            const auto  end   = std::min(state->next + k_stream_batch, state->items.size());
+            for (; state->next < end; ++state->next)
+            {
+                if (state->next > 0)
+                    chunk += ',';
+                chunk += to_json(state->items[state->next]).dump();
+            }
+            const bool last = state->next == state->items.size();
+            if (last)
+                chunk += ']';
+
+            std::string out;
+            if (state->compressor)
+            {
+                state->compressor->write(chunk.data(), chunk.size(), out);
+                if (last)
+                    state->compressor->finish(out);
+            }
+            else
+            {
+                out.swap(chunk);
+            }
+            if (!out.empty() && !sink.write(out.data(), out.size()))
+                return false;
+            if (last)
+                sink.done();
+            return true;
+        },
+        [ticket](bool /*success*/) { *ticket = AdmissionTicket{}; });
+}
+
 // NOLINTNEXTLINE(misc-use-anonymous-namespace)
 static bool check_auth(IStore& store, const httplib::Request& req, const std::string& user_id)
 {
@@ -68,16 +252,108 @@ static void record_log(IStore& store, const httplib::Request& req, const httplib
     store.append_log(r);
 }
 
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void reject_overloaded(httplib::Response& res, const char* error)
+{
+    res.set_header("Retry-After", "1");
+    error_response(res, error, 503);
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void reject_rate_limited(httplib::Response& res, long retry_after_sec)
+{
+    res.set_header("Retry-After", std::to_string(retry_after_sec));
+    error_response(res, "rate_limited", 429);
+}
+
+// Extracts {id} from /users/{id}/... without running a regex; empty for other paths.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::string user_id_from_path(const std::string& path)
+{
+    const std::string prefix = "/users/";
+    if (path.rfind(prefix, 0) != 0)
+        return {};
+    const auto end = path.find('/', prefix.size());
+    if (end == std::string::npos)
+        return {}; // /users/register
+    return path.substr(prefix.size(), end - prefix.size());
+}
+
+// Cheap gatekeeping that runs before routing, auth and body parsing.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void install_gatekeeping(httplib::Server& svr, const ApiServices& services)
+{
+    svr.set_pre_routing_handler(
+        [services](const httplib::Request& req, httplib::Response& res)
+        {
+            tl_admission_ticket = AdmissionTicket{};
+
+            // First request on a connection admitted past the worker pool's queue bound
+            if (WorkStealingTaskQueue::take_current_job_shed())
+            {
+                res.set_header("Connection", "close");
+                reject_overloaded(res, "server_busy");
+                return httplib::Server::HandlerResponse::Handled;
+            }
+
+            const auto cls = classify_route(req.method, req.path);
+            if (cls != RouteClass::Health)
+            {
+                long retry_after = 1;
+                if (services.ip_limiter != nullptr &&
+                    !services.ip_limiter->allow(req.remote_addr, &retry_after))
+                {
+                    reject_rate_limited(res, retry_after);
+                    return httplib::Server::HandlerResponse::Handled;
+                }
+                const std::string user_id =
+                    services.user_limiter != nullptr ? user_id_from_path(req.path) : std::string();
+                if (!user_id.empty() && !services.user_limiter->allow(user_id, &retry_after))
+                {
+                    // A throttled user must not use up the budget of everyone behind the same IP
+                    if (services.ip_limiter != nullptr)
+                        services.ip_limiter->refund(req.remote_addr);
+                    reject_rate_limited(res, retry_after);
+                    return httplib::Server::HandlerResponse::Handled;
+                }
+            }
+
+            if (services.admission != nullptr)
+            {
+                tl_admission_ticket = services.admission->try_acquire(cls);
+                if (!tl_admission_ticket)
+                {
+                    reject_overloaded(res, "overloaded");
+                    return httplib::Server::HandlerResponse::Handled;
+                }
+            }
+            return httplib::Server::HandlerResponse::Unhandled;
+        });
+
+    svr.set_post_routing_handler([](const httplib::Request&, httplib::Response&)
+                                 { tl_admission_ticket = AdmissionTicket{}; });
+}
+
 // NOLINTNEXTLINE(-warnings-as-errors)
-void configure_routes(httplib::Server& svr,
-                      IStore&          store) // NOLINT(readability-function-cognitive-complexity)
+void configure_routes(httplib::Server& svr, IStore& store,
+                      const ApiServices& services) // NOLINT(readability-function-cognitive-complexity)
 {
+    install_gatekeeping(svr, services);
+
     // Health
     svr.Get("/health",
             [&](const httplib::Request& req, httplib::Response& res)
             {
                 const auto start = now_epoch();
-                json_response(res, { { "ok", true }, { "service", "charizard" }, { "time", start } });
+                write_json_response(res,
+                                    [&](JsonWriter& w)
+                                    {
+                                        w.begin_object()
+                                            .field("ok", true)
+                                            .field("service", "charizard")
+                                            .field("time", start)
+                                            .end_object();
+                                    });
                 record_log(store, req, res, "", start, 0.0);
             });
 
@@ -86,22 +362,22 @@ void configure_routes(httplib::Server& svr,
         "/users/register",
         [&](const httplib::Request& req, httplib::Response& res)
         {
-            nlohmann::json body;
+            std::optional<std::string> body_app_name;
             try
             {
-                body = nlohmann::json::parse(req.body);
+                body_app_name = decode_register_body(req.body);
             }
-            catch (...)
+            catch (const JsonSyntaxError&)
             {
-                json_response(res, { { "error", "invalid_json" } }, 400);
+                error_response(res, "invalid_json", 400);
                 return;
             }
-            if (!body.contains("app_name") || !body["app_name"].is_string())
+            if (!body_app_name)
             {
-                json_response(res, { { "error", "missing_app_name" } }, 400);
+                error_response(res, "missing_app_name", 400);
                 return;
             }
-            const std::string app_name = body["app_name"].get<std::string>();
+            const std::string app_name = *body_app_name;
 
             auto rnd_hex = [](size_t len)
             {
@@ -125,13 +401,13 @@ void configure_routes(httplib::Server& svr,
 
     // Transit
     svr.Post(R"(/users/([A-Za-z0-9_\-]+)/transit)",
-             [&](const httplib::Request& req, httplib::Response& res)
+             [&, services](const httplib::Request& req, httplib::Response& res)
              {
                  std::smatch      m;
                  std::regex const re(R"(/users/([A-Za-z0-9_\-]+)/transit)");
                  if (!std::regex_match(req.path, m, re) || m.size() < 2)
                  {
-                     json_response(res, { { "error", "bad_path" } }, 404);
+                     error_response(res, "bad_path", 404);
                      return;
                  }
                  const std::string user_id = m[1].str();
@@ -139,53 +415,52 @@ void configure_routes(httplib::Server& svr,
                  const auto start = now_epoch();
                  if (!check_auth(store, req, user_id))
                  {
-                     json_response(res, { { "error", "unauthorized" } }, 401);
+                     error_response(res, "unauthorized", 401);
                      return;
                  }
 
-                 nlohmann::json body;
-                 try
-                 {
-                     body = nlohmann::json::parse(req.body);
-                 }
-                 catch (...)
+                 // Well-formed bodies of the usual shape are read in place; anything else (and every
+                 // error) goes through the JSON backend, which decides how to answer it.
+                 TransitPayload payload;
+                 TransitBody    body;
+                 if (!parse_transit_payload(req.body, payload))
                  {
-                     json_response(res, { { "error", "invalid_json" } }, 400);
-                     return;
-                 }
-                 // TO-DO: we should probably have an enum on this `mode` field...
-                 // if (!body.contains("mode") || !body.contains("distance_km")) return json_response(res,
-                 // {{"error","missing_fields"}}, 400);
-
-                 // TransitEvent ev; ev.user_id = user_id; ev.mode = body["mode"].get<std::string>();
-                 // ev.distance_km = body["distance_km"].get<double>(); ev.ts = body.value("ts",
-                 // static_cast<std::int64_t>(now_epoch()));
-                 try
-                 {
-                     if (!body.contains("mode") || !body.contains("distance_km"))
+                     try
+                     {
+                         body = decode_transit_body(req.body);
+                     }
+                     catch (const JsonSyntaxError&)
                      {
-                         json_response(res, { { "error", "missing_fields" } }, 400);
+                         error_response(res, "invalid_json", 400);
                          return;
                      }
-
-                     TransitEvent const ev(user_id, body["mode"].get<std::string>(),
-                                           body["distance_km"].get<double>(), body.value("ts", now_epoch()));
+                     catch (const JsonShapeError&)
+                     {
+                         error_response(res, "invalid JSON payload", 400);
+                         return;
+                     }
+                     if (!body.has_mode || !body.has_distance)
+                     {
+                         error_response(res, "missing_fields", 400);
+                         return;
+                     }
+                     payload = body.payload();
+                 }
+                 try
+                 {
+                     TransitEvent const ev = make_transit_event(user_id, payload, now_epoch());
 
                      store.add_event(ev);
                  }
                  catch (const std::runtime_error& e)
                  {
-                     json_response(res, { { "error", e.what() } }, 400);
-                     return;
-                 }
-                 catch (const nlohmann::json::exception&)
-                 {
-                     json_response(res, { { "error", "invalid JSON payload" } }, 400);
+                     error_response(res, e.what(), 400);
                      return;
                  }
 
                  // store.add_event(ev);
-                 json_response(res, { { "status", "ok" } }, 201);
+                 write_json_response(
+                     res, [](JsonWriter& w) { w.begin_object().field("status", "ok").end_object(); }, 201);
                  const auto end = now_epoch();
                  record_log(store, req, res, user_id, start, static_cast<double>((end - start) * 1000));
              });
@@ -198,22 +473,28 @@ void configure_routes(httplib::Server& svr,
                 std::regex const re(R"(/users/([A-Za-z0-9_\-]+)/lifetime-footprint)");
                 if (!std::regex_match(req.path, m, re) || m.size() < 2)
                 {
-                    json_response(res, { { "error", "bad_path" } }, 404);
+                    error_response(res, "bad_path", 404);
                     return;
                 }
                 const std::string user_id = m[1].str();
                 const auto        start   = now_epoch();
                 if (!check_auth(store, req, user_id))
                 {
-                    json_response(res, { { "error", "unauthorized" } }, 401);
+                    error_response(res, "unauthorized", 401);
                     return;
                 }
-                auto       s   = store.summarize(user_id);
-                json const out = { { "user_id", user_id },
-                                   { "lifetime_kg_co2", s.lifetime_kg_co2 },
-                                   { "last_7d_kg_co2", s.week_kg_co2 },
-                                   { "last_30d_kg_co2", s.month_kg_co2 } };
-                json_response(res, out);
+                const auto s = store.summarize(user_id);
+                // Members in key order, as json::dump() writes them
+                write_json_response(res,
+                                    [&](JsonWriter& w)
+                                    {
+                                        w.begin_object()
+                                            .field("last_30d_kg_co2", s.month_kg_co2)
+                                            .field("last_7d_kg_co2", s.week_kg_co2)
+                                            .field("lifetime_kg_co2", s.lifetime_kg_co2)
+                                            .field("user_id", user_id)
+                                            .end_object();
+                                    });
                 const auto end = now_epoch();
                 record_log(store, req, res, user_id, start, static_cast<double>((end - start) * 1000));
             });
@@ -226,17 +507,20 @@ void configure_routes(httplib::Server& svr,
                 std::regex const re(R"(/users/([A-Za-z0-9_\-]+)/suggestions)");
                 if (!std::regex_match(req.path, m, re) || m.size() < 2)
                 {
-                    json_response(res, { { "error", "bad_path" } }, 404);
+                    error_response(res, "bad_path", 404);
                     return;
                 }
                 const std::string user_id = m[1].str();
                 if (!check_auth(store, req, user_id))
                 {
-                    json_response(res, { { "error", "unauthorized" } }, 401);
+                    error_response(res, "unauthorized", 401);
                     return;
                 }
                 auto s           = store.summarize(user_id);
                 json suggestions = json::array();
+                // Specific week-over-week changes first, then the general advice
+                for (auto& tip : trend_suggestions(weekly_trends(store, user_id, now_epoch())))
+                    suggestions.push_back(std::move(tip));
                 if (s.week_kg_co2 > 20.0)
                 {
                     suggestions.push_back("Try switching short taxi rides to subway or bus.");
@@ -252,40 +536,149 @@ void configure_routes(httplib::Server& svr,
 
     // Analytics
     svr.Get(R"(/users/([A-Za-z0-9_\-]+)/analytics)",
-            [&](const httplib::Request& req, httplib::Response& res)
+            [&, services](const httplib::Request& req, httplib::Response& res)
             {
                 std::smatch      m;
                 std::regex const re(R"(/users/([A-Za-z0-9_\-]+)/analytics)");
                 if (!std::regex_match(req.path, m, re) || m.size() < 2)
                 {
-                    json_response(res, { { "error", "bad_path" } }, 404);
+                    error_response(res, "bad_path", 404);
                     return;
                 }
                 const std::string user_id = m[1].str();
                 if (!check_auth(store, req, user_id))
                 {
-                    json_response(res, { { "error", "unauthorized" } }, 401);
+                    error_response(res, "unauthorized", 401);
                     return;
                 }
-                const auto start    = now_epoch();
-                auto       s        = store.summarize(user_id);
-                double     peer_avg = store.global_average_weekly();
-                json const out      = { { "user_id", user_id },
-                                        { "this_week_kg_co2", s.week_kg_co2 },
-                                        { "peer_week_avg_kg_co2", peer_avg },
-                                        { "above_peer_avg", s.week_kg_co2 > peer_avg } };
+                const auto start  = now_epoch();
+                auto       s      = store.summarize(user_id);
+                const auto trends = weekly_trends(store, user_id, start);
+                const auto peers  = services.peers != nullptr ? services.peers->snapshot(start) : nullptr;
+                // The peer mean comes with the snapshot; only without one is every user scanned
+                const double peer_avg = peers ? peers->mean_kg_co2() : store.global_average_weekly();
+
+                json modes = json::object();
+                for (const auto& m : trends.modes)
+                    modes[m.mode] = { { "this_week", totals_json(m.this_week) },
+                                      { "last_week", totals_json(m.last_week) },
+                                      { "kg_co2_delta", m.this_week.kg_co2 - m.last_week.kg_co2 } };
+                json shifts = json::array();
+                for (const auto& sh : trends.shifts)
+                    shifts.push_back({ { "from", sh.from_mode },
+                                       { "to", sh.to_mode },
+                                       { "distance_km", sh.distance_km },
+                                       { "kg_co2_delta", sh.kg_co2_delta } });
+                json const week_over_week = {
+                    { "this_week", totals_json(trends.this_week) },
+                    { "last_week", totals_json(trends.last_week) },
+                    { "kg_co2_delta", trends.kg_co2_delta() },
+                    { "kg_co2_change_pct", trends.last_week.kg_co2 > 0.0
+                                               ? json(100.0 * trends.kg_co2_delta() / trends.last_week.kg_co2)
+                                               : json(nullptr) }
+                };
+                json out = { { "user_id", user_id },
+                             { "this_week_kg_co2", s.week_kg_co2 },
+                             { "peer_week_avg_kg_co2", peer_avg },
+                             { "above_peer_avg", s.week_kg_co2 > peer_avg },
+                             { "week_over_week", week_over_week },
+                             { "modes", modes },
+                             { "mode_shifts", shifts } };
+                if (peers) // null until the background thread's first build
+                {
+                    // Ranked on the same 7-day rollup window the peer digest is built from
+                    const auto& d     = peers->weekly_kg_co2;
+                    const auto  value = [&](double v) { return d.empty() ? json(nullptr) : json(v); };
+                    out["peer_count"]           = peers->users;
+                    out["peer_week_p50_kg_co2"] = value(d.quantile(0.5));
+                    out["peer_week_p90_kg_co2"] = value(d.quantile(0.9));
+                    out["week_percentile"]      = value(100.0 * d.cdf(trends.this_week.kg_co2));
+                }
                 json_response(res, out);
                 const auto end = now_epoch();
                 record_log(store, req, res, user_id, start, static_cast<double>((end - start) * 1000));
             });
 
+    // History: per-bucket totals read from the daily rollups, never from raw events
+    svr.Get(R"(/users/([A-Za-z0-9_\-]+)/history)",
+            [&](const httplib::Request& req, httplib::Response& res)
+            {
+                std::smatch      m;
+                std::regex const re(R"(/users/([A-Za-z0-9_\-]+)/history)");
+                if (!std::regex_match(req.path, m, re) || m.size() < 2)
+                {
+                    error_response(res, "bad_path", 404);
+                    return;
+                }
+                const std::string user_id = m[1].str();
+                if (!check_auth(store, req, user_id))
+                {
+                    error_response(res, "unauthorized", 401);
+                    return;
+                }
+                const auto start       = now_epoch();
+                const auto granularity = parse_granularity(
+                    req.has_param("granularity") ? req.get_param_value("granularity") : "day");
+                if (!granularity)
+                {
+                    error_response(res, "invalid_granularity", 400);
+                    return;
+                }
+                // Defaults to the year up to today (UTC)
+                auto to_day   = std::optional<std::int64_t>(epoch_day(start));
+                auto from_day = std::optional<std::int64_t>();
+                if (req.has_param("to"))
+                    to_day = parse_iso_day(req.get_param_value("to"));
+                if (req.has_param("from"))
+                    from_day = parse_iso_day(req.get_param_value("from"));
+                else if (to_day)
+                    from_day = *to_day - (k_default_history_days - 1);
+                if (!from_day || !to_day)
+                {
+                    error_response(res, "invalid_date", 400);
+                    return;
+                }
+                if (*from_day > *to_day)
+                {
+                    error_response(res, "invalid_range", 400);
+                    return;
+                }
+                if (*to_day - *from_day >= k_max_history_days)
+                {
+                    error_response(res, "range_too_large", 400);
+                    return;
+                }
+
+                const auto rollups = store.get_rollups(user_id, *from_day, *to_day);
+                json       buckets = json::array();
+                for (const auto& b : bucket_rollups(rollups, *granularity))
+                {
+                    json modes = json::object();
+                    for (const auto& [mode, t] : b.modes)
+                        modes[mode] = totals_json(t);
+                    buckets.push_back({ { "start", format_iso_day(b.start_day) },
+                                        { "trips", b.total.trips },
+                                        { "distance_km", b.total.distance_km },
+                                        { "kg_co2", b.total.kg_co2 },
+                                        { "modes", modes } });
+                }
+                json const out = { { "user_id", user_id },
+                                   { "granularity", granularity_name(*granularity) },
+                                   { "from", format_iso_day(*from_day) },
+                                   { "to", format_iso_day(*to_day) },
+                                   { "buckets", buckets } };
+                json_response(req, res, out);
+                const auto end = now_epoch();
+                record_log(store, req, res, user_id, start, static_cast<double>((end - start) * 1000));
+            });
+
     // Admin endpoints
     svr.Get("/admin/logs",
             [&](const httplib::Request& req, httplib::Response& res)
             {
                 if (!check_admin(req))
                 {
-                    json_response(res, { { "error", "unauthorized" } }, 401);
+                    error_response(res, "unauthorized", 401);
                     return;
                 }
                 auto logs = store.get_logs(1000);
@@ -298,7 +691,7 @@ void configure_routes(httplib::Server& svr,
                                     { "duration_ms", l.duration_ms },
                                     { "client_ip", l.client_ip },
                                     { "user_id", l.user_id } });
-                json_response(res, arr);
+                json_response(req, res, arr);
             });
 
     svr.Delete("/admin/logs",
@@ -306,7 +699,7 @@ void configure_routes(httplib::Server& svr,
                {
                    if (!check_admin(req))
                    {
-                       json_response(res, { { "error", "unauthorized" } }, 401);
+                       error_response(res, "unauthorized", 401);
                        return;
                    }
                    store.clear_logs();
@@ -318,11 +711,11 @@ void configure_routes(httplib::Server& svr,
             {
                 if (!check_admin(req))
                 {
-                    json_response(res, { { "error", "unauthorized" } }, 401);
+                    error_response(res, "unauthorized", 401);
                     return;
                 }
                 auto clients = store.get_clients();
-                json_response(res, clients);
+                json_response(req, res, clients);
             });
 
     svr.Get(R"(/admin/clients/([A-Za-z0-9_\-]+)/data)",
@@ -330,22 +723,24 @@ void configure_routes(httplib::Server& svr,
             {
                 if (!check_admin(req))
                 {
-                    json_response(res, { { "error", "unauthorized" } }, 401);
+                    error_response(res, "unauthorized", 401);
                     return;
                 }
                 std::smatch      m;
                 std::regex const re(R"(/admin/clients/([A-Za-z0-9_\-]+)/data)");
                 if (!std::regex_match(req.path, m, re) || m.size() < 2)
                 {
-                    json_response(res, { { "error", "bad_path" } }, 404);
+                    error_response(res, "bad_path", 404);
                     return;
                 }
                 const std::string client_id = m[1].str();
-                auto              data      = store.get_client_data(client_id);
-                json              arr       = json::array();
-                for (auto& e : data)
-                    arr.push_back({ { "mode", e.mode }, { "distance_km", e.distance_km }, { "ts", e.ts } });
-                json_response(res, arr);
+                stream_json_array(req, res, store.get_client_data(client_id),
+                                  [](const TransitEvent& e)
+                                  {
+                                      return json{ { "mode", e.mode },
+                                                   { "distance_km", e.distance_km },
+                                                   { "ts", e.ts } };
+                                  });
             });
 
     svr.Get("/admin/clear-db-events",
@@ -353,7 +748,7 @@ void configure_routes(httplib::Server& svr,
             {
                 if (!check_admin(req))
                 {
-                    json_response(res, { { "error", "unauthorized" } }, 401);
+                    error_response(res, "unauthorized", 401);
                     return;
                 }
                 store.clear_db_events();
@@ -365,73 +760,166 @@ void configure_routes(httplib::Server& svr,
             {
                 if (!check_admin(req))
                 {
-                    json_response(res, { { "error", "unauthorized" } }, 401);
+                    error_response(res, "unauthorized", 401);
                     return;
                 }
                 store.clear_db();
                 json_response(res, { { "status", "ok" } });
             });
 
+    // Admin: admission and rate-limit counters
+    svr.Get("/admin/metrics",
+            [&, services](const httplib::Request& req, httplib::Response& res)
+            {
+                if (!check_admin(req))
+                {
+                    error_response(res, "unauthorized", 401);
+                    return;
+                }
+                json out = json::object();
+                if (services.admission != nullptr)
+                {
+                    json admission = json::object();
+                    for (std::size_t i = 0; i < k_route_class_count; ++i)
+                    {
+                        const auto cls = static_cast<RouteClass>(i);
+                        const auto st  = services.admission->stats(cls);
+                        admission[route_class_name(cls)] = { { "max_concurrent", st.max_concurrent },
+                                                             { "in_flight", st.in_flight },
+                                                             { "admitted", st.admitted },
+                                                             { "rejected", st.rejected } };
+                    }
+                    out["admission"] = admission;
+                }
+                json rate_limit = json::object();
+                if (services.user_limiter != nullptr)
+                    rate_limit["user"] = { { "tracked_keys", services.user_limiter->tracked_keys() },
+                                           { "rejected", services.user_limiter->rejected() } };
+                if (services.ip_limiter != nullptr)
+                    rate_limit["ip"] = { { "tracked_keys", services.ip_limiter->tracked_keys() },
+                                         { "rejected", services.ip_limiter->rejected() } };
+                if (!rate_limit.empty())
+                    out["rate_limit"] = rate_limit;
+                if (services.store_cache != nullptr)
+                {
+                    const auto st = services.store_cache->stats();
+                    out["store_cache"] = { { "hits", st.hits },
+                                           { "misses", st.misses },
+                                           { "hit_ratio", st.hit_ratio() },
+                                           { "summary_hits", st.summary_hits },
+                                           { "evictions", st.evictions },
+                                           { "cached_users", st.cached_users },
+                                           { "bytes", st.cache_bytes },
+                                           { "budget_bytes", st.cache_budget },
+                                           { "pending_writes", st.pending },
+                                           { "flushed_writes", st.flushed },
+                                           { "failed_batches", st.failed_batches } };
+                }
+                json_response(res, out);
+            });
+
+    // Admin: approximate distinct active users (HyperLogLog per day)
+    svr.Get("/admin/stats",
+            [&, services](const httplib::Request& req, httplib::Response& res)
+            {
+                if (!check_admin(req))
+                {
+                    error_response(res, "unauthorized", 401);
+                    return;
+                }
+                json out = json::object();
+                if (services.active_users != nullptr)
+                {
+                    const auto now   = now_epoch();
+                    const auto c     = services.active_users->counts(now);
+                    json       daily = json::array();
+                    for (const auto& [day, users] : services.active_users->daily(now, ActiveUsers::k_days))
+                        daily.push_back({ { "date", format_iso_day(day) }, { "users", users } });
+                    out["active_users"] = { { "as_of", format_iso_day(epoch_day(now)) },
+                                            { "dau", c.daily },
+                                            { "wau", c.weekly },
+                                            { "mau", c.monthly },
+                                            { "daily", daily },
+                                            { "relative_error", services.active_users->relative_error() },
+                                            { "sketch_bytes", services.active_users->memory_bytes() } };
+                }
+                json_response(res, out);
+            });
+
     // Admin: list stored/default emission factors
     svr.Get("/admin/emission-factors",
             [&](const httplib::Request& req, httplib::Response& res)
             {
                 if (!check_admin(req))
                 {
-                    json_response(res, { { "error", "unauthorized" } }, 401);
+                    error_response(res, "unauthorized", 401);
                     return;
                 }
 
-                // Prefer persisted factors if the store has any; otherwise return DEFRA defaults
+                // Prefer persisted factors if the store has any; otherwise return the active table
+                // (DEFRA defaults unless EMISSION_FACTORS_PATH replaced them)
                 auto persisted = store.get_all_emission_factors();
                 json arr       = json::array();
                 if (!persisted.empty())
                 {
                     for (const auto& f : persisted)
-                    {
-                        arr.push_back({ { "mode", f.mode },
-                                        { "fuel_type", f.fuel_type },
-                                        { "vehicle_size", f.vehicle_size },
-                                        { "kg_co2_per_km", f.kg_co2_per_km },
-                                        { "source", f.source },
-                                        { "updated_at", f.updated_at } });
-                    }
+                        arr.push_back(factor_json(f));
                 }
                 else
                 {
-                    auto factors = EmissionDataLoader::load_defra_2024();
-                    for (const auto& f : factors)
-                    {
-                        arr.push_back({ { "mode", f.mode },
-                                        { "fuel_type", f.fuel_type },
-                                        { "vehicle_size", f.vehicle_size },
-                                        { "kg_co2_per_km", f.kg_co2_per_km },
-                                        { "source", f.source },
-                                        { "updated_at", f.updated_at } });
-                    }
+                    const auto table = active_factor_table();
+                    for (const auto& f : table->factors())
+                        arr.push_back(factor_json(f));
                 }
 
-                json_response(res, arr);
+                json_response(req, res, arr);
             });
 
-    // Admin: trigger loader to fetch DEFRA 2024 factors (returns count)
+    // Admin: persist the active factor table (DEFRA 2024 or EMISSION_FACTORS_PATH; returns count)
     svr.Post("/admin/emission-factors/load",
              [&](const httplib::Request& req, httplib::Response& res)
              {
                  if (!check_admin(req))
                  {
-                     json_response(res, { { "error", "unauthorized" } }, 401);
+                     error_response(res, "unauthorized", 401);
                      return;
                  }
 
-                 // Load factors (currently from hardcoded DEFRA defaults). Persist to store.
-                 auto factors = EmissionDataLoader::load_defra_2024();
-                 int  count   = 0;
-                 for (const auto& f : factors)
+                 // Persist the global factors requests are priced with today; the stored set keeps
+                 // one factor per key, without regions or validity periods
+                 const auto table = active_factor_table();
+                 int        count = 0;
+                 for (const auto& f : table->resolved())
                  {
                      store.store_emission_factor(f);
                      count++;
                  }
-                 json_response(res, { { "status", "ok" }, { "loaded", count } });
+                 json out = { { "status", "ok" }, { "loaded", count } };
+
+                 // Rebuild the stored rollups with these factors in the background; a job already
+                 // running has priced some users with an earlier table, so another is queued after it
+                 if (services.recompute != nullptr)
+                 {
+                     out["recompute_started"] = services.recompute->start();
+                     out["recompute"]         = recompute_json(services.recompute->status());
+                 }
+                 json_response(res, out);
              });
+
+    // Admin: progress of the rollup recompute started by /admin/emission-factors/load
+    svr.Get("/admin/emission-factors/recompute",
+            [&](const httplib::Request& req, httplib::Response& res)
+            {
+                if (!check_admin(req))
+                {
+                    error_response(res, "unauthorized", 401);
+                    return;
+                }
+                if (services.recompute == nullptr)
+                {
+                    error_response(res, "recompute_disabled", 404);
+                    return;
+                }
+                json_response(res, recompute_json(services.recompute->status()));
+            });
 }
\ No newline at end of file
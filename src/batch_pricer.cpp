@@ -0,0 +1,115 @@
+#include "batch_pricer.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+void validate_trip(double occupancy, double distance_km)
+{
+    if (!std::isfinite(distance_km))
+    {
+        throw std::runtime_error("Distance must be a finite number");
+    }
+
+    if (distance_km < 0.0)
+    {
+        throw std::runtime_error("Distance cannot be negative");
+    }
+
+    if (!std::isfinite(occupancy))
+    {
+        throw std::runtime_error("Occupancy must be a finite number");
+    }
+
+    if (occupancy < 1.0)
+    {
+        throw std::runtime_error("Occupancy must be at least 1.0");
+    }
+}
+
+double default_kg_per_km(std::string_view mode)
+{
+    if (mode == "car" || mode == "taxi")
+    {
+        return 0.18;
+    }
+    if (mode == "bus")
+    {
+        return 0.073;
+    }
+    if (mode == "subway" || mode == "train" || mode == "underground" || mode == "rail")
+    {
+        return 0.041;
+    }
+    if (mode == "bike" || mode == "walk")
+    {
+        return 0.0;
+    }
+    // Unknown mode, use conservative estimate
+    return 0.1;
+}
+
+bool priced_per_vehicle(std::string_view mode)
+{
+    return mode == "car" || mode == "taxi";
+}
+
+BatchPricer::BatchPricer(std::shared_ptr<const FactorTable> table)
+    : table_(std::move(table)), factor_ids_(table_->factors().size(), k_no_id)
+{
+}
+
+std::uint32_t BatchPricer::id_of(std::string_view mode, std::string_view fuel_type,
+                                 std::string_view vehicle_size, std::string_view region, std::int64_t ts)
+{
+    if (const auto* factor = table_->find(mode, fuel_type, vehicle_size, region, ts))
+    {
+        // An index rather than a second hash lookup: find() points into factors()
+        auto& id = factor_ids_[static_cast<std::size_t>(factor - table_->factors().data())];
+        if (id == k_no_id)
+            id = add_rate(factor->kg_co2_per_km, mode);
+        return id;
+    }
+    const auto [it, added] = default_ids_.try_emplace(std::string(mode), 0);
+    if (added)
+        it->second = add_rate(default_kg_per_km(mode), mode);
+    return it->second;
+}
+
+std::uint32_t BatchPricer::add_rate(double kg_per_km, std::string_view mode)
+{
+    kg_per_km_.push_back(kg_per_km);
+    per_vehicle_.push_back(priced_per_vehicle(mode) ? 1.0 : 0.0);
+    return static_cast<std::uint32_t>(kg_per_km_.size() - 1);
+}
+
+void BatchPricer::price(const std::uint32_t* ids, const double* distance_km, const double* occupancy,
+                        double* kg_co2, std::size_t n) const
+{
+    // One pass over the whole batch first, without an early exit, so it vectorises too
+    const auto rates = static_cast<std::uint32_t>(kg_per_km_.size());
+    bool       valid = true;
+    for (std::size_t i = 0; i < n; ++i)
+        valid &= std::isfinite(distance_km[i]) & !(distance_km[i] < 0.0) & std::isfinite(occupancy[i]) &
+                 !(occupancy[i] < 1.0) & (ids[i] < rates);
+    if (!valid)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            validate_trip(occupancy[i], distance_km[i]);
+            if (ids[i] >= rates)
+                throw std::runtime_error("Unknown rate id " + std::to_string(ids[i]));
+        }
+    }
+
+    // 1 + (occupancy - 1) is exactly occupancy, so per-vehicle trips come out as price_trip()
+    // prices them, and the others are divided by exactly 1
+    const double* kg_per_km   = kg_per_km_.data();
+    const double* per_vehicle = per_vehicle_.data();
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        const auto id = ids[i];
+        kg_co2[i]     = kg_per_km[id] * distance_km[i] / (1.0 + per_vehicle[id] * (occupancy[i] - 1.0));
+    }
+}
@@ -0,0 +1,131 @@
+#include "csv_reader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+bool CsvReader::next(std::vector<std::string_view>& fields)
+{
+    if (pos_ >= in_.size())
+        return false;
+    line_ = next_line_;
+
+    // Find where the record ends. Without a quote that is simply the next newline; with one, newlines
+    // inside a quoted field belong to it. Only a quote at the start of a field opens one.
+    const char* begin = in_.data() + pos_;
+    const char* end   = in_.data() + in_.size();
+    const auto  rest  = static_cast<std::size_t>(end - begin);
+    const char* stop  = static_cast<const char*>(std::memchr(begin, '\n', rest));
+    if (stop == nullptr)
+        stop = end;
+    if (std::memchr(begin, '"', static_cast<std::size_t>(stop - begin)) != nullptr)
+    {
+        bool at_field_start = true;
+        bool quoted         = false;
+        for (stop = begin; stop != end; ++stop)
+        {
+            const char c = *stop;
+            if (quoted)
+            {
+                if (c == '"' && stop + 1 != end && stop[1] == '"')
+                    ++stop;
+                else if (c == '"')
+                    quoted = false;
+                else if (c == '\n')
+                    ++next_line_;
+            }
+            else if (c == '\n')
+            {
+                break;
+            }
+            else if (c == ',')
+            {
+                at_field_start = true;
+            }
+            else if (!is_blank(c))
+            {
+                quoted         = at_field_start && c == '"';
+                at_field_start = false;
+            }
+        }
+        if (quoted)
+            throw std::runtime_error("CSV format error at row " + std::to_string(line_) +
+                                     ": unterminated quoted field");
+    }
+    std::string_view record(begin, static_cast<std::size_t>(stop - begin));
+    pos_ = static_cast<std::size_t>(stop - in_.data()) + 1;
+    ++next_line_;
+    if (!record.empty() && record.back() == '\r')
+        record.remove_suffix(1);
+
+    split(record, fields);
+    return true;
+}
+
+void CsvReader::split(std::string_view record, std::vector<std::string_view>& fields)
+{
+    fields.clear();
+    scratch_.clear();
+    // Unescaping only ever shrinks a field, so this keeps views into scratch_ from being invalidated
+    scratch_.reserve(record.size());
+
+    const std::size_t n = record.size();
+    std::size_t       i = 0;
+    while (true)
+    {
+        while (i < n && is_blank(record[i]))
+            ++i;
+        if (i < n && record[i] == '"')
+        {
+            std::size_t from    = ++i;
+            std::size_t escaped = std::string::npos; // start of this field in scratch_, once it has a ""
+            while (true)
+            {
+                // Quotes are balanced (checked by next()), so a closing one is always found
+                const auto q = record.find('"', i);
+                if (q + 1 < n && record[q + 1] == '"')
+                {
+                    if (escaped == std::string::npos)
+                        escaped = scratch_.size();
+                    scratch_.append(record.substr(from, q + 1 - from));
+                    i = from = q + 2;
+                    continue;
+                }
+                if (escaped == std::string::npos)
+                {
+                    fields.push_back(record.substr(from, q - from));
+                }
+                else
+                {
+                    scratch_.append(record.substr(from, q - from));
+                    fields.emplace_back(scratch_.data() + escaped, scratch_.size() - escaped);
+                }
+                i = q + 1;
+                break;
+            }
+            while (i < n && is_blank(record[i]))
+                ++i;
+            if (i < n && record[i] != ',')
+                throw std::runtime_error("CSV format error at row " + std::to_string(line_) +
+                                         ": unexpected character after quoted field");
+        }
+        else
+        {
+            const auto comma = std::min(record.find(',', i), n);
+            auto       field = record.substr(i, comma - i);
+            while (!field.empty() && is_blank(field.back()))
+                field.remove_suffix(1);
+            fields.push_back(field);
+            i = comma;
+        }
+        if (i >= n)
+            return;
+        ++i; // the comma
+    }
+}
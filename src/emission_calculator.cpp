@@ -1,65 +1,62 @@
+#include "batch_pricer.hpp"
 #include "emission_factors.hpp"
+#include "factor_table.hpp"
 #include "storage.hpp"
 
 #include <cmath>
 #include <stdexcept>
+#include <vector>
 
-double calculate_co2_emissions(const std::string& mode, const std::string& fuel_type,
-                               const std::string& vehicle_size, double occupancy, double distance_km)
+// Prices a trip with `factor`, the active table's factor for it (nullptr if it has none).
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static double price_trip(const EmissionFactor* factor, const std::string& mode, double occupancy,
+                         double distance_km)
 {
-    // Validate inputs
-    if (distance_km < 0.0)
-    {
-        throw std::runtime_error("Distance cannot be negative");
-    }
-
-    if (occupancy < 1.0)
-    {
-        throw std::runtime_error("Occupancy must be at least 1.0");
-    }
+    validate_trip(occupancy, distance_km);
 
-    // Get the appropriate emission factor
-    // First try to get from database/external sources via DefaultEmissionFactors
-    std::optional<EmissionFactor> factor_opt =
-        DefaultEmissionFactors::get_default_factor(mode, fuel_type, vehicle_size);
+    // First try the active factor table (DEFRA 2024 unless EMISSION_FACTORS_PATH replaced it),
+    // then fall back to the simplified defaults
+    const double kg_co2_per_km = factor != nullptr ? factor->kg_co2_per_km : default_kg_per_km(mode);
 
-    if (!factor_opt)
+    // Calculate total CO2 emissions
+    double total_kg_co2 = kg_co2_per_km * distance_km;
+    if (priced_per_vehicle(mode))
     {
-        // Fallback to simplified defaults if not found
-        if (mode == "car" || mode == "taxi")
-        {
-            factor_opt = EmissionFactor{ mode, fuel_type, vehicle_size, 0.18, "FALLBACK", 0 };
-        }
-        else if (mode == "bus")
-        {
-            factor_opt = EmissionFactor{ mode, "", "", 0.073, "FALLBACK", 0 };
-        }
-        else if (mode == "subway" || mode == "train" || mode == "underground" || mode == "rail")
-        {
-            factor_opt = EmissionFactor{ mode, "", "", 0.041, "FALLBACK", 0 };
-        }
-        else if (mode == "bike" || mode == "walk")
-        {
-            factor_opt = EmissionFactor{ mode, "", "", 0.0, "FALLBACK", 0 };
-        }
-        else
-        {
-            // Unknown mode, use conservative estimate
-            factor_opt = EmissionFactor{ mode, "", "", 0.1, "FALLBACK", 0 };
-        }
+        total_kg_co2 = total_kg_co2 / occupancy;
     }
 
-    const auto& factor = factor_opt.value();
+    return total_kg_co2;
+}
 
-    // Calculate total CO2 emissions
-    double total_kg_co2 = factor.kg_co2_per_km * distance_km;
+double calculate_co2_emissions(const std::string& mode, const std::string& fuel_type,
+                               const std::string& vehicle_size, double occupancy, double distance_km,
+                               std::string_view region)
+{
+    const auto table = active_factor_table();
+    return price_trip(table->find(mode, fuel_type, vehicle_size, region), mode, occupancy, distance_km);
+}
+
+double calculate_co2_emissions(const TransitEvent& ev)
+{
+    // The factor in effect when the trip was made, resolved for its region
+    const auto table = active_factor_table();
+    return price_trip(table->find(ev.mode, ev.fuel_type, ev.vehicle_size, ev.region, ev.ts), ev.mode,
+                      ev.occupancy, ev.distance_km);
+}
 
-    // For private vehicles (car, taxi), divide by occupancy (sharing emissions)
-    // For public transit, occupancy already factored into the per-passenger factor
-    if (mode == "car" || mode == "taxi")
+std::vector<double> calculate_co2_emissions(const std::vector<TransitEvent>& evs)
+{
+    BatchPricer                pricer;
+    std::vector<std::uint32_t> ids(evs.size());
+    std::vector<double>        distance_km(evs.size());
+    std::vector<double>        occupancy(evs.size());
+    for (std::size_t i = 0; i < evs.size(); ++i)
     {
-        total_kg_co2 = total_kg_co2 / occupancy;
+        ids[i]         = pricer.id_of(evs[i]);
+        distance_km[i] = evs[i].distance_km;
+        occupancy[i]   = evs[i].occupancy;
     }
-
-    return total_kg_co2;
+    std::vector<double> kg_co2(evs.size());
+    pricer.price(ids.data(), distance_km.data(), occupancy.data(), kg_co2.data(), evs.size());
+    return kg_co2;
 }
@@ -1,12 +1,16 @@
 #include "emission_data_loader.hpp"
 
+#include "csv_reader.hpp"
 #include "emission_factors.hpp"
+#include "file_io.hpp"
+#include "history.hpp"
+#include "json_backend.hpp"
 
-#include <nlohmann/json.hpp>
-#include <sstream>
+#include <algorithm>
+#include <charconv>
+#include <initializer_list>
 #include <stdexcept>
-
-using json = nlohmann::json;
+#include <system_error>
 
 std::vector<EmissionFactor> EmissionDataLoader::load_defra_2024()
 {
@@ -19,109 +23,154 @@ std::vector<EmissionFactor> EmissionDataLoader::load_defra_2024()
 }
 
 std::vector<EmissionFactor> EmissionDataLoader::load_from_json(const std::string& json_str)
+{
+    // nlohmann::json or simdjson, depending on the build (see json_backend.hpp)
+    return decode_factors(json_str);
+}
+
+std::vector<EmissionFactor> EmissionDataLoader::load_from_csv(const std::string& csv_str)
 {
     std::vector<EmissionFactor> factors;
+    parse_csv(csv_str, [&](EmissionFactor&& f) { factors.push_back(std::move(f)); });
+    return factors;
+}
 
-    try
-    {
-        const auto j = json::parse(json_str);
+static constexpr std::size_t k_absent = static_cast<std::size_t>(-1);
 
-        if (!j.is_array())
+// Where each factor field is in a row; k_absent for optional columns the file doesn't have.
+struct CsvColumns
+{
+    std::size_t mode         = 0;
+    std::size_t fuel_type    = 1;
+    std::size_t vehicle_size = 2;
+    std::size_t kg_co2       = 3;
+    std::size_t source       = 4;
+    std::size_t updated_at   = k_absent;
+    std::size_t region       = k_absent;
+    std::size_t valid_from   = k_absent;
+    std::size_t valid_until  = k_absent;
+    std::size_t min_fields   = 5; // rows with fewer fields are malformed
+
+    explicit CsvColumns(const std::vector<std::string_view>& header)
+    {
+        auto find = [&](std::string_view name)
         {
-            throw std::runtime_error("Expected JSON array of factors");
-        }
-
-        for (const auto& item : j)
+            const auto it = std::find(header.begin(), header.end(), name);
+            return it == header.end() ? k_absent : static_cast<std::size_t>(it - header.begin());
+        };
+        if (find("mode") == k_absent || find("kg_co2_per_km") == k_absent)
+            return; // positional
+        mode         = find("mode");
+        fuel_type    = find("fuel_type");
+        vehicle_size = find("vehicle_size");
+        kg_co2       = find("kg_co2_per_km");
+        source       = find("source");
+        updated_at   = find("updated_at");
+        region       = find("region");
+        valid_from   = find("valid_from");
+        valid_until  = find("valid_until");
+        min_fields   = 0;
+        for (const auto col :
+             { mode, fuel_type, vehicle_size, kg_co2, source, updated_at, region, valid_from, valid_until })
         {
-            if (!item.is_object())
-            {
-                throw std::runtime_error("Each factor item must be a JSON object");
-            }
-
-            EmissionFactor factor;
-            factor.mode          = item.at("mode").get<std::string>();
-            factor.fuel_type     = item.value("fuel_type", "");
-            factor.vehicle_size  = item.value("vehicle_size", "");
-            factor.kg_co2_per_km = item.at("kg_co2_per_km").get<double>();
-            factor.source        = item.value("source", "UNKNOWN");
-            factor.updated_at    = item.value("updated_at", static_cast<std::int64_t>(0));
-
-            factors.push_back(std::move(factor));
+            if (col != k_absent)
+                min_fields = std::max(min_fields, col + 1);
         }
     }
-    catch (const json::exception& e)
-    {
-        throw std::runtime_error(std::string("JSON parsing error: ") + e.what());
-    }
+};
 
-    return factors;
+template <typename T>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool parse_whole(std::string_view text, T& out)
+{
+    const auto* end = text.data() + text.size();
+    const auto  res = std::from_chars(text.data(), end, out);
+    return !text.empty() && res.ec == std::errc() && res.ptr == end;
 }
 
-std::vector<EmissionFactor> EmissionDataLoader::load_from_csv(const std::string& csv_str)
+std::size_t EmissionDataLoader::parse_csv(std::string_view csv, const FactorSink& sink)
 {
-    std::vector<EmissionFactor> factors;
-    std::istringstream          iss(csv_str);
-    std::string                 line;
+    // Spreadsheet exports often start with a UTF-8 byte order mark
+    if (csv.substr(0, 3) == "\xEF\xBB\xBF")
+        csv.remove_prefix(3);
 
-    // Skip header
-    if (!std::getline(iss, line))
+    CsvReader                     reader(csv);
+    std::vector<std::string_view> fields;
+    if (!reader.next(fields))
     {
         throw std::runtime_error("CSV is empty");
     }
+    const CsvColumns cols(fields);
 
-    // Parse data rows
-    int row_num = 1;
-    while (std::getline(iss, line))
+    auto field = [&](std::size_t col) { return col == k_absent ? std::string_view() : fields[col]; };
+    // A validity bound as epoch seconds; an empty field leaves it unbounded
+    auto read_day = [&](std::size_t col, const char* name, std::int64_t& out)
     {
-        row_num++;
+        const auto date = field(col);
+        if (date.empty())
+            return;
+        const auto day = parse_iso_day(std::string(date));
+        if (!day)
+        {
+            throw std::runtime_error("Failed to parse " + std::string(name) + " at row " +
+                                     std::to_string(reader.line()) + ": '" + std::string(date) + "'");
+        }
+        out = *day * 86400;
+    };
+
+    std::size_t count = 0;
+    while (reader.next(fields))
+    {
+        const auto row_num = std::to_string(reader.line());
 
         // Skip empty lines
-        if (line.empty())
+        if (fields.size() == 1 && fields[0].empty())
             continue;
 
-        std::istringstream row_stream(line);
-        std::string        mode, fuel_type, vehicle_size, kg_str, source;
-
-        if (!std::getline(row_stream, mode, ',') || !std::getline(row_stream, fuel_type, ',') ||
-            !std::getline(row_stream, vehicle_size, ',') || !std::getline(row_stream, kg_str, ',') ||
-            !std::getline(row_stream, source, ','))
+        if (fields.size() < cols.min_fields)
         {
-            throw std::runtime_error("CSV format error at row " + std::to_string(row_num));
+            throw std::runtime_error("CSV format error at row " + row_num);
         }
 
-        // Trim whitespace
-        auto trim = [](std::string& s)
-        {
-            s.erase(0, s.find_first_not_of(" \t\r\n"));
-            s.erase(s.find_last_not_of(" \t\r\n") + 1);
-        };
-
-        trim(mode);
-        trim(fuel_type);
-        trim(vehicle_size);
-        trim(kg_str);
-        trim(source);
-
-        try
+        EmissionFactor factor;
+        if (!parse_whole(field(cols.kg_co2), factor.kg_co2_per_km))
         {
-            double kg_co2_per_km = std::stod(kg_str);
-
-            EmissionFactor factor;
-            factor.mode          = mode;
-            factor.fuel_type     = fuel_type;
-            factor.vehicle_size  = vehicle_size;
-            factor.kg_co2_per_km = kg_co2_per_km;
-            factor.source        = source;
-            factor.updated_at    = 0; // CSV doesn't have timestamps
-
-            factors.push_back(std::move(factor));
+            throw std::runtime_error("Failed to parse kg_co2_per_km at row " + row_num + ": '" +
+                                     std::string(field(cols.kg_co2)) + "'");
         }
-        catch (const std::exception& e)
+        const auto updated_at = field(cols.updated_at);
+        if (!updated_at.empty() && !parse_whole(updated_at, factor.updated_at))
         {
-            throw std::runtime_error("Failed to parse kg_co2_per_km at row " + std::to_string(row_num) +
-                                     ": " + e.what());
+            throw std::runtime_error("Failed to parse updated_at at row " + row_num + ": '" +
+                                     std::string(updated_at) + "'");
         }
+        factor.mode         = field(cols.mode);
+        factor.fuel_type    = field(cols.fuel_type);
+        factor.vehicle_size = field(cols.vehicle_size);
+        factor.source       = cols.source == k_absent ? std::string_view("UNKNOWN") : field(cols.source);
+        factor.region       = field(cols.region);
+        read_day(cols.valid_from, "valid_from", factor.valid_from);
+        read_day(cols.valid_until, "valid_until", factor.valid_until);
+
+        sink(std::move(factor));
+        ++count;
     }
+    return count;
+}
 
-    return factors;
+std::size_t EmissionDataLoader::load_csv_file(const std::string& path, const FactorSink& sink)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        throw std::runtime_error("Factor file not found: " + path);
+    }
+    try
+    {
+        return parse_csv(file.bytes(), sink);
+    }
+    catch (const std::runtime_error& e)
+    {
+        throw std::runtime_error(path + ": " + e.what());
+    }
 }
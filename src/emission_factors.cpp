@@ -1,98 +1,45 @@
 #include "emission_factors.hpp"
 
-std::vector<EmissionFactor> DefaultEmissionFactors::basic_defaults()
-{
-    // Simple, conservative default emission factors (used until DEFRA data is loaded)
-    // These are basic approximations to provide a working service without external data
-
-    std::vector<EmissionFactor> factors;
-
-    // ===== CARS (simplified: all sizes use same factor) =====
-    factors.push_back({ "car", "petrol", "small", 0.200, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "car", "petrol", "medium", 0.200, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "car", "petrol", "large", 0.200, "BASIC-DEFAULT", 0 });
-
-    factors.push_back({ "car", "diesel", "small", 0.180, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "car", "diesel", "medium", 0.180, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "car", "diesel", "large", 0.180, "BASIC-DEFAULT", 0 });
-
-    factors.push_back({ "car", "electric", "small", 0.100, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "car", "electric", "medium", 0.100, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "car", "electric", "large", 0.100, "BASIC-DEFAULT", 0 });
-
-    factors.push_back({ "car", "hybrid", "small", 0.150, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "car", "hybrid", "medium", 0.150, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "car", "hybrid", "large", 0.150, "BASIC-DEFAULT", 0 });
+#include "embedded_factors.hpp"
 
-    // ===== TAXIS (simplified) =====
-    factors.push_back({ "taxi", "petrol", "medium", 0.200, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "taxi", "diesel", "medium", 0.180, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "taxi", "electric", "medium", 0.100, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "taxi", "hybrid", "medium", 0.150, "BASIC-DEFAULT", 0 });
+// Both default tables are compiled in from data/emission_factors/*.csv by cmake/embed_factors.cmake:
+// basic_defaults.csv holds simple, conservative approximations to provide a working service without
+// external data; defra_2024.csv the DEFRA 2024 UK Government Greenhouse Gas Conversion Factors
+// (https://www.gov.uk/guidance/greenhouse-gas-reporting-conversion-factors-2024), in kg CO2e per
+// passenger-km, well-to-wheel. Car and taxi factors are per vehicle, divided by occupancy at
+// calculation time; public transit factors are already per passenger.
 
-    // ===== PUBLIC TRANSIT (simplified estimates) =====
-    factors.push_back({ "bus", "", "", 0.100, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "subway", "", "", 0.050, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "train", "", "", 0.070, "BASIC-DEFAULT", 0 });
-
-    // ===== ZERO-EMISSION MODES =====
-    factors.push_back({ "bike", "", "", 0.0, "BASIC-DEFAULT", 0 });
-    factors.push_back({ "walk", "", "", 0.0, "BASIC-DEFAULT", 0 });
-
-    return factors;
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static EmissionFactor to_emission_factor(const EmbeddedFactor& f)
+{
+    return { std::string(name_of(f.mode)),
+             std::string(name_of(f.fuel_type)),
+             std::string(name_of(f.vehicle_size)),
+             f.kg_co2_per_km,
+             std::string(f.source),
+             0,
+             {} };
 }
 
-std::vector<EmissionFactor> DefaultEmissionFactors::defra_2024_factors()
+template <std::size_t N>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::vector<EmissionFactor> to_emission_factors(const EmbeddedFactor (&table)[N])
 {
-    // DEFRA 2024 UK Government Greenhouse Gas Conversion Factors
-    // Source: https://www.gov.uk/guidance/greenhouse-gas-reporting-conversion-factors-2024
-    // All factors in kg CO2e per passenger·km (well-to-wheel, including fuel production)
-
     std::vector<EmissionFactor> factors;
+    factors.reserve(N);
+    for (const auto& f : table)
+        factors.push_back(to_emission_factor(f));
+    return factors;
+}
 
-    // ===== CARS (private vehicles, per passenger with occupancy adjustment) =====
-    // Petrol cars
-    factors.push_back({ "car", "petrol", "small", 0.167, "DEFRA-2024", 0 });
-    factors.push_back({ "car", "petrol", "medium", 0.203, "DEFRA-2024", 0 });
-    factors.push_back({ "car", "petrol", "large", 0.291, "DEFRA-2024", 0 });
-
-    // Diesel cars (more efficient than petrol for same size)
-    factors.push_back({ "car", "diesel", "small", 0.142, "DEFRA-2024", 0 });
-    factors.push_back({ "car", "diesel", "medium", 0.168, "DEFRA-2024", 0 });
-    factors.push_back({ "car", "diesel", "large", 0.241, "DEFRA-2024", 0 });
-
-    // Electric cars (much lower; reflects 2024 UK grid ~50% renewable)
-    factors.push_back({ "car", "electric", "small", 0.074, "DEFRA-2024", 0 });
-    factors.push_back({ "car", "electric", "medium", 0.088, "DEFRA-2024", 0 });
-    factors.push_back({ "car", "electric", "large", 0.115, "DEFRA-2024", 0 });
-
-    // Hybrid cars (between electric and petrol)
-    factors.push_back({ "car", "hybrid", "small", 0.132, "DEFRA-2024", 0 });
-    factors.push_back({ "car", "hybrid", "medium", 0.155, "DEFRA-2024", 0 });
-    factors.push_back({ "car", "hybrid", "large", 0.210, "DEFRA-2024", 0 });
-
-    // ===== TAXIS (similar to cars, but often higher occupancy) =====
-    // For taxis, use same factors as cars (occupancy adjustment applied at calculation time)
-    factors.push_back({ "taxi", "petrol", "medium", 0.203, "DEFRA-2024", 0 });
-    factors.push_back({ "taxi", "diesel", "medium", 0.168, "DEFRA-2024", 0 });
-    factors.push_back({ "taxi", "electric", "medium", 0.088, "DEFRA-2024", 0 });
-    factors.push_back({ "taxi", "hybrid", "medium", 0.155, "DEFRA-2024", 0 });
-
-    // ===== PUBLIC TRANSIT (per passenger, already averaged) =====
-    // Bus (averaged across ~40 passengers per vehicle)
-    factors.push_back({ "bus", "", "", 0.073, "DEFRA-2024", 0 });
-
-    // Underground/Subway (electric, very efficient)
-    factors.push_back({ "subway", "", "", 0.041, "DEFRA-2024", 0 });
-
-    // Train/Rail (mix of electric and diesel)
-    factors.push_back({ "train", "", "", 0.051, "DEFRA-2024", 0 });
-
-    // ===== ZERO-EMISSION MODES =====
-    factors.push_back({ "bike", "", "", 0.0, "DEFRA-2024", 0 });
-    factors.push_back({ "walk", "", "", 0.0, "DEFRA-2024", 0 });
+std::vector<EmissionFactor> DefaultEmissionFactors::basic_defaults()
+{
+    return to_emission_factors(k_basic_defaults_factors);
+}
 
-    return factors;
+std::vector<EmissionFactor> DefaultEmissionFactors::defra_2024_factors()
+{
+    return to_emission_factors(k_defra_2024_factors);
 }
 
 std::optional<EmissionFactor> DefaultEmissionFactors::get_default_factor(const std::string& mode,
@@ -100,13 +47,7 @@ std::optional<EmissionFactor> DefaultEmissionFactors::get_default_factor(const s
                                                                          const std::string& vehicle_size)
 {
     // Return DEFRA 2024 factors (the detailed ones)
-    const auto all_factors = defra_2024_factors();
-    for (const auto& factor : all_factors)
-    {
-        if (factor.mode == mode && factor.fuel_type == fuel_type && factor.vehicle_size == vehicle_size)
-        {
-            return factor;
-        }
-    }
+    if (const auto* f = find_embedded_factor(k_defra_2024_factors, mode, fuel_type, vehicle_size))
+        return to_emission_factor(*f);
     return std::nullopt;
 }
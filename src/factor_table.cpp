@@ -0,0 +1,451 @@
+#include "factor_table.hpp"
+
+#include "emission_data_loader.hpp"
+#include "json_backend.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void make_key(std::string& key, std::string_view mode, std::string_view fuel_type,
+                     std::string_view vehicle_size)
+{
+    key.assign(mode);
+    key += '\0';
+    key += fuel_type;
+    key += '\0';
+    key += vehicle_size;
+}
+
+// "US-CA" -> "US" -> "" (global).
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::string_view parent_region(std::string_view region)
+{
+    const auto dash = region.rfind('-');
+    return dash == std::string_view::npos ? std::string_view() : region.substr(0, dash);
+}
+
+FactorTable::FactorTable(std::vector<EmissionFactor> factors, std::string origin,
+                         std::vector<std::string> source_priority)
+    : origin_(std::move(origin))
+{
+    static std::atomic<std::uint64_t> built{ 0 };
+    version_ = ++built;
+
+    // Per entry of factors_: its key and region index, its source's rank (unlisted sources rank
+    // last) and when it was loaded, for breaking ties between equally ranked sources.
+    struct Entry
+    {
+        std::uint32_t key;
+        std::uint32_t region;
+        std::size_t   rank;
+        std::size_t   loaded;
+    };
+    std::vector<Entry>                           entries;
+    std::unordered_map<std::string, std::size_t> seen; // key, region, source, valid_from -> factors_
+    factors_.reserve(factors.size());
+    entries.reserve(factors.size());
+    regions_.emplace("", 0);
+    region_names_.emplace_back();
+    std::string key;
+    for (std::size_t i = 0; i < factors.size(); ++i)
+    {
+        auto& f  = factors[i];
+        f.region = normalize_region(f.region);
+        if (f.valid_from >= f.valid_until)
+            throw std::runtime_error("emission factor for " + f.mode + " has an empty validity period");
+        make_key(key, f.mode, f.fuel_type, f.vehicle_size);
+        const auto key_id = keys_.emplace(key, static_cast<std::uint32_t>(keys_.size())).first->second;
+        const auto [region, added] = regions_.emplace(f.region, static_cast<std::uint32_t>(regions_.size()));
+        if (added)
+            region_names_.push_back(f.region);
+        const auto rank =
+            static_cast<std::size_t>(std::find(source_priority.begin(), source_priority.end(), f.source) -
+                                     source_priority.begin());
+
+        key += '\0';
+        key += f.region;
+        key += '\0';
+        key += f.source;
+        key += '\0';
+        key += std::to_string(f.valid_from);
+        const auto [it, inserted] = seen.emplace(key, factors_.size());
+        if (inserted)
+        {
+            factors_.push_back(std::move(f));
+            entries.push_back({ key_id, region->second, rank, i });
+        }
+        else
+        {
+            factors_[it->second]       = std::move(f);
+            entries[it->second].loaded = i;
+        }
+    }
+
+    // The entries of each key within each region on its own...
+    const auto                              key_count = keys_.size();
+    std::vector<std::vector<std::uint32_t>> own(regions_.size() * key_count);
+    for (std::size_t i = 0; i < entries.size(); ++i)
+        own[entries[i].region * key_count + entries[i].key].push_back(static_cast<std::uint32_t>(i));
+
+    // ...then each region falls back through its known parents to the global factors. Candidates
+    // are kept in chain order, so the first one in effect at a time is the nearest region's.
+    spans_.resize(own.size());
+    std::vector<std::uint32_t> chain;
+    std::vector<std::uint32_t> candidates;
+    std::vector<std::int64_t>  bounds;
+    for (std::uint32_t region = 0; region < region_names_.size(); ++region)
+    {
+        chain.assign(1, region);
+        for (auto parent = parent_region(region_names_[region]); !parent.empty();
+             parent = parent_region(parent))
+        {
+            const auto it = regions_.find(std::string(parent));
+            if (it != regions_.end())
+                chain.push_back(it->second);
+        }
+        if (region != 0)
+            chain.push_back(0);
+
+        for (std::size_t k = 0; k < key_count; ++k)
+        {
+            auto& span = spans_[region * key_count + k];
+            span.begin = span.end = static_cast<std::uint32_t>(starts_.size());
+            candidates.clear();
+            bounds.assign(1, std::numeric_limits<std::int64_t>::min());
+            for (const auto link : chain)
+            {
+                const auto& level = own[link * key_count + k];
+                candidates.insert(candidates.end(), level.begin(), level.end());
+            }
+            if (candidates.empty())
+                continue;
+            for (const auto c : candidates)
+            {
+                bounds.push_back(factors_[c].valid_from);
+                bounds.push_back(factors_[c].valid_until);
+            }
+            std::sort(bounds.begin(), bounds.end());
+            bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+            if (bounds.back() == std::numeric_limits<std::int64_t>::max())
+                bounds.pop_back(); // the end of time starts no period
+
+            // Each period takes the best candidate in effect at its start: nearest region first,
+            // then source rank, then the one loaded last
+            for (const auto start : bounds)
+            {
+                auto     best       = k_unresolved;
+                unsigned best_depth = 0;
+                unsigned depth      = 0;
+                for (std::size_t c = 0, level_end = 0; c < candidates.size(); ++c)
+                {
+                    while (c == level_end)
+                        level_end += own[chain[depth++] * key_count + k].size();
+                    const auto& f = factors_[candidates[c]];
+                    if (start < f.valid_from || start >= f.valid_until)
+                        continue;
+                    const auto& e = entries[candidates[c]];
+                    if (best == k_unresolved ||
+                        (depth == best_depth &&
+                         (e.rank < entries[best].rank ||
+                          (e.rank == entries[best].rank && e.loaded > entries[best].loaded))))
+                    {
+                        best       = candidates[c];
+                        best_depth = depth;
+                    }
+                }
+                if (span.end > span.begin && slots_.back() == best)
+                    continue; // same factor as the period before
+                starts_.push_back(start);
+                slots_.push_back(best);
+                ++span.end;
+            }
+        }
+    }
+}
+
+std::uint32_t FactorTable::region_index(std::string_view region) const
+{
+    thread_local std::string name;
+    for (; !region.empty(); region = parent_region(region))
+    {
+        name.assign(region);
+        const auto it = regions_.find(name);
+        if (it != regions_.end())
+            return it->second;
+    }
+    return 0;
+}
+
+std::size_t FactorTable::span_index(std::string_view mode, std::string_view fuel_type,
+                                    std::string_view vehicle_size, std::string_view region) const
+{
+    // Reused so a lookup doesn't allocate for keys past the small-string buffer
+    thread_local std::string key;
+    make_key(key, mode, fuel_type, vehicle_size);
+    const auto it = keys_.find(key);
+    if (it == keys_.end())
+        return spans_.size();
+    return region_index(region) * keys_.size() + it->second;
+}
+
+const EmissionFactor* FactorTable::find(std::string_view mode, std::string_view fuel_type,
+                                        std::string_view vehicle_size, std::string_view region,
+                                        std::int64_t as_of) const
+{
+    const auto index = span_index(mode, fuel_type, vehicle_size, region);
+    if (index == spans_.size() || spans_[index].begin == spans_[index].end)
+        return nullptr;
+    // The last period starting at or before as_of; the first starts at the minimum int64
+    const auto* first = starts_.data() + spans_[index].begin;
+    const auto* last  = starts_.data() + spans_[index].end;
+    const auto  slot  = slots_[static_cast<std::size_t>(std::upper_bound(first, last, as_of) - first - 1) +
+                              spans_[index].begin];
+    return slot == k_unresolved ? nullptr : &factors_[slot];
+}
+
+const EmissionFactor* FactorTable::find(std::string_view mode, std::string_view fuel_type,
+                                        std::string_view vehicle_size, std::string_view region) const
+{
+    return find(mode, fuel_type, vehicle_size, region, static_cast<std::int64_t>(std::time(nullptr)));
+}
+
+std::vector<EmissionFactor> FactorTable::resolved(std::string_view region) const
+{
+    const auto                  now = static_cast<std::int64_t>(std::time(nullptr));
+    std::vector<EmissionFactor> out;
+    std::vector<bool>           done(keys_.size());
+    for (const auto& f : factors_)
+    {
+        const auto index = span_index(f.mode, f.fuel_type, f.vehicle_size, region);
+        const auto key   = index % keys_.size();
+        if (done[key])
+            continue;
+        done[key] = true;
+        if (const auto* current = find(f.mode, f.fuel_type, f.vehicle_size, region, now))
+            out.push_back(*current);
+    }
+    return out;
+}
+
+std::vector<std::pair<std::int64_t, const EmissionFactor*>>
+FactorTable::timeline(std::string_view mode, std::string_view fuel_type, std::string_view vehicle_size,
+                      std::string_view region) const
+{
+    std::vector<std::pair<std::int64_t, const EmissionFactor*>> periods;
+    const auto index = span_index(mode, fuel_type, vehicle_size, region);
+    if (index == spans_.size())
+        return periods;
+    for (auto i = spans_[index].begin; i < spans_[index].end; ++i)
+        periods.emplace_back(starts_[i], slots_[i] == k_unresolved ? nullptr : &factors_[slots_[i]]);
+    if (periods.empty())
+        periods.emplace_back(std::numeric_limits<std::int64_t>::min(), nullptr);
+    return periods;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool same_price(const EmissionFactor* a, const EmissionFactor* b)
+{
+    return a == nullptr || b == nullptr ? a == b : a->kg_co2_per_km == b->kg_co2_per_km;
+}
+
+FactorChangeSet::FactorChangeSet(const FactorTable& before, const FactorTable& after)
+{
+    using Timeline = std::vector<std::pair<std::int64_t, const EmissionFactor*>>;
+    const auto in_effect = [](const Timeline& periods, std::int64_t t)
+    {
+        const auto it = std::upper_bound(periods.begin(), periods.end(), t,
+                                         [](std::int64_t v, const auto& p) { return v < p.first; });
+        return std::prev(it)->second;
+    };
+
+    std::vector<std::string> regions = before.regions();
+    regions.insert(regions.end(), after.regions().begin(), after.regions().end());
+    std::sort(regions.begin(), regions.end());
+    regions.erase(std::unique(regions.begin(), regions.end()), regions.end());
+
+    std::string                     key;
+    std::vector<std::int64_t>       bounds;
+    std::unordered_set<std::string> visited;
+    for (const auto* table : { &before, &after })
+    {
+        for (const auto& f : table->factors())
+        {
+            make_key(key, f.mode, f.fuel_type, f.vehicle_size);
+            if (!visited.insert(key).second)
+                continue;
+            auto& periods = periods_[key];
+            for (const auto& region : regions)
+            {
+                const auto old_periods = before.timeline(f.mode, f.fuel_type, f.vehicle_size, region);
+                const auto new_periods = after.timeline(f.mode, f.fuel_type, f.vehicle_size, region);
+                const Timeline none{ { std::numeric_limits<std::int64_t>::min(), nullptr } };
+                const auto&    a = old_periods.empty() ? none : old_periods;
+                const auto&    b = new_periods.empty() ? none : new_periods;
+                bounds.clear();
+                for (const auto& p : a)
+                    bounds.push_back(p.first);
+                for (const auto& p : b)
+                    bounds.push_back(p.first);
+                std::sort(bounds.begin(), bounds.end());
+                bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+                for (std::size_t i = 0; i < bounds.size(); ++i)
+                {
+                    if (same_price(in_effect(a, bounds[i]), in_effect(b, bounds[i])))
+                        continue;
+                    const auto until =
+                        i + 1 < bounds.size() ? bounds[i + 1] : std::numeric_limits<std::int64_t>::max();
+                    periods.emplace_back(bounds[i], until);
+                }
+            }
+            if (periods.empty())
+            {
+                periods_.erase(key);
+                continue;
+            }
+            // Merge the periods of all regions into disjoint ones
+            std::sort(periods.begin(), periods.end());
+            std::size_t merged = 0;
+            for (std::size_t i = 1; i < periods.size(); ++i)
+            {
+                if (periods[i].first <= periods[merged].second)
+                    periods[merged].second = std::max(periods[merged].second, periods[i].second);
+                else
+                    periods[++merged] = periods[i];
+            }
+            periods.resize(merged + 1);
+        }
+    }
+}
+
+bool FactorChangeSet::affects(std::string_view mode, std::string_view fuel_type,
+                              std::string_view vehicle_size, std::int64_t ts) const
+{
+    if (all_)
+        return true;
+    thread_local std::string key;
+    make_key(key, mode, fuel_type, vehicle_size);
+    const auto it = periods_.find(key);
+    if (it == periods_.end())
+        return false;
+    // The last period starting at or before ts, if it hasn't ended
+    const auto& periods = it->second;
+    const auto  next    = std::upper_bound(periods.begin(), periods.end(), ts,
+                                           [](std::int64_t v, const auto& p) { return v < p.first; });
+    return next != periods.begin() && ts < std::prev(next)->second;
+}
+
+std::string normalize_region(std::string_view region)
+{
+    std::string out(region);
+    bool        ok = out.size() <= 16 && out.find("--") == std::string::npos &&
+                     (out.empty() || (out.front() != '-' && out.back() != '-'));
+    for (auto& c : out)
+    {
+        if (c >= 'a' && c <= 'z')
+            c = static_cast<char>(c - 'a' + 'A');
+        else if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-'))
+            ok = false;
+    }
+    if (!ok)
+        throw std::runtime_error("invalid region '" + std::string(region) + "'");
+    return out;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::shared_ptr<const FactorTable>& active_table_slot()
+{
+    static std::shared_ptr<const FactorTable> slot =
+        std::make_shared<const FactorTable>(DefaultEmissionFactors::defra_2024_factors(), "built-in");
+    return slot;
+}
+
+std::shared_ptr<const FactorTable> active_factor_table()
+{
+    return std::atomic_load(&active_table_slot());
+}
+
+void set_active_factor_table(std::shared_ptr<const FactorTable> table)
+{
+    std::atomic_store(&active_table_slot(), std::move(table));
+}
+
+// Copied into memory rather than mapped: the watcher reloads files rewritten in place, and one
+// truncated while it is read then comes out short (and fails to parse) instead of raising SIGBUS.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::string read_factor_file(const std::filesystem::path& file)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Factor file not found: " + file.string());
+    std::string bytes{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+    if (in.bad())
+        throw std::runtime_error("cannot read " + file.string());
+    return bytes;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void load_factor_file(const std::filesystem::path& file, std::vector<EmissionFactor>& out)
+{
+    const auto ext = file.extension();
+    if (ext != ".csv" && ext != ".json")
+        throw std::runtime_error("Unsupported factor file (expected .csv or .json): " + file.string());
+
+    const auto bytes = read_factor_file(file);
+    try
+    {
+        if (ext == ".csv")
+        {
+            EmissionDataLoader::parse_csv(bytes, [&](EmissionFactor&& f) { out.push_back(std::move(f)); });
+            return;
+        }
+        auto factors = decode_factors(bytes);
+        std::move(factors.begin(), factors.end(), std::back_inserter(out));
+    }
+    catch (const std::runtime_error& e)
+    {
+        throw std::runtime_error(file.string() + ": " + e.what());
+    }
+}
+
+std::vector<EmissionFactor> load_factor_path(const std::string& path)
+{
+    namespace fs = std::filesystem;
+    std::vector<EmissionFactor> factors;
+    if (!fs::exists(path))
+        throw std::runtime_error("Factor path not found: " + path);
+    if (fs::is_directory(path))
+    {
+        std::vector<fs::path> files;
+        for (const auto& entry : fs::directory_iterator(path))
+        {
+            if (entry.is_regular_file() && is_factor_file_name(entry.path().filename().string()))
+                files.push_back(entry.path());
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files)
+            load_factor_file(file, factors);
+    }
+    else
+    {
+        load_factor_file(path, factors);
+    }
+    if (factors.empty())
+        throw std::runtime_error("No emission factors found in " + path);
+    return factors;
+}
+
+bool is_factor_file_name(std::string_view name)
+{
+    auto ends_with = [&](std::string_view suffix)
+    { return name.size() > suffix.size() && name.substr(name.size() - suffix.size()) == suffix; };
+    return !name.empty() && name.front() != '.' && (ends_with(".csv") || ends_with(".json"));
+}
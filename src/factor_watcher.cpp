@@ -0,0 +1,204 @@
+#include "factor_watcher.hpp"
+
+#include "factor_table.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+FactorFileWatcher::FactorFileWatcher(std::string path, std::chrono::milliseconds debounce,
+                                     std::vector<std::string> source_priority)
+    : path_(std::move(path)), debounce_(debounce), source_priority_(std::move(source_priority))
+{
+    const std::filesystem::path p(path_);
+    if (std::filesystem::is_directory(p))
+    {
+        watched_dir_ = path_;
+    }
+    else
+    {
+        watched_dir_  = p.has_parent_path() ? p.parent_path().string() : ".";
+        watched_name_ = p.filename().string();
+    }
+}
+
+FactorFileWatcher::~FactorFileWatcher()
+{
+    if (thread_.joinable())
+    {
+        const char byte = 0;
+        if (::write(stop_fds_[1], &byte, 1) != 1)
+            std::cerr << "[charizard] factor watcher: cannot signal shutdown: " << std::strerror(errno)
+                      << '\n';
+        thread_.join();
+    }
+    for (const int fd : { inotify_fd_, stop_fds_[0], stop_fds_[1] })
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+}
+
+void FactorFileWatcher::start()
+{
+    if (thread_.joinable())
+        return;
+    if (::pipe(stop_fds_) != 0)
+        throw std::runtime_error(std::string("factor watcher: pipe: ") + std::strerror(errno));
+#ifdef __linux__
+    inotify_fd_ = ::inotify_init1(IN_CLOEXEC);
+    if (inotify_fd_ < 0)
+        throw std::runtime_error(std::string("factor watcher: inotify_init1: ") + std::strerror(errno));
+    if (::inotify_add_watch(inotify_fd_, watched_dir_.c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0)
+        throw std::runtime_error("factor watcher: cannot watch " + watched_dir_ + ": " +
+                                 std::strerror(errno));
+#endif
+    thread_ = std::thread([this] { loop(); });
+}
+
+bool FactorFileWatcher::reload()
+{
+    std::shared_ptr<const FactorTable> before;
+    std::shared_ptr<const FactorTable> after;
+    try
+    {
+        after = std::make_shared<const FactorTable>(load_factor_path(path_), path_, source_priority_);
+        before = active_factor_table();
+        set_active_factor_table(after);
+        ++reloads_;
+        std::cout << "[charizard] loaded " << after->factors().size() << " emission factors from " << path_
+                  << '\n';
+    }
+    catch (const std::exception& ex)
+    {
+        ++failed_;
+        std::cerr << "[charizard] keeping the current emission factors, reloading " << path_
+                  << " failed: " << ex.what() << '\n';
+        return false;
+    }
+
+    if (on_publish_)
+    {
+        try
+        {
+            on_publish_(*before, *after);
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << "[charizard] emission factors from " << path_
+                      << " are active, but their publish hook failed: " << ex.what() << '\n';
+        }
+    }
+    return true;
+}
+
+#ifdef __linux__
+
+void FactorFileWatcher::loop()
+{
+    pollfd fds[2] = { { inotify_fd_, POLLIN, 0 }, { stop_fds_[0], POLLIN, 0 } };
+    alignas(inotify_event) char buf[4096];
+    bool                        changed = false;
+    while (true)
+    {
+        // Once something changed, wait until a whole debounce interval passes without events
+        const int ready = ::poll(fds, 2, changed ? static_cast<int>(debounce_.count()) : -1);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready < 0 || (fds[1].revents & POLLIN) != 0)
+            return;
+        if (ready == 0)
+        {
+            changed = false;
+            reload();
+            continue;
+        }
+        const auto len = ::read(inotify_fd_, buf, sizeof(buf));
+        if (len <= 0)
+            continue;
+        for (const char* p = buf; p < buf + len;)
+        {
+            const auto* ev = reinterpret_cast<const inotify_event*>(p);
+            if ((ev->mask & IN_IGNORED) != 0)
+            {
+                std::cerr << "[charizard] factor watcher: " << watched_dir_
+                          << " went away, no longer watching" << '\n';
+                return;
+            }
+            const std::string_view name = ev->len > 0 ? ev->name : "";
+            if (watched_name_.empty() ? is_factor_file_name(name) : name == watched_name_)
+                changed = true;
+            p += sizeof(inotify_event) + ev->len;
+        }
+    }
+}
+
+#else
+
+void FactorFileWatcher::loop()
+{
+    pollfd      stop    = { stop_fds_[0], POLLIN, 0 };
+    std::string last    = fingerprint();
+    bool        changed = false;
+    while (true)
+    {
+        const int ready = ::poll(&stop, 1, static_cast<int>(debounce_.count()));
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready != 0)
+            return;
+        // Reload once the files have stopped changing for one interval
+        auto now = fingerprint();
+        if (now != last)
+        {
+            last    = std::move(now);
+            changed = true;
+        }
+        else if (changed)
+        {
+            changed = false;
+            reload();
+        }
+    }
+}
+
+#endif
+
+std::string FactorFileWatcher::fingerprint() const
+{
+    namespace fs = std::filesystem;
+    auto stamp   = [](const fs::path& file)
+    {
+        std::error_code ec;
+        const auto      mtime = fs::last_write_time(file, ec).time_since_epoch().count();
+        const auto      size  = fs::file_size(file, ec);
+        return file.filename().string() + ':' + std::to_string(mtime) + ':' + std::to_string(size) + '\n';
+    };
+    if (!watched_name_.empty())
+        return stamp(path_);
+
+    std::vector<std::string> lines;
+    std::error_code          ec;
+    for (const auto& entry : fs::directory_iterator(path_, ec))
+    {
+        if (is_factor_file_name(entry.path().filename().string()))
+            lines.push_back(stamp(entry.path()));
+    }
+    std::sort(lines.begin(), lines.end());
+    std::string out;
+    for (const auto& line : lines)
+        out += line;
+    return out;
+}
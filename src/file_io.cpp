@@ -0,0 +1,108 @@
+#include "file_io.hpp"
+#include "wal.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+static constexpr std::size_t k_write_buffer = 1U << 20;
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+        ::munmap(data_, size_);
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+            return false;
+        throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+    }
+    struct stat st = {};
+    if (::fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("cannot stat " + path);
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ > 0)
+    {
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("cannot map " + path + ": " + std::strerror(errno));
+        }
+        data_ = p;
+        ::madvise(data_, size_, MADV_WILLNEED);
+    }
+    ::close(fd);
+    return true;
+}
+
+AtomicFileWriter::AtomicFileWriter(std::string path)
+    : path_(std::move(path)), tmp_path_(path_ + ".tmp"),
+      fd_(::open(tmp_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+{
+    if (fd_ < 0)
+        throw std::runtime_error("cannot create " + tmp_path_ + ": " + std::strerror(errno));
+    buf_.reserve(k_write_buffer);
+}
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        std::remove(tmp_path_.c_str());
+    }
+}
+
+void AtomicFileWriter::write(std::string_view data)
+{
+    buf_.append(data.data(), data.size());
+    offset_ += data.size();
+    if (buf_.size() >= k_write_buffer)
+        drain();
+}
+
+void AtomicFileWriter::commit()
+{
+    drain();
+    if (::fsync(fd_) != 0)
+        throw std::runtime_error("fsync of " + tmp_path_ + " failed: " + std::strerror(errno));
+    ::close(fd_);
+    fd_ = -1;
+    if (std::rename(tmp_path_.c_str(), path_.c_str()) != 0)
+        throw std::runtime_error("cannot install " + path_ + ": " + std::strerror(errno));
+    sync_parent_dir(path_);
+}
+
+void AtomicFileWriter::drain()
+{
+    const char* p = buf_.data();
+    std::size_t n = buf_.size();
+    while (n > 0)
+    {
+        const auto w = ::write(fd_, p, n);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("write to " + tmp_path_ + " failed: " + std::strerror(errno));
+        }
+        p += w;
+        n -= static_cast<std::size_t>(w);
+    }
+    buf_.clear();
+}
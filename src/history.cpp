@@ -0,0 +1,109 @@
+#include "history.hpp"
+
+#include "calendar.hpp"
+
+#include <cstdio>
+#include <initializer_list>
+
+std::optional<HistoryGranularity> parse_granularity(const std::string& name)
+{
+    if (name == "day")
+        return HistoryGranularity::Day;
+    if (name == "week")
+        return HistoryGranularity::Week;
+    if (name == "month")
+        return HistoryGranularity::Month;
+    return std::nullopt;
+}
+
+const char* granularity_name(HistoryGranularity g)
+{
+    switch (g)
+    {
+    case HistoryGranularity::Week:
+        return "week";
+    case HistoryGranularity::Month:
+        return "month";
+    default:
+        return "day";
+    }
+}
+
+std::optional<std::int64_t> parse_iso_day(const std::string& text)
+{
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-')
+        return std::nullopt;
+    auto digits = [&](std::size_t pos, std::size_t len) -> std::optional<unsigned>
+    {
+        unsigned v = 0;
+        for (std::size_t i = pos; i < pos + len; ++i)
+        {
+            if (text[i] < '0' || text[i] > '9')
+                return std::nullopt;
+            v = v * 10 + static_cast<unsigned>(text[i] - '0');
+        }
+        return v;
+    };
+    const auto year  = digits(0, 4);
+    const auto month = digits(5, 2);
+    const auto day   = digits(8, 2);
+    if (!year || !month || !day || *month < 1 || *month > 12)
+        return std::nullopt;
+    if (*day < 1 || *day > days_in_month(*year, *month))
+        return std::nullopt;
+    return days_from_civil(CivilDate{ *year, *month, *day });
+}
+
+std::string format_iso_day(std::int64_t day)
+{
+    const auto date = civil_from_days(day);
+    char       buf[32];
+    std::snprintf(buf, sizeof(buf), "%04lld-%02u-%02u", static_cast<long long>(date.year), date.month,
+                  date.day);
+    return buf;
+}
+
+std::int64_t bucket_start(std::int64_t day, HistoryGranularity g)
+{
+    switch (g)
+    {
+    case HistoryGranularity::Week:
+    {
+        // 1970-01-01 was a Thursday, so Monday is day 4 of the week counted from it
+        const std::int64_t since_monday = ((day + 3) % 7 + 7) % 7;
+        return day - since_monday;
+    }
+    case HistoryGranularity::Month:
+    {
+        auto date = civil_from_days(day);
+        date.day  = 1;
+        return days_from_civil(date);
+    }
+    default:
+        return day;
+    }
+}
+
+std::vector<HistoryBucket> bucket_rollups(const std::vector<DailyRollup>& rollups, HistoryGranularity g)
+{
+    std::map<std::int64_t, HistoryBucket> buckets;
+    for (const auto& r : rollups)
+    {
+        if (r.trips == 0)
+            continue;
+        const auto start  = bucket_start(r.day, g);
+        auto&      bucket = buckets[start];
+        bucket.start_day  = start;
+        for (auto* totals : { &bucket.total, &bucket.modes[r.mode] })
+        {
+            totals->trips += r.trips;
+            totals->distance_km += r.distance_km;
+            totals->kg_co2 += r.kg_co2;
+        }
+    }
+    std::vector<HistoryBucket> out;
+    out.reserve(buckets.size());
+    for (auto& [start, bucket] : buckets)
+        out.push_back(std::move(bucket));
+    return out;
+}
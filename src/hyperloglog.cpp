@@ -0,0 +1,78 @@
+#include "hyperloglog.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+HyperLogLog::HyperLogLog(unsigned precision)
+    : precision_(std::clamp(precision, 4U, 18U)), registers_(std::size_t{ 1 } << precision_, 0)
+{
+}
+
+std::uint64_t HyperLogLog::hash(std::string_view key)
+{
+    std::uint64_t h = 14695981039346656037ULL;
+    for (const char c : key)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ULL;
+    }
+    // FNV-1a alone leaves the high bits, which pick the register, poorly mixed for short keys
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+void HyperLogLog::add(std::string_view key)
+{
+    const auto h     = hash(key);
+    const auto index = static_cast<std::size_t>(h >> (64 - precision_));
+    // Rank of the first set bit in the remaining 64 - p bits, 1-based
+    std::uint64_t rest = h << precision_;
+    std::uint8_t  rank = 1;
+    while (rank <= 64 - precision_ && (rest & (std::uint64_t{ 1 } << 63)) == 0)
+    {
+        ++rank;
+        rest <<= 1;
+    }
+    registers_[index] = std::max(registers_[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other)
+{
+    if (other.precision_ != precision_)
+        throw std::runtime_error("cannot merge HyperLogLog sketches of different precision");
+    for (std::size_t i = 0; i < registers_.size(); ++i)
+        registers_[i] = std::max(registers_[i], other.registers_[i]);
+}
+
+void HyperLogLog::clear()
+{
+    std::fill(registers_.begin(), registers_.end(), 0);
+}
+
+std::uint64_t HyperLogLog::estimate() const
+{
+    const auto  m     = static_cast<double>(registers_.size());
+    double      sum   = 0.0;
+    std::size_t zeros = 0;
+    for (const auto r : registers_)
+    {
+        sum += std::ldexp(1.0, -static_cast<int>(r));
+        zeros += r == 0 ? 1 : 0;
+    }
+    const double alpha = m >= 128 ? 0.7213 / (1 + 1.079 / m) : (m >= 64 ? 0.709 : (m >= 32 ? 0.697 : 0.673));
+    double       est   = alpha * m * m / sum;
+    // While registers are still empty, linear counting on the empty ones is more accurate
+    if (est <= 2.5 * m && zeros > 0)
+        est = m * std::log(m / static_cast<double>(zeros));
+    return static_cast<std::uint64_t>(std::llround(est));
+}
+
+double HyperLogLog::relative_error() const
+{
+    return 1.04 / std::sqrt(static_cast<double>(registers_.size()));
+}
@@ -0,0 +1,432 @@
+#include "json_backend.hpp"
+
+#include "history.hpp"
+
+#include <nlohmann/json.hpp>
+#include <utility>
+#ifdef CHARIZARD_WITH_SIMDJSON
+#include <algorithm>
+#include <cstring>
+#include <simdjson.h>
+#endif
+
+// The decoders below are written once against two backend hooks:
+//   for_each_field(fn) calls fn(key, reader) for each member of an object, in document order;
+//   the reader's string(), number() and integer() assign the member's value and return false if it
+//   has another type, throwing JsonSyntaxError if it is malformed.
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::runtime_error factor_error(std::size_t index, const std::string& what)
+{
+    return std::runtime_error("JSON parsing error: factor " + std::to_string(index) + ": " + what);
+}
+
+template <typename ForEachField>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static TransitBody decode_transit_fields(ForEachField&& for_each_field)
+{
+    TransitBody out;
+    std::string wrong_type;
+    for_each_field(
+        [&](std::string_view key, auto& read)
+        {
+            bool ok = true;
+            if (key == "mode")
+            {
+                out.has_mode = true;
+                ok           = read.string(out.mode);
+            }
+            else if (key == "distance_km")
+            {
+                out.has_distance = true;
+                ok               = read.number(out.distance_km);
+            }
+            else if (key == "ts")
+                ok = read.integer(out.ts);
+            else if (key == "fuel_type")
+                ok = read.string(out.fuel_type);
+            else if (key == "vehicle_size")
+                ok = read.string(out.vehicle_size);
+            else if (key == "occupancy")
+                ok = read.number(out.occupancy);
+            else if (key == "region")
+                ok = read.string(out.region);
+            if (!ok && wrong_type.empty())
+                wrong_type = key;
+        });
+    if (!wrong_type.empty() && out.has_mode && out.has_distance)
+        throw JsonShapeError("'" + wrong_type + "' has the wrong type");
+    return out;
+}
+
+template <typename ForEachField>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::optional<std::string> decode_register_fields(ForEachField&& for_each_field)
+{
+    std::optional<std::string> app_name;
+    for_each_field(
+        [&](std::string_view key, auto& read)
+        {
+            if (key != "app_name")
+                return;
+            std::string value;
+            app_name = read.string(value) ? std::optional<std::string>(std::move(value)) : std::nullopt;
+        });
+    return app_name;
+}
+
+template <typename ForEachField>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static EmissionFactor decode_factor_fields(std::size_t index, ForEachField&& for_each_field)
+{
+    EmissionFactor f;
+    f.source        = "UNKNOWN";
+    f.updated_at    = 0;
+    bool has_mode   = false;
+    bool has_kg_co2 = false;
+    for_each_field(
+        [&](std::string_view key, auto& read)
+        {
+            bool ok = true;
+            if (key == "mode")
+            {
+                has_mode = true;
+                ok       = read.string(f.mode);
+            }
+            else if (key == "kg_co2_per_km")
+            {
+                has_kg_co2 = true;
+                ok         = read.number(f.kg_co2_per_km);
+            }
+            else if (key == "fuel_type")
+                ok = read.string(f.fuel_type);
+            else if (key == "vehicle_size")
+                ok = read.string(f.vehicle_size);
+            else if (key == "source")
+                ok = read.string(f.source);
+            else if (key == "updated_at")
+                ok = read.integer(f.updated_at);
+            else if (key == "region")
+                ok = read.string(f.region);
+            else if (key == "valid_from" || key == "valid_until")
+            {
+                std::string date;
+                ok = read.string(date);
+                const auto day = ok ? parse_iso_day(date) : std::nullopt;
+                if (ok && !day)
+                    throw factor_error(index, "'" + std::string(key) + "' is not a YYYY-MM-DD date");
+                if (day)
+                    (key == "valid_from" ? f.valid_from : f.valid_until) = *day * 86400;
+            }
+            if (!ok)
+                throw factor_error(index, "'" + std::string(key) + "' has the wrong type");
+        });
+    if (!has_mode)
+        throw factor_error(index, "missing 'mode'");
+    if (!has_kg_co2)
+        throw factor_error(index, "missing 'kg_co2_per_km'");
+    return f;
+}
+
+// ----- nlohmann::json -----
+// Always built: it is the default backend, and the simdjson one uses it to classify documents
+// whose root isn't what the caller expects.
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static nlohmann::json parse_nlohmann(std::string_view text)
+{
+    try
+    {
+        return nlohmann::json::parse(text);
+    }
+    catch (const nlohmann::json::parse_error& e)
+    {
+        throw JsonSyntaxError(e.what());
+    }
+}
+
+struct NlohmannReader
+{
+    const nlohmann::json& value;
+
+    bool string(std::string& to) const
+    {
+        if (!value.is_string())
+            return false;
+        to = value.get_ref<const std::string&>();
+        return true;
+    }
+    bool number(double& to) const
+    {
+        if (!value.is_number())
+            return false;
+        to = value.get<double>();
+        return true;
+    }
+    bool integer(std::int64_t& to) const
+    {
+        if (!value.is_number())
+            return false;
+        to = value.get<std::int64_t>();
+        return true;
+    }
+};
+
+#ifndef CHARIZARD_WITH_SIMDJSON
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static auto nlohmann_fields(const nlohmann::json& object)
+{
+    return [&object](auto&& fn)
+    {
+        if (!object.is_object())
+            return;
+        for (const auto& item : object.items())
+        {
+            NlohmannReader read{ item.value() };
+            fn(std::string_view(item.key()), read);
+        }
+    };
+}
+
+const char* json_backend_name()
+{
+    return "nlohmann";
+}
+
+TransitBody decode_transit_body(std::string_view text)
+{
+    const auto doc = parse_nlohmann(text);
+    return decode_transit_fields(nlohmann_fields(doc));
+}
+
+std::optional<std::string> decode_register_body(std::string_view text)
+{
+    const auto doc = parse_nlohmann(text);
+    return decode_register_fields(nlohmann_fields(doc));
+}
+
+std::vector<EmissionFactor> decode_factors(std::string_view text)
+{
+    nlohmann::json doc;
+    try
+    {
+        doc = parse_nlohmann(text);
+    }
+    catch (const JsonSyntaxError& e)
+    {
+        throw std::runtime_error(std::string("JSON parsing error: ") + e.what());
+    }
+    if (!doc.is_array())
+        throw std::runtime_error("Expected JSON array of factors");
+
+    std::vector<EmissionFactor> factors;
+    factors.reserve(doc.size());
+    for (const auto& item : doc)
+    {
+        if (!item.is_object())
+            throw std::runtime_error("Each factor item must be a JSON object");
+        factors.push_back(decode_factor_fields(factors.size(), nlohmann_fields(item)));
+    }
+    return factors;
+}
+
+#else // CHARIZARD_WITH_SIMDJSON
+
+namespace od = simdjson::ondemand;
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+[[noreturn]] static void throw_syntax(simdjson::error_code err)
+{
+    throw JsonSyntaxError(simdjson::error_message(err));
+}
+
+// simdjson reads up to SIMDJSON_PADDING bytes past the end of the text, so documents are copied into
+// a per-thread buffer with room for that. The parser's own buffers are reused the same way; a
+// thread must finish with one document before starting the next.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static od::document iterate(std::string_view text)
+{
+    thread_local std::vector<char> buffer;
+    thread_local od::parser        parser;
+    buffer.resize(std::max(buffer.size(), text.size() + simdjson::SIMDJSON_PADDING));
+    std::memcpy(buffer.data(), text.data(), text.size());
+    od::document doc;
+    if (auto err = parser.iterate(buffer.data(), text.size(), buffer.size()).get(doc))
+        throw_syntax(err);
+    return doc;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static od::json_type root_type(od::document& doc)
+{
+    od::json_type type{};
+    if (auto err = doc.type().get(type))
+        throw_syntax(err);
+    return type;
+}
+
+struct SimdjsonReader
+{
+    od::value& value;
+
+    bool string(std::string& to)
+    {
+        std::string_view s;
+        const auto       err = value.get_string().get(s);
+        if (err == simdjson::SUCCESS)
+            to.assign(s.data(), s.size());
+        return accept(err);
+    }
+    bool number(double& to)
+    {
+        return accept(value.get_double().get(to));
+    }
+    // nlohmann::json truncates a fractional number read as an integer; so does this.
+    bool integer(std::int64_t& to)
+    {
+        auto err = value.get_int64().get(to);
+        if (err != simdjson::INCORRECT_TYPE && err != simdjson::NUMBER_OUT_OF_RANGE)
+            return accept(err);
+        double d = 0.0;
+        err      = value.get_double().get(d);
+        if (err == simdjson::SUCCESS && (d < -0x1p63 || d >= 0x1p63))
+            return false;
+        if (err == simdjson::SUCCESS)
+            to = static_cast<std::int64_t>(d);
+        return accept(err);
+    }
+
+    // On INCORRECT_TYPE the value is read as what it is, so that a malformed one is still reported
+    // as a syntax error. Objects and arrays are taken on trust.
+    bool accept(simdjson::error_code err)
+    {
+        if (err == simdjson::SUCCESS)
+            return true;
+        if (err != simdjson::INCORRECT_TYPE)
+            throw_syntax(err);
+        od::json_type type{};
+        if ((err = value.type().get(type)))
+            throw_syntax(err);
+        std::string_view s;
+        double           d = 0.0;
+        bool             b = false;
+        switch (type)
+        {
+        case od::json_type::string:
+            err = value.get_string().get(s);
+            break;
+        case od::json_type::number:
+            err = value.get_double().get(d);
+            break;
+        case od::json_type::boolean:
+            err = value.get_bool().get(b);
+            break;
+        case od::json_type::null:
+            err = value.is_null().get(b);
+            if (err == simdjson::SUCCESS && !b)
+                err = simdjson::N_ATOM_ERROR;
+            break;
+        default:
+            break;
+        }
+        if (err)
+            throw_syntax(err);
+        return false;
+    }
+};
+
+template <typename Fn>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void simdjson_fields(od::object& object, Fn&& fn)
+{
+    for (auto member : object)
+    {
+        od::field field;
+        if (auto err = std::move(member).get(field))
+            throw_syntax(err);
+        std::string_view key;
+        if (auto err = field.unescaped_key().get(key))
+            throw_syntax(err);
+        SimdjsonReader read{ field.value() };
+        fn(key, read);
+    }
+}
+
+// Runs `decode` over the root object's fields, or, for any other root, over no fields once the
+// document is known to be valid JSON.
+template <typename Decode>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static auto decode_root_object(std::string_view text, Decode&& decode)
+{
+    auto doc = iterate(text);
+    if (root_type(doc) != od::json_type::object)
+    {
+        (void)parse_nlohmann(text);
+        return decode([](auto&&) {});
+    }
+    od::object object;
+    if (auto err = doc.get_object().get(object))
+        throw_syntax(err);
+    auto result = decode([&](auto&& fn) { simdjson_fields(object, fn); });
+    if (!doc.at_end())
+        throw JsonSyntaxError("unexpected content after the JSON document");
+    return result;
+}
+
+const char* json_backend_name()
+{
+    return "simdjson";
+}
+
+TransitBody decode_transit_body(std::string_view text)
+{
+    return decode_root_object(text, [](auto&& fields) { return decode_transit_fields(fields); });
+}
+
+std::optional<std::string> decode_register_body(std::string_view text)
+{
+    return decode_root_object(text, [](auto&& fields) { return decode_register_fields(fields); });
+}
+
+std::vector<EmissionFactor> decode_factors(std::string_view text)
+{
+    try
+    {
+        auto doc = iterate(text);
+        if (root_type(doc) != od::json_type::array)
+        {
+            (void)parse_nlohmann(text);
+            throw std::runtime_error("Expected JSON array of factors");
+        }
+        od::array array;
+        if (auto err = doc.get_array().get(array))
+            throw_syntax(err);
+
+        std::vector<EmissionFactor> factors;
+        for (auto element : array)
+        {
+            od::value  item;
+            od::object object;
+            if (auto err = std::move(element).get(item))
+                throw_syntax(err);
+            if (auto err = item.get_object().get(object))
+            {
+                if (err != simdjson::INCORRECT_TYPE)
+                    throw_syntax(err);
+                throw std::runtime_error("Each factor item must be a JSON object");
+            }
+            factors.push_back(decode_factor_fields(
+                factors.size(), [&](auto&& fn) { simdjson_fields(object, fn); }));
+        }
+        if (!doc.at_end())
+            throw JsonSyntaxError("unexpected content after the JSON document");
+        return factors;
+    }
+    catch (const JsonSyntaxError& e)
+    {
+        throw std::runtime_error(std::string("JSON parsing error: ") + e.what());
+    }
+}
+
+#endif // CHARIZARD_WITH_SIMDJSON
@@ -0,0 +1,220 @@
+#include "json_writer.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <nlohmann/json.hpp>
+
+// Writes `d` (finite) at `out` in dump()'s layout, with the shortest digits that read back as `d`:
+// plain decimals while the exponent is between -4 and 14, integral values ending in ".0", and
+// d.ddde+XX otherwise. Returns the end of what was written; `out` needs 32 bytes.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static char* format_double(char* out, double d)
+{
+    // Scientific to_chars gives the digits and exponent, "[-]d[.ddd]e[+-]XX"
+    char        sci[32];
+    const auto  res = std::to_chars(sci, sci + sizeof(sci), d, std::chars_format::scientific);
+    const char* p   = sci;
+    if (*p == '-')
+        *out++ = *p++;
+    char digits[20];
+    int  k = 0; // number of digits
+    for (; *p != 'e'; ++p)
+    {
+        if (*p != '.')
+            digits[k++] = *p;
+    }
+    int exp10 = 0;
+    std::from_chars(p + 2, res.ptr, exp10);
+    const int n = (p[1] == '-' ? -exp10 : exp10) + 1; // d = 0.digits x 10^n
+
+    if (k <= n && n <= 15)
+    {
+        // 1234e7 -> 12340000000.0
+        std::memcpy(out, digits, static_cast<std::size_t>(k));
+        out    = std::fill_n(out + k, n - k, '0');
+        *out++ = '.';
+        *out++ = '0';
+        return out;
+    }
+    if (0 < n && n <= 15)
+    {
+        // 1234e-2 -> 12.34
+        std::memcpy(out, digits, static_cast<std::size_t>(n));
+        out += n;
+        *out++ = '.';
+        std::memcpy(out, digits + n, static_cast<std::size_t>(k - n));
+        return out + (k - n);
+    }
+    if (-4 < n && n <= 0)
+    {
+        // 1234e-6 -> 0.001234
+        *out++ = '0';
+        *out++ = '.';
+        out    = std::fill_n(out, -n, '0');
+        std::memcpy(out, digits, static_cast<std::size_t>(k));
+        return out + k;
+    }
+    // 1e+21, 1.234e-05: at least two exponent digits
+    *out++ = digits[0];
+    if (k > 1)
+    {
+        *out++ = '.';
+        std::memcpy(out, digits + 1, static_cast<std::size_t>(k - 1));
+        out += k - 1;
+    }
+    const int e = n - 1;
+    *out++      = 'e';
+    *out++      = e < 0 ? '-' : '+';
+    const int a = e < 0 ? -e : e;
+    if (a < 10)
+        *out++ = '0';
+    return std::to_chars(out, out + 4, a).ptr;
+}
+
+void JsonWriter::separate()
+{
+    if (after_key_)
+        after_key_ = false;
+    else if (!first_)
+        out_ += ',';
+    first_ = false;
+}
+
+JsonWriter& JsonWriter::begin_object()
+{
+    separate();
+    out_ += '{';
+    first_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_object()
+{
+    out_ += '}';
+    first_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_array()
+{
+    separate();
+    out_ += '[';
+    first_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_array()
+{
+    out_ += ']';
+    first_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view k)
+{
+    separate();
+    write_string(k);
+    out_ += ':';
+    after_key_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(std::string_view s)
+{
+    separate();
+    write_string(s);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double d)
+{
+    separate();
+    if (!std::isfinite(d))
+    {
+        out_ += "null";
+        return *this;
+    }
+    char buf[32];
+    out_.append(buf, format_double(buf, d));
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool b)
+{
+    separate();
+    out_ += b ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::null()
+{
+    separate();
+    out_ += "null";
+    return *this;
+}
+
+// The escapes dump() uses with ensure_ascii off: the short forms where JSON has them, \u00xx
+// (lower-case hex) for other control characters, everything else as is.
+void JsonWriter::write_string(std::string_view s)
+{
+    const auto start = out_.size();
+    out_ += '"';
+    std::size_t plain = 0; // start of the run of characters not yet copied
+    for (std::size_t i = 0; i < s.size(); ++i)
+    {
+        const auto c = static_cast<unsigned char>(s[i]);
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+            continue;
+        if (c >= 0x80)
+        {
+            // dump() validates UTF-8 and throws on bad input; leave that to it
+            out_.resize(start);
+            out_ += nlohmann::json(std::string(s)).dump();
+            return;
+        }
+        out_.append(s.data() + plain, i - plain);
+        plain = i + 1;
+        switch (c)
+        {
+        case '"':
+            out_ += "\\\"";
+            break;
+        case '\\':
+            out_ += "\\\\";
+            break;
+        case '\b':
+            out_ += "\\b";
+            break;
+        case '\f':
+            out_ += "\\f";
+            break;
+        case '\n':
+            out_ += "\\n";
+            break;
+        case '\r':
+            out_ += "\\r";
+            break;
+        case '\t':
+            out_ += "\\t";
+            break;
+        default:
+        {
+            static constexpr char k_hex[] = "0123456789abcdef";
+            out_ += "\\u00";
+            out_ += k_hex[c >> 4];
+            out_ += k_hex[c & 0xF];
+        }
+        }
+    }
+    out_.append(s.data() + plain, s.size() - plain);
+    out_ += '"';
+}
+
+std::string& response_buffer()
+{
+    thread_local std::string buffer;
+    buffer.clear();
+    return buffer;
+}
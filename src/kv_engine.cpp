@@ -0,0 +1,794 @@
+#include "kv_engine.hpp"
+#include "file_io.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+/*
+ * Table file layout (integers little-endian):
+ *
+ *   magic "CHZSST01"
+ *   entries  sorted by key: u32 key length, u32 value length (0xFFFFFFFF = delete), key, value
+ *   index    u32 count, then every k_index_interval-th entry: u32 key length, key, u64 offset
+ *   bloom    u8 hash count, bit array
+ *   footer   u64 index offset, u64 bloom offset, u64 entry count,
+ *            u64 first input id, u64 WAL generation, u32 crc of everything above, magic
+ *
+ * "first input id" is the oldest table a merged table replaced; on open, any older file in
+ * that range is a leftover from a merge that did not finish cleaning up. "WAL generation" is
+ * the newest log segment whose records the table contains.
+ */
+
+static constexpr char          k_table_magic[8]   = { 'C', 'H', 'Z', 'S', 'S', 'T', '0', '1' };
+static constexpr std::size_t   k_footer_bytes     = 5 * 8 + 4 + sizeof k_table_magic;
+static constexpr std::size_t   k_index_interval   = 16;
+static constexpr std::size_t   k_bloom_bits_per   = 10;
+static constexpr std::uint8_t  k_bloom_hashes     = 6;
+static constexpr std::uint32_t k_tombstone        = 0xFFFFFFFFU;
+static constexpr std::uint8_t  k_wal_batch_record = 1;
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void put_le(std::string& out, std::uint64_t v, std::size_t width)
+{
+    for (std::size_t i = 0; i < width; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xFFU));
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::uint64_t get_le(const char* p, std::size_t width)
+{
+    std::uint64_t v = 0;
+    for (std::size_t i = width; i-- > 0;)
+        v = (v << 8) | static_cast<std::uint8_t>(p[i]);
+    return v;
+}
+
+// FNV-1a; stable across builds, unlike std::hash, because the bloom filter is stored on disk.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::uint64_t fnv1a(std::string_view s)
+{
+    std::uint64_t h = 14695981039346656037ULL;
+    for (const char c : s)
+    {
+        h ^= static_cast<std::uint8_t>(c);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Double hashing: probe i is h1 + i * h2.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::pair<std::uint64_t, std::uint64_t> bloom_hashes(std::string_view key)
+{
+    const auto h = fnv1a(key);
+    return { h, (h >> 33) | 1U };
+}
+
+// ===== KvBatch =====
+
+void KvBatch::put(std::string_view key, std::string_view value)
+{
+    ops_.emplace_back(std::string(key), std::string(value));
+}
+
+void KvBatch::erase(std::string_view key)
+{
+    ops_.emplace_back(std::string(key), std::nullopt);
+}
+
+// ===== SortedTable =====
+
+// Streams sorted entries into a new table file.
+class TableBuilder
+{
+  public:
+    explicit TableBuilder(const std::string& path) : out_(path)
+    {
+        write(std::string_view(k_table_magic, sizeof k_table_magic));
+    }
+
+    void add(std::string_view key, const std::optional<std::string_view>& value)
+    {
+        if (count_ % k_index_interval == 0)
+            index_.emplace_back(std::string(key), out_.offset());
+        hashes_.push_back(bloom_hashes(key));
+        std::string header;
+        put_le(header, key.size(), 4);
+        put_le(header, value ? value->size() : k_tombstone, 4);
+        write(header);
+        write(key);
+        if (value)
+            write(*value);
+        count_++;
+    }
+
+    void finish(std::uint64_t first_input_id, std::uint64_t wal_generation)
+    {
+        const auto  index_offset = out_.offset();
+        std::string index;
+        put_le(index, index_.size(), 4);
+        for (const auto& [key, offset] : index_)
+        {
+            put_le(index, key.size(), 4);
+            index += key;
+            put_le(index, offset, 8);
+        }
+        write(index);
+
+        const auto  bloom_offset = out_.offset();
+        const auto  min_bits     = std::max<std::size_t>(64, hashes_.size() * k_bloom_bits_per);
+        const auto  n_bits       = (min_bits + 7) / 8 * 8;
+        std::string bloom(1 + n_bits / 8, '\0');
+        bloom[0] = static_cast<char>(k_bloom_hashes);
+        for (const auto& [h1, h2] : hashes_)
+        {
+            for (std::uint8_t i = 0; i < k_bloom_hashes; ++i)
+            {
+                const auto bit = (h1 + i * h2) % n_bits;
+                bloom[1 + bit / 8] |= static_cast<char>(1U << (bit % 8));
+            }
+        }
+        write(bloom);
+
+        std::string footer;
+        put_le(footer, index_offset, 8);
+        put_le(footer, bloom_offset, 8);
+        put_le(footer, count_, 8);
+        put_le(footer, first_input_id, 8);
+        put_le(footer, wal_generation, 8);
+        write(footer);
+        footer.clear();
+        put_le(footer, crc_, 4);
+        footer.append(k_table_magic, sizeof k_table_magic);
+        out_.write(footer);
+        out_.commit();
+    }
+
+  private:
+    void write(std::string_view data)
+    {
+        crc_ = wal_crc32(data, crc_);
+        out_.write(data);
+    }
+
+    AtomicFileWriter                                     out_;
+    std::uint32_t                                        crc_   = 0;
+    std::uint64_t                                        count_ = 0;
+    std::vector<std::pair<std::string, std::uint64_t>>   index_;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> hashes_;
+};
+
+// An open, immutable table file.
+class SortedTable
+{
+  public:
+    struct Entry
+    {
+        std::string_view                key;
+        std::optional<std::string_view> value; // nullopt = delete
+        std::size_t                     next = 0;
+    };
+
+    SortedTable(std::string path, std::uint64_t id) : path_(std::move(path)), id_(id)
+    {
+        if (!file_.open(path_))
+            throw std::runtime_error("table " + path_ + " disappeared");
+        data_ = file_.bytes();
+        if (data_.size() < sizeof k_table_magic + k_footer_bytes ||
+            data_.compare(0, sizeof k_table_magic, k_table_magic, sizeof k_table_magic) != 0 ||
+            data_.compare(data_.size() - sizeof k_table_magic, sizeof k_table_magic, k_table_magic,
+                          sizeof k_table_magic) != 0)
+            throw corrupt("bad header or footer");
+
+        const char* footer   = data_.data() + data_.size() - k_footer_bytes;
+        const auto  checksum = static_cast<std::uint32_t>(get_le(footer + 40, 4));
+        if (wal_crc32(data_.substr(0, data_.size() - 4 - sizeof k_table_magic)) != checksum)
+            throw corrupt("checksum mismatch");
+
+        const auto index_offset = get_le(footer, 8);
+        const auto bloom_offset = get_le(footer + 8, 8);
+        first_input_id_         = get_le(footer + 24, 8);
+        wal_generation_         = get_le(footer + 32, 8);
+        const auto footer_start = data_.size() - k_footer_bytes;
+        if (index_offset < sizeof k_table_magic || index_offset > bloom_offset ||
+            bloom_offset >= footer_start)
+            throw corrupt("bad section offsets");
+        data_end_ = static_cast<std::size_t>(index_offset);
+        bloom_    = data_.substr(bloom_offset, footer_start - bloom_offset);
+
+        auto       pos  = static_cast<std::size_t>(index_offset);
+        const auto need = [&](std::size_t n)
+        {
+            if (pos + n > bloom_offset)
+                throw corrupt("index overruns its section");
+        };
+        need(4);
+        const auto count = get_le(data_.data() + pos, 4);
+        pos += 4;
+        index_.reserve(static_cast<std::size_t>(count));
+        for (std::uint64_t i = 0; i < count; ++i)
+        {
+            need(4);
+            const auto klen = static_cast<std::size_t>(get_le(data_.data() + pos, 4));
+            need(4 + klen + 8);
+            const auto key    = data_.substr(pos + 4, klen);
+            const auto offset = static_cast<std::size_t>(get_le(data_.data() + pos + 4 + klen, 8));
+            if (offset < sizeof k_table_magic || offset >= data_end_)
+                throw corrupt("index points outside the entries");
+            index_.emplace_back(key, offset);
+            pos += 4 + klen + 8;
+        }
+    }
+
+    std::uint64_t id() const
+    {
+        return id_;
+    }
+
+    std::uint64_t first_input_id() const
+    {
+        return first_input_id_;
+    }
+
+    std::uint64_t wal_generation() const
+    {
+        return wal_generation_;
+    }
+
+    const std::string& path() const
+    {
+        return path_;
+    }
+
+    // Offset of the first entry, for full iteration.
+    std::size_t begin() const
+    {
+        return sizeof k_table_magic;
+    }
+
+    // Offset of the first entry whose key is >= `key`, or end().
+    std::size_t seek(std::string_view key) const
+    {
+        // Last indexed entry with key <= `key`, then walk at most one interval
+        auto it = std::upper_bound(index_.begin(), index_.end(), key,
+                                   [](std::string_view k, const auto& e) { return k < e.first; });
+        std::size_t pos = it == index_.begin() ? begin() : std::prev(it)->second;
+        while (pos < data_end_)
+        {
+            const auto e = entry_at(pos);
+            if (e.key >= key)
+                break;
+            pos = e.next;
+        }
+        return pos;
+    }
+
+    std::size_t end() const
+    {
+        return data_end_;
+    }
+
+    Entry entry_at(std::size_t pos) const
+    {
+        if (pos + 8 > data_end_)
+            throw corrupt("entry header overruns the table");
+        const auto klen = static_cast<std::size_t>(get_le(data_.data() + pos, 4));
+        const auto vlen = static_cast<std::uint32_t>(get_le(data_.data() + pos + 4, 4));
+        const auto vsz  = vlen == k_tombstone ? 0 : static_cast<std::size_t>(vlen);
+        if (pos + 8 + klen + vsz > data_end_)
+            throw corrupt("entry overruns the table");
+        Entry e;
+        e.key = data_.substr(pos + 8, klen);
+        if (vlen != k_tombstone)
+            e.value = data_.substr(pos + 8 + klen, vsz);
+        e.next = pos + 8 + klen + vsz;
+        return e;
+    }
+
+    bool may_contain(std::string_view key) const
+    {
+        if (bloom_.size() < 2)
+            return true;
+        const auto n_hashes = static_cast<std::uint8_t>(bloom_[0]);
+        const auto n_bits   = (bloom_.size() - 1) * 8;
+        const auto [h1, h2] = bloom_hashes(key);
+        for (std::uint8_t i = 0; i < n_hashes; ++i)
+        {
+            const auto bit = (h1 + i * h2) % n_bits;
+            if ((static_cast<std::uint8_t>(bloom_[1 + bit / 8]) & (1U << (bit % 8))) == 0)
+                return false;
+        }
+        return true;
+    }
+
+    // True if the table has an entry for `key` (possibly a delete, reported as nullopt).
+    bool find(std::string_view key, std::optional<std::string_view>& value) const
+    {
+        if (!may_contain(key))
+            return false;
+        const auto pos = seek(key);
+        if (pos >= data_end_)
+            return false;
+        const auto e = entry_at(pos);
+        if (e.key != key)
+            return false;
+        value = e.value;
+        return true;
+    }
+
+  private:
+    std::runtime_error corrupt(const std::string& why) const
+    {
+        return std::runtime_error("table " + path_ + " is corrupt: " + why);
+    }
+
+    std::string                                           path_;
+    std::uint64_t                                         id_;
+    std::uint64_t                                         first_input_id_ = 0;
+    std::uint64_t                                         wal_generation_ = 0;
+    MappedFile                                            file_;
+    std::string_view                                      data_;
+    std::size_t                                           data_end_ = 0;
+    std::string_view                                      bloom_;
+    std::vector<std::pair<std::string_view, std::size_t>> index_;
+};
+
+// ===== Merging =====
+
+// One sorted input to a merge: either a memtable slice or a table.
+class MergeSource
+{
+  public:
+    explicit MergeSource(const std::vector<std::pair<std::string, std::optional<std::string>>>* rows)
+        : rows_(rows)
+    {
+    }
+
+    MergeSource(const SortedTable* table, std::string_view start) : table_(table), pos_(table->seek(start))
+    {
+        load();
+    }
+
+    bool valid() const
+    {
+        return table_ != nullptr ? pos_ < table_->end() : row_ < rows_->size();
+    }
+
+    std::string_view key() const
+    {
+        return table_ != nullptr ? entry_.key : std::string_view((*rows_)[row_].first);
+    }
+
+    std::optional<std::string_view> value() const
+    {
+        if (table_ != nullptr)
+            return entry_.value;
+        const auto& v = (*rows_)[row_].second;
+        return v ? std::optional<std::string_view>(*v) : std::nullopt;
+    }
+
+    void next()
+    {
+        if (table_ == nullptr)
+        {
+            row_++;
+            return;
+        }
+        pos_ = entry_.next;
+        load();
+    }
+
+  private:
+    void load()
+    {
+        if (pos_ < table_->end())
+            entry_ = table_->entry_at(pos_);
+    }
+
+    const std::vector<std::pair<std::string, std::optional<std::string>>>* rows_  = nullptr;
+    std::size_t                                                            row_   = 0;
+    const SortedTable*                                                     table_ = nullptr;
+    std::size_t                                                            pos_   = 0;
+    SortedTable::Entry                                                     entry_;
+};
+
+// Walks `sources` (newest first) in key order, reporting each key once with its newest value
+// (nullopt for deletes) until `end` (empty = unbounded) or until `emit` returns false.
+template <typename Emit>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void merge_sources(std::vector<MergeSource>& sources, std::string_view end, Emit emit)
+{
+    for (;;)
+    {
+        const MergeSource* newest = nullptr;
+        for (const auto& src : sources)
+        {
+            if (src.valid() && (newest == nullptr || src.key() < newest->key()))
+                newest = &src;
+        }
+        if (newest == nullptr || (!end.empty() && newest->key() >= end))
+            return;
+
+        const std::string key(newest->key());
+        const bool        keep_going = emit(std::string_view(key), newest->value());
+        for (auto& src : sources)
+        {
+            if (src.valid() && src.key() == key)
+                src.next();
+        }
+        if (!keep_going)
+            return;
+    }
+}
+
+// ===== KvEngine =====
+
+KvEngine::KvEngine(std::string dir, const KvOptions& opts) : dir_(std::move(dir)), opts_(opts)
+{
+    recover();
+    compactor_ = std::thread([this] { compaction_loop(); });
+}
+
+KvEngine::~KvEngine()
+{
+    {
+        std::scoped_lock lk(mu_);
+        stopping_ = true;
+    }
+    compact_cv_.notify_all();
+    if (compactor_.joinable())
+        compactor_.join();
+}
+
+std::string KvEngine::table_path(std::uint64_t id) const
+{
+    return (std::filesystem::path(dir_) / (std::to_string(id) + ".sst")).string();
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void apply_batch_record(std::string_view payload,
+                               std::map<std::string, std::optional<std::string>, std::less<>>& memtable,
+                               std::size_t& memtable_bytes)
+{
+    WalDecoder dec(payload);
+    for (auto n = dec.u32(); n > 0; --n)
+    {
+        const bool has_value = dec.u8() != 0;
+        auto       key       = dec.str();
+        memtable_bytes += key.size() + 32;
+        if (has_value)
+        {
+            auto value = dec.str();
+            memtable_bytes += value.size();
+            memtable[std::move(key)] = std::move(value);
+        }
+        else
+            memtable[std::move(key)] = std::nullopt;
+    }
+}
+
+void KvEngine::recover()
+{
+    namespace fs = std::filesystem;
+    fs::create_directories(dir_);
+
+    std::vector<std::shared_ptr<const SortedTable>> found;
+    for (const auto& entry : fs::directory_iterator(dir_))
+    {
+        const auto name = entry.path().filename().string();
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+        {
+            fs::remove(entry.path()); // a flush or merge that never committed
+            continue;
+        }
+        if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".sst") != 0)
+            continue;
+        const auto stem = name.substr(0, name.size() - 4);
+        if (stem.find_first_not_of("0123456789") != std::string::npos)
+            continue;
+        found.push_back(std::make_shared<const SortedTable>(entry.path().string(), std::stoull(stem)));
+    }
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a->id() < b->id(); });
+
+    // Drop inputs of merges whose output was installed but whose cleanup did not finish
+    std::uint64_t wal_covered = 0;
+    for (const auto& t : found)
+    {
+        next_id_    = std::max(next_id_, t->id() + 1);
+        wal_covered = std::max(wal_covered, t->wal_generation());
+        const bool superseded =
+            std::any_of(found.begin(), found.end(), [&t](const auto& u)
+                        { return u->id() > t->id() && u->first_input_id() <= t->id(); });
+        if (superseded)
+            fs::remove(t->path());
+        else
+            tables_.push_back(t);
+    }
+
+    const auto wal_path = (fs::path(dir_) / "wal").string();
+    const auto apply    = [this](std::uint8_t type, std::string_view payload)
+    {
+        if (type != k_wal_batch_record)
+            throw std::runtime_error("unknown KV log record type " + std::to_string(type));
+        apply_batch_record(payload, memtable_, memtable_bytes_);
+    };
+    for (const auto& [generation, segment] : list_wal_segments(wal_path))
+    {
+        next_id_ = std::max(next_id_, generation + 1);
+        if (generation <= wal_covered)
+            fs::remove(segment);
+        else
+            WriteAheadLog::replay_file(segment, apply);
+    }
+    wal_ = std::make_unique<WriteAheadLog>(wal_path, opts_.wal, apply);
+}
+
+void KvEngine::write(const KvBatch& batch)
+{
+    if (batch.empty())
+        return;
+    WalEncoder enc;
+    enc.put_u32(static_cast<std::uint32_t>(batch.ops_.size()));
+    for (const auto& [key, value] : batch.ops_)
+    {
+        enc.put_u8(value ? 1 : 0);
+        enc.put_str(key);
+        if (value)
+            enc.put_str(*value);
+    }
+
+    std::uint64_t seq      = 0;
+    std::uint64_t flush_id = 0;
+    {
+        std::scoped_lock lk(mu_);
+        seq = wal_->append(k_wal_batch_record, enc.bytes());
+        for (const auto& [key, value] : batch.ops_)
+        {
+            memtable_bytes_ += key.size() + (value ? value->size() : 0) + 32;
+            memtable_[key] = value;
+        }
+        // While an earlier memtable is still being written, this one keeps growing
+        if (memtable_bytes_ >= opts_.memtable_bytes && !sealed_)
+            flush_id = seal_memtable_locked();
+    }
+    if (flush_id != 0)
+        write_sealed(flush_id);
+    wal_->wait_durable(seq);
+}
+
+void KvEngine::put(std::string_view key, std::string_view value)
+{
+    KvBatch b;
+    b.put(key, value);
+    write(b);
+}
+
+void KvEngine::erase(std::string_view key)
+{
+    KvBatch b;
+    b.erase(key);
+    write(b);
+}
+
+std::optional<std::string> KvEngine::get(std::string_view key) const
+{
+    Tables tables;
+    {
+        std::scoped_lock lk(mu_);
+        auto             it = memtable_.find(key);
+        if (it != memtable_.end())
+            return it->second;
+        if (sealed_)
+        {
+            it = sealed_->find(key);
+            if (it != sealed_->end())
+                return it->second;
+        }
+        tables = tables_;
+    }
+    for (auto it = tables.rbegin(); it != tables.rend(); ++it)
+    {
+        std::optional<std::string_view> value;
+        if ((*it)->find(key, value))
+            return value ? std::optional<std::string>(*value) : std::nullopt;
+    }
+    return std::nullopt;
+}
+
+void KvEngine::scan(std::string_view start, std::string_view end, const Visitor& visit) const
+{
+    // Copy the memtable slice and pin the sealed memtable and the tables, then merge without
+    // holding the lock
+    std::vector<std::pair<std::string, std::optional<std::string>>> rows;
+    std::vector<std::pair<std::string, std::optional<std::string>>> sealed_rows;
+    std::shared_ptr<const Memtable>                                 sealed;
+    Tables                                                          tables;
+    {
+        std::scoped_lock lk(mu_);
+        auto             last = end.empty() ? memtable_.end() : memtable_.lower_bound(end);
+        for (auto it = memtable_.lower_bound(start); it != last; ++it)
+            rows.emplace_back(it->first, it->second);
+        sealed = sealed_;
+        tables = tables_;
+    }
+    if (sealed)
+    {
+        auto last = end.empty() ? sealed->end() : sealed->lower_bound(end);
+        for (auto it = sealed->lower_bound(start); it != last; ++it)
+            sealed_rows.emplace_back(it->first, it->second);
+    }
+
+    std::vector<MergeSource> sources;
+    sources.reserve(tables.size() + 2);
+    sources.emplace_back(&rows);
+    sources.emplace_back(&sealed_rows);
+    for (auto it = tables.rbegin(); it != tables.rend(); ++it)
+        sources.emplace_back(it->get(), start);
+
+    merge_sources(sources, end,
+                  [&visit](std::string_view key, const std::optional<std::string_view>& value)
+                  { return !value || visit(key, *value); });
+}
+
+void KvEngine::scan_prefix(std::string_view prefix, const Visitor& visit) const
+{
+    // Smallest key greater than every key with this prefix
+    std::string end(prefix);
+    while (!end.empty() && static_cast<std::uint8_t>(end.back()) == 0xFFU)
+        end.pop_back();
+    if (!end.empty())
+        end.back() = static_cast<char>(static_cast<std::uint8_t>(end.back()) + 1);
+    scan(prefix, end, visit);
+}
+
+void KvEngine::flush()
+{
+    std::uint64_t id = 0;
+    {
+        std::unique_lock<std::mutex> lk(mu_);
+        sealed_cv_.wait(lk, [this] { return !sealed_; }); // a write may be flushing already
+        id = seal_memtable_locked();
+    }
+    if (id != 0)
+        write_sealed(id);
+}
+
+std::uint64_t KvEngine::seal_memtable_locked()
+{
+    if (memtable_.empty())
+        return 0;
+    const auto id = next_id_++;
+    wal_->rotate(wal_segment_path(wal_->path(), id));
+    sealed_ = std::make_shared<const Memtable>(std::move(memtable_));
+    memtable_.clear();
+    memtable_bytes_ = 0;
+    return id;
+}
+
+void KvEngine::write_sealed(std::uint64_t id)
+{
+    std::shared_ptr<const Memtable> sealed;
+    {
+        std::scoped_lock lk(mu_);
+        sealed = sealed_;
+    }
+
+    std::shared_ptr<const SortedTable> table;
+    try
+    {
+        TableBuilder builder(table_path(id));
+        for (const auto& [key, value] : *sealed)
+            builder.add(key, value ? std::optional<std::string_view>(*value) : std::nullopt);
+        builder.finish(id, id);
+        table = std::make_shared<const SortedTable>(table_path(id), id);
+    }
+    catch (...)
+    {
+        // Hand the entries back to the memtable (newer values there win) so the next flush
+        // retries them; their log segment stays on disk until a table covers it
+        {
+            std::scoped_lock lk(mu_);
+            for (const auto& [key, value] : *sealed)
+            {
+                if (memtable_.emplace(key, value).second)
+                    memtable_bytes_ += key.size() + (value ? value->size() : 0) + 32;
+            }
+            sealed_.reset();
+        }
+        sealed_cv_.notify_all();
+        throw;
+    }
+
+    {
+        std::scoped_lock lk(mu_);
+        tables_.push_back(std::move(table));
+        sealed_.reset();
+        if (tables_.size() > opts_.max_tables)
+        {
+            compact_requested_ = true;
+            compact_cv_.notify_one();
+        }
+    }
+    sealed_cv_.notify_all();
+
+    const auto segment = wal_segment_path(wal_->path(), id);
+    std::filesystem::remove(segment);
+    sync_parent_dir(segment);
+}
+
+void KvEngine::compact()
+{
+    std::scoped_lock merge_lk(compact_mu_);
+    Tables           inputs;
+    {
+        std::scoped_lock lk(mu_);
+        inputs = tables_;
+    }
+    if (inputs.size() < 2)
+        return;
+
+    // The output replaces the newest input under the same id; tables flushed meanwhile are newer
+    const auto    out_id  = inputs.back()->id();
+    std::uint64_t wal_gen = 0;
+    for (const auto& t : inputs)
+        wal_gen = std::max(wal_gen, t->wal_generation());
+
+    std::vector<MergeSource> sources;
+    sources.reserve(inputs.size());
+    for (auto it = inputs.rbegin(); it != inputs.rend(); ++it)
+        sources.emplace_back(it->get(), std::string_view{});
+
+    TableBuilder builder(table_path(out_id));
+    merge_sources(sources, std::string_view{},
+                  [&builder](std::string_view key, const std::optional<std::string_view>& value)
+                  {
+                      if (value) // nothing older remains, so deletes can be dropped
+                          builder.add(key, value);
+                      return true;
+                  });
+    builder.finish(inputs.front()->id(), wal_gen);
+    auto merged = std::make_shared<const SortedTable>(table_path(out_id), out_id);
+
+    {
+        std::scoped_lock lk(mu_);
+        Tables           next{ merged };
+        next.insert(next.end(), tables_.begin() + static_cast<std::ptrdiff_t>(inputs.size()), tables_.end());
+        tables_.swap(next);
+    }
+    // Readers that still hold the old tables keep their mappings until they finish
+    for (std::size_t i = 0; i + 1 < inputs.size(); ++i)
+        std::filesystem::remove(inputs[i]->path());
+    sync_parent_dir(table_path(out_id));
+}
+
+std::size_t KvEngine::table_count() const
+{
+    std::scoped_lock lk(mu_);
+    return tables_.size();
+}
+
+void KvEngine::compaction_loop()
+{
+    std::unique_lock<std::mutex> lk(mu_);
+    for (;;)
+    {
+        compact_cv_.wait(lk, [this] { return stopping_ || compact_requested_; });
+        if (stopping_)
+            return;
+        compact_requested_ = false;
+        lk.unlock();
+        try
+        {
+            compact();
+        }
+        catch (const std::exception& e)
+        {
+            // Inputs are untouched until the merged table is installed, so a later merge retries
+            std::cerr << "[charizard] KV compaction failed: " << e.what() << '\n';
+        }
+        lk.lock();
+    }
+}
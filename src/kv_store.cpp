@@ -0,0 +1,704 @@
+#include "kv_store.hpp"
+#include "batch_pricer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+static constexpr std::uint64_t k_seq_block = 1U << 16; // sequence numbers reserved per write
+
+static const std::string k_seq_key("m\0seq", 5);
+static const std::string k_horizon_key("m\0horizon", 9);
+static const std::string k_rollups_key("m\0rollups", 9);
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void put_be64(std::string& out, std::uint64_t v)
+{
+    for (int i = 7; i >= 0; --i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xFFU));
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::uint64_t get_be64(std::string_view s)
+{
+    std::uint64_t v = 0;
+    for (std::size_t i = 0; i < 8 && i < s.size(); ++i)
+        v = (v << 8) | static_cast<std::uint8_t>(s[i]);
+    return v;
+}
+
+// Flipping the sign bit makes negative timestamps sort before positive ones.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::uint64_t ordered_ts(std::int64_t ts)
+{
+    return static_cast<std::uint64_t>(ts) ^ (1ULL << 63);
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::int64_t unordered_ts(std::uint64_t v)
+{
+    return static_cast<std::int64_t>(v ^ (1ULL << 63));
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::string user_key(char kind, const std::string& user)
+{
+    std::string key{ kind, '\0' };
+    key += user;
+    return key;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::string events_prefix(const std::string& user)
+{
+    auto key = user_key('e', user);
+    key.push_back('\0');
+    return key;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::string rollups_prefix(const std::string& user)
+{
+    auto key = user_key('r', user);
+    key.push_back('\0');
+    return key;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::string rollup_key(const std::string& user, std::int64_t day, const std::string& mode)
+{
+    auto key = rollups_prefix(user);
+    put_be64(key, ordered_ts(day));
+    key += mode;
+    return key;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::string factor_key(const std::string& mode, const std::string& fuel_type,
+                              const std::string& vehicle_size)
+{
+    std::string key{ 'f', '\0' };
+    key += mode;
+    key.push_back('\0');
+    key += fuel_type;
+    key.push_back('\0');
+    key += vehicle_size;
+    return key;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static TransitEvent decode_event(std::string_view key, std::string_view value)
+{
+    // key: e \0 user \0 ts(8) seq(8)
+    TransitEvent ev;
+    ev.user_id = std::string(key.substr(2, key.size() - 2 - 1 - 16));
+    ev.ts      = unordered_ts(get_be64(key.substr(key.size() - 16, 8)));
+    WalDecoder dec(value);
+    ev.mode         = dec.str();
+    ev.fuel_type    = dec.str();
+    ev.vehicle_size = dec.str();
+    ev.occupancy    = dec.f64();
+    ev.distance_km  = dec.f64();
+    // Values written before events carried a region end here
+    if (!dec.at_end())
+        ev.region = dec.str();
+    return ev;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static DailyRollup decode_rollup(std::string_view key, std::string_view value)
+{
+    // key: r \0 user \0 day(8) mode
+    const auto  sep = key.find('\0', 2);
+    DailyRollup r;
+    r.user_id = std::string(key.substr(2, sep - 2));
+    r.day     = unordered_ts(get_be64(key.substr(sep + 1, 8)));
+    r.mode    = std::string(key.substr(sep + 9));
+    WalDecoder dec(value);
+    r.trips       = dec.i64();
+    r.distance_km = dec.f64();
+    r.kg_co2      = dec.f64();
+    return r;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::string encode_rollup(const DailyRollup& r)
+{
+    WalEncoder enc;
+    enc.put_i64(r.trips);
+    enc.put_f64(r.distance_km);
+    enc.put_f64(r.kg_co2);
+    return enc.bytes();
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static EmissionFactor decode_factor(std::string_view value)
+{
+    WalDecoder     dec(value);
+    EmissionFactor f{};
+    f.mode          = dec.str();
+    f.fuel_type     = dec.str();
+    f.vehicle_size  = dec.str();
+    f.kg_co2_per_km = dec.f64();
+    f.source        = dec.str();
+    f.updated_at    = dec.i64();
+    return f;
+}
+
+// Prices the events a scan visits k_chunk at a time, handing each to `priced` with its kg CO2e,
+// so a scan over every event holds one chunk of them rather than all. One BatchPricer prices every
+// chunk, so they all get the same table. Throws, as calculate_co2_emissions() does, on an invalid
+// event; events of earlier chunks have been handed out by then.
+class ChunkedPricer
+{
+  public:
+    static constexpr std::size_t k_chunk = 4096;
+
+    using Priced = std::function<void(const TransitEvent& ev, double kg_co2)>;
+
+    explicit ChunkedPricer(Priced priced) : priced_(std::move(priced))
+    {
+        evs_.reserve(k_chunk);
+    }
+
+    void add(TransitEvent ev)
+    {
+        evs_.push_back(std::move(ev));
+        if (evs_.size() == k_chunk)
+            flush();
+    }
+
+    // Prices the events of a partial chunk; called once the scan is done.
+    void flush()
+    {
+        const auto n = evs_.size();
+        ids_.resize(n);
+        distance_km_.resize(n);
+        occupancy_.resize(n);
+        kg_co2_.resize(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            ids_[i]         = pricer_.id_of(evs_[i]);
+            distance_km_[i] = evs_[i].distance_km;
+            occupancy_[i]   = evs_[i].occupancy;
+        }
+        pricer_.price(ids_.data(), distance_km_.data(), occupancy_.data(), kg_co2_.data(), n);
+        for (std::size_t i = 0; i < n; ++i)
+            priced_(evs_[i], kg_co2_[i]);
+        evs_.clear();
+    }
+
+  private:
+    BatchPricer                pricer_;
+    Priced                     priced_;
+    std::vector<TransitEvent>  evs_;
+    std::vector<std::uint32_t> ids_;
+    std::vector<double>        distance_km_;
+    std::vector<double>        occupancy_;
+    std::vector<double>        kg_co2_;
+};
+
+KvStore::KvStore(const std::string& dir, const KvOptions& opts) : engine_(dir, opts)
+{
+    // Resume after everything a previous run may have handed out
+    if (auto v = engine_.get(k_seq_key))
+        seq_reserved_ = get_be64(*v);
+    seq_ = seq_reserved_.load();
+    if (auto v = engine_.get(k_horizon_key))
+        horizon_ = unordered_ts(get_be64(*v));
+    if (!engine_.get(k_rollups_key))
+        build_rollups();
+}
+
+void KvStore::build_rollups()
+{
+    // Rollups written by earlier retention passes only cover deleted days, so the horizon starts
+    // after the last of them; the days from there on are rebuilt from their events.
+    std::int64_t horizon = horizon_;
+    if (!engine_.get(k_horizon_key))
+    {
+        engine_.scan_prefix(std::string("r\0", 2),
+                            [&horizon](std::string_view key, std::string_view value)
+                            {
+                                horizon = std::max(horizon, (decode_rollup(key, value).day + 1) * 86400);
+                                return true;
+                            });
+    }
+    std::map<std::string, DailyRollup> rollups;
+    ChunkedPricer                      pricer(
+        [&rollups](const TransitEvent& ev, double kg_co2)
+        { add_to_rollup(rollups[rollup_key(ev.user_id, epoch_day(ev.ts), ev.mode)], ev, kg_co2); });
+    engine_.scan_prefix(std::string("e\0", 2),
+                        [&](std::string_view key, std::string_view value)
+                        {
+                            auto ev = decode_event(key, value);
+                            if (ev.ts >= horizon)
+                                pricer.add(std::move(ev));
+                            return true;
+                        });
+    pricer.flush();
+
+    KvBatch batch;
+    for (const auto& [key, r] : rollups)
+        batch.put(key, encode_rollup(r));
+    std::string v;
+    put_be64(v, ordered_ts(horizon));
+    batch.put(k_horizon_key, v);
+    batch.put(k_rollups_key, "1");
+    engine_.write(batch);
+    horizon_ = horizon;
+}
+
+std::mutex& KvStore::rollup_lock(const std::string& user)
+{
+    return rollup_mu_[std::hash<std::string>{}(user) % rollup_mu_.size()];
+}
+
+std::uint64_t KvStore::next_seq()
+{
+    const auto seq = ++seq_;
+    if (seq <= seq_reserved_)
+        return seq;
+
+    std::scoped_lock lk(seq_mu_);
+    if (seq > seq_reserved_)
+    {
+        const auto  reserved = seq + k_seq_block;
+        std::string v;
+        put_be64(v, reserved);
+        engine_.put(k_seq_key, v);
+        seq_reserved_ = reserved;
+    }
+    return seq;
+}
+
+void KvStore::erase_prefix(const std::string& prefix)
+{
+    KvBatch batch;
+    engine_.scan_prefix(prefix,
+                        [&batch](std::string_view key, std::string_view)
+                        {
+                            batch.erase(key);
+                            return true;
+                        });
+    engine_.write(batch);
+}
+
+// ===== API keys =====
+
+void KvStore::set_api_key(const std::string& user, const std::string& key, const std::string& app_name)
+{
+    KvBatch batch;
+    batch.put(user_key('k', user), hash_api_key(key));
+    if (!app_name.empty())
+        batch.put(user_key('a', user), app_name);
+    engine_.write(batch);
+}
+
+bool KvStore::check_api_key(const std::string& user, const std::string& key) const
+{
+    const auto stored = engine_.get(user_key('k', user));
+    return stored && *stored == hash_api_key(key);
+}
+
+bool KvStore::has_api_keys() const
+{
+    bool found = false;
+    engine_.scan_prefix(std::string{ 'k', '\0' },
+                        [&found](std::string_view, std::string_view)
+                        {
+                            found = true;
+                            return false;
+                        });
+    return found;
+}
+
+// ===== Logs and admin =====
+
+void KvStore::append_log(const ApiLogRecord& rec)
+{
+    std::string key{ 'l', '\0' };
+    put_be64(key, ordered_ts(rec.ts));
+    put_be64(key, next_seq());
+    WalEncoder enc;
+    enc.put_str(rec.method);
+    enc.put_str(rec.path);
+    enc.put_i64(rec.status);
+    enc.put_f64(rec.duration_ms);
+    enc.put_str(rec.client_ip);
+    enc.put_str(rec.user_id);
+    engine_.put(key, enc.bytes());
+}
+
+std::vector<ApiLogRecord> KvStore::get_logs(std::size_t limit) const
+{
+    // Keep the newest `limit`, like InMemoryStore
+    std::deque<ApiLogRecord> tail;
+    engine_.scan_prefix(std::string("l\0", 2),
+                        [&tail, limit](std::string_view key, std::string_view value)
+                        {
+                            ApiLogRecord r;
+                            r.ts = unordered_ts(get_be64(key.substr(2, 8)));
+                            WalDecoder dec(value);
+                            r.method      = dec.str();
+                            r.path        = dec.str();
+                            r.status      = static_cast<int>(dec.i64());
+                            r.duration_ms = dec.f64();
+                            r.client_ip   = dec.str();
+                            r.user_id     = dec.str();
+                            tail.push_back(std::move(r));
+                            if (tail.size() > limit)
+                                tail.pop_front();
+                            return true;
+                        });
+    return { tail.begin(), tail.end() };
+}
+
+void KvStore::clear_logs()
+{
+    erase_prefix(std::string("l\0", 2));
+}
+
+std::vector<std::string> KvStore::users_with(char kind) const
+{
+    // Jump from one user's range to the next instead of reading every key
+    std::vector<std::string> out;
+    std::string              start{ kind, '\0' };
+    const std::string        end{ kind, '\1' };
+    for (;;)
+    {
+        std::string user;
+        bool        found = false;
+        engine_.scan(start, end,
+                     [&](std::string_view key, std::string_view)
+                     {
+                         const auto sep = key.find('\0', 2);
+                         user           = std::string(key.substr(2, sep - 2));
+                         found          = true;
+                         return false;
+                     });
+        if (!found)
+            break;
+        out.push_back(user);
+        start = user_key(kind, user);
+        start.push_back('\1'); // just past this user's keys
+    }
+    return out;
+}
+
+std::vector<std::string> KvStore::get_clients() const
+{
+    // Users whose events have all been rolled up are still clients
+    const auto               with_events  = users_with('e');
+    const auto               with_rollups = users_with('r');
+    std::vector<std::string> out;
+    std::set_union(with_events.begin(), with_events.end(), with_rollups.begin(), with_rollups.end(),
+                   std::back_inserter(out));
+    return out;
+}
+
+std::vector<TransitEvent> KvStore::get_client_data(const std::string& client_id) const
+{
+    return get_events(client_id);
+}
+
+void KvStore::clear_db_events()
+{
+    std::scoped_lock lk(retention_mu_);
+    erase_prefix(std::string("e\0", 2));
+    erase_prefix(std::string("r\0", 2));
+    engine_.erase(k_horizon_key);
+    horizon_ = 0;
+}
+
+void KvStore::clear_db()
+{
+    clear_db_events();
+    for (const char kind : { 'k', 'a', 'l', 'f' })
+        erase_prefix(std::string{ kind, '\0' });
+}
+
+// ===== Events =====
+
+void KvStore::put_event(KvBatch& batch, const TransitEvent& ev)
+{
+    auto key = events_prefix(ev.user_id);
+    put_be64(key, ordered_ts(ev.ts));
+    put_be64(key, next_seq());
+    WalEncoder enc;
+    enc.put_str(ev.mode);
+    enc.put_str(ev.fuel_type);
+    enc.put_str(ev.vehicle_size);
+    enc.put_f64(ev.occupancy);
+    enc.put_f64(ev.distance_km);
+    enc.put_str(ev.region);
+    batch.put(key, enc.bytes());
+}
+
+void KvStore::add_event(const TransitEvent& ev)
+{
+    const auto       rkey = rollup_key(ev.user_id, epoch_day(ev.ts), ev.mode);
+    std::scoped_lock lk(rollup_lock(ev.user_id));
+    DailyRollup      r;
+    if (auto v = engine_.get(rkey))
+        r = decode_rollup(rkey, *v);
+    add_to_rollup(r, ev);
+    KvBatch batch;
+    put_event(batch, ev);
+    batch.put(rkey, encode_rollup(r));
+    engine_.write(batch);
+    notify_ingested(ev);
+}
+
+void KvStore::add_events(const std::vector<TransitEvent>& evs)
+{
+    // Priced in one batch up front; then one write per user, of its events and the rollups they
+    // touch, under its rollup lock as add_event() writes one
+    const auto                                                kg = calculate_co2_emissions(evs);
+    std::unordered_map<std::string, std::vector<std::size_t>> by_user;
+    for (std::size_t i = 0; i < evs.size(); ++i)
+        by_user[evs[i].user_id].push_back(i);
+
+    for (const auto& [user, indexes] : by_user)
+    {
+        std::scoped_lock                   lk(rollup_lock(user));
+        std::map<std::string, DailyRollup> rollups;
+        KvBatch                            batch;
+        for (const auto i : indexes)
+        {
+            const auto& ev            = evs[i];
+            auto        rkey          = rollup_key(user, epoch_day(ev.ts), ev.mode);
+            const auto [it, inserted] = rollups.try_emplace(std::move(rkey));
+            if (inserted)
+            {
+                if (auto v = engine_.get(it->first))
+                    it->second = decode_rollup(it->first, *v);
+            }
+            add_to_rollup(it->second, ev, kg[i]);
+            put_event(batch, ev);
+        }
+        for (const auto& [rkey, r] : rollups)
+            batch.put(rkey, encode_rollup(r));
+        engine_.write(batch);
+        for (const auto i : indexes)
+            notify_ingested(evs[i]);
+    }
+}
+
+std::vector<TransitEvent> KvStore::get_events(const std::string& user) const
+{
+    std::vector<TransitEvent> out;
+    engine_.scan_prefix(events_prefix(user),
+                        [&out](std::string_view key, std::string_view value)
+                        {
+                            out.push_back(decode_event(key, value));
+                            return true;
+                        });
+    return out;
+}
+
+FootprintSummary KvStore::summarize(const std::string& user)
+{
+    using clock = std::chrono::system_clock;
+    const auto now =
+        std::chrono::duration_cast<std::chrono::seconds>(clock::now().time_since_epoch()).count();
+    const auto week_start  = now - (7 * 24 * 3600);
+    const auto month_start = now - (30 * 24 * 3600);
+
+    const auto  horizon = horizon_.load();
+
+    // Days before the horizon only exist as rollups; later ones are summed from their events
+    FootprintSummary s{};
+    engine_.scan_prefix(rollups_prefix(user),
+                        [&](std::string_view key, std::string_view value)
+                        {
+                            const auto r = decode_rollup(key, value);
+                            if (r.day * 86400 >= horizon)
+                                return false;
+                            add_to_summary(s, r, week_start, month_start);
+                            return true;
+                        });
+    auto start = events_prefix(user);
+    auto end   = start;
+    end.back() = '\1';
+    put_be64(start, ordered_ts(horizon));
+    ChunkedPricer pricer(
+        [&](const TransitEvent& ev, double kg)
+        {
+            s.lifetime_kg_co2 += kg;
+            if (ev.ts >= week_start)
+                s.week_kg_co2 += kg;
+            if (ev.ts >= month_start)
+                s.month_kg_co2 += kg;
+        });
+    engine_.scan(start, end,
+                 [&pricer](std::string_view key, std::string_view value)
+                 {
+                     pricer.add(decode_event(key, value));
+                     return true;
+                 });
+    pricer.flush();
+    return s;
+}
+
+double KvStore::global_average_weekly()
+{
+    using clock = std::chrono::system_clock;
+    const auto now =
+        std::chrono::duration_cast<std::chrono::seconds>(clock::now().time_since_epoch()).count();
+    const auto week_start = now - (7 * 24 * 3600);
+
+    std::unordered_map<std::string, double> user_week;
+    engine_.scan_prefix(std::string("e\0", 2),
+                        [&](std::string_view key, std::string_view value)
+                        {
+                            const auto ev = decode_event(key, value);
+                            if (ev.ts >= week_start)
+                                user_week[ev.user_id] += calculate_co2_emissions(ev);
+                            return true;
+                        });
+    if (user_week.empty())
+        return 0.0;
+    double total = 0.0;
+    for (const auto& [_, kg] : user_week)
+        total += kg;
+    return total / static_cast<double>(user_week.size());
+}
+
+// ===== Retention =====
+
+RetentionResult KvStore::apply_retention(std::int64_t event_cutoff, std::int64_t log_cutoff)
+{
+    std::scoped_lock lk(retention_mu_);
+    RetentionResult  res;
+    if (event_cutoff > 0)
+    {
+        // The horizon is stored before anything is deleted, so summaries never count a day twice
+        const auto horizon = std::max(horizon_.load(), epoch_day(event_cutoff) * 86400);
+        if (horizon != horizon_)
+        {
+            std::string v;
+            put_be64(v, ordered_ts(horizon));
+            engine_.put(k_horizon_key, v);
+            horizon_ = horizon;
+        }
+        for (const auto& user : users_with('e'))
+        {
+            auto end = events_prefix(user);
+            put_be64(end, ordered_ts(horizon));
+            KvBatch batch;
+            engine_.scan(events_prefix(user), end,
+                         [&](std::string_view key, std::string_view)
+                         {
+                             batch.erase(key);
+                             ++res.events_rolled_up;
+                             return true;
+                         });
+            if (!batch.empty())
+                engine_.write(batch);
+        }
+    }
+    if (log_cutoff > 0)
+    {
+        std::string end{ 'l', '\0' };
+        put_be64(end, ordered_ts(log_cutoff));
+        KvBatch batch;
+        engine_.scan(std::string("l\0", 2), end,
+                     [&](std::string_view key, std::string_view)
+                     {
+                         batch.erase(key);
+                         ++res.logs_deleted;
+                         return true;
+                     });
+        if (!batch.empty())
+            engine_.write(batch);
+    }
+    return res;
+}
+
+std::int64_t KvStore::retention_horizon() const
+{
+    return horizon_;
+}
+
+std::vector<DailyRollup> KvStore::get_rollups(const std::string& user, std::int64_t from_day,
+                                              std::int64_t to_day) const
+{
+    std::vector<DailyRollup> out;
+    if (from_day > to_day)
+        return out;
+    auto start = rollups_prefix(user);
+    auto end   = start;
+    end.back() = '\1'; // just past this user's rollups
+    put_be64(start, ordered_ts(from_day));
+    engine_.scan(start, end,
+                 [&out, to_day](std::string_view key, std::string_view value)
+                 {
+                     auto r = decode_rollup(key, value);
+                     if (r.day > to_day)
+                         return false;
+                     out.push_back(std::move(r));
+                     return true;
+                 });
+    return out;
+}
+
+std::size_t KvStore::reprice_rollups(const std::string& user, const FactorChangeSet& changes)
+{
+    // Held across the read and the write, as add_event() holds it, so no event slips in between
+    std::scoped_lock lk(rollup_lock(user));
+    const auto       rebuilt = repriced_rollups(get_events(user), changes, horizon_.load());
+    if (rebuilt.empty())
+        return 0;
+    KvBatch batch;
+    for (const auto& r : rebuilt)
+        batch.put(rollup_key(user, r.day, r.mode), encode_rollup(r));
+    engine_.write(batch);
+    return rebuilt.size();
+}
+
+// ===== Emission factors =====
+
+void KvStore::store_emission_factor(const EmissionFactor& factor)
+{
+    WalEncoder enc;
+    enc.put_str(factor.mode);
+    enc.put_str(factor.fuel_type);
+    enc.put_str(factor.vehicle_size);
+    enc.put_f64(factor.kg_co2_per_km);
+    enc.put_str(factor.source);
+    enc.put_i64(factor.updated_at);
+    engine_.put(factor_key(factor.mode, factor.fuel_type, factor.vehicle_size), enc.bytes());
+}
+
+std::optional<EmissionFactor> KvStore::get_emission_factor(const std::string& mode,
+                                                           const std::string& fuel_type,
+                                                           const std::string& vehicle_size) const
+{
+    const auto v = engine_.get(factor_key(mode, fuel_type, vehicle_size));
+    if (!v)
+        return std::nullopt;
+    return decode_factor(*v);
+}
+
+std::vector<EmissionFactor> KvStore::get_all_emission_factors() const
+{
+    std::vector<EmissionFactor> out;
+    engine_.scan_prefix(std::string("f\0", 2),
+                        [&out](std::string_view, std::string_view value)
+                        {
+                            out.push_back(decode_factor(value));
+                            return true;
+                        });
+    return out;
+}
+
+void KvStore::clear_emission_factors()
+{
+    erase_prefix(std::string("f\0", 2));
+}
@@ -1,43 +1,274 @@
-#include <cstdlib>
-#include <iostream>
-#include <memory>
-// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
-#define CPPHTTPLIB_THREAD_POOL_COUNT 8
+#include "active_users.hpp"
 #include "api.hpp"
+#include "factor_table.hpp"
+#include "factor_watcher.hpp"
+#include "kv_store.hpp"
+#include "peer_stats.hpp"
+#include "repricing.hpp"
+#include "retention.hpp"
+#include "server_config.hpp"
 #include "storage.hpp"
+#include "write_behind_store.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
 #include <httplib.h>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <pthread.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 #ifdef CHARIZARD_WITH_MONGO
 #include "mongo_store.hpp"
 #endif
 
+// The value of the environment variable `name`, if set; throws naming it unless it is a whole
+// non-negative number (see parse_unsigned()).
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::optional<unsigned long long> env_unsigned(const char* name)
+{
+    const char* value = std::getenv(name);
+    if (value == nullptr)
+        return std::nullopt;
+    return parse_unsigned(name, value);
+}
+
 // NOLINTNEXTLINE(misc-use-anonymous-namespace)
 static std::unique_ptr<IStore> make_store()
 {
 #ifdef CHARIZARD_WITH_MONGO
     if (const char* uri = std::getenv("MONGO_URI"))
-        return std::make_unique<MongoStore>(std::string{ uri });
+    {
+        auto mongo_store = std::make_unique<MongoStore>(std::string{ uri });
+        if (const char* days = std::getenv("LOG_RETENTION_DAYS"))
+            mongo_store->enable_log_ttl(std::chrono::hours(24) * std::stol(days));
+        std::unique_ptr<IStore> mongo = std::move(mongo_store);
+        const char*             mode  = std::getenv("MONGO_WRITE_MODE");
+        if (mode == nullptr || std::string(mode) == "direct")
+            return mongo;
+
+        WriteBehindOptions opts;
+        if (std::string(mode) == "write-through")
+            opts.mode = WriteMode::WriteThrough;
+        else if (std::string(mode) != "write-behind")
+            throw std::runtime_error("MONGO_WRITE_MODE must be direct, write-through or write-behind");
+        if (const auto n = env_unsigned("WRITE_BEHIND_MAX_PENDING"))
+            opts.max_pending = static_cast<std::size_t>(*n);
+        if (const auto n = env_unsigned("WRITE_BEHIND_BATCH"))
+            opts.batch_size = static_cast<std::size_t>(*n);
+        if (const auto ms = env_unsigned("WRITE_BEHIND_FLUSH_MS"))
+            opts.flush_interval = std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(*ms));
+        if (const auto mb = env_unsigned("MONGO_CACHE_MB"))
+            opts.cache_bytes = static_cast<std::size_t>(*mb) << 20;
+        if (const auto sec = env_unsigned("MONGO_SUMMARY_TTL_SEC"))
+            opts.summary_ttl = std::chrono::seconds(static_cast<std::chrono::seconds::rep>(*sec));
+        std::cout << "[charizard] caching MongoDB reads, " << mode << " writes" << '\n';
+        return std::make_unique<WriteBehindStore>(std::move(mongo), opts);
+    }
 #endif
-    return std::make_unique<InMemoryStore>();
+    if (const char* dir = std::getenv("KV_STORE_PATH"))
+    {
+        KvOptions opts;
+        if (const char* sync = std::getenv("WAL_SYNC"))
+            opts.wal.sync = std::string(sync) != "0";
+        if (const char* ms = std::getenv("WAL_GROUP_COMMIT_MS"))
+            opts.wal.group_commit_interval = std::chrono::milliseconds(std::stol(ms));
+        std::cout << "[charizard] using embedded KV store in " << dir << '\n';
+        return std::make_unique<KvStore>(dir, opts);
+    }
+    auto store = std::make_unique<InMemoryStore>();
+    if (const char* wal_path = std::getenv("INMEMORY_WAL_PATH"))
+    {
+        WalOptions opts;
+        if (const char* sync = std::getenv("WAL_SYNC"))
+            opts.sync = std::string(sync) != "0";
+        if (const char* ms = std::getenv("WAL_GROUP_COMMIT_MS"))
+            opts.group_commit_interval = std::chrono::milliseconds(std::stol(ms));
+        SnapshotOptions snap;
+        snap.path = std::string(wal_path) + ".snap";
+        if (const char* path = std::getenv("INMEMORY_SNAPSHOT_PATH"))
+            snap.path = path; // empty disables snapshots
+        if (const char* mb = std::getenv("SNAPSHOT_MIN_WAL_MB"))
+            snap.min_wal_bytes = std::stoull(mb) << 20;
+        if (const char* sec = std::getenv("SNAPSHOT_CHECK_SEC"))
+            snap.check_interval = std::chrono::seconds(std::stol(sec));
+        if (const char* n = std::getenv("SNAPSHOT_LOAD_THREADS"))
+            snap.load_threads = static_cast<unsigned>(std::stoul(n));
+
+        store->open_wal(wal_path, opts, snap);
+        const auto& rec = store->recovery();
+        std::cout << "[charizard] restored " << rec.snapshot_events << " events from snapshot generation "
+                  << rec.snapshot_generation << " and replayed " << rec.wal_records << " WAL records in "
+                  << rec.elapsed_ms << " ms" << '\n';
+    }
+    return store;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static RetentionPolicy retention_policy_from_env()
+{
+    RetentionPolicy policy;
+    if (const char* months = std::getenv("EVENT_RETENTION_MONTHS"))
+        policy.event_months = std::stoi(months);
+    if (const char* days = std::getenv("LOG_RETENTION_DAYS"))
+        policy.log_days = std::stoi(days);
+    if (const char* min = std::getenv("RETENTION_INTERVAL_MIN"))
+        policy.interval = std::chrono::minutes(std::stol(min));
+    return policy;
+}
+
+// EMISSION_SOURCE_PRIORITY: comma-separated factor sources, most preferred first.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::vector<std::string> source_priority_from_env()
+{
+    std::vector<std::string> sources;
+    const char*              list = std::getenv("EMISSION_SOURCE_PRIORITY");
+    if (list == nullptr)
+        return sources;
+    std::string_view rest(list);
+    while (!rest.empty())
+    {
+        const auto comma  = std::min(rest.find(','), rest.size());
+        auto       source = rest.substr(0, comma);
+        while (!source.empty() && source.front() == ' ')
+            source.remove_prefix(1);
+        while (!source.empty() && source.back() == ' ')
+            source.remove_suffix(1);
+        if (!source.empty())
+            sources.emplace_back(source);
+        rest.remove_prefix(std::min(comma + 1, rest.size()));
+    }
+    return sources;
 }
 
-int main()
+int main(int argc, char** argv)
 {
     try
     {
+        // SIGINT/SIGTERM stop the server so listen() returns and the store is destroyed normally,
+        // which flushes anything a write-behind store still buffers. Blocked before any thread is
+        // started so they all inherit the mask and only the waiter below receives them.
+        sigset_t stop_signals;
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGINT);
+        sigaddset(&stop_signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+        ServerConfig cfg = server_config_from_env();
+        apply_cli_overrides(cfg, argc, argv);
+
+        // Replace the built-in DEFRA factors before anything is priced; a bad file stops startup
+        const char* factors_path = std::getenv("EMISSION_FACTORS_PATH");
+        auto        priority     = source_priority_from_env();
+        if (factors_path != nullptr)
+        {
+            auto table =
+                std::make_shared<const FactorTable>(load_factor_path(factors_path), factors_path, priority);
+            std::cout << "[charizard] loaded " << table->factors().size() << " emission factors from "
+                      << factors_path << '\n';
+            set_active_factor_table(std::move(table));
+        }
+
+        // The demo key goes into a fresh store only, so restarts don't log it again and a
+        // revoked key stays revoked
         auto store = make_store();
-        store->set_api_key("demo", "secret-demo-key");
+        if (!store->has_api_keys())
+            store->set_api_key("demo", "secret-demo-key");
+
+        // Declared after the store so it stops first: a reload re-prices the store's rollups with
+        // the corrected factors (see reprice_store())
+        std::unique_ptr<FactorFileWatcher> factor_watcher;
+        const char*                        watch = std::getenv("EMISSION_FACTORS_WATCH");
+        if (factors_path != nullptr && (watch == nullptr || std::string(watch) != "0"))
+        {
+            factor_watcher = std::make_unique<FactorFileWatcher>(factors_path, std::chrono::milliseconds(200),
+                                                                 std::move(priority));
+            factor_watcher->on_publish(
+                [&store](const FactorTable& before, const FactorTable& after)
+                {
+                    const FactorChangeSet changes(before, after);
+                    if (changes.empty())
+                        return;
+                    const auto start  = std::chrono::steady_clock::now();
+                    const auto result = reprice_store(*store, changes);
+                    const auto ms     = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start);
+                    std::cout << "[charizard] " << changes.key_count()
+                              << " emission factors changed, re-priced " << result.rollups << " rollups of "
+                              << result.users << " users in " << ms.count() << " ms" << '\n';
+                });
+            factor_watcher->start();
+        }
+
+        const auto   retention_policy = retention_policy_from_env();
+        RetentionJob retention(*store, retention_policy);
+        if (retention_policy.event_months > 0 || retention_policy.log_days > 0)
+            retention.start();
+
+        std::chrono::seconds peer_refresh(60);
+        if (const char* sec = std::getenv("PEER_STATS_REFRESH_SEC"))
+            peer_refresh = std::chrono::seconds(std::stol(sec));
+        PeerStats peers(*store, peer_refresh);
+        peers.start();
+
+        // Rebuilds the stored rollups when factors are loaded through the admin API
+        unsigned recompute_threads = 0;
+        if (const char* n = std::getenv("FACTOR_RECOMPUTE_THREADS"))
+            recompute_threads = static_cast<unsigned>(std::stoul(n));
+        RecomputeJob recompute(*store, recompute_threads);
+
+        // Active-user sketches are memory-only; rebuild the last 30 days from the rollups, then
+        // count every event the store ingests
+        ActiveUsers active_users;
+        active_users.seed(*store, static_cast<std::int64_t>(std::time(nullptr)));
+        active_users.attach(*store);
+
+        AdmissionController admission(cfg.admission);
+        RateLimiter         user_limiter(cfg.per_user_rate, cfg.rate_limit_max_keys);
+        RateLimiter         ip_limiter(cfg.per_ip_rate, cfg.rate_limit_max_keys);
+        ApiServices         services;
+        services.admission    = &admission;
+        services.user_limiter = &user_limiter;
+        services.ip_limiter   = &ip_limiter;
+        services.store_cache  = dynamic_cast<WriteBehindStore*>(store.get());
+        services.peers        = &peers;
+        services.active_users = &active_users;
+        services.recompute    = &recompute;
 
         httplib::Server svr;
-        configure_routes(svr, *store);
+        apply_server_config(svr, cfg);
+        configure_routes(svr, *store, services);
+
+        // Joined before svr goes out of scope: if listen() returns for any other reason, the
+        // waiter is woken with a SIGTERM of its own and leaves svr alone
+        std::atomic<bool> exiting{ false };
+        std::thread       signal_waiter(
+            [&svr, &exiting, stop_signals]
+            {
+                int sig = 0;
+                sigwait(&stop_signals, &sig);
+                if (exiting)
+                    return;
+                std::cout << "[charizard] signal " << sig << ", shutting down" << '\n';
+                svr.stop();
+            });
 
-        const char*       env_port  = std::getenv("PORT");
-        int const         port      = (env_port != nullptr) ? std::atoi(env_port) : 8080;
-        const char*       host      = std::getenv("HOST");
-        std::string const bind_host = (host != nullptr) ? host : "0.0.0.0";
+        std::cout << "[charizard] listening on " << cfg.host << ":" << cfg.port << " with "
+                  << cfg.effective_worker_threads() << " workers" << '\n';
+        svr.listen(cfg.host, cfg.port);
 
-        std::cout << "[charizard] listening on " << bind_host << ":" << port << '\n';
-        svr.listen(bind_host, port);
+        exiting = true;
+        pthread_kill(signal_waiter.native_handle(), SIGTERM);
+        signal_waiter.join();
     }
     catch (const std::exception& ex)
     {
@@ -0,0 +1,101 @@
+#include "peer_stats.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+PeerStats::PeerStats(const IStore& store, std::chrono::seconds max_age) : store_(store), max_age_(max_age) {}
+
+PeerStats::~PeerStats()
+{
+    {
+        std::scoped_lock lk(mu_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void PeerStats::start()
+{
+    std::scoped_lock lk(mu_);
+    if (background_)
+        return;
+    background_ = true;
+    thread_     = std::thread([this] { loop(); });
+}
+
+std::shared_ptr<const PeerSnapshot> PeerStats::snapshot(std::int64_t now)
+{
+    {
+        std::scoped_lock lk(mu_);
+        if (background_)
+            return current_;
+        const bool fresh = current_ && now - current_->built_at < max_age_.count();
+        if (fresh || (current_ && rebuilding_))
+            return current_;
+        rebuilding_ = true;
+    }
+    try
+    {
+        return rebuild(now);
+    }
+    catch (...)
+    {
+        std::scoped_lock lk(mu_);
+        rebuilding_ = false;
+        throw;
+    }
+}
+
+std::shared_ptr<const PeerSnapshot> PeerStats::rebuild(std::int64_t now)
+{
+    auto       snap  = std::make_shared<PeerSnapshot>();
+    const auto today = epoch_day(now);
+    for (const auto& user : store_.get_clients())
+    {
+        double      kg    = 0.0;
+        std::size_t trips = 0;
+        for (const auto& r : store_.get_rollups(user, today - 6, today))
+        {
+            kg += r.kg_co2;
+            trips += static_cast<std::size_t>(r.trips);
+        }
+        if (trips == 0)
+            continue;
+        snap->weekly_kg_co2.add(kg);
+        snap->total_kg_co2 += kg;
+        ++snap->users;
+    }
+    snap->weekly_kg_co2.compress();
+    snap->built_at = now;
+
+    std::scoped_lock lk(mu_);
+    rebuilding_ = false;
+    if (!current_ || current_->built_at <= now)
+        current_ = snap;
+    return snap;
+}
+
+void PeerStats::loop()
+{
+    const auto       interval = std::max(max_age_, std::chrono::seconds(1));
+    std::unique_lock lk(mu_);
+    do
+    {
+        lk.unlock();
+        try
+        {
+            rebuild(std::chrono::duration_cast<std::chrono::seconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                        .count());
+        }
+        catch (const std::exception& ex)
+        {
+            // Requests keep getting the previous snapshot
+            std::cerr << "[charizard] peer stats rebuild failed, will retry: " << ex.what() << '\n';
+        }
+        lk.lock();
+    } while (!cv_.wait_for(lk, interval, [this] { return stopping_; }));
+}
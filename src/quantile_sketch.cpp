@@ -0,0 +1,212 @@
+#include "quantile_sketch.hpp"
+
+#include "wal.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+static constexpr std::uint8_t k_tdigest_format = 1;
+static constexpr double       k_pi             = 3.14159265358979323846;
+
+TDigest::TDigest(double compression) : compression_(std::max(compression, 10.0)) {}
+
+void TDigest::add(double x, double weight)
+{
+    if (!(weight > 0.0) || std::isnan(x))
+        return;
+    if (total_weight() == 0.0)
+        min_ = max_ = x;
+    min_ = std::min(min_, x);
+    max_ = std::max(max_, x);
+    buffer_.push_back({ x, weight });
+    if (buffer_.size() >= 5 * static_cast<std::size_t>(compression_))
+        compress();
+}
+
+void TDigest::merge(const TDigest& other)
+{
+    if (other.empty())
+        return;
+    if (empty())
+    {
+        min_ = other.min_;
+        max_ = other.max_;
+    }
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    buffer_.insert(buffer_.end(), other.centroids_.begin(), other.centroids_.end());
+    buffer_.insert(buffer_.end(), other.buffer_.begin(), other.buffer_.end());
+    compress();
+}
+
+void TDigest::compress()
+{
+    if (buffer_.empty())
+        return;
+    std::vector<Centroid> all;
+    all.reserve(centroids_.size() + buffer_.size());
+    all.insert(all.end(), centroids_.begin(), centroids_.end());
+    all.insert(all.end(), buffer_.begin(), buffer_.end());
+    buffer_.clear();
+    std::sort(all.begin(), all.end(), [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+
+    double total = 0.0;
+    for (const auto& c : all)
+        total += c.weight;
+    // k1 scale function: a centroid may span at most one unit of k, which is steep at the tails
+    const auto k = [&](double q)
+    { return compression_ / (2 * k_pi) * std::asin(2 * std::clamp(q, 0.0, 1.0) - 1); };
+
+    centroids_.clear();
+    double   so_far = 0.0;
+    Centroid cur    = all.front();
+    for (std::size_t i = 1; i < all.size(); ++i)
+    {
+        const double proposed = cur.weight + all[i].weight;
+        if (k((so_far + proposed) / total) - k(so_far / total) <= 1.0)
+        {
+            cur.mean += (all[i].mean - cur.mean) * all[i].weight / proposed;
+            cur.weight = proposed;
+        }
+        else
+        {
+            so_far += cur.weight;
+            centroids_.push_back(cur);
+            cur = all[i];
+        }
+    }
+    centroids_.push_back(cur);
+
+    weight_ = total;
+    cumulative_.resize(centroids_.size());
+    double before = 0.0;
+    for (std::size_t i = 0; i < centroids_.size(); ++i)
+    {
+        cumulative_[i] = before;
+        before += centroids_[i].weight;
+    }
+}
+
+double TDigest::total_weight() const
+{
+    double w = weight_;
+    for (const auto& c : buffer_)
+        w += c.weight;
+    return w;
+}
+
+double TDigest::quantile(double q) const
+{
+    if (!buffer_.empty())
+    {
+        TDigest copy = *this;
+        copy.compress();
+        return copy.quantile(q);
+    }
+    if (centroids_.empty())
+        return 0.0;
+    const std::size_t n = centroids_.size();
+    if (n == 1)
+        return centroids_[0].mean;
+
+    const double target = std::clamp(q, 0.0, 1.0) * weight_;
+    if (target <= centre(0))
+        return min_ + (centroids_[0].mean - min_) * target / centre(0);
+    if (target >= centre(n - 1))
+        return centroids_[n - 1].mean +
+               (max_ - centroids_[n - 1].mean) * (target - centre(n - 1)) / (weight_ - centre(n - 1));
+
+    // Last centroid whose centre is at or below the target; the next one's is above it
+    std::size_t lo = 0;
+    std::size_t hi = n - 1;
+    while (hi - lo > 1)
+    {
+        const auto mid = lo + (hi - lo) / 2;
+        (centre(mid) <= target ? lo : hi) = mid;
+    }
+    const double frac = (target - centre(lo)) / (centre(hi) - centre(lo));
+    return centroids_[lo].mean + frac * (centroids_[hi].mean - centroids_[lo].mean);
+}
+
+double TDigest::cdf(double x) const
+{
+    if (!buffer_.empty())
+    {
+        TDigest copy = *this;
+        copy.compress();
+        return copy.cdf(x);
+    }
+    if (centroids_.empty() || x < min_)
+        return 0.0;
+    if (x > max_)
+        return 1.0;
+
+    auto       by_mean = [](const Centroid& c, double v) { return c.mean < v; };
+    const auto lo      = static_cast<std::size_t>(
+        std::lower_bound(centroids_.begin(), centroids_.end(), x, by_mean) - centroids_.begin());
+    auto hi = lo;
+    while (hi < centroids_.size() && centroids_[hi].mean == x)
+        ++hi;
+    const std::size_t n = centroids_.size();
+
+    double rank = 0.0;
+    if (hi > lo) // ties: the middle of the tied weight
+        rank = (cumulative_[lo] + (hi < n ? cumulative_[hi] : weight_)) / 2;
+    else if (lo == 0)
+        rank = centre(0) * (x - min_) / (centroids_[0].mean - min_);
+    else if (lo == n)
+        rank = centre(n - 1) +
+               (weight_ - centre(n - 1)) * (x - centroids_[n - 1].mean) / (max_ - centroids_[n - 1].mean);
+    else
+        rank = centre(lo - 1) + (centre(lo) - centre(lo - 1)) * (x - centroids_[lo - 1].mean) /
+                                    (centroids_[lo].mean - centroids_[lo - 1].mean);
+    return rank / weight_;
+}
+
+std::string TDigest::encode() const
+{
+    if (!buffer_.empty())
+    {
+        TDigest copy = *this;
+        copy.compress();
+        return copy.encode();
+    }
+    WalEncoder enc;
+    enc.put_u8(k_tdigest_format);
+    enc.put_f64(compression_);
+    enc.put_f64(min_);
+    enc.put_f64(max_);
+    enc.put_u32(static_cast<std::uint32_t>(centroids_.size()));
+    for (const auto& c : centroids_)
+    {
+        enc.put_f64(c.mean);
+        enc.put_f64(c.weight);
+    }
+    return enc.bytes();
+}
+
+TDigest TDigest::decode(std::string_view bytes)
+{
+    WalDecoder dec(bytes);
+    if (dec.u8() != k_tdigest_format)
+        throw std::runtime_error("unsupported t-digest format");
+    TDigest d(dec.f64());
+    const double min = dec.f64();
+    const double max = dec.f64();
+    const auto   n   = dec.u32();
+    for (std::uint32_t i = 0; i < n; ++i)
+    {
+        const double mean   = dec.f64();
+        const double weight = dec.f64();
+        if (!(weight > 0.0) || mean < min || mean > max)
+            throw std::runtime_error("corrupt t-digest");
+        d.buffer_.push_back({ mean, weight });
+    }
+    if (!dec.at_end())
+        throw std::runtime_error("corrupt t-digest: trailing bytes");
+    d.min_ = min;
+    d.max_ = max;
+    d.compress();
+    return d;
+}
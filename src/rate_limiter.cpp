@@ -0,0 +1,95 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+RateLimiter::RateLimiter(const TokenBucketConfig& cfg, std::size_t max_keys, std::size_t shards)
+    : cfg_(cfg)
+{
+    if (shards == 0)
+        shards = 1;
+    if (cfg_.burst < 1.0)
+        cfg_.burst = std::max(1.0, cfg_.rate_per_sec);
+    per_shard_capacity_ = std::max<std::size_t>(1, max_keys / shards);
+    shards_.reserve(shards);
+    for (std::size_t i = 0; i < shards; ++i)
+        shards_.push_back(std::make_unique<Shard>());
+}
+
+RateLimiter::Shard& RateLimiter::shard_for(const std::string& key)
+{
+    return *shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
+
+bool RateLimiter::allow(const std::string& key, long* retry_after_sec)
+{
+    return allow(key, clock::now(), retry_after_sec);
+}
+
+bool RateLimiter::allow(const std::string& key, clock::time_point now, long* retry_after_sec)
+{
+    if (!enabled())
+        return true;
+
+    auto&            shard = shard_for(key);
+    std::scoped_lock lk(shard.mu);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end())
+    {
+        if (shard.index.size() >= per_shard_capacity_)
+        {
+            shard.index.erase(shard.lru.back().key);
+            shard.lru.pop_back();
+        }
+        shard.lru.push_front(Bucket{ key, cfg_.burst, now });
+        it = shard.index.emplace(key, shard.lru.begin()).first;
+    }
+    else
+    {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    }
+
+    auto&        b       = *it->second;
+    const double elapsed = std::chrono::duration<double>(now - b.last).count();
+    if (elapsed > 0.0)
+    {
+        b.tokens = std::min(cfg_.burst, b.tokens + elapsed * cfg_.rate_per_sec);
+        b.last   = now;
+    }
+
+    if (b.tokens >= 1.0)
+    {
+        b.tokens -= 1.0;
+        return true;
+    }
+
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    if (retry_after_sec != nullptr)
+        *retry_after_sec = std::max(1L, static_cast<long>(std::ceil((1.0 - b.tokens) / cfg_.rate_per_sec)));
+    return false;
+}
+
+void RateLimiter::refund(const std::string& key)
+{
+    if (!enabled())
+        return;
+
+    auto&            shard = shard_for(key);
+    std::scoped_lock lk(shard.mu);
+    auto             it = shard.index.find(key);
+    if (it != shard.index.end())
+        it->second->tokens = std::min(cfg_.burst, it->second->tokens + 1.0);
+}
+
+std::size_t RateLimiter::tracked_keys() const
+{
+    std::size_t n = 0;
+    for (const auto& s : shards_)
+    {
+        std::scoped_lock lk(s->mu);
+        n += s->index.size();
+    }
+    return n;
+}
@@ -0,0 +1,231 @@
+#include "repricing.hpp"
+
+#include "batch_pricer.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
+std::vector<DailyRollup> repriced_rollups(const std::vector<TransitEvent>& evs,
+                                          const FactorChangeSet& changes, std::int64_t horizon)
+{
+    // First the days holding a re-priced trip, then every trip of those days and modes
+    std::map<std::pair<std::int64_t, std::string>, DailyRollup> days;
+    for (const auto& ev : evs)
+    {
+        if (ev.ts >= horizon && changes.affects(ev.mode, ev.fuel_type, ev.vehicle_size, ev.ts))
+            days.try_emplace({ epoch_day(ev.ts), ev.mode });
+    }
+    if (days.empty())
+        return {};
+
+    // Their trips priced in one batch, in columns
+    BatchPricer                pricer;
+    std::vector<DailyRollup*>  targets;
+    std::vector<std::size_t>   indexes;
+    std::vector<std::uint32_t> ids;
+    std::vector<double>        distance_km;
+    std::vector<double>        occupancy;
+    for (std::size_t i = 0; i < evs.size(); ++i)
+    {
+        const auto& ev = evs[i];
+        if (ev.ts < horizon)
+            continue;
+        const auto it = days.find({ epoch_day(ev.ts), ev.mode });
+        if (it == days.end())
+            continue;
+        targets.push_back(&it->second);
+        indexes.push_back(i);
+        ids.push_back(pricer.id_of(ev));
+        distance_km.push_back(ev.distance_km);
+        occupancy.push_back(ev.occupancy);
+    }
+    std::vector<double> kg(ids.size());
+    pricer.price(ids.data(), distance_km.data(), occupancy.data(), kg.data(), ids.size());
+    for (std::size_t j = 0; j < targets.size(); ++j)
+        add_to_rollup(*targets[j], evs[indexes[j]], kg[j]);
+
+    std::vector<DailyRollup> out;
+    out.reserve(days.size());
+    for (auto& [key, r] : days)
+        out.push_back(std::move(r));
+    return out;
+}
+
+RepriceResult reprice_store(IStore& store, const FactorChangeSet& changes)
+{
+    RepriceResult result;
+    if (changes.empty())
+        return result;
+    for (const auto& user : store.get_clients())
+    {
+        result.rollups += store.reprice_rollups(user, changes);
+        ++result.users;
+    }
+    return result;
+}
+
+RecomputeJob::RecomputeJob(IStore& store, unsigned threads, std::size_t chunk)
+    : store_(store), threads_(threads), chunk_(std::max<std::size_t>(1, chunk))
+{
+}
+
+RecomputeJob::~RecomputeJob()
+{
+    stopping_ = true;
+    if (thread_.joinable())
+        thread_.join();
+}
+
+bool RecomputeJob::start()
+{
+    std::scoped_lock lk(mu_);
+    if (status_.running)
+    {
+        // Users the running job has already visited were priced with an earlier table
+        rerun_ = true;
+        return false;
+    }
+    // The previous job's thread has nothing left to do but return
+    if (thread_.joinable())
+        thread_.join();
+
+    begin_locked();
+    thread_ = std::thread([this] { run(); });
+    return true;
+}
+
+void RecomputeJob::begin_locked()
+{
+    const auto table       = active_factor_table();
+    const auto runs        = status_.runs + 1;
+    status_                = RecomputeStatus{};
+    status_.running        = true;
+    status_.runs           = runs;
+    status_.factor_version = table->version();
+    status_.factor_origin  = table->origin();
+    started_               = std::chrono::steady_clock::now();
+    users_done_            = 0;
+    rollups_               = 0;
+    latest_version_        = table->version();
+}
+
+void RecomputeJob::wait()
+{
+    std::unique_lock lk(mu_);
+    idle_cv_.wait(lk, [this] { return !status_.running; });
+}
+
+RecomputeStatus RecomputeJob::status() const
+{
+    std::scoped_lock lk(mu_);
+    auto             out = status_;
+    out.rerun_pending    = rerun_;
+    if (out.running)
+    {
+        out.latest_factor_version = latest_version_.load();
+        out.users_done            = users_done_.load();
+        out.rollups               = rollups_.load();
+        out.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+    }
+    return out;
+}
+
+void RecomputeJob::run()
+{
+    while (run_once())
+    {
+    }
+}
+
+bool RecomputeJob::run_once()
+{
+    std::vector<std::string> users;
+    std::mutex               error_mu;
+    std::string              error;
+    try
+    {
+        users = store_.get_clients();
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+    }
+    {
+        std::scoped_lock lk(mu_);
+        status_.users_total = users.size();
+    }
+
+    const auto               changes = FactorChangeSet::all();
+    std::atomic<std::size_t> next{ 0 };
+    const auto               worker = [&]
+    {
+        for (std::size_t begin = next.fetch_add(chunk_); begin < users.size() && !stopping_;
+             begin = next.fetch_add(chunk_))
+        {
+            const auto end = std::min(begin + chunk_, users.size());
+            try
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    // Read first, so a table published meanwhile can only make it an underestimate
+                    const auto version = active_factor_table()->version();
+                    rollups_ += store_.reprice_rollups(users[i], changes);
+                    ++users_done_;
+                    auto latest = latest_version_.load();
+                    while (latest < version && !latest_version_.compare_exchange_weak(latest, version))
+                    {
+                    }
+                }
+            }
+            catch (const std::exception& e)
+            {
+                std::scoped_lock lk(error_mu);
+                if (error.empty())
+                    error = e.what();
+                next = users.size();
+            }
+        }
+    };
+
+    unsigned threads = threads_ != 0 ? threads_ : std::max(1U, std::thread::hardware_concurrency());
+    threads          = static_cast<unsigned>(
+        std::min<std::size_t>(threads, std::max<std::size_t>(1, (users.size() + chunk_ - 1) / chunk_)));
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool)
+        t.join();
+
+    std::scoped_lock lk(mu_);
+    status_.running               = false;
+    status_.latest_factor_version = latest_version_.load();
+    status_.users_done            = users_done_.load();
+    status_.rollups               = rollups_.load();
+    status_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+    if (error.empty() && status_.users_done < status_.users_total)
+        error = "stopped at shutdown";
+    status_.error = error;
+    if (error.empty())
+        std::cout << "[charizard] recomputed " << status_.rollups << " rollups of " << status_.users_done
+                  << " users with emission factors v" << status_.factor_version << " in " << status_.seconds
+                  << " s (" << status_.users_per_second() << " users/s)" << '\n';
+    else
+        std::cerr << "[charizard] recompute stopped after " << status_.users_done << " of "
+                  << status_.users_total << " users: " << error << '\n';
+
+    // A load during the job: start over with the table active now, on this thread
+    if (rerun_ && !stopping_)
+    {
+        rerun_ = false;
+        begin_locked();
+        return true;
+    }
+    rerun_ = false;
+    idle_cv_.notify_all();
+    return false;
+}
@@ -0,0 +1,71 @@
+#include "retention.hpp"
+
+#include "calendar.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+std::int64_t months_before(std::int64_t now, int months)
+{
+    auto               date        = civil_from_days(epoch_day(now));
+    const std::int64_t month_index = date.year * 12 + (date.month - 1) - months;
+    date.year  = month_index >= 0 ? month_index / 12 : -((-month_index + 11) / 12);
+    date.month = static_cast<unsigned>(month_index - date.year * 12) + 1;
+    date.day   = std::min(date.day, days_in_month(date.year, date.month));
+    return days_from_civil(date) * 86400;
+}
+
+RetentionJob::RetentionJob(IStore& store, const RetentionPolicy& policy) : store_(store), policy_(policy)
+{
+}
+
+RetentionJob::~RetentionJob()
+{
+    {
+        std::scoped_lock lk(mu_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void RetentionJob::start()
+{
+    if (!thread_.joinable())
+        thread_ = std::thread([this] { loop(); });
+}
+
+RetentionResult RetentionJob::run_once(std::int64_t now)
+{
+    const std::int64_t event_cutoff = policy_.event_months > 0 ? months_before(now, policy_.event_months) : 0;
+    const std::int64_t log_cutoff =
+        policy_.log_days > 0 ? now - static_cast<std::int64_t>(policy_.log_days) * 86400 : 0;
+    if (event_cutoff == 0 && log_cutoff == 0)
+        return {};
+    return store_.apply_retention(event_cutoff, log_cutoff);
+}
+
+void RetentionJob::loop()
+{
+    std::unique_lock lk(mu_);
+    do
+    {
+        lk.unlock();
+        try
+        {
+            const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+            const auto res = run_once(now);
+            if (res.events_rolled_up > 0 || res.logs_deleted > 0)
+                std::cout << "[charizard] retention: deleted " << res.events_rolled_up
+                          << " rolled-up events and " << res.logs_deleted << " log records" << '\n';
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << "[charizard] retention pass failed, will retry: " << ex.what() << '\n';
+        }
+        lk.lock();
+    } while (!cv_.wait_for(lk, policy_.interval, [this] { return stopping_; }));
+}
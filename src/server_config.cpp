@@ -0,0 +1,172 @@
+#include "server_config.hpp"
+
+#include "task_queue.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+
+unsigned long long parse_unsigned(const std::string& name, const std::string& value)
+{
+    if (value.empty() || value.front() == '-')
+        throw std::runtime_error("invalid value for " + name + ": '" + value + "'");
+    errno          = 0;
+    char* end      = nullptr;
+    const auto out = std::strtoull(value.c_str(), &end, 10);
+    if (errno != 0 || end == value.c_str() || *end != '\0')
+        throw std::runtime_error("invalid value for " + name + ": '" + value + "'");
+    return out;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static double parse_non_negative(const std::string& name, const std::string& value)
+{
+    errno          = 0;
+    char* end      = nullptr;
+    const auto out = std::strtod(value.c_str(), &end);
+    if (value.empty() || errno != 0 || end == value.c_str() || *end != '\0' || !(out >= 0.0))
+        throw std::runtime_error("invalid value for " + name + ": '" + value + "'");
+    return out;
+}
+
+// Handles --<class>-max-concurrent and --<class>-queue-ms.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool set_admission_option(AdmissionLimits& limits, const std::string& name, const std::string& value)
+{
+    const std::pair<const char*, AdmissionLimit*> classes[] = {
+        { "ingest", &limits.ingest },
+        { "read", &limits.read },
+        { "analytics", &limits.analytics },
+        { "admin", &limits.admin },
+    };
+    for (const auto& [cls, limit] : classes)
+    {
+        const std::string prefix = std::string(cls) + "-";
+        if (name.rfind(prefix, 0) != 0)
+            continue;
+        const auto field = name.substr(prefix.size());
+        if (field == "max-concurrent")
+            limit->max_concurrent = static_cast<std::size_t>(parse_unsigned(name, value));
+        else if (field == "queue-ms")
+            limit->queue_budget_ms = static_cast<std::size_t>(parse_unsigned(name, value));
+        else
+            return false;
+        return true;
+    }
+    return false;
+}
+
+// Applies one named option to `cfg`; returns false if the name is not recognized.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool set_option(ServerConfig& cfg, const std::string& name, const std::string& value)
+{
+    if (name == "host")
+        cfg.host = value;
+    else if (name == "port")
+    {
+        const auto p = parse_unsigned(name, value);
+        if (p > 65535)
+            throw std::runtime_error("invalid value for port: '" + value + "'");
+        cfg.port = static_cast<int>(p);
+    }
+    else if (name == "workers")
+        cfg.worker_threads = static_cast<std::size_t>(parse_unsigned(name, value));
+    else if (name == "max-queued")
+        cfg.max_queued_requests = static_cast<std::size_t>(parse_unsigned(name, value));
+    else if (name == "keep-alive-max-count")
+        cfg.keep_alive_max_count = static_cast<std::size_t>(parse_unsigned(name, value));
+    else if (name == "keep-alive-timeout")
+        cfg.keep_alive_timeout_sec = static_cast<std::time_t>(parse_unsigned(name, value));
+    else if (name == "read-timeout")
+        cfg.read_timeout_sec = static_cast<std::time_t>(parse_unsigned(name, value));
+    else if (name == "write-timeout")
+        cfg.write_timeout_sec = static_cast<std::time_t>(parse_unsigned(name, value));
+    else if (name == "payload-max-bytes")
+        cfg.payload_max_bytes = static_cast<std::size_t>(parse_unsigned(name, value));
+    else if (name == "user-rate")
+        cfg.per_user_rate.rate_per_sec = parse_non_negative(name, value);
+    else if (name == "user-burst")
+        cfg.per_user_rate.burst = parse_non_negative(name, value);
+    else if (name == "ip-rate")
+        cfg.per_ip_rate.rate_per_sec = parse_non_negative(name, value);
+    else if (name == "ip-burst")
+        cfg.per_ip_rate.burst = parse_non_negative(name, value);
+    else if (name == "rate-limit-max-keys")
+        cfg.rate_limit_max_keys = static_cast<std::size_t>(parse_unsigned(name, value));
+    else
+        return set_admission_option(cfg.admission, name, value);
+    return true;
+}
+
+std::size_t ServerConfig::effective_worker_threads() const
+{
+    if (worker_threads > 0)
+        return worker_threads;
+    const auto hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+ServerConfig server_config_from_env()
+{
+    // Environment variable -> option name understood by set_option
+    static const std::pair<const char*, const char*> k_env_options[] = {
+        { "HOST", "host" },
+        { "PORT", "port" },
+        { "HTTP_WORKER_THREADS", "workers" },
+        { "HTTP_MAX_QUEUED_REQUESTS", "max-queued" },
+        { "HTTP_KEEP_ALIVE_MAX_COUNT", "keep-alive-max-count" },
+        { "HTTP_KEEP_ALIVE_TIMEOUT_SEC", "keep-alive-timeout" },
+        { "HTTP_READ_TIMEOUT_SEC", "read-timeout" },
+        { "HTTP_WRITE_TIMEOUT_SEC", "write-timeout" },
+        { "HTTP_PAYLOAD_MAX_BYTES", "payload-max-bytes" },
+        { "ADMISSION_INGEST_MAX_CONCURRENT", "ingest-max-concurrent" },
+        { "ADMISSION_INGEST_QUEUE_MS", "ingest-queue-ms" },
+        { "ADMISSION_READ_MAX_CONCURRENT", "read-max-concurrent" },
+        { "ADMISSION_READ_QUEUE_MS", "read-queue-ms" },
+        { "ADMISSION_ANALYTICS_MAX_CONCURRENT", "analytics-max-concurrent" },
+        { "ADMISSION_ANALYTICS_QUEUE_MS", "analytics-queue-ms" },
+        { "ADMISSION_ADMIN_MAX_CONCURRENT", "admin-max-concurrent" },
+        { "ADMISSION_ADMIN_QUEUE_MS", "admin-queue-ms" },
+        { "RATE_LIMIT_USER_RPS", "user-rate" },
+        { "RATE_LIMIT_USER_BURST", "user-burst" },
+        { "RATE_LIMIT_IP_RPS", "ip-rate" },
+        { "RATE_LIMIT_IP_BURST", "ip-burst" },
+        { "RATE_LIMIT_MAX_KEYS", "rate-limit-max-keys" },
+    };
+
+    ServerConfig cfg;
+    for (const auto& [env, name] : k_env_options)
+    {
+        if (const char* v = std::getenv(env))
+            set_option(cfg, name, v);
+    }
+    return cfg;
+}
+
+void apply_cli_overrides(ServerConfig& cfg, int argc, const char* const* argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const auto        eq  = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos)
+            throw std::runtime_error("unrecognized argument: " + arg + " (expected --name=value)");
+        if (!set_option(cfg, arg.substr(2, eq - 2), arg.substr(eq + 1)))
+            throw std::runtime_error("unknown option: " + arg.substr(0, eq));
+    }
+}
+
+void apply_server_config(httplib::Server& svr, const ServerConfig& cfg)
+{
+    svr.set_keep_alive_max_count(cfg.keep_alive_max_count);
+    svr.set_keep_alive_timeout(cfg.keep_alive_timeout_sec);
+    svr.set_read_timeout(cfg.read_timeout_sec, 0);
+    svr.set_write_timeout(cfg.write_timeout_sec, 0);
+    svr.set_payload_max_length(cfg.payload_max_bytes);
+
+    const auto n_workers  = cfg.effective_worker_threads();
+    const auto max_queued = cfg.max_queued_requests;
+    svr.new_task_queue    = [n_workers, max_queued]
+    { return new WorkStealingTaskQueue(n_workers, max_queued); };
+}
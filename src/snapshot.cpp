@@ -0,0 +1,448 @@
+#include "storage.hpp"
+#include "file_io.hpp"
+#include "wal.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+/*
+ * Snapshot file layout (all integers little-endian):
+ *
+ *   header   magic "CHZSNP01", u64 generation
+ *   blocks   one per user, columnar:
+ *              mode[n], fuel_type[n], vehicle_size[n]   dictionary codes, `code_width` bytes each
+ *              occupancy[n], distance_km[n]             f64
+ *              ts[n]                                    i64
+ *   meta     u8 code_width, u32 count + dictionary strings,
+ *            u32 count + (user, key hash), u32 count + (user, app name),
+ *            u32 count + emission factors,
+ *            u32 count + directory entries (user, u64 n, u64 block offset, u32 block crc),
+ *            u32 count + daily rollups (user, day, mode, trips, distance, kg),   [optional]
+ *            i64 retention horizon                                            [optional]
+ *            u32 count + event regions (user, i64 event index, region)        [optional]
+ *   footer   u64 meta offset, u64 meta length, u32 meta crc, magic "CHZSNP01"
+ *
+ * The directory lives at the end so blocks can be streamed out as they are encoded, and each
+ * block carries its own CRC so a reader can verify and decode users on several threads at once.
+ */
+
+static constexpr char        k_snapshot_magic[8] = { 'C', 'H', 'Z', 'S', 'N', 'P', '0', '1' };
+static constexpr std::size_t k_header_bytes      = sizeof k_snapshot_magic + 8;
+static constexpr std::size_t k_footer_bytes      = 8 + 8 + 4 + sizeof k_snapshot_magic;
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void put_le(std::string& out, std::uint64_t v, std::size_t width)
+{
+    for (std::size_t i = 0; i < width; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xFFU));
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::uint64_t get_le(const char* p, std::size_t width)
+{
+    std::uint64_t v = 0;
+    for (std::size_t i = width; i-- > 0;)
+        v = (v << 8) | static_cast<std::uint8_t>(p[i]);
+    return v;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::uint64_t f64_bits(double v)
+{
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &v, sizeof bits);
+    return bits;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static double bits_f64(std::uint64_t bits)
+{
+    double v = 0.0;
+    std::memcpy(&v, &bits, sizeof v);
+    return v;
+}
+
+struct SnapshotDirectoryEntry
+{
+    std::string   user;
+    std::uint64_t count  = 0;
+    std::uint64_t offset = 0;
+    std::uint32_t crc    = 0;
+};
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::size_t code_width_for(std::size_t dictionary_size)
+{
+    if (dictionary_size <= 0xFFU)
+        return 1;
+    if (dictionary_size <= 0xFFFFU)
+        return 2;
+    return 4;
+}
+
+// InMemorySnapshot holds its state by value, InMemorySnapshotView through shared pointers
+template <typename T>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static const T& deref(const T& v)
+{
+    return v;
+}
+
+template <typename T>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static const T& deref(const std::shared_ptr<const T>& p)
+{
+    return *p;
+}
+
+template <typename Snapshot>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void write_snapshot_file(const std::string& path, const Snapshot& snap)
+{
+    // Dictionary of the low-cardinality string columns; code 0 is the empty string
+    std::vector<std::string>                       dictionary{ "" };
+    std::unordered_map<std::string, std::uint32_t> codes{ { "", 0 } };
+    const auto intern = [&](const std::string& s)
+    {
+        auto [it, inserted] = codes.emplace(s, static_cast<std::uint32_t>(dictionary.size()));
+        if (inserted)
+            dictionary.push_back(s);
+        return it->second;
+    };
+    for (const auto& [user, evs] : snap.events)
+    {
+        for (const auto& ev : deref(evs))
+        {
+            intern(ev.mode);
+            intern(ev.fuel_type);
+            intern(ev.vehicle_size);
+        }
+    }
+    const auto width = code_width_for(dictionary.size());
+
+    AtomicFileWriter out(path);
+    std::string      header(k_snapshot_magic, sizeof k_snapshot_magic);
+    put_le(header, snap.generation, 8);
+    out.write(header);
+
+    std::vector<SnapshotDirectoryEntry> directory;
+    directory.reserve(snap.events.size());
+    std::string block;
+    for (const auto& [user, user_evs] : snap.events)
+    {
+        const auto& evs = deref(user_evs);
+        block.clear();
+        block.reserve(evs.size() * (3 * width + 24));
+        for (const auto& ev : evs)
+            put_le(block, codes.at(ev.mode), width);
+        for (const auto& ev : evs)
+            put_le(block, codes.at(ev.fuel_type), width);
+        for (const auto& ev : evs)
+            put_le(block, codes.at(ev.vehicle_size), width);
+        for (const auto& ev : evs)
+            put_le(block, f64_bits(ev.occupancy), 8);
+        for (const auto& ev : evs)
+            put_le(block, f64_bits(ev.distance_km), 8);
+        for (const auto& ev : evs)
+            put_le(block, static_cast<std::uint64_t>(ev.ts), 8);
+
+        directory.push_back({ user, evs.size(), out.offset(), wal_crc32(block) });
+        out.write(block);
+    }
+
+    WalEncoder meta;
+    meta.put_u8(static_cast<std::uint8_t>(width));
+    meta.put_u32(static_cast<std::uint32_t>(dictionary.size()));
+    for (const auto& s : dictionary)
+        meta.put_str(s);
+    meta.put_u32(static_cast<std::uint32_t>(deref(snap.api_keys).size()));
+    for (const auto& [user, hash] : deref(snap.api_keys))
+    {
+        meta.put_str(user);
+        meta.put_str(hash);
+    }
+    meta.put_u32(static_cast<std::uint32_t>(deref(snap.app_names).size()));
+    for (const auto& [user, app] : deref(snap.app_names))
+    {
+        meta.put_str(user);
+        meta.put_str(app);
+    }
+    meta.put_u32(static_cast<std::uint32_t>(deref(snap.emission_factors).size()));
+    for (const auto& f : deref(snap.emission_factors))
+    {
+        meta.put_str(f.mode);
+        meta.put_str(f.fuel_type);
+        meta.put_str(f.vehicle_size);
+        meta.put_f64(f.kg_co2_per_km);
+        meta.put_str(f.source);
+        meta.put_i64(f.updated_at);
+    }
+    meta.put_u32(static_cast<std::uint32_t>(directory.size()));
+    for (const auto& d : directory)
+    {
+        meta.put_str(d.user);
+        meta.put_i64(static_cast<std::int64_t>(d.count));
+        meta.put_i64(static_cast<std::int64_t>(d.offset));
+        meta.put_u32(d.crc);
+    }
+    meta.put_u32(static_cast<std::uint32_t>(snap.rollups.size()));
+    for (const auto& r : snap.rollups)
+    {
+        meta.put_str(r.user_id);
+        meta.put_i64(r.day);
+        meta.put_str(r.mode);
+        meta.put_i64(r.trips);
+        meta.put_f64(r.distance_km);
+        meta.put_f64(r.kg_co2);
+    }
+    meta.put_i64(snap.retention_horizon);
+    // Most events have no region, so the few that do are listed rather than given a column
+    std::vector<std::pair<const TransitEvent*, std::size_t>> regions;
+    for (const auto& [user, user_evs] : snap.events)
+    {
+        const auto& evs = deref(user_evs);
+        for (std::size_t i = 0; i < evs.size(); ++i)
+        {
+            if (!evs[i].region.empty())
+                regions.emplace_back(&evs[i], i);
+        }
+    }
+    meta.put_u32(static_cast<std::uint32_t>(regions.size()));
+    for (const auto& [ev, index] : regions)
+    {
+        meta.put_str(ev->user_id);
+        meta.put_i64(static_cast<std::int64_t>(index));
+        meta.put_str(ev->region);
+    }
+
+    std::string footer;
+    put_le(footer, out.offset(), 8);
+    put_le(footer, meta.bytes().size(), 8);
+    put_le(footer, wal_crc32(meta.bytes()), 4);
+    footer.append(k_snapshot_magic, sizeof k_snapshot_magic);
+    out.write(meta.bytes());
+    out.write(footer);
+    out.commit();
+}
+
+void write_store_snapshot(const std::string& path, const InMemorySnapshot& snap)
+{
+    write_snapshot_file(path, snap);
+}
+
+void write_store_snapshot(const std::string& path, const InMemorySnapshotView& snap)
+{
+    write_snapshot_file(path, snap);
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void decode_user_block(std::string_view block, const SnapshotDirectoryEntry& entry,
+                              const std::vector<std::string>& dictionary, std::size_t width,
+                              std::vector<TransitEvent>& evs)
+{
+    if (wal_crc32(block) != entry.crc)
+        throw std::runtime_error("snapshot block for user " + entry.user + " is corrupt");
+
+    const auto  n    = static_cast<std::size_t>(entry.count);
+    const char* p    = block.data();
+    const auto  code = [&](std::size_t column, std::size_t i) -> const std::string&
+    {
+        const auto c = get_le(p + (column * n + i) * width, width);
+        if (c >= dictionary.size())
+            throw std::runtime_error("snapshot dictionary code out of range");
+        return dictionary[c];
+    };
+    const char* numbers = p + 3 * n * width;
+
+    evs.resize(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        auto& ev        = evs[i];
+        ev.user_id      = entry.user;
+        ev.mode         = code(0, i);
+        ev.fuel_type    = code(1, i);
+        ev.vehicle_size = code(2, i);
+        ev.occupancy    = bits_f64(get_le(numbers + 8 * i, 8));
+        ev.distance_km  = bits_f64(get_le(numbers + 8 * (n + i), 8));
+        ev.ts           = static_cast<std::int64_t>(get_le(numbers + 8 * (2 * n + i), 8));
+    }
+}
+
+bool read_store_snapshot(const std::string& path, InMemorySnapshot& out, unsigned threads)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    const auto data    = file.bytes();
+    const auto corrupt = [&path](const std::string& why)
+    { return std::runtime_error("snapshot " + path + " is corrupt: " + why); };
+
+    if (data.size() < k_header_bytes + k_footer_bytes ||
+        data.compare(0, sizeof k_snapshot_magic, k_snapshot_magic, sizeof k_snapshot_magic) != 0 ||
+        data.compare(data.size() - sizeof k_snapshot_magic, sizeof k_snapshot_magic, k_snapshot_magic,
+                     sizeof k_snapshot_magic) != 0)
+        throw corrupt("bad header or footer");
+
+    const char* footer      = data.data() + data.size() - k_footer_bytes;
+    const auto  meta_offset = get_le(footer, 8);
+    const auto  meta_len    = get_le(footer + 8, 8);
+    const auto  meta_crc    = static_cast<std::uint32_t>(get_le(footer + 16, 4));
+    if (meta_offset < k_header_bytes || meta_offset > data.size() - k_footer_bytes ||
+        meta_len != data.size() - k_footer_bytes - meta_offset)
+        throw corrupt("bad metadata offset");
+    const auto meta_bytes = data.substr(meta_offset, meta_len);
+    if (wal_crc32(meta_bytes) != meta_crc)
+        throw corrupt("metadata checksum mismatch");
+
+    InMemorySnapshot                    snap;
+    std::vector<std::string>            dictionary;
+    std::vector<SnapshotDirectoryEntry> directory;
+    std::size_t                         width = 0;
+
+    std::vector<std::tuple<std::string, std::size_t, std::string>> regions; // (user, event index, region)
+    try
+    {
+        snap.generation = get_le(data.data() + sizeof k_snapshot_magic, 8);
+        WalDecoder meta(meta_bytes);
+        width = meta.u8();
+        if (width != 1 && width != 2 && width != 4)
+            throw std::runtime_error("bad code width");
+        dictionary.resize(meta.u32());
+        for (auto& s : dictionary)
+            s = meta.str();
+        for (auto n = meta.u32(); n > 0; --n)
+        {
+            auto user           = meta.str();
+            snap.api_keys[user] = meta.str();
+        }
+        for (auto n = meta.u32(); n > 0; --n)
+        {
+            auto user            = meta.str();
+            snap.app_names[user] = meta.str();
+        }
+        snap.emission_factors.resize(meta.u32());
+        for (auto& f : snap.emission_factors)
+        {
+            f.mode          = meta.str();
+            f.fuel_type     = meta.str();
+            f.vehicle_size  = meta.str();
+            f.kg_co2_per_km = meta.f64();
+            f.source        = meta.str();
+            f.updated_at    = meta.i64();
+        }
+        directory.resize(meta.u32());
+        for (auto& d : directory)
+        {
+            d.user   = meta.str();
+            d.count  = static_cast<std::uint64_t>(meta.i64());
+            d.offset = static_cast<std::uint64_t>(meta.i64());
+            d.crc    = meta.u32();
+            if (d.offset < k_header_bytes || d.offset > meta_offset ||
+                d.count > (meta_offset - d.offset) / (3 * width + 24))
+                throw std::runtime_error("block for user " + d.user + " is out of bounds");
+        }
+        // Snapshots written before retention existed end after the directory
+        if (!meta.at_end())
+        {
+            snap.rollups.resize(meta.u32());
+            for (auto& r : snap.rollups)
+            {
+                r.user_id     = meta.str();
+                r.day         = meta.i64();
+                r.mode        = meta.str();
+                r.trips       = meta.i64();
+                r.distance_km = meta.f64();
+                r.kg_co2      = meta.f64();
+            }
+            if (!meta.at_end())
+                snap.retention_horizon = meta.i64();
+            else
+            {
+                // Older snapshots held only retired days, all of which precede the horizon
+                for (const auto& r : snap.rollups)
+                    snap.retention_horizon = std::max(snap.retention_horizon, (r.day + 1) * 86400);
+            }
+        }
+        // Nor did events carry a region
+        if (!meta.at_end())
+        {
+            regions.resize(meta.u32());
+            for (auto& [user, index, region] : regions)
+            {
+                user   = meta.str();
+                index  = static_cast<std::size_t>(meta.i64());
+                region = meta.str();
+            }
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        throw corrupt(e.what());
+    }
+
+    // Create every map entry up front so the decoding threads only touch their own vectors
+    std::vector<std::vector<TransitEvent>*> targets;
+    targets.reserve(directory.size());
+    snap.events.reserve(directory.size());
+    for (const auto& d : directory)
+    {
+        auto [it, inserted] = snap.events.try_emplace(d.user);
+        if (!inserted)
+            throw corrupt("duplicate user " + d.user);
+        targets.push_back(&it->second);
+    }
+
+    if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(
+        std::min<std::size_t>(threads, std::max<std::size_t>(1, directory.size())));
+
+    std::atomic<std::size_t> next{ 0 };
+    std::mutex               error_mu;
+    std::string              error;
+    const auto               worker = [&]
+    {
+        for (std::size_t i = next++; i < directory.size(); i = next++)
+        {
+            const auto& d = directory[i];
+            try
+            {
+                const auto bytes = static_cast<std::size_t>(d.count) * (3 * width + 24);
+                decode_user_block(data.substr(d.offset, bytes), d, dictionary, width, *targets[i]);
+            }
+            catch (const std::exception& e)
+            {
+                std::scoped_lock lk(error_mu);
+                if (error.empty())
+                    error = e.what();
+                next = directory.size();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool)
+        t.join();
+    if (!error.empty())
+        throw corrupt(error);
+
+    for (auto& [user, index, region] : regions)
+    {
+        const auto it = snap.events.find(user);
+        if (it == snap.events.end() || index >= it->second.size())
+            throw corrupt("region for a missing event of user " + user);
+        it->second[index].region = std::move(region);
+    }
+
+    out = std::move(snap);
+    return true;
+}
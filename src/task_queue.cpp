@@ -0,0 +1,123 @@
+#include "task_queue.hpp"
+
+#include <utility>
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static thread_local bool tl_current_job_shed = false;
+
+WorkStealingTaskQueue::WorkStealingTaskQueue(std::size_t n_workers, std::size_t max_queued)
+    : max_queued_(max_queued)
+{
+    if (n_workers == 0)
+        n_workers = 1;
+    queues_.reserve(n_workers);
+    for (std::size_t i = 0; i < n_workers; ++i)
+        queues_.push_back(std::make_unique<WorkerDeque>());
+    workers_.reserve(n_workers);
+    for (std::size_t i = 0; i < n_workers; ++i)
+        workers_.emplace_back([this, i] { worker_loop(i); });
+}
+
+WorkStealingTaskQueue::~WorkStealingTaskQueue()
+{
+    shutdown();
+}
+
+bool WorkStealingTaskQueue::take_current_job_shed()
+{
+    return std::exchange(tl_current_job_shed, false);
+}
+
+bool WorkStealingTaskQueue::enqueue(std::function<void()> fn)
+{
+    if (stopping_.load())
+        return false;
+
+    const auto depth = pending_.fetch_add(1);
+    if (max_queued_ > 0 && depth >= 2 * max_queued_)
+    {
+        pending_.fetch_sub(1);
+        shed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    const bool shed = max_queued_ > 0 && depth >= max_queued_;
+    if (shed)
+        shed_.fetch_add(1, std::memory_order_relaxed);
+
+    auto& q = *queues_[next_.fetch_add(1, std::memory_order_relaxed) % queues_.size()];
+    {
+        std::scoped_lock lk(q.mu);
+        q.jobs.push_back(Job{ std::move(fn), shed });
+    }
+    // Take the idle lock so a worker between its predicate check and wait() can't miss the wakeup.
+    {
+        std::scoped_lock lk(idle_mu_);
+    }
+    idle_cv_.notify_one();
+    return true;
+}
+
+void WorkStealingTaskQueue::shutdown()
+{
+    stopping_.store(true);
+    {
+        std::scoped_lock lk(idle_mu_);
+    }
+    idle_cv_.notify_all();
+    // Workers drain the remaining jobs before exiting, like httplib::ThreadPool.
+    for (auto& t : workers_)
+    {
+        if (t.joinable())
+            t.join();
+    }
+    workers_.clear();
+}
+
+bool WorkStealingTaskQueue::try_pop(std::size_t self, Job& out)
+{
+    // Own deque first, oldest job first
+    {
+        auto&            q = *queues_[self];
+        std::scoped_lock lk(q.mu);
+        if (!q.jobs.empty())
+        {
+            out = std::move(q.jobs.front());
+            q.jobs.pop_front();
+            return true;
+        }
+    }
+    // Then steal from the tail of the others, starting at our right-hand neighbour
+    for (std::size_t k = 1; k < queues_.size(); ++k)
+    {
+        auto&            q = *queues_[(self + k) % queues_.size()];
+        std::scoped_lock lk(q.mu);
+        if (!q.jobs.empty())
+        {
+            out = std::move(q.jobs.back());
+            q.jobs.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingTaskQueue::worker_loop(std::size_t self)
+{
+    for (;;)
+    {
+        Job job;
+        if (try_pop(self, job))
+        {
+            pending_.fetch_sub(1);
+            tl_current_job_shed = job.shed;
+            job.fn();
+            tl_current_job_shed = false;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lk(idle_mu_);
+        idle_cv_.wait(lk, [this] { return stopping_.load() || pending_.load() > 0; });
+        if (stopping_.load() && pending_.load() == 0)
+            return; // stopping and drained
+    }
+}
@@ -1,7 +1,29 @@
 #include "transit_logic.hpp"
 
+#include "factor_table.hpp"
+
+#include <cmath>
 #include <ctime>
 #include <stdexcept>
+#include <utility>
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::int64_t default_ts(std::int64_t now_epoch)
+{
+    return now_epoch == 0 ? static_cast<std::int64_t>(std::time(nullptr)) : now_epoch;
+}
+
+// The optional vehicle details only matter to cars and taxis, but are kept for every mode.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void set_vehicle(TransitEvent& ev, std::string fuel_type, std::string vehicle_size, double occupancy)
+{
+    // An inf occupancy would price a bus trip as NaN in a batch (see BatchPricer::price)
+    if (!std::isfinite(occupancy) || occupancy < 1.0)
+        throw std::runtime_error("Occupancy must be at least 1.0");
+    ev.fuel_type    = std::move(fuel_type);
+    ev.vehicle_size = std::move(vehicle_size);
+    ev.occupancy    = occupancy;
+}
 
 TransitEvent
 make_transit_event_from_json(const std::string& user_id, const nlohmann::json& body,
@@ -15,9 +37,22 @@ make_transit_event_from_json(const std::string& user_id, const nlohmann::json& b
 
     const std::string  mode     = body["mode"].get<std::string>();
     const double       distance = body["distance_km"].get<double>();
-    const std::int64_t ts =
-        body.value("ts", now_epoch == 0 ? static_cast<std::int64_t>(std::time(nullptr)) : now_epoch);
+    const std::int64_t ts       = body.value("ts", default_ts(now_epoch));
 
     // Delegate validation to the existing TransitEvent ctor in transit_validator.cpp
-    return { user_id, mode, distance, ts };
+    TransitEvent ev{ user_id, mode, distance, ts };
+    set_vehicle(ev, body.value("fuel_type", std::string()), body.value("vehicle_size", std::string()),
+                body.value("occupancy", 1.0));
+    ev.region = normalize_region(body.value("region", std::string()));
+    return ev;
+}
+
+TransitEvent make_transit_event(const std::string& user_id, const TransitPayload& payload,
+                                std::int64_t now_epoch) // NOLINT(bugprone-easily-swappable-parameters)
+{
+    TransitEvent ev{ user_id, std::string(payload.mode), payload.distance_km,
+                     payload.ts == 0 ? default_ts(now_epoch) : payload.ts };
+    set_vehicle(ev, std::string(payload.fuel_type), std::string(payload.vehicle_size), payload.occupancy);
+    ev.region = normalize_region(payload.region);
+    return ev;
 }
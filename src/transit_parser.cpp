@@ -0,0 +1,193 @@
+#include "transit_parser.hpp"
+
+#include <charconv>
+#include <initializer_list>
+
+// Each helper consumes what it recognises from the front of `in` and returns false if it can't.
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void skip_ws(std::string_view& in)
+{
+    std::size_t i = 0;
+    while (i < in.size() && (in[i] == ' ' || in[i] == '\t' || in[i] == '\n' || in[i] == '\r'))
+        ++i;
+    in.remove_prefix(i);
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool consume(std::string_view& in, char c)
+{
+    skip_ws(in);
+    if (in.empty() || in.front() != c)
+        return false;
+    in.remove_prefix(1);
+    return true;
+}
+
+// A string without escapes, control characters or non-ASCII bytes, which is then its own value.
+// The others need decoding or UTF-8 validation and are left to the generic path.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool parse_string(std::string_view& in, std::string_view& out)
+{
+    if (!consume(in, '"'))
+        return false;
+    for (std::size_t i = 0; i < in.size(); ++i)
+    {
+        const auto c = static_cast<unsigned char>(in[i]);
+        if (c == '"')
+        {
+            out = in.substr(0, i);
+            in.remove_prefix(i + 1);
+            return true;
+        }
+        if (c == '\\' || c < 0x20 || c >= 0x80)
+            return false;
+    }
+    return false;
+}
+
+// A token matching the JSON number grammar; `integral` is set when it has no fraction or exponent.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool scan_number(std::string_view& in, std::string_view& token, bool& integral)
+{
+    skip_ws(in);
+    std::size_t i      = 0;
+    auto        digits = [&]
+    {
+        const auto from = i;
+        while (i < in.size() && in[i] >= '0' && in[i] <= '9')
+            ++i;
+        return i > from;
+    };
+    if (i < in.size() && in[i] == '-')
+        ++i;
+    if (i < in.size() && in[i] == '0')
+        ++i;
+    else if (!digits())
+        return false;
+    integral = true;
+    if (i < in.size() && in[i] == '.')
+    {
+        ++i;
+        if (!digits())
+            return false;
+        integral = false;
+    }
+    if (i < in.size() && (in[i] == 'e' || in[i] == 'E'))
+    {
+        ++i;
+        if (i < in.size() && (in[i] == '+' || in[i] == '-'))
+            ++i;
+        if (!digits())
+            return false;
+        integral = false;
+    }
+    token = in.substr(0, i);
+    in.remove_prefix(i);
+    return true;
+}
+
+template <typename T>
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool from_chars_exact(std::string_view token, T& out)
+{
+    const auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), out);
+    return ec == std::errc() && end == token.data() + token.size();
+}
+
+// nlohmann::json keeps integer literals as integers and converts them on get<double>(), so do the
+// same to produce bit-identical values (it matters for -0).
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool parse_double(std::string_view& in, double& out)
+{
+    std::string_view token;
+    bool             integral = false;
+    if (!scan_number(in, token, integral))
+        return false;
+    if (!integral)
+        return from_chars_exact(token, out);
+    std::int64_t v = 0;
+    if (!from_chars_exact(token, v))
+        return false;
+    out = static_cast<double>(v);
+    return true;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool parse_int(std::string_view& in, std::int64_t& out)
+{
+    std::string_view token;
+    bool             integral = false;
+    return scan_number(in, token, integral) && integral && from_chars_exact(token, out);
+}
+
+// Skips the value of a key we don't use; objects and arrays are left to the generic path.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static bool skip_value(std::string_view& in)
+{
+    skip_ws(in);
+    if (in.empty())
+        return false;
+    if (in.front() == '"')
+    {
+        std::string_view ignored;
+        return parse_string(in, ignored);
+    }
+    for (const std::string_view literal : { "true", "false", "null" })
+    {
+        if (in.substr(0, literal.size()) == literal)
+        {
+            in.remove_prefix(literal.size());
+            return true;
+        }
+    }
+    std::string_view token;
+    bool             integral = false;
+    return scan_number(in, token, integral);
+}
+
+bool parse_transit_payload(std::string_view body, TransitPayload& out)
+{
+    TransitPayload p;
+    bool           has_mode     = false;
+    bool           has_distance = false;
+
+    if (!consume(body, '{'))
+        return false;
+    if (consume(body, '}'))
+        return false; // no mode or distance_km
+    do
+    {
+        std::string_view key;
+        if (!parse_string(body, key) || !consume(body, ':'))
+            return false;
+
+        bool ok = false;
+        if (key == "mode")
+            ok = has_mode = parse_string(body, p.mode);
+        else if (key == "distance_km")
+            ok = has_distance = parse_double(body, p.distance_km);
+        else if (key == "ts")
+            ok = parse_int(body, p.ts);
+        else if (key == "fuel_type")
+            ok = parse_string(body, p.fuel_type);
+        else if (key == "vehicle_size")
+            ok = parse_string(body, p.vehicle_size);
+        else if (key == "occupancy")
+            ok = parse_double(body, p.occupancy);
+        else if (key == "region")
+            ok = parse_string(body, p.region);
+        else
+            ok = skip_value(body);
+        if (!ok)
+            return false;
+    } while (consume(body, ','));
+
+    if (!consume(body, '}'))
+        return false;
+    skip_ws(body);
+    if (!body.empty() || !has_mode || !has_distance)
+        return false;
+    out = p;
+    return true;
+}
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <stdexcept>
 #include <vector>
 
@@ -22,6 +23,9 @@ TransitEvent::TransitEvent(const std::string& user_id_, const std::string& mode_
     if (distance_km_ < 0.0)
         throw std::runtime_error("Negative value for distance_km is not allowed.");
 
+    if (!std::isfinite(distance_km_))
+        throw std::runtime_error("distance_km must be a finite number.");
+
     if (std::find(k_allowed_transit_modes.begin(), k_allowed_transit_modes.end(), mode_) ==
         k_allowed_transit_modes.end())
         throw std::runtime_error("invalid mode");
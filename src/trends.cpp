@@ -0,0 +1,136 @@
+#include "trends.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static void add_totals(HistoryTotals& t, const DailyRollup& r)
+{
+    t.trips += r.trips;
+    t.distance_km += r.distance_km;
+    t.kg_co2 += r.kg_co2;
+}
+
+// kg CO2e per km for a mode, preferring this week's mix of trips; 0 if it wasn't used at all.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static double intensity(const ModeTrend& m)
+{
+    if (m.this_week.distance_km > 0.0)
+        return m.this_week.kg_co2 / m.this_week.distance_km;
+    if (m.last_week.distance_km > 0.0)
+        return m.last_week.kg_co2 / m.last_week.distance_km;
+    return 0.0;
+}
+
+// Pairs the modes whose distance fell with the modes whose distance grew, largest first, so the
+// km each pair moved is attributed once.
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::vector<ModeShift> detect_shifts(const WeeklyTrends& t)
+{
+    std::vector<ModeShift> shifts;
+    if (t.last_week.distance_km <= 0.0)
+        return shifts;
+    const double min_km = std::max(k_min_shift_km, k_min_shift_share * t.last_week.distance_km);
+
+    struct Change
+    {
+        const ModeTrend* mode;
+        double           km;
+    };
+    std::vector<Change> fell;
+    std::vector<Change> grew;
+    for (const auto& m : t.modes)
+    {
+        const double d = m.this_week.distance_km - m.last_week.distance_km;
+        if (d < 0.0)
+            fell.push_back({ &m, -d });
+        else if (d > 0.0)
+            grew.push_back({ &m, d });
+    }
+    auto by_km = [](const Change& a, const Change& b) { return a.km > b.km; };
+    std::sort(fell.begin(), fell.end(), by_km);
+    std::sort(grew.begin(), grew.end(), by_km);
+
+    std::size_t f = 0;
+    std::size_t g = 0;
+    while (f < fell.size() && g < grew.size())
+    {
+        const double km = std::min(fell[f].km, grew[g].km);
+        if (km >= min_km)
+            shifts.push_back({ fell[f].mode->mode, grew[g].mode->mode, km,
+                               km * (intensity(*grew[g].mode) - intensity(*fell[f].mode)) });
+        fell[f].km -= km;
+        grew[g].km -= km;
+        if (fell[f].km <= 0.0)
+            ++f;
+        if (grew[g].km <= 0.0)
+            ++g;
+    }
+    std::sort(shifts.begin(), shifts.end(), [](const ModeShift& a, const ModeShift& b)
+              { return std::abs(a.kg_co2_delta) > std::abs(b.kg_co2_delta); });
+    return shifts;
+}
+
+WeeklyTrends weekly_trends(const std::vector<DailyRollup>& rollups, std::int64_t today)
+{
+    WeeklyTrends                     t;
+    std::map<std::string, ModeTrend> modes;
+    for (const auto& r : rollups)
+    {
+        const auto age = today - r.day;
+        if (age < 0 || age >= 14)
+            continue;
+        auto& m = modes[r.mode];
+        m.mode  = r.mode;
+        add_totals(age < 7 ? m.this_week : m.last_week, r);
+        add_totals(age < 7 ? t.this_week : t.last_week, r);
+    }
+    t.modes.reserve(modes.size());
+    for (auto& [mode, m] : modes)
+        t.modes.push_back(std::move(m));
+    t.shifts = detect_shifts(t);
+    return t;
+}
+
+WeeklyTrends weekly_trends(const IStore& store, const std::string& user, std::int64_t now)
+{
+    const auto today = epoch_day(now);
+    return weekly_trends(store.get_rollups(user, today - 13, today), today);
+}
+
+std::vector<std::string> trend_suggestions(const WeeklyTrends& t)
+{
+    std::vector<std::string> out;
+    for (const auto& s : t.shifts)
+    {
+        std::ostringstream msg;
+        msg << std::fixed << std::setprecision(0);
+        if (s.kg_co2_delta > 0.0)
+            msg << "About " << s.distance_km << " km moved from " << s.from_mode << " to " << s.to_mode
+                << " this week, adding " << std::setprecision(1) << s.kg_co2_delta
+                << " kg CO2e. Switching back would save that.";
+        else if (s.kg_co2_delta < 0.0)
+            msg << "Nice shift: about " << s.distance_km << " km moved from " << s.from_mode << " to "
+                << s.to_mode << " saved " << std::setprecision(1) << -s.kg_co2_delta << " kg CO2e this week.";
+        else
+            continue;
+        out.push_back(msg.str());
+    }
+
+    // A rise of more than a fifth (and a kilogram) that the shifts above don't already explain
+    const double delta = t.kg_co2_delta();
+    if (t.last_week.kg_co2 > 0.0 && delta > std::max(1.0, 0.2 * t.last_week.kg_co2) && t.shifts.empty())
+    {
+        const auto top = std::max_element(
+            t.modes.begin(), t.modes.end(), [](const ModeTrend& a, const ModeTrend& b)
+            { return a.this_week.kg_co2 - a.last_week.kg_co2 < b.this_week.kg_co2 - b.last_week.kg_co2; });
+        std::ostringstream msg;
+        msg << std::fixed << std::setprecision(0) << "Your footprint is up "
+            << 100.0 * delta / t.last_week.kg_co2 << "% on last week, mostly from " << top->mode << " trips.";
+        out.push_back(msg.str());
+    }
+    return out;
+}
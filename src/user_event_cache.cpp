@@ -0,0 +1,139 @@
+#include "user_event_cache.hpp"
+
+// Hash node, list node and bookkeeping per cached user
+static constexpr std::size_t k_entry_overhead = 128;
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::size_t heap_bytes(const std::string& s)
+{
+    // Short strings live inside the object (SSO)
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+// NOLINTNEXTLINE(misc-use-anonymous-namespace)
+static std::size_t heap_bytes(const TransitEvent& ev)
+{
+    return heap_bytes(ev.user_id) + heap_bytes(ev.mode) + heap_bytes(ev.fuel_type) +
+           heap_bytes(ev.vehicle_size) + heap_bytes(ev.region);
+}
+
+UserEventCache::UserEventCache(std::size_t budget_bytes) : budget_(budget_bytes)
+{
+}
+
+const std::vector<TransitEvent>* UserEventCache::find(const std::string& user)
+{
+    const auto it = index_.find(user);
+    if (it == index_.end())
+        return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return &it->second->events;
+}
+
+bool UserEventCache::contains(const std::string& user) const
+{
+    return index_.count(user) != 0;
+}
+
+const std::vector<DailyRollup>& UserEventCache::rollups(const std::string& user) const
+{
+    static const std::vector<DailyRollup> none;
+    const auto                            it = index_.find(user);
+    return it == index_.end() ? none : it->second->rollups;
+}
+
+void UserEventCache::insert(const std::string& user, std::vector<TransitEvent> events,
+                            std::vector<DailyRollup> rollups)
+{
+    erase(user);
+    lru_.push_front(Entry{ user, std::move(events), std::move(rollups), std::nullopt, {}, 0 });
+    index_.emplace(user, lru_.begin());
+    account(lru_.front());
+    evict_to_budget(lru_.begin());
+}
+
+void UserEventCache::append(const TransitEvent& ev)
+{
+    const auto it = index_.find(ev.user_id);
+    if (it == index_.end())
+        return;
+    auto&      entry    = *it->second;
+    const auto old_size = entry.bytes;
+    const auto old_cap  = entry.events.capacity();
+    entry.events.push_back(ev);
+    entry.summary.reset();
+    entry.bytes += (entry.events.capacity() - old_cap) * sizeof(TransitEvent) + heap_bytes(ev);
+    bytes_ += entry.bytes - old_size;
+    evict_to_budget(it->second);
+}
+
+void UserEventCache::erase(const std::string& user)
+{
+    const auto it = index_.find(user);
+    if (it == index_.end())
+        return;
+    bytes_ -= it->second->bytes;
+    lru_.erase(it->second);
+    index_.erase(it);
+}
+
+void UserEventCache::clear()
+{
+    lru_.clear();
+    index_.clear();
+    bytes_ = 0;
+}
+
+std::optional<FootprintSummary> UserEventCache::summary(const std::string& user, Clock::time_point now,
+                                                        Clock::duration max_age) const
+{
+    const auto it = index_.find(user);
+    if (it == index_.end() || !it->second->summary || now - it->second->summary_at > max_age)
+        return std::nullopt;
+    return it->second->summary;
+}
+
+void UserEventCache::set_summary(const std::string& user, const FootprintSummary& s, Clock::time_point now)
+{
+    const auto it = index_.find(user);
+    if (it == index_.end())
+        return;
+    it->second->summary    = s;
+    it->second->summary_at = now;
+}
+
+void UserEventCache::drop_summary(const std::string& user)
+{
+    const auto it = index_.find(user);
+    if (it != index_.end())
+        it->second->summary.reset();
+}
+
+void UserEventCache::account(Entry& e)
+{
+    std::size_t bytes = k_entry_overhead + heap_bytes(e.user) + e.events.capacity() * sizeof(TransitEvent);
+    for (const auto& ev : e.events)
+        bytes += heap_bytes(ev);
+    bytes += e.rollups.capacity() * sizeof(DailyRollup);
+    for (const auto& r : e.rollups)
+        bytes += heap_bytes(r.user_id) + heap_bytes(r.mode);
+    bytes_  = bytes_ - e.bytes + bytes;
+    e.bytes = bytes;
+}
+
+void UserEventCache::evict_to_budget(const Lru::iterator& keep)
+{
+    if (budget_ == 0)
+        return;
+    auto it = lru_.end();
+    while (bytes_ > budget_ && it != lru_.begin())
+    {
+        --it;
+        if (it == keep)
+            continue;
+        bytes_ -= it->bytes;
+        index_.erase(it->user);
+        it = lru_.erase(it);
+        ++evictions_;
+    }
+}
@@ -0,0 +1,453 @@
+#include "write_behind_store.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <map>
+
+WriteBehindStore::WriteBehindStore(std::unique_ptr<IStore> inner, const WriteBehindOptions& opts)
+    : inner_(std::move(inner)), opts_(opts), cache_(opts.cache_bytes)
+{
+    if (!inner_)
+        throw std::runtime_error("WriteBehindStore needs a store to wrap");
+    opts_.batch_size  = std::max<std::size_t>(opts_.batch_size, 1);
+    opts_.max_pending = std::max(opts_.max_pending, opts_.batch_size);
+    horizon_          = inner_->retention_horizon();
+    if (opts_.mode == WriteMode::WriteBehind)
+        flusher_ = std::thread([this] { flusher_loop(); });
+}
+
+WriteBehindStore::~WriteBehindStore()
+{
+    {
+        std::scoped_lock lk(mu_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    if (flusher_.joinable())
+        flusher_.join();
+
+    try
+    {
+        flush();
+    }
+    catch (const std::exception& ex)
+    {
+        std::scoped_lock lk(mu_);
+        std::cerr << "[charizard] write-behind: dropping " << pending_events_.size() << " events and "
+                  << pending_logs_.size() << " log records on shutdown: " << ex.what() << '\n';
+    }
+}
+
+void WriteBehindStore::flusher_loop()
+{
+    std::unique_lock lk(mu_);
+    while (!stopping_)
+    {
+        work_cv_.wait_for(lk, opts_.flush_interval,
+                          [this]
+                          {
+                              return stopping_ ||
+                                     pending_events_.size() + pending_logs_.size() >= opts_.batch_size;
+                          });
+        if (stopping_ || (pending_events_.empty() && pending_logs_.empty()))
+            continue;
+        lk.unlock();
+        bool failed = false;
+        try
+        {
+            std::scoped_lock flk(flush_mu_);
+            flush_batch_locked();
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << "[charizard] write-behind flush failed, will retry: " << ex.what() << '\n';
+            failed = true;
+        }
+        lk.lock();
+        if (failed) // don't spin against a store that is down
+            work_cv_.wait_for(lk, opts_.flush_interval, [this] { return stopping_; });
+    }
+}
+
+void WriteBehindStore::flush_batch_locked() const
+{
+    // Copy rather than pop: a batch stays buffered (and visible to load_user) until it is written
+    std::vector<TransitEvent> evs;
+    std::vector<ApiLogRecord> logs;
+    {
+        std::scoped_lock lk(mu_);
+        const auto n_evs = std::min(pending_events_.size(), opts_.batch_size);
+        evs.assign(pending_events_.begin(), pending_events_.begin() + static_cast<std::ptrdiff_t>(n_evs));
+        const auto n_logs = std::min(pending_logs_.size(), opts_.batch_size - n_evs);
+        logs.assign(pending_logs_.begin(), pending_logs_.begin() + static_cast<std::ptrdiff_t>(n_logs));
+    }
+
+    auto write = [this](auto& pending, const auto& batch, auto&& write_batch)
+    {
+        if (batch.empty())
+            return;
+        try
+        {
+            write_batch(batch);
+        }
+        catch (...)
+        {
+            std::scoped_lock lk(mu_);
+            ++stats_.failed_batches;
+            throw;
+        }
+        {
+            std::scoped_lock lk(mu_);
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(batch.size()));
+            stats_.flushed += batch.size();
+            ++stats_.batches;
+        }
+        space_cv_.notify_all();
+    };
+    write(pending_events_, evs, [this](const auto& batch) { inner_->add_events(batch); });
+    write(pending_logs_, logs, [this](const auto& batch) { inner_->append_logs(batch); });
+}
+
+void WriteBehindStore::drain_locked() const
+{
+    for (;;)
+    {
+        {
+            std::scoped_lock lk(mu_);
+            if (pending_events_.empty() && pending_logs_.empty())
+                return;
+        }
+        flush_batch_locked();
+    }
+}
+
+void WriteBehindStore::flush() const
+{
+    std::scoped_lock flk(flush_mu_);
+    drain_locked();
+}
+
+WriteBehindStats WriteBehindStore::stats() const
+{
+    std::scoped_lock lk(mu_);
+    auto             s = stats_;
+    s.pending          = pending_events_.size() + pending_logs_.size();
+    s.evictions        = cache_.evictions();
+    s.cached_users     = cache_.size();
+    s.cache_bytes      = cache_.bytes();
+    s.cache_budget     = cache_.budget_bytes();
+    return s;
+}
+
+void WriteBehindStore::load_user(const std::string& user) const
+{
+    std::scoped_lock flk(flush_mu_);
+    {
+        std::scoped_lock lk(mu_);
+        if (cache_.contains(user))
+            return;
+    }
+    // With flush_mu_ held every event is either in the wrapped store or still buffered, never
+    // both. Events added while we read are buffered, so they are picked up below.
+    // Only days before the horizon need their rollups; summarize sums later days from events
+    auto                     evs = inner_->get_events(user);
+    std::vector<DailyRollup> rollups;
+    if (const auto horizon = retention_horizon(); horizon > 0)
+        rollups = inner_->get_rollups(user, std::numeric_limits<std::int64_t>::min(), epoch_day(horizon) - 1);
+    std::scoped_lock lk(mu_);
+    for (const auto& ev : pending_events_)
+    {
+        if (ev.user_id != user)
+            continue;
+        evs.push_back(ev);
+        if (ev.ts >= horizon_)
+            continue;
+        // A backdated event the wrapped store will fold into a retired day once it is flushed
+        const auto day      = epoch_day(ev.ts);
+        auto       same_day = [&](const DailyRollup& r) { return r.day == day && r.mode == ev.mode; };
+        auto       it       = std::find_if(rollups.begin(), rollups.end(), same_day);
+        add_to_rollup(it == rollups.end() ? rollups.emplace_back() : *it, ev);
+    }
+    cache_.insert(user, std::move(evs), std::move(rollups));
+}
+
+const std::vector<TransitEvent>& WriteBehindStore::cached_events(const std::string&            user,
+                                                                 std::unique_lock<std::mutex>& lk) const
+{
+    bool loaded = false;
+    auto evs    = cache_.find(user);
+    while (evs == nullptr) // another load may evict the user again before we relock
+    {
+        lk.unlock();
+        load_user(user);
+        lk.lock();
+        loaded = true;
+        evs    = cache_.find(user);
+    }
+    ++(loaded ? stats_.misses : stats_.hits);
+    return *evs;
+}
+
+// ===== API keys =====
+
+void WriteBehindStore::set_api_key(const std::string& user, const std::string& key,
+                                   const std::string& app_name)
+{
+    inner_->set_api_key(user, key, app_name);
+}
+
+bool WriteBehindStore::check_api_key(const std::string& user, const std::string& key) const
+{
+    return inner_->check_api_key(user, key);
+}
+
+bool WriteBehindStore::has_api_keys() const
+{
+    return inner_->has_api_keys();
+}
+
+// ===== Logs and admin =====
+
+void WriteBehindStore::append_log(const ApiLogRecord& rec)
+{
+    if (opts_.mode == WriteMode::WriteThrough)
+    {
+        inner_->append_log(rec);
+        std::scoped_lock lk(mu_);
+        ++stats_.flushed;
+        return;
+    }
+    std::unique_lock lk(mu_);
+    space_cv_.wait(lk, [this] { return pending_events_.size() + pending_logs_.size() < opts_.max_pending; });
+    pending_logs_.push_back(rec);
+    if (pending_events_.size() + pending_logs_.size() >= opts_.batch_size)
+        work_cv_.notify_one();
+}
+
+std::vector<ApiLogRecord> WriteBehindStore::get_logs(std::size_t limit) const
+{
+    flush();
+    return inner_->get_logs(limit);
+}
+
+void WriteBehindStore::clear_logs()
+{
+    std::scoped_lock flk(flush_mu_);
+    {
+        std::scoped_lock lk(mu_);
+        pending_logs_.clear();
+    }
+    space_cv_.notify_all();
+    inner_->clear_logs();
+}
+
+std::vector<std::string> WriteBehindStore::get_clients() const
+{
+    flush();
+    return inner_->get_clients();
+}
+
+std::vector<TransitEvent> WriteBehindStore::get_client_data(const std::string& client_id) const
+{
+    return get_events(client_id);
+}
+
+void WriteBehindStore::clear_db_events()
+{
+    std::scoped_lock flk(flush_mu_);
+    {
+        std::scoped_lock lk(mu_);
+        pending_events_.clear();
+        cache_.clear();
+    }
+    space_cv_.notify_all();
+    inner_->clear_db_events();
+}
+
+void WriteBehindStore::clear_db()
+{
+    std::scoped_lock flk(flush_mu_);
+    {
+        std::scoped_lock lk(mu_);
+        pending_events_.clear();
+        pending_logs_.clear();
+        cache_.clear();
+    }
+    space_cv_.notify_all();
+    inner_->clear_db();
+}
+
+// ===== Events =====
+
+void WriteBehindStore::add_event(const TransitEvent& ev)
+{
+    if (opts_.mode == WriteMode::WriteThrough)
+    {
+        // flush_mu_ keeps a concurrent load_user from missing or double-counting this event
+        {
+            std::scoped_lock flk(flush_mu_);
+            inner_->add_event(ev);
+            std::scoped_lock lk(mu_);
+            ++stats_.flushed;
+            cache_event(ev);
+        }
+        notify_ingested(ev);
+        return;
+    }
+    {
+        std::unique_lock lk(mu_);
+        space_cv_.wait(lk,
+                       [this] { return pending_events_.size() + pending_logs_.size() < opts_.max_pending; });
+        pending_events_.push_back(ev);
+        cache_event(ev);
+        if (pending_events_.size() + pending_logs_.size() >= opts_.batch_size)
+            work_cv_.notify_one();
+    }
+    // Counted once accepted; the wrapped store, which gets it later, has no listener of its own
+    notify_ingested(ev);
+}
+
+void WriteBehindStore::cache_event(const TransitEvent& ev)
+{
+    // An event before the horizon belongs in a cached rollup; reloading the user rebuilds them
+    if (ev.ts < horizon_)
+        cache_.erase(ev.user_id);
+    else
+        cache_.append(ev);
+}
+
+std::vector<TransitEvent> WriteBehindStore::get_events(const std::string& user) const
+{
+    std::unique_lock lk(mu_);
+    return cached_events(user, lk);
+}
+
+FootprintSummary WriteBehindStore::summarize(const std::string& user)
+{
+    using clock = std::chrono::system_clock;
+    const auto now =
+        std::chrono::duration_cast<std::chrono::seconds>(clock::now().time_since_epoch()).count();
+    const auto week_start  = now - (7 * 24 * 3600);
+    const auto month_start = now - (30 * 24 * 3600);
+    const auto computed_at = UserEventCache::Clock::now();
+
+    std::unique_lock lk(mu_);
+    if (auto cached = cache_.summary(user, computed_at, opts_.summary_ttl))
+    {
+        cache_.find(user); // keep it recently used
+        ++stats_.hits;
+        ++stats_.summary_hits;
+        return *cached;
+    }
+
+    FootprintSummary s{};
+    const auto&      evs = cached_events(user, lk);
+    const auto       kgs = calculate_co2_emissions(evs);
+    for (std::size_t i = 0; i < evs.size(); ++i)
+    {
+        const auto& ev = evs[i];
+        if (ev.ts < horizon_)
+            continue; // counted in its rollup
+        const double kg = kgs[i];
+        s.lifetime_kg_co2 += kg;
+        if (ev.ts >= week_start)
+            s.week_kg_co2 += kg;
+        if (ev.ts >= month_start)
+            s.month_kg_co2 += kg;
+    }
+    for (const auto& r : cache_.rollups(user))
+        add_to_summary(s, r, week_start, month_start);
+    cache_.set_summary(user, s, computed_at);
+    return s;
+}
+
+double WriteBehindStore::global_average_weekly()
+{
+    flush();
+    return inner_->global_average_weekly();
+}
+
+// ===== Emission factors =====
+
+void WriteBehindStore::store_emission_factor(const EmissionFactor& factor)
+{
+    inner_->store_emission_factor(factor);
+}
+
+std::optional<EmissionFactor> WriteBehindStore::get_emission_factor(const std::string& mode,
+                                                                    const std::string& fuel_type,
+                                                                    const std::string& vehicle_size) const
+{
+    return inner_->get_emission_factor(mode, fuel_type, vehicle_size);
+}
+
+std::vector<EmissionFactor> WriteBehindStore::get_all_emission_factors() const
+{
+    return inner_->get_all_emission_factors();
+}
+
+void WriteBehindStore::clear_emission_factors()
+{
+    inner_->clear_emission_factors();
+}
+
+// ===== Retention =====
+
+RetentionResult WriteBehindStore::apply_retention(std::int64_t event_cutoff, std::int64_t log_cutoff)
+{
+    std::scoped_lock flk(flush_mu_);
+    drain_locked();
+    const auto res     = inner_->apply_retention(event_cutoff, log_cutoff);
+    const auto horizon = inner_->retention_horizon();
+    std::scoped_lock lk(mu_);
+    horizon_ = horizon;
+    cache_.clear();
+    return res;
+}
+
+std::int64_t WriteBehindStore::retention_horizon() const
+{
+    std::scoped_lock lk(mu_);
+    return horizon_;
+}
+
+std::size_t WriteBehindStore::reprice_rollups(const std::string& user, const FactorChangeSet& changes)
+{
+    // Not under flush_mu_, which would stall every reader of the wrapped store: each store keeps
+    // its own add_events() out of the rollups it is rewriting
+    const auto rewritten = inner_->reprice_rollups(user, changes);
+    // A cached summary priced the user's events with the table in effect when it was computed.
+    // The cached events and the retired days' rollups are still right, since repricing leaves
+    // days before the horizon alone.
+    std::scoped_lock lk(mu_);
+    cache_.drop_summary(user);
+    return rewritten;
+}
+
+std::vector<DailyRollup> WriteBehindStore::get_rollups(const std::string& user, std::int64_t from_day,
+                                                       std::int64_t to_day) const
+{
+    // As in load_user, flush_mu_ puts every event either in the wrapped store or in the buffer
+    std::scoped_lock                                             flk(flush_mu_);
+    std::map<std::pair<std::int64_t, std::string>, DailyRollup> days;
+    for (auto& r : inner_->get_rollups(user, from_day, to_day))
+    {
+        auto key = std::make_pair(r.day, r.mode);
+        days.emplace(std::move(key), std::move(r));
+    }
+    {
+        std::scoped_lock lk(mu_);
+        for (const auto& ev : pending_events_)
+        {
+            const auto day = epoch_day(ev.ts);
+            if (ev.user_id == user && day >= from_day && day <= to_day)
+                add_to_rollup(days[{ day, ev.mode }], ev);
+        }
+    }
+    std::vector<DailyRollup> out;
+    out.reserve(days.size());
+    for (auto& [key, r] : days)
+        out.push_back(std::move(r));
+    return out;
+}
@@ -4,8 +4,10 @@
 #include "storage.hpp"
 
 #include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <httplib.h>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <thread>
 #include <tuple>
@@ -56,9 +58,9 @@ struct TestServer
     std::thread     th;
     int             port = 18080; // fixed test port; change if needed
 
-    TestServer(IStore& store)
+    TestServer(IStore& store, const ApiServices& services = {})
     {
-        configure_routes(svr, store);
+        configure_routes(svr, store, services);
         th = std::thread(
             [this]
             {
@@ -494,6 +496,47 @@ TEST(ApiTransit, Success_IntegerDistanceAccepted)
     EXPECT_EQ(json::parse(res->body).value("status", ""), "ok");
 }
 
+TEST(ApiTransit, Success_StoresVehicleDetails)
+{
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    // The first body takes the fixed-schema parser, the escaped one the generic JSON path
+    for (const char* body : { R"({"mode":"car","distance_km":10,"fuel_type":"diesel","occupancy":2})",
+                              R"({"mode":"c\u0061r","distance_km":10,"fuel_type":"diesel","occupancy":2})" })
+    {
+        auto res = cli.Post("/users/demo/transit", demo_auth_headers(), body, "application/json");
+        ASSERT_TRUE(res != nullptr);
+        EXPECT_EQ(res->status, 201) << body;
+    }
+
+    const auto events = mem.get_events("demo");
+    ASSERT_EQ(events.size(), 2U);
+    for (const auto& ev : events)
+    {
+        EXPECT_EQ(ev.mode, "car");
+        EXPECT_EQ(ev.fuel_type, "diesel");
+        EXPECT_DOUBLE_EQ(ev.occupancy, 2.0);
+    }
+}
+
+TEST(ApiTransit, Failure_OccupancyBelowOne)
+{
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    auto res = cli.Post("/users/demo/transit", demo_auth_headers(),
+                        R"({"mode":"car","distance_km":5,"occupancy":0})", "application/json");
+
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 400);
+    EXPECT_TRUE(mem.get_events("demo").empty());
+}
+
 /* Content-Type variations: server parses req.body regardless of header */
 TEST(ApiTransit, Failure_TextPlainWithJsonBody)
 {
@@ -608,6 +651,35 @@ TEST(ApiFootprint, Success_ZeroWhenNoEvents)
     EXPECT_DOUBLE_EQ(j.value("last_30d_kg_co2", 123.0), 0.0);
 }
 
+// The handlers write these bodies with JsonWriter, member by member: pin the exact bytes so a
+// field added out of key order shows up here rather than in a client
+TEST(ApiFootprint, BodiesArePinnedByteForByte)
+{
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    auto res = cli.Get("/users/demo/lifetime-footprint", demo_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->body,
+              R"({"last_30d_kg_co2":0.0,"last_7d_kg_co2":0.0,"lifetime_kg_co2":0.0,"user_id":"demo"})");
+
+    res = cli.Get("/users/demo/lifetime-footprint");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->body, R"({"error":"unauthorized"})");
+
+    const json body = { { "mode", "bus" }, { "distance_km", 1.0 } };
+    res             = cli.Post("/users/demo/transit", demo_auth_headers(), body.dump(), "application/json");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->body, R"({"status":"ok"})");
+
+    res = cli.Get("/health");
+    ASSERT_TRUE(res != nullptr);
+    const auto time = json::parse(res->body)["time"].get<std::int64_t>();
+    EXPECT_EQ(res->body, R"({"ok":true,"service":"charizard","time":)" + std::to_string(time) + "}");
+}
+
 // -------------- Success: with events ----------------
 
 TEST(ApiFootprint, Success_AccumulatesAndRespectsWindows)
@@ -2029,6 +2101,119 @@ TEST(AdminEmissionFactors, LoadDefra2024_Unauthorized)
     EXPECT_EQ(res->status, 401);
 }
 
+TEST(AdminEmissionFactors, LoadStartsRecomputeAndReportsProgress)
+{
+    set_admin_key("super-secret");
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    RecomputeJob recompute(mem, 2, 1);
+    ApiServices  services;
+    services.recompute = &recompute;
+
+    TestServer const server(mem, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+    post_transit(cli, 5.0, "bus", static_cast<std::int64_t>(std::time(nullptr)));
+
+    auto res = cli.Post("/admin/emission-factors/load", admin_auth_headers(), "", "application/json");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    auto j = json::parse(res->body);
+    EXPECT_TRUE(j["recompute_started"].get<bool>());
+    EXPECT_EQ(j["recompute"]["runs"], 1);
+
+    recompute.wait();
+    res = cli.Get("/admin/emission-factors/recompute", admin_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    j = json::parse(res->body);
+    EXPECT_FALSE(j["running"].get<bool>());
+    EXPECT_EQ(j["users_total"], 1);
+    EXPECT_EQ(j["users_done"], 1);
+    EXPECT_EQ(j["rollups"], 1);
+    EXPECT_TRUE(j["error"].is_null());
+
+    res = cli.Get("/admin/emission-factors/recompute", demo_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 401);
+}
+
+// Holds the first re-priced user until release(), so a second load lands during the job.
+class GatedRepriceStore : public InMemoryStore
+{
+  public:
+    std::size_t reprice_rollups(const std::string& user, const FactorChangeSet& changes) override
+    {
+        {
+            std::unique_lock lk(mu_);
+            if (!entered_)
+            {
+                entered_ = true;
+                cv_.notify_all();
+                cv_.wait(lk, [this] { return released_; });
+            }
+        }
+        return InMemoryStore::reprice_rollups(user, changes);
+    }
+
+    void wait_entered()
+    {
+        std::unique_lock lk(mu_);
+        cv_.wait(lk, [this] { return entered_; });
+    }
+
+    void release()
+    {
+        std::scoped_lock lk(mu_);
+        released_ = true;
+        cv_.notify_all();
+    }
+
+  private:
+    std::mutex              mu_;
+    std::condition_variable cv_;
+    bool                    entered_  = false;
+    bool                    released_ = false;
+};
+
+TEST(AdminEmissionFactors, LoadDuringRecomputeQueuesAnotherRun)
+{
+    set_admin_key("super-secret");
+    GatedRepriceStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    RecomputeJob recompute(mem, 1, 1);
+    ApiServices  services;
+    services.recompute = &recompute;
+
+    TestServer const server(mem, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+    post_transit(cli, 5.0, "bus", static_cast<std::int64_t>(std::time(nullptr)));
+
+    auto res = cli.Post("/admin/emission-factors/load", admin_auth_headers(), "", "application/json");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_TRUE(json::parse(res->body)["recompute_started"].get<bool>());
+    mem.wait_entered();
+
+    res = cli.Post("/admin/emission-factors/load", admin_auth_headers(), "", "application/json");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    auto j = json::parse(res->body);
+    EXPECT_FALSE(j["recompute_started"].get<bool>());
+    EXPECT_TRUE(j["recompute"]["running"].get<bool>());
+    EXPECT_TRUE(j["recompute"]["rerun_pending"].get<bool>());
+
+    mem.release();
+    recompute.wait();
+    res = cli.Get("/admin/emission-factors/recompute", admin_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    j = json::parse(res->body);
+    EXPECT_FALSE(j["running"].get<bool>());
+    EXPECT_FALSE(j["rerun_pending"].get<bool>());
+    EXPECT_EQ(j["runs"], 2);
+    EXPECT_EQ(j["factor_version"], active_factor_table()->version());
+    EXPECT_EQ(j["latest_factor_version"], active_factor_table()->version());
+    EXPECT_EQ(j["users_done"], 1);
+}
+
 TEST(AdminEmissionFactors, GetFactors_Unauthorized)
 {
     set_admin_key("super-secret");
@@ -2042,3 +2227,392 @@ TEST(AdminEmissionFactors, GetFactors_Unauthorized)
     ASSERT_TRUE(res != nullptr);
     EXPECT_EQ(res->status, 401);
 }
+
+/* ---- Admission Control Tests ---- */
+
+TEST(Admission, AnalyticsOverLimit_Returns503WithRetryAfter)
+{
+    AdmissionLimits limits;
+    limits.analytics = { 1, 0 };
+    AdmissionController admission(limits);
+    ApiServices         services;
+    services.admission = &admission;
+
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    TestServer const server(mem, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    // Occupy the only analytics slot; ingestion must still go through
+    auto held = admission.try_acquire(RouteClass::Analytics);
+    ASSERT_TRUE(held);
+
+    auto res = cli.Get("/users/demo/analytics", demo_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 503);
+    EXPECT_EQ(res->get_header_value("Retry-After"), "1");
+    EXPECT_EQ(json::parse(res->body)["error"], "overloaded");
+
+    post_transit(cli, 5.0, "bus", static_cast<std::int64_t>(std::time(nullptr)));
+
+    held    = AdmissionTicket{};
+    auto ok = cli.Get("/users/demo/analytics", demo_auth_headers());
+    ASSERT_TRUE(ok != nullptr);
+    EXPECT_EQ(ok->status, 200);
+}
+
+TEST(Admission, StreamedExportHoldsAdminSlotUntilBodyIsSent)
+{
+    set_admin_key("super-secret");
+    AdmissionController admission;
+    ApiServices         services;
+    services.admission = &admission;
+
+    InMemoryStore mem;
+    for (int i = 0; i < 1000; ++i)
+        mem.add_event(TransitEvent("demo", "car", 1.0 + i, 1700000000 + i));
+    TestServer const server(mem, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    std::size_t in_flight_while_streaming = 0;
+    std::string body;
+    auto        receive = [&](const char* data, std::size_t len)
+    {
+        if (body.empty())
+            in_flight_while_streaming = admission.stats(RouteClass::Admin).in_flight;
+        body.append(data, len);
+        return true;
+    };
+    auto res = cli.Get("/admin/clients/demo/data", admin_auth_headers(), receive);
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    EXPECT_EQ(json::parse(body).size(), 1000U);
+    EXPECT_EQ(in_flight_while_streaming, 1U);
+
+    // Released once the last chunk has been written
+    for (int spins = 0; admission.stats(RouteClass::Admin).in_flight > 0 && spins < 1000; ++spins)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(admission.stats(RouteClass::Admin).in_flight, 0U);
+}
+
+TEST(AdminMetrics, ReportsAdmissionCountersPerRouteClass)
+{
+    set_admin_key("super-secret");
+    AdmissionController admission;
+    ApiServices         services;
+    services.admission = &admission;
+
+    InMemoryStore    mem;
+    TestServer const server(mem, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    ASSERT_TRUE(cli.Get("/health") != nullptr);
+    auto res = cli.Get("/admin/metrics", admin_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+
+    auto j = json::parse(res->body);
+    ASSERT_TRUE(j.contains("admission"));
+    EXPECT_EQ(j["admission"]["health"]["admitted"].get<int>(), 1);
+    EXPECT_EQ(j["admission"]["analytics"]["max_concurrent"].get<int>(), 4);
+    EXPECT_EQ(j["admission"]["analytics"]["rejected"].get<int>(), 0);
+}
+
+TEST(AdminMetrics, ReportsStoreCacheHitRatio)
+{
+    set_admin_key("super-secret");
+    WriteBehindStore store(std::make_unique<InMemoryStore>());
+    store.set_api_key("demo", "secret-demo-key");
+    ApiServices services;
+    services.store_cache = &store;
+
+    TestServer const server(store, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    post_transit(cli, 5.0, "bus", static_cast<std::int64_t>(std::time(nullptr)));
+    ASSERT_TRUE(cli.Get("/users/demo/lifetime-footprint", demo_auth_headers()) != nullptr);
+    ASSERT_TRUE(cli.Get("/users/demo/lifetime-footprint", demo_auth_headers()) != nullptr);
+
+    auto res = cli.Get("/admin/metrics", admin_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    auto j = json::parse(res->body);
+    ASSERT_TRUE(j.contains("store_cache"));
+    EXPECT_EQ(j["store_cache"]["misses"].get<int>(), 1);
+    EXPECT_GE(j["store_cache"]["hits"].get<int>(), 1);
+    EXPECT_GT(j["store_cache"]["hit_ratio"].get<double>(), 0.0);
+}
+
+TEST(AdminMetrics, Unauthorized)
+{
+    set_admin_key("super-secret");
+    InMemoryStore    mem;
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    auto res = cli.Get("/admin/metrics");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 401);
+}
+
+/* ---- Rate Limiting Tests ---- */
+
+TEST(RateLimit, PerUserBucket_Returns429BeforeAuth)
+{
+    RateLimiter user_limiter({ 0.01, 2.0 });
+    ApiServices services;
+    services.user_limiter = &user_limiter;
+
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    TestServer const server(mem, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    const auto now = static_cast<std::int64_t>(std::time(nullptr));
+    post_transit(cli, 1.0, "bus", now);
+    post_transit(cli, 1.0, "bus", now);
+
+    // Bucket is empty: rejected even with a wrong key and a garbage body
+    httplib::Headers bad = { { "X-API-Key", "nope" } };
+    auto             res = cli.Post("/users/demo/transit", bad, "not json", "application/json");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 429);
+    EXPECT_EQ(json::parse(res->body)["error"], "rate_limited");
+    EXPECT_FALSE(res->get_header_value("Retry-After").empty());
+
+    // Another user has its own bucket
+    auto other = cli.Get("/users/someone-else/lifetime-footprint");
+    ASSERT_TRUE(other != nullptr);
+    EXPECT_EQ(other->status, 401);
+}
+
+TEST(RateLimit, PerIpBucket_HealthIsExempt)
+{
+    RateLimiter ip_limiter({ 0.01, 1.0 });
+    ApiServices services;
+    services.ip_limiter = &ip_limiter;
+
+    InMemoryStore    mem;
+    TestServer const server(mem, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    auto first = cli.Post("/users/register", R"({"app_name":"a"})", "application/json");
+    ASSERT_TRUE(first != nullptr);
+    EXPECT_EQ(first->status, 201);
+
+    auto second = cli.Post("/users/register", R"({"app_name":"b"})", "application/json");
+    ASSERT_TRUE(second != nullptr);
+    EXPECT_EQ(second->status, 429);
+
+    auto health = cli.Get("/health");
+    ASSERT_TRUE(health != nullptr);
+    EXPECT_EQ(health->status, 200);
+}
+
+/* ---- Response Compression Tests ---- */
+
+TEST(Compression, SmallExport_NotCompressed)
+{
+    set_admin_key("super-secret");
+    InMemoryStore mem;
+    mem.add_event(TransitEvent("demo", "bus", 3.0, 1700000000));
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    auto headers = admin_auth_headers();
+    headers.insert({ "Accept-Encoding", "gzip, br" });
+    auto res = cli.Get("/admin/clients/demo/data", headers);
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    EXPECT_FALSE(res->has_header("Content-Encoding"));
+    EXPECT_EQ(json::parse(res->body).size(), 1U);
+}
+
+TEST(Compression, LargeExport_StreamedUncompressedWithoutAcceptEncoding)
+{
+    set_admin_key("super-secret");
+    InMemoryStore mem;
+    for (int i = 0; i < 1000; ++i)
+        mem.add_event(TransitEvent("demo", "car", 1.0 + i, 1700000000 + i));
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    auto res = cli.Get("/admin/clients/demo/data", admin_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    EXPECT_FALSE(res->has_header("Content-Encoding"));
+    auto arr = json::parse(res->body);
+    ASSERT_EQ(arr.size(), 1000U);
+    EXPECT_DOUBLE_EQ(arr[999]["distance_km"].get<double>(), 1000.0);
+}
+
+#ifdef CHARIZARD_WITH_ZLIB
+TEST(Compression, LargeExport_GzipWhenAccepted)
+{
+    set_admin_key("super-secret");
+    InMemoryStore mem;
+    for (int i = 0; i < 1000; ++i)
+        mem.add_event(TransitEvent("demo", "car", 1.0 + i, 1700000000 + i));
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    auto headers = admin_auth_headers();
+    headers.insert({ "Accept-Encoding", "gzip" });
+    auto res = cli.Get("/admin/clients/demo/data", headers);
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    EXPECT_EQ(res->get_header_value("Content-Encoding"), "gzip");
+    // gzip magic bytes
+    ASSERT_GE(res->body.size(), 2U);
+    EXPECT_EQ(static_cast<unsigned char>(res->body[0]), 0x1f);
+    EXPECT_EQ(static_cast<unsigned char>(res->body[1]), 0x8b);
+}
+#endif
+
+/* ---- History Tests ---- */
+
+TEST(ApiHistory, Success_WeeklyBucketsFromRollups)
+{
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    const std::int64_t jan1 = 1704067200; // 2024-01-01, a Monday
+    post_transit(cli, 10.0, "bus", jan1 + 3600);
+    post_transit(cli, 20.0, "car", jan1 + 2 * 86400);
+    post_transit(cli, 5.0, "bus", jan1 + 9 * 86400);
+    // Retiring the raw events must not change the answer
+    mem.apply_retention(jan1 + 100 * 86400, 0);
+
+    auto res =
+        cli.Get("/users/demo/history?from=2024-01-01&to=2024-01-31&granularity=week", demo_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+
+    auto j = json::parse(res->body);
+    EXPECT_EQ(j.value("granularity", ""), "week");
+    EXPECT_EQ(j.value("from", ""), "2024-01-01");
+    ASSERT_EQ(j["buckets"].size(), 2U);
+    EXPECT_EQ(j["buckets"][0].value("start", ""), "2024-01-01");
+    EXPECT_EQ(j["buckets"][0].value("trips", 0), 2);
+    EXPECT_DOUBLE_EQ(j["buckets"][0].value("distance_km", 0.0), 30.0);
+    EXPECT_EQ(j["buckets"][0]["modes"]["car"].value("trips", 0), 1);
+    EXPECT_EQ(j["buckets"][1].value("start", ""), "2024-01-08");
+}
+
+TEST(ApiHistory, Failure_InvalidParameters)
+{
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    const std::pair<const char*, const char*> cases[] = {
+        { "/users/demo/history?granularity=year", "invalid_granularity" },
+        { "/users/demo/history?from=2024-02-30", "invalid_date" },
+        { "/users/demo/history?from=2024-02-01&to=2024-01-01", "invalid_range" },
+        { "/users/demo/history?from=2000-01-01&to=2024-01-01", "range_too_large" },
+    };
+    for (const auto& [path, error] : cases)
+    {
+        auto res = cli.Get(path, demo_auth_headers());
+        ASSERT_TRUE(res != nullptr);
+        EXPECT_EQ(res->status, 400) << path;
+        EXPECT_EQ(json::parse(res->body).value("error", ""), error) << path;
+    }
+
+    auto res = cli.Get("/users/demo/history");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 401);
+}
+
+/* ---- Trend Tests ---- */
+
+TEST(ApiAnalytics, Success_ReportsWeekOverWeekModeShift)
+{
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    TestServer const server(mem);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    const auto now = static_cast<std::int64_t>(std::time(nullptr));
+    post_transit(cli, 40.0, "subway", now - 9 * 86400);
+    post_transit(cli, 40.0, "taxi", now);
+
+    auto res = cli.Get("/users/demo/analytics", demo_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    auto j = json::parse(res->body);
+    EXPECT_DOUBLE_EQ(j["week_over_week"]["last_week"].value("distance_km", 0.0), 40.0);
+    EXPECT_GT(j["week_over_week"].value("kg_co2_delta", 0.0), 0.0);
+    EXPECT_DOUBLE_EQ(j["modes"]["taxi"]["this_week"].value("distance_km", 0.0), 40.0);
+    ASSERT_EQ(j["mode_shifts"].size(), 1U);
+    EXPECT_EQ(j["mode_shifts"][0].value("from", ""), "subway");
+    EXPECT_EQ(j["mode_shifts"][0].value("to", ""), "taxi");
+
+    res = cli.Get("/users/demo/suggestions", demo_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    const auto tips = json::parse(res->body)["suggestions"];
+    ASSERT_GE(tips.size(), 2U);
+    EXPECT_NE(tips[0].get<std::string>().find("from subway to taxi"), std::string::npos);
+}
+
+TEST(ApiAnalytics, Success_ReportsPeerPercentiles)
+{
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    const auto now = static_cast<std::int64_t>(std::time(nullptr));
+    for (int u = 1; u <= 9; ++u)
+        mem.add_event(TransitEvent("peer" + std::to_string(u), "bus", 10.0 * u, now));
+    PeerStats   peers(mem, std::chrono::seconds(0));
+    ApiServices services;
+    services.peers = &peers;
+    TestServer const server(mem, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    post_transit(cli, 1000.0, "bus", now); // the heaviest of ten users
+
+    auto res = cli.Get("/users/demo/analytics", demo_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    auto j = json::parse(res->body);
+    EXPECT_EQ(j.value("peer_count", 0), 10);
+    EXPECT_DOUBLE_EQ(j.value("week_percentile", 0.0), 95.0);
+    EXPECT_LT(j.value("peer_week_p50_kg_co2", 0.0), j.value("peer_week_p90_kg_co2", 0.0));
+    // The mean is pulled up by the heavy user; the median is not
+    EXPECT_GT(j.value("peer_week_avg_kg_co2", 0.0), j.value("peer_week_p50_kg_co2", 0.0));
+    // ... and comes from the peer snapshot rather than a scan of the store
+    EXPECT_NEAR(j.value("peer_week_avg_kg_co2", 0.0), peers.snapshot(now)->mean_kg_co2(), 1e-9);
+}
+
+/* ---- Active User Tests ---- */
+
+TEST(AdminStats, ReportsApproximateActiveUsers)
+{
+    set_admin_key("super-secret");
+    InMemoryStore mem;
+    mem.set_api_key("demo", "secret-demo-key");
+    ActiveUsers active;
+    active.attach(mem);
+    active.record("peer", static_cast<std::int64_t>(std::time(nullptr)) - 3 * 86400);
+    ApiServices services;
+    services.active_users = &active;
+    TestServer const server(mem, services);
+    httplib::Client  cli("127.0.0.1", server.port);
+
+    post_transit(cli, 3.0, "bus", static_cast<std::int64_t>(std::time(nullptr)));
+
+    auto res = cli.Get("/admin/stats", admin_auth_headers());
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+    const auto j = json::parse(res->body)["active_users"];
+    EXPECT_EQ(j.value("dau", 0), 1);
+    EXPECT_EQ(j.value("wau", 0), 2);
+    EXPECT_EQ(j.value("mau", 0), 2);
+    EXPECT_EQ(j["daily"].size(), 30U);
+
+    res = cli.Get("/admin/stats");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 401);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+
+// Fixture base giving each test an empty directory of its own, dir_
+// ("<tmp>/charizard_<suite>_<test>"), which is removed again afterwards. Fixtures that override
+// SetUp()/TearDown() call these first.
+class TempDirTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        auto        name = std::string("charizard_") + info->test_suite_name() + "_" + info->name();
+        std::replace(name.begin(), name.end(), '/', '_'); // parameterized names
+        dir_ = std::filesystem::temp_directory_path() / name;
+        std::filesystem::remove_all(dir_);
+        std::filesystem::create_directories(dir_);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(dir_, ec);
+    }
+
+    std::filesystem::path dir_;
+};
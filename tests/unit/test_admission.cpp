@@ -0,0 +1,104 @@
+#include "admission.hpp"
+#include "server_config.hpp"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// ===== Route classification =====
+
+TEST(Admission, ClassifyRoute_MapsEndpointsToCostClasses)
+{
+    EXPECT_EQ(classify_route("GET", "/health"), RouteClass::Health);
+    EXPECT_EQ(classify_route("POST", "/users/register"), RouteClass::Ingest);
+    EXPECT_EQ(classify_route("POST", "/users/demo/transit"), RouteClass::Ingest);
+    EXPECT_EQ(classify_route("GET", "/users/demo/lifetime-footprint"), RouteClass::Read);
+    EXPECT_EQ(classify_route("GET", "/users/demo/suggestions"), RouteClass::Read);
+    EXPECT_EQ(classify_route("GET", "/users/demo/analytics"), RouteClass::Analytics);
+    EXPECT_EQ(classify_route("GET", "/admin/logs"), RouteClass::Admin);
+    EXPECT_EQ(classify_route("POST", "/admin/emission-factors/load"), RouteClass::Admin);
+}
+
+// ===== AdmissionController =====
+
+TEST(Admission, UnlimitedClassAlwaysAdmits)
+{
+    AdmissionController          ctrl;
+    std::vector<AdmissionTicket> held;
+    for (int i = 0; i < 100; ++i)
+    {
+        held.push_back(ctrl.try_acquire(RouteClass::Ingest));
+        EXPECT_TRUE(held.back());
+    }
+    EXPECT_EQ(ctrl.stats(RouteClass::Ingest).in_flight, 100U);
+    held.clear();
+    EXPECT_EQ(ctrl.stats(RouteClass::Ingest).in_flight, 0U);
+}
+
+TEST(Admission, LimitedClassRejectsPastLimitAndCountsIt)
+{
+    AdmissionLimits limits;
+    limits.analytics = { 2, 0 };
+    AdmissionController ctrl(limits);
+
+    auto a = ctrl.try_acquire(RouteClass::Analytics);
+    auto b = ctrl.try_acquire(RouteClass::Analytics);
+    auto c = ctrl.try_acquire(RouteClass::Analytics);
+    EXPECT_TRUE(a);
+    EXPECT_TRUE(b);
+    EXPECT_FALSE(c);
+
+    // Other classes are unaffected by analytics being saturated
+    EXPECT_TRUE(ctrl.try_acquire(RouteClass::Ingest));
+
+    const auto st = ctrl.stats(RouteClass::Analytics);
+    EXPECT_EQ(st.max_concurrent, 2U);
+    EXPECT_EQ(st.in_flight, 2U);
+    EXPECT_EQ(st.admitted, 2U);
+    EXPECT_EQ(st.rejected, 1U);
+}
+
+TEST(Admission, ReleasedTicketFreesSlot)
+{
+    AdmissionLimits limits;
+    limits.admin = { 1, 0 };
+    AdmissionController ctrl(limits);
+    {
+        auto t = ctrl.try_acquire(RouteClass::Admin);
+        EXPECT_TRUE(t);
+        EXPECT_FALSE(ctrl.try_acquire(RouteClass::Admin));
+    }
+    EXPECT_TRUE(ctrl.try_acquire(RouteClass::Admin));
+}
+
+TEST(Admission, WaitsWithinQueueBudgetForSlot)
+{
+    AdmissionLimits limits;
+    limits.analytics = { 1, 2000 };
+    AdmissionController ctrl(limits);
+
+    auto        held = ctrl.try_acquire(RouteClass::Analytics);
+    std::thread releaser(
+        [&held]
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            held = AdmissionTicket{};
+        });
+    EXPECT_TRUE(ctrl.try_acquire(RouteClass::Analytics));
+    releaser.join();
+    EXPECT_EQ(ctrl.stats(RouteClass::Analytics).rejected, 0U);
+}
+
+TEST(Admission, LimitsConfigurableFromCli)
+{
+    ServerConfig      cfg;
+    const char* const argv[] = { "charizard_api", "--analytics-max-concurrent=8", "--admin-queue-ms=250" };
+    apply_cli_overrides(cfg, 3, argv);
+    EXPECT_EQ(cfg.admission.analytics.max_concurrent, 8U);
+    EXPECT_EQ(cfg.admission.admin.queue_budget_ms, 250U);
+
+    const char* const bad[] = { "charizard_api", "--analytics-max-speed=1" };
+    EXPECT_THROW(apply_cli_overrides(cfg, 2, bad), std::runtime_error);
+}
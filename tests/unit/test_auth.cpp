@@ -1,7 +1,9 @@
+#include "api_key_hash.hpp"
 #include "storage.hpp"
 #include "test_auth_helpers.hpp"
 
 #include <gtest/gtest.h>
+#include <string>
 
 TEST(AuthStore, SetAndCheckApiKey)
 {
@@ -32,6 +34,27 @@ TEST(AuthStore, MultipleUsers)
     EXPECT_FALSE(s.check_api_key("a", "kb"));
 }
 
+TEST(AuthStore, HasApiKeysOnceAnyIsSet)
+{
+    InMemoryStore s;
+    EXPECT_FALSE(s.has_api_keys());
+    s.set_api_key("a", "ka");
+    EXPECT_TRUE(s.has_api_keys());
+    s.clear_db();
+    EXPECT_FALSE(s.has_api_keys());
+}
+
+TEST(ApiKeyHash, MatchesSha256TestVectors)
+{
+    EXPECT_EQ(hash_api_key(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(hash_api_key("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    // 56 bytes: the length no longer fits in the first padded block
+    EXPECT_EQ(hash_api_key("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    EXPECT_EQ(hash_api_key(std::string(1000000, 'a')),
+              "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
 TEST(AuthHeaders, MissingHeaderFails)
 {
     InMemoryStore s;
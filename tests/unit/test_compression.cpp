@@ -0,0 +1,102 @@
+#include "compression.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+
+#ifdef CHARIZARD_WITH_ZLIB
+#include <zlib.h>
+
+// Inflates a gzip-wrapped body
+static std::string gunzip(const std::string& in)
+{
+    z_stream zs{};
+    inflateInit2(&zs, 15 + 16);
+    zs.next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    std::string out;
+    char        buf[4096];
+    int         ret = Z_OK;
+    while (ret == Z_OK)
+    {
+        zs.next_out  = reinterpret_cast<Bytef*>(buf);
+        zs.avail_out = sizeof(buf);
+        ret          = inflate(&zs, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+    }
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END ? out : std::string();
+}
+#endif
+
+static std::string sample_json(int n)
+{
+    std::string s = "[";
+    for (int i = 0; i < n; ++i)
+        s += std::string(i ? "," : "") + R"({"mode":"car","distance_km":12.5,"ts":1700000000})";
+    return s + "]";
+}
+
+// ===== Negotiation =====
+
+TEST(Compression, Negotiate_EmptyOrUnknownIsIdentity)
+{
+    EXPECT_EQ(negotiate_encoding(""), ContentEncoding::Identity);
+    EXPECT_EQ(negotiate_encoding("identity"), ContentEncoding::Identity);
+    EXPECT_EQ(negotiate_encoding("compress, deflate"), ContentEncoding::Identity);
+    EXPECT_STREQ(encoding_name(ContentEncoding::Identity), "");
+}
+
+#ifdef CHARIZARD_WITH_ZLIB
+TEST(Compression, Negotiate_GzipAndQValues)
+{
+    EXPECT_EQ(negotiate_encoding("gzip"), ContentEncoding::Gzip);
+    EXPECT_EQ(negotiate_encoding("deflate, gzip;q=0.8"), ContentEncoding::Gzip);
+    EXPECT_EQ(negotiate_encoding("*"), ContentEncoding::Gzip);
+    EXPECT_EQ(negotiate_encoding("gzip;q=0"), ContentEncoding::Identity);
+    EXPECT_STREQ(encoding_name(ContentEncoding::Gzip), "gzip");
+}
+
+TEST(Compression, GzipRoundTrip_OneShot)
+{
+    const auto body = sample_json(500);
+    const auto gz   = compress_body(ContentEncoding::Gzip, body);
+    EXPECT_LT(gz.size(), body.size() / 4);
+    EXPECT_EQ(gunzip(gz), body);
+}
+
+TEST(Compression, GzipRoundTrip_Streamed)
+{
+    const auto  body = sample_json(2000);
+    auto        c    = StreamCompressor::create(ContentEncoding::Gzip);
+    std::string out;
+    ASSERT_TRUE(c != nullptr);
+    for (std::size_t off = 0; off < body.size(); off += 777)
+        c->write(body.data() + off, std::min<std::size_t>(777, body.size() - off), out);
+    c->finish(out);
+    EXPECT_EQ(gunzip(out), body);
+}
+#endif
+
+#ifdef CHARIZARD_WITH_BROTLI
+TEST(Compression, Negotiate_PrefersBrotliOnEqualQ)
+{
+    EXPECT_EQ(negotiate_encoding("gzip, br"), ContentEncoding::Brotli);
+    EXPECT_EQ(negotiate_encoding("br;q=0.5, gzip"), ContentEncoding::Gzip);
+    EXPECT_STREQ(encoding_name(ContentEncoding::Brotli), "br");
+}
+
+TEST(Compression, BrotliShrinksRepetitiveJson)
+{
+    const auto body = sample_json(500);
+    const auto br   = compress_body(ContentEncoding::Brotli, body);
+    EXPECT_FALSE(br.empty());
+    EXPECT_LT(br.size(), body.size() / 4);
+}
+#endif
+
+TEST(Compression, IdentityLeavesBodyUntouched)
+{
+    const auto body = sample_json(10);
+    EXPECT_EQ(compress_body(ContentEncoding::Identity, body), body);
+    EXPECT_EQ(StreamCompressor::create(ContentEncoding::Identity), nullptr);
+}
@@ -0,0 +1,57 @@
+#include "csv_reader.hpp"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using Row = std::vector<std::string>;
+
+static std::vector<Row> read_all(std::string_view text)
+{
+    CsvReader                     reader(text);
+    std::vector<std::string_view> fields;
+    std::vector<Row>              rows;
+    while (reader.next(fields))
+        rows.emplace_back(fields.begin(), fields.end());
+    return rows;
+}
+
+TEST(CsvReader, SplitsPlainRecords)
+{
+    EXPECT_EQ(read_all("a,b,c\n1,,3\r\n\n  x , y\t,z  "),
+              (std::vector<Row>{ { "a", "b", "c" }, { "1", "", "3" }, { "" }, { "x", "y", "z" } }));
+    EXPECT_EQ(read_all("a,\n,"), (std::vector<Row>{ { "a", "" }, { "", "" } }));
+    EXPECT_TRUE(read_all("").empty());
+    EXPECT_EQ(read_all("only\n"), (std::vector<Row>{ { "only" } }));
+}
+
+TEST(CsvReader, HandlesQuotedFields)
+{
+    const auto rows = read_all("\"Car, large\",\"say \"\"hi\"\"\",\"two\nlines\" , \"\"\n"
+                               "\"\"\"\",plain\"quote,\"\"\"a\"\"\"\"b\"");
+    ASSERT_EQ(rows.size(), 2U);
+    EXPECT_EQ(rows[0], (Row{ "Car, large", "say \"hi\"", "two\nlines", "" }));
+    EXPECT_EQ(rows[1], (Row{ "\"", "plain\"quote", "\"a\"\"b" }));
+}
+
+TEST(CsvReader, ReportsLineNumbers)
+{
+    CsvReader                     reader("h\n\"multi\nline\"\nnext\n");
+    std::vector<std::string_view> fields;
+    ASSERT_TRUE(reader.next(fields));
+    EXPECT_EQ(reader.line(), 1U);
+    ASSERT_TRUE(reader.next(fields));
+    EXPECT_EQ(reader.line(), 2U);
+    ASSERT_TRUE(reader.next(fields));
+    EXPECT_EQ(reader.line(), 4U);
+    EXPECT_EQ(fields[0], "next");
+    EXPECT_FALSE(reader.next(fields));
+}
+
+TEST(CsvReader, RejectsBrokenQuoting)
+{
+    EXPECT_THROW(read_all("a\n\"never closed,b\n"), std::runtime_error);
+    EXPECT_THROW(read_all("\"closed\"early,b"), std::runtime_error);
+}
@@ -1,5 +1,7 @@
 #include "emission_data_loader.hpp"
 
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
 
 class EmissionDataLoaderTest : public ::testing::Test
@@ -233,3 +235,75 @@ TEST_F(EmissionDataLoaderTest, LoadFromCSVEmpty)
 
     EXPECT_THROW(EmissionDataLoader::load_from_csv(csv_str), std::runtime_error);
 }
+
+TEST_F(EmissionDataLoaderTest, LoadFromCSVMapsColumnsByName)
+{
+    std::string csv_str = "\xEF\xBB\xBFnotes,kg_co2_per_km,mode,vehicle_size,updated_at\r\n"
+                          "\"Average, all sizes\",0.14,car,\"medium\",1700000000\r\n"
+                          "\"multi\nline\",0.035,subway,,\r\n";
+
+    auto factors = EmissionDataLoader::load_from_csv(csv_str);
+
+    ASSERT_EQ(factors.size(), 2);
+    EXPECT_EQ(factors[0].mode, "car");
+    EXPECT_EQ(factors[0].fuel_type, "");
+    EXPECT_EQ(factors[0].vehicle_size, "medium");
+    EXPECT_DOUBLE_EQ(factors[0].kg_co2_per_km, 0.14);
+    EXPECT_EQ(factors[0].source, "UNKNOWN");
+    EXPECT_EQ(factors[0].updated_at, 1700000000);
+    EXPECT_EQ(factors[1].mode, "subway");
+    EXPECT_EQ(factors[1].updated_at, 0);
+}
+
+TEST_F(EmissionDataLoaderTest, LoadFromCSVErrorsNameTheLine)
+{
+    auto message = [](const std::string& csv)
+    {
+        try
+        {
+            EmissionDataLoader::load_from_csv(csv);
+        }
+        catch (const std::runtime_error& e)
+        {
+            return std::string(e.what());
+        }
+        return std::string("no error");
+    };
+    const std::string header = "mode,fuel_type,vehicle_size,kg_co2_per_km,source\n";
+    EXPECT_EQ(message(header + "car,petrol,small,0.1,T\n\nbus,,,0.07x,T"),
+              "Failed to parse kg_co2_per_km at row 4: '0.07x'");
+    EXPECT_EQ(message(header + "\"a\nb\",,,0.1,T\ncar,petrol"), "CSV format error at row 4");
+    EXPECT_EQ(message("mode,kg_co2_per_km,updated_at\ncar,0.1,soon"),
+              "Failed to parse updated_at at row 2: 'soon'");
+}
+
+TEST_F(EmissionDataLoaderTest, LoadCSVFileStreamsRows)
+{
+    const auto path = std::filesystem::temp_directory_path() / "charizard_factors_stream.csv";
+    {
+        std::ofstream out(path);
+        out << "mode,fuel_type,vehicle_size,kg_co2_per_km,source\n";
+        for (int i = 0; i < 10000; ++i)
+            out << "car,petrol,small," << i << ",\"FILE, " << i << "\"\n";
+    }
+
+    std::size_t seen  = 0;
+    double      total = 0.0;
+    const auto  count = EmissionDataLoader::load_csv_file(path.string(),
+                                                          [&](EmissionFactor&& f)
+                                                          {
+                                                              if (seen == 42)
+                                                              {
+                                                                  EXPECT_EQ(f.source, "FILE, 42");
+                                                              }
+                                                              ++seen;
+                                                              total += f.kg_co2_per_km;
+                                                          });
+    EXPECT_EQ(count, 10000U);
+    EXPECT_EQ(seen, 10000U);
+    EXPECT_DOUBLE_EQ(total, 49995000.0);
+    std::filesystem::remove(path);
+
+    EXPECT_THROW(EmissionDataLoader::load_csv_file(path.string(), [](EmissionFactor&&) {}),
+                 std::runtime_error);
+}
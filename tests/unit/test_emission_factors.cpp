@@ -1,7 +1,15 @@
+#include "batch_pricer.hpp"
+#include "embedded_factors.hpp"
 #include "emission_factors.hpp"
 #include "storage.hpp"
 
 #include <gtest/gtest.h>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 // ===== Tests for calculate_co2_emissions (DEFRA 2024 factors) =====
 
@@ -275,3 +283,183 @@ TEST(EmissionCalculation, BikeFallbackZeroEvenOnLookupMiss)
     double kg = calculate_co2_emissions("bike", "whatever", "xxl", 1.0, 123.0);
     EXPECT_DOUBLE_EQ(kg, 0.0);
 }
+
+// ===== Batch pricing =====
+
+namespace
+{
+
+// Table hits, shared cars and taxis, synonyms and every fallback
+std::vector<TransitEvent> mixed_trips()
+{
+    std::vector<TransitEvent> evs;
+    const auto trip = [&evs](const char* mode, const char* fuel, const char* size, double occupancy,
+                             double km)
+    {
+        TransitEvent ev;
+        ev.user_id      = "alice";
+        ev.mode         = mode;
+        ev.fuel_type    = fuel;
+        ev.vehicle_size = size;
+        ev.occupancy    = occupancy;
+        ev.distance_km  = km;
+        ev.ts           = 1700000000 + static_cast<std::int64_t>(evs.size());
+        evs.push_back(ev);
+    };
+    trip("car", "petrol", "small", 1.0, 10.0);
+    trip("car", "petrol", "small", 3.0, 10.0);
+    trip("car", "diesel", "medium", 1.5, 20.0);
+    trip("taxi", "hydrogen", "medium", 3.0, 12.0);
+    trip("bus", "", "", 2.0, 10.0);
+    trip("rail", "", "", 4.0, 50.0);
+    trip("hoverboard", "", "", 1.0, 7.5);
+    trip("walk", "", "", 1.0, 3.0);
+    trip("car", "petrol", "small", 2.5, 0.0);
+    return evs;
+}
+
+} // namespace
+
+TEST(BatchPricing, MatchesPerEventPricing)
+{
+    const auto evs = mixed_trips();
+    const auto kg  = calculate_co2_emissions(evs);
+    ASSERT_EQ(kg.size(), evs.size());
+    // Bit for bit, not within a few ulps: stored rollups mix batch and per-event prices
+    for (std::size_t i = 0; i < evs.size(); ++i)
+        EXPECT_EQ(kg[i], calculate_co2_emissions(evs[i])) << evs[i].mode;
+    EXPECT_TRUE(calculate_co2_emissions(std::vector<TransitEvent>{}).empty());
+}
+
+TEST(BatchPricing, ReusesRateIdsPerFactorAndMode)
+{
+    BatchPricer pricer;
+    const auto  car  = pricer.id_of("car", "petrol", "small", "", 0);
+    const auto  bus  = pricer.id_of("bus", "", "", "", 0);
+    const auto  rock = pricer.id_of("rocket", "", "", "", 0);
+    EXPECT_EQ(car, 0U);
+    EXPECT_EQ(bus, 1U);
+    EXPECT_EQ(rock, 2U);
+    EXPECT_EQ(pricer.id_of("car", "petrol", "small", "GB", 5), car);
+    EXPECT_EQ(pricer.id_of("rocket", "x", "y", "", 0), rock);
+    EXPECT_EQ(pricer.rate_count(), 3U);
+
+    const std::uint32_t ids[]         = { car, bus, rock, car };
+    const double        distance_km[] = { 10.0, 10.0, 7.5, 10.0 };
+    const double        occupancy[]   = { 2.0, 2.0, 1.0, 1.0 };
+    double              kg[4]         = {};
+    pricer.price(ids, distance_km, occupancy, kg, 4);
+    EXPECT_NEAR(kg[0], 0.835, 1e-9);
+    EXPECT_NEAR(kg[1], 0.73, 1e-9);
+    EXPECT_NEAR(kg[2], 0.75, 1e-9);
+    EXPECT_NEAR(kg[3], 1.67, 1e-9);
+}
+
+TEST(BatchPricing, RejectsTheWholeBatchBeforePricing)
+{
+    BatchPricer         pricer;
+    const std::uint32_t ids[]     = { pricer.id_of("bus", "", "", "", 0),
+                                      pricer.id_of("car", "", "", "", 0) };
+    const double        good[]    = { 10.0, 10.0 };
+    const double        one[]     = { 1.0, 1.0 };
+    const double        bad_km[]  = { 10.0, -1.0 };
+    const double        bad_occ[] = { 1.0, 0.5 };
+    double              kg[2]     = { -7.0, -7.0 };
+
+    EXPECT_THROW(pricer.price(ids, bad_km, one, kg, 2), std::runtime_error);
+    EXPECT_THROW(pricer.price(ids, good, bad_occ, kg, 2), std::runtime_error);
+    const std::uint32_t unknown[] = { 0, 9 };
+    EXPECT_THROW(pricer.price(unknown, good, one, kg, 2), std::runtime_error);
+    EXPECT_DOUBLE_EQ(kg[0], -7.0);
+    EXPECT_DOUBLE_EQ(kg[1], -7.0);
+
+    auto evs           = mixed_trips();
+    evs[3].distance_km = -2.0;
+    EXPECT_THROW(calculate_co2_emissions(evs), std::runtime_error);
+}
+
+TEST(BatchPricing, RejectsNonFiniteTrips)
+{
+    // On a bus the branch-free formula would compute 0 * (inf - 1), NaN, where price_trip() ignores
+    // the occupancy; both must reject the trip instead
+    const double inf = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (const auto& [occupancy, km] : { std::pair{ inf, 10.0 }, std::pair{ nan, 10.0 },
+                                         std::pair{ 1.0, inf }, std::pair{ 1.0, nan } })
+    {
+        auto evs           = mixed_trips();
+        evs[4].occupancy   = occupancy;
+        evs[4].distance_km = km;
+        ASSERT_EQ(evs[4].mode, "bus");
+        EXPECT_THROW(calculate_co2_emissions(evs[4]), std::runtime_error) << occupancy << " " << km;
+        EXPECT_THROW(calculate_co2_emissions(evs), std::runtime_error) << occupancy << " " << km;
+
+        BatchPricer         pricer;
+        const std::uint32_t ids[] = { pricer.id_of(evs[4]) };
+        double              kg[1] = { -7.0 };
+        EXPECT_THROW(pricer.price(ids, &km, &occupancy, kg, 1), std::runtime_error);
+        EXPECT_DOUBLE_EQ(kg[0], -7.0);
+    }
+}
+
+TEST(BatchPricing, InMemoryBulkAddMatchesSingleAdds)
+{
+    const auto    evs = mixed_trips();
+    InMemoryStore bulk;
+    InMemoryStore single;
+    bulk.add_events(evs);
+    for (const auto& ev : evs)
+        single.add_event(ev);
+    const auto a = bulk.get_rollups("alice", 0, epoch_day(evs.back().ts));
+    const auto b = single.get_rollups("alice", 0, epoch_day(evs.back().ts));
+    ASSERT_EQ(a.size(), b.size());
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+        EXPECT_EQ(a[i].trips, b[i].trips);
+        EXPECT_DOUBLE_EQ(a[i].kg_co2, b[i].kg_co2);
+    }
+    EXPECT_DOUBLE_EQ(bulk.summarize("alice").lifetime_kg_co2, single.summarize("alice").lifetime_kg_co2);
+
+    // One invalid event and nothing is added
+    auto broken         = evs;
+    broken[5].occupancy = 0.0;
+    InMemoryStore store;
+    EXPECT_THROW(store.add_events(broken), std::runtime_error);
+    EXPECT_TRUE(store.get_events("alice").empty());
+}
+
+// ===== Embedded (compile-time) factor tables =====
+
+// The tables generated from data/emission_factors/*.csv can be checked without running anything
+static_assert(find_embedded_factor(k_defra_2024_factors, "car", "petrol", "small")->kg_co2_per_km == 0.167);
+static_assert(find_embedded_factor(k_defra_2024_factors, FactorMode::bus, FactorFuel::none, FactorSize::none)
+                  ->source == "DEFRA-2024");
+static_assert(find_embedded_factor(k_basic_defaults_factors, "walk", "", "")->kg_co2_per_km == 0.0);
+static_assert(find_embedded_factor(k_defra_2024_factors, "bus", "diesel", "") == nullptr);
+static_assert(find_embedded_factor(k_defra_2024_factors, "hoverboard", "", "") == nullptr);
+static_assert(name_of(FactorFuel::none).empty() && name_of(FactorSize::medium) == "medium");
+
+TEST(EmbeddedFactors, VectorsMatchTables)
+{
+    const auto factors = DefaultEmissionFactors::defra_2024_factors();
+    ASSERT_EQ(factors.size(), std::size(k_defra_2024_factors));
+    for (std::size_t i = 0; i < factors.size(); ++i)
+    {
+        const auto& e = k_defra_2024_factors[i];
+        EXPECT_EQ(factors[i].mode, name_of(e.mode));
+        EXPECT_EQ(factors[i].fuel_type, name_of(e.fuel_type));
+        EXPECT_EQ(factors[i].vehicle_size, name_of(e.vehicle_size));
+        EXPECT_EQ(factors[i].kg_co2_per_km, e.kg_co2_per_km);
+        EXPECT_EQ(factors[i].source, e.source);
+    }
+    EXPECT_EQ(DefaultEmissionFactors::basic_defaults().size(), std::size(k_basic_defaults_factors));
+}
+
+TEST(EmbeddedFactors, KeysAreUnique)
+{
+    for (const auto& a : k_defra_2024_factors)
+    {
+        EXPECT_EQ(find_embedded_factor(k_defra_2024_factors, a.mode, a.fuel_type, a.vehicle_size), &a)
+            << name_of(a.mode) << '/' << name_of(a.fuel_type) << '/' << name_of(a.vehicle_size);
+    }
+}
@@ -0,0 +1,327 @@
+#include "factor_table.hpp"
+#include "factor_watcher.hpp"
+#include "storage.hpp"
+#include "temp_dir.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+const std::string k_header = "mode,fuel_type,vehicle_size,kg_co2_per_km,source\n";
+
+constexpr std::int64_t k_2024 = 1704067200; // 2024-01-01T00:00:00Z
+constexpr std::int64_t k_2025 = 1735689600; // 2025-01-01T00:00:00Z
+constexpr std::int64_t k_min  = std::numeric_limits<std::int64_t>::min();
+constexpr std::int64_t k_max  = std::numeric_limits<std::int64_t>::max();
+
+EmissionFactor factor_between(const char* mode, double kg, const char* region, std::int64_t from,
+                              std::int64_t until)
+{
+    return { mode, "", "", kg, "TEST", 0, region, from, until };
+}
+
+// Bus factors for 2023, 2024 (with a French one) and from 2025; train only in 2024.
+std::vector<EmissionFactor> yearly_factors()
+{
+    return { factor_between("bus", 0.10, "", k_min, k_2024),
+             factor_between("bus", 0.08, "", k_2024, k_2025),
+             factor_between("bus", 0.07, "", k_2025, k_max),
+             factor_between("bus", 0.02, "FR", k_2024, k_2025),
+             factor_between("train", 0.04, "", k_2024, k_2025) };
+}
+
+class FactorTableTest : public TempDirTest
+{
+  protected:
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        saved_ = active_factor_table();
+    }
+
+    void TearDown() override
+    {
+        set_active_factor_table(saved_);
+        TempDirTest::TearDown();
+    }
+
+    // Writes through a temporary and renames it into place, as a deployment would.
+    void write_file(const std::string& name, const std::string& text) const
+    {
+        const auto tmp = dir_ / ("." + name + ".tmp");
+        std::ofstream(tmp) << text;
+        std::filesystem::rename(tmp, dir_ / name);
+    }
+
+    // Waits up to two seconds for `pred`, which the watcher thread makes true.
+    template <typename Pred>
+    static bool eventually(Pred pred)
+    {
+        for (int i = 0; i < 200 && !pred(); ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return pred();
+    }
+
+    std::shared_ptr<const FactorTable> saved_;
+};
+
+TEST_F(FactorTableTest, FindsExactKeysAndLaterEntriesWin)
+{
+    const FactorTable table({ { "car", "petrol", "small", 0.2, "A", 0 },
+                              { "bus", "", "", 0.07, "A", 0 },
+                              { "car", "petrol", "small", 0.17, "B", 0 },
+                              { "bus", "", "", 0.06, "A", 0 } },
+                            "test");
+    ASSERT_EQ(table.factors().size(), 3U);
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "")->kg_co2_per_km, 0.06);
+    ASSERT_NE(table.find("car", "petrol", "small"), nullptr);
+    EXPECT_DOUBLE_EQ(table.find("car", "petrol", "small")->kg_co2_per_km, 0.17);
+    EXPECT_EQ(table.find("car", "petrol", "small")->source, "B");
+    EXPECT_NE(table.find("bus", "", ""), nullptr);
+    EXPECT_EQ(table.find("bus", "diesel", ""), nullptr);
+    EXPECT_EQ(table.find("car", "petrolsmall", ""), nullptr);
+    EXPECT_EQ(table.origin(), "test");
+}
+
+TEST_F(FactorTableTest, ResolvesRegionThenSourceThenGlobal)
+{
+    auto factor = [](const char* mode, double kg, const char* source, const char* region)
+    { return EmissionFactor{ mode, "", "", kg, source, 0, region }; };
+    const FactorTable table({ factor("bus", 0.07, "DEFRA", ""),
+                              factor("train", 0.04, "DEFRA", ""),
+                              factor("bus", 0.09, "EPA", "us"),
+                              factor("bus", 0.08, "GRID", "US"),
+                              factor("train", 0.03, "CARB", "us-ca") },
+                            "test", { "EPA", "CARB" });
+    EXPECT_EQ(table.factors().size(), 5U);
+    EXPECT_EQ(table.factors()[2].region, "US");
+
+    EXPECT_EQ(table.find("bus", "", "")->source, "DEFRA");
+    EXPECT_EQ(table.find("bus", "", "", "GB")->source, "DEFRA");
+    // Within a region the ranked source wins over the unranked one loaded later
+    EXPECT_EQ(table.find("bus", "", "", "US")->source, "EPA");
+    // A sub-region without its own factor falls back to its parent, then to the global one
+    EXPECT_EQ(table.find("bus", "", "", "US-CA")->source, "EPA");
+    EXPECT_EQ(table.find("train", "", "", "US-CA")->source, "CARB");
+    EXPECT_EQ(table.find("train", "", "", "US-NY")->source, "DEFRA");
+    EXPECT_EQ(table.find("train", "", "", "US-CA-SF")->source, "CARB");
+    EXPECT_EQ(table.find("walk", "", "", "US"), nullptr);
+
+    const auto us = table.resolved("US");
+    ASSERT_EQ(us.size(), 2U);
+    EXPECT_EQ(us[0].source, "EPA");
+    EXPECT_EQ(us[1].source, "DEFRA");
+
+    EXPECT_THROW(FactorTable({ factor("bus", 0.1, "X", "U S") }), std::runtime_error);
+}
+
+TEST_F(FactorTableTest, FindsTheFactorInEffectAtATime)
+{
+    const FactorTable table(yearly_factors(), "test");
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "", k_2024 - 1)->kg_co2_per_km, 0.10);
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "", k_2024)->kg_co2_per_km, 0.08);
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "GB", k_2025 - 1)->kg_co2_per_km, 0.08);
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "", k_2025)->kg_co2_per_km, 0.07);
+    // A regional factor applies only while valid; outside it the region falls back to the global one
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "FR", k_2024 + 86400)->kg_co2_per_km, 0.02);
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "FR", k_2024 - 1)->kg_co2_per_km, 0.10);
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "FR", k_2025)->kg_co2_per_km, 0.07);
+    EXPECT_EQ(table.find("train", "", "", "", k_2024 - 1), nullptr);
+    EXPECT_NE(table.find("train", "", "", "", k_2024), nullptr);
+    EXPECT_EQ(table.find("train", "", "", "", k_2025), nullptr);
+
+    const auto fr = table.timeline("bus", "", "", "FR");
+    ASSERT_EQ(fr.size(), 3U);
+    EXPECT_EQ(fr[0].first, k_min);
+    EXPECT_EQ(fr[1].first, k_2024);
+    EXPECT_EQ(fr[1].second->region, "FR");
+    EXPECT_EQ(fr[2].first, k_2025);
+    const auto train = table.timeline("train", "", "", "");
+    ASSERT_EQ(train.size(), 3U);
+    EXPECT_EQ(train[0].second, nullptr);
+    EXPECT_TRUE(table.timeline("walk", "", "", "").empty());
+
+    EXPECT_THROW(FactorTable({ factor_between("bus", 0.1, "", k_2024, k_2024) }), std::runtime_error);
+}
+
+TEST_F(FactorTableTest, EventsArePricedAsOfTheirTime)
+{
+    set_active_factor_table(std::make_shared<const FactorTable>(yearly_factors(), "test"));
+    TransitEvent ev("alice", "bus", 10.0, k_2024 - 3600);
+    EXPECT_DOUBLE_EQ(calculate_co2_emissions(ev), 1.0);
+    ev.ts = k_2024 + 3600;
+    EXPECT_DOUBLE_EQ(calculate_co2_emissions(ev), 0.8);
+    ev.region = "FR";
+    EXPECT_DOUBLE_EQ(calculate_co2_emissions(ev), 0.2);
+    // Without a factor in effect the simplified defaults apply, as for an unknown key
+    TransitEvent train("alice", "train", 10.0, k_2024 - 3600);
+    EXPECT_DOUBLE_EQ(calculate_co2_emissions(train), calculate_co2_emissions("train", "", "", 1.0, 10.0));
+}
+
+TEST_F(FactorTableTest, ChangeSetHoldsOnlyRepricedPeriods)
+{
+    const FactorTable before(yearly_factors());
+    EXPECT_TRUE(FactorChangeSet(before, FactorTable(yearly_factors())).empty());
+
+    // The 2024 French bus factor is corrected
+    auto factors = yearly_factors();
+    factors[3].kg_co2_per_km = 0.03;
+    const FactorChangeSet changes(before, FactorTable(factors));
+    EXPECT_EQ(changes.key_count(), 1U);
+    EXPECT_FALSE(changes.affects("bus", "", "", k_2024 - 1));
+    EXPECT_TRUE(changes.affects("bus", "", "", k_2024));
+    EXPECT_TRUE(changes.affects("bus", "", "", k_2025 - 1));
+    EXPECT_FALSE(changes.affects("bus", "", "", k_2025));
+    EXPECT_FALSE(changes.affects("train", "", "", k_2024));
+
+    // Extending train back a year adds a factor where there was none
+    factors = yearly_factors();
+    factors[4].valid_from = k_2024 - 365 * 86400;
+    const FactorChangeSet extended(before, FactorTable(factors));
+    EXPECT_TRUE(extended.affects("train", "", "", k_2024 - 1));
+    EXPECT_FALSE(extended.affects("train", "", "", k_2024));
+    EXPECT_FALSE(extended.affects("bus", "", "", k_2024 - 1));
+}
+
+TEST_F(FactorTableTest, NormalizesRegions)
+{
+    EXPECT_EQ(normalize_region(""), "");
+    EXPECT_EQ(normalize_region("gb"), "GB");
+    EXPECT_EQ(normalize_region("us-Ca"), "US-CA");
+    for (const char* bad : { "-US", "US-", "US--CA", "U_S", "GB ", "ABCDEFGHIJKLMNOPQ" })
+        EXPECT_THROW(normalize_region(bad), std::runtime_error) << bad;
+}
+
+TEST_F(FactorTableTest, ActiveTablePricesEvents)
+{
+    EXPECT_EQ(active_factor_table()->origin(), "built-in");
+    EXPECT_DOUBLE_EQ(calculate_co2_emissions("bus", "", "", 1.0, 10.0), 0.73);
+
+    set_active_factor_table(std::make_shared<const FactorTable>(
+        std::vector<EmissionFactor>{ { "bus", "", "", 0.05, "FILE", 0 } }, "file"));
+    EXPECT_DOUBLE_EQ(calculate_co2_emissions("bus", "", "", 1.0, 10.0), 0.5);
+    // Keys the table lacks fall back to the simplified defaults
+    EXPECT_DOUBLE_EQ(calculate_co2_emissions("car", "petrol", "small", 2.0, 10.0), 0.9);
+
+    set_active_factor_table(std::make_shared<const FactorTable>(
+        std::vector<EmissionFactor>{ { "bus", "", "", 0.05, "FILE", 0 },
+                                     { "bus", "", "", 0.1, "FILE", 0, "FR" } },
+        "file"));
+    EXPECT_DOUBLE_EQ(calculate_co2_emissions("bus", "", "", 1.0, 10.0, "FR"), 1.0);
+    EXPECT_DOUBLE_EQ(calculate_co2_emissions("bus", "", "", 1.0, 10.0, "DE"), 0.5);
+}
+
+TEST_F(FactorTableTest, LoadsFilesAndDirectoriesInNameOrder)
+{
+    write_file("10-defra.csv", k_header + "car,petrol,small,0.167,DEFRA\nbus,,,0.073,DEFRA\n");
+    write_file("20-local.json", R"([{"mode":"bus","kg_co2_per_km":0.06,"source":"LOCAL"},)"
+                                R"({"mode":"bus","kg_co2_per_km":0.02,"source":"LOCAL","region":"fr"}])");
+    write_file("30-grid.csv", "region,mode,fuel_type,vehicle_size,kg_co2_per_km,source\n"
+                              "FR,car,electric,medium,0.01,GRID\n");
+    write_file("notes.txt", "ignored");
+
+    auto factors = load_factor_path((dir_ / "10-defra.csv").string());
+    EXPECT_EQ(factors.size(), 2U);
+
+    factors = load_factor_path(dir_.string());
+    ASSERT_EQ(factors.size(), 5U);
+    const FactorTable table(factors);
+    EXPECT_EQ(table.find("bus", "", "")->source, "LOCAL");
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "FR")->kg_co2_per_km, 0.02);
+    EXPECT_EQ(table.find("car", "electric", "medium", "FR")->source, "GRID");
+    EXPECT_EQ(table.find("car", "electric", "medium"), nullptr);
+
+    EXPECT_THROW(load_factor_path((dir_ / "notes.txt").string()), std::runtime_error);
+    EXPECT_THROW(load_factor_path((dir_ / "missing.csv").string()), std::runtime_error);
+    std::filesystem::create_directories(dir_ / "empty");
+    EXPECT_THROW(load_factor_path((dir_ / "empty").string()), std::runtime_error);
+}
+
+TEST_F(FactorTableTest, LoadsValidityPeriods)
+{
+    write_file("a.csv", "mode,fuel_type,vehicle_size,kg_co2_per_km,source,valid_from,valid_until\n"
+                        "bus,,,0.10,A,,2024-01-01\n"
+                        "bus,,,0.08,A,2024-01-01,\n");
+    write_file("b.json", R"([{"mode":"train","kg_co2_per_km":0.04,"valid_from":"2024-01-01",)"
+                         R"("valid_until":"2025-01-01"}])");
+    const FactorTable table(load_factor_path(dir_.string()));
+    ASSERT_EQ(table.factors().size(), 3U);
+    EXPECT_EQ(table.factors()[0].valid_from, k_min);
+    EXPECT_EQ(table.factors()[0].valid_until, k_2024);
+    EXPECT_EQ(table.factors()[1].valid_until, k_max);
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "", k_2024 - 1)->kg_co2_per_km, 0.10);
+    EXPECT_DOUBLE_EQ(table.find("bus", "", "", "", k_2024)->kg_co2_per_km, 0.08);
+    EXPECT_EQ(table.find("train", "", "", "", k_2025), nullptr);
+    EXPECT_EQ(table.factors()[2].valid_until, k_2025);
+
+    write_file("a.csv", "mode,kg_co2_per_km,valid_from\nbus,0.1,2024-13-01\n");
+    EXPECT_THROW(load_factor_path((dir_ / "a.csv").string()), std::runtime_error);
+    write_file("b.json", R"([{"mode":"bus","kg_co2_per_km":0.1,"valid_until":20240101}])");
+    EXPECT_THROW(load_factor_path((dir_ / "b.json").string()), std::runtime_error);
+}
+
+TEST_F(FactorTableTest, WatcherSwapsTableWhenFileChanges)
+{
+    write_file("factors.csv", k_header + "bus,,,0.05,V1\n");
+    const auto path = (dir_ / "factors.csv").string();
+
+    FactorFileWatcher watcher(path, std::chrono::milliseconds(20));
+    ASSERT_TRUE(watcher.reload());
+    watcher.start();
+    EXPECT_EQ(active_factor_table()->find("bus", "", "")->source, "V1");
+
+    // A change to another file in the directory is not a reload
+    write_file("other.csv", k_header + "bus,,,0.09,OTHER\n");
+    write_file("factors.csv", k_header + "bus,,,0.06,V2\n");
+    EXPECT_TRUE(eventually([&] { return active_factor_table()->find("bus", "", "")->source == "V2"; }));
+    EXPECT_EQ(watcher.reloads(), 2U);
+
+    // A broken update is reported and the working table stays active
+    write_file("factors.csv", k_header + "bus,,,not-a-number,V3\n");
+    EXPECT_TRUE(eventually([&] { return watcher.failed_reloads() == 1; }));
+    EXPECT_EQ(active_factor_table()->find("bus", "", "")->source, "V2");
+}
+
+TEST_F(FactorTableTest, WatcherHandsReplacedTableToPublishHook)
+{
+    write_file("factors.csv", k_header + "bus,,,0.05,V1\n");
+    FactorFileWatcher watcher((dir_ / "factors.csv").string(), std::chrono::milliseconds(20));
+    std::vector<std::string> seen;
+    watcher.on_publish(
+        [&seen](const FactorTable& before, const FactorTable& after)
+        {
+            seen.push_back(before.origin() + " -> " + after.find("bus", "", "")->source);
+            throw std::runtime_error("hook failed");
+        });
+    ASSERT_TRUE(watcher.reload());
+    write_file("factors.csv", k_header + "bus,,,0.06,V2\n");
+    // A failing hook doesn't fail the reload
+    ASSERT_TRUE(watcher.reload());
+    ASSERT_EQ(seen.size(), 2U);
+    EXPECT_EQ(seen[0], "built-in -> V1");
+    EXPECT_EQ(seen[1], (dir_ / "factors.csv").string() + " -> V2");
+    EXPECT_EQ(watcher.failed_reloads(), 0U);
+}
+
+TEST_F(FactorTableTest, WatcherReloadsDirectory)
+{
+    write_file("a.csv", k_header + "bus,,,0.05,A\n");
+    FactorFileWatcher watcher(dir_.string(), std::chrono::milliseconds(20));
+    ASSERT_TRUE(watcher.reload());
+    watcher.start();
+
+    write_file("b.json", R"([{"mode":"train","kg_co2_per_km":0.03}])");
+    EXPECT_TRUE(eventually([] { return active_factor_table()->find("train", "", "") != nullptr; }));
+    EXPECT_NE(active_factor_table()->find("bus", "", ""), nullptr);
+}
+
+} // namespace
@@ -0,0 +1,71 @@
+#include "history.hpp"
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+constexpr std::int64_t k_jan1_2024 = 19723; // days since 1970-01-01, a Monday
+
+DailyRollup rollup(std::int64_t day, const std::string& mode, std::int64_t trips, double km, double kg)
+{
+    DailyRollup r;
+    r.user_id     = "alice";
+    r.day         = day;
+    r.mode        = mode;
+    r.trips       = trips;
+    r.distance_km = km;
+    r.kg_co2      = kg;
+    return r;
+}
+
+} // namespace
+
+TEST(History, ParsesAndFormatsIsoDays)
+{
+    EXPECT_EQ(parse_iso_day("1970-01-01"), 0);
+    EXPECT_EQ(parse_iso_day("2024-01-01"), k_jan1_2024);
+    EXPECT_EQ(parse_iso_day("2024-02-29"), k_jan1_2024 + 59);
+    EXPECT_EQ(parse_iso_day("1969-12-31"), -1);
+    EXPECT_EQ(format_iso_day(k_jan1_2024 + 59), "2024-02-29");
+    EXPECT_EQ(format_iso_day(-1), "1969-12-31");
+
+    for (const char* bad : { "2023-02-29", "2024-13-01", "2024-00-10", "2024-1-01", "2024/01/01", "" })
+        EXPECT_FALSE(parse_iso_day(bad).has_value()) << bad;
+}
+
+TEST(History, BucketsStartOnMondaysAndFirstsOfTheMonth)
+{
+    EXPECT_EQ(bucket_start(k_jan1_2024 + 6, HistoryGranularity::Week), k_jan1_2024); // a Sunday
+    EXPECT_EQ(bucket_start(k_jan1_2024 + 7, HistoryGranularity::Week), k_jan1_2024 + 7);
+    EXPECT_EQ(bucket_start(0, HistoryGranularity::Week), -3); // a Thursday
+    EXPECT_EQ(bucket_start(k_jan1_2024 + 59, HistoryGranularity::Month), k_jan1_2024 + 31);
+    EXPECT_EQ(bucket_start(k_jan1_2024 + 59, HistoryGranularity::Day), k_jan1_2024 + 59);
+    EXPECT_EQ(parse_granularity("week"), HistoryGranularity::Week);
+    EXPECT_FALSE(parse_granularity("year").has_value());
+}
+
+TEST(History, SumsRollupsPerBucketAndMode)
+{
+    const std::vector<DailyRollup> rollups = {
+        rollup(k_jan1_2024 + 8, "bus", 1, 4.0, 0.4),
+        rollup(k_jan1_2024, "bus", 2, 10.0, 1.0),
+        rollup(k_jan1_2024 + 2, "car", 1, 20.0, 3.6),
+        rollup(k_jan1_2024 + 3, "bus", 1, 5.0, 0.5),
+        rollup(k_jan1_2024 + 40, "walk", 0, 0.0, 0.0), // empty: no bucket
+    };
+
+    const auto weeks = bucket_rollups(rollups, HistoryGranularity::Week);
+    ASSERT_EQ(weeks.size(), 2U);
+    EXPECT_EQ(weeks[0].start_day, k_jan1_2024);
+    EXPECT_EQ(weeks[0].total.trips, 4);
+    EXPECT_DOUBLE_EQ(weeks[0].total.distance_km, 35.0);
+    EXPECT_DOUBLE_EQ(weeks[0].modes.at("bus").kg_co2, 1.5);
+    EXPECT_EQ(weeks[0].modes.at("car").trips, 1);
+    EXPECT_EQ(weeks[1].start_day, k_jan1_2024 + 7);
+
+    const auto months = bucket_rollups(rollups, HistoryGranularity::Month);
+    ASSERT_EQ(months.size(), 1U);
+    EXPECT_EQ(months[0].total.trips, 5);
+    EXPECT_EQ(bucket_rollups(rollups, HistoryGranularity::Day).size(), 4U);
+}
@@ -0,0 +1,125 @@
+#include "active_users.hpp"
+#include "hyperloglog.hpp"
+#include "write_behind_store.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr std::int64_t k_day  = 86400;
+constexpr std::int64_t k_jan1 = 1704067200; // 2024-01-01T00:00:00Z
+
+} // namespace
+
+TEST(HyperLogLog, CountsSmallSetsExactly)
+{
+    HyperLogLog hll;
+    EXPECT_EQ(hll.estimate(), 0U);
+    for (int round = 0; round < 3; ++round) // repeats don't count
+        for (int i = 0; i < 50; ++i)
+            hll.add("user" + std::to_string(i));
+    EXPECT_EQ(hll.estimate(), 50U);
+    EXPECT_EQ(hll.memory_bytes(), 4096U);
+}
+
+TEST(HyperLogLog, StaysWithinItsErrorBoundAtScale)
+{
+    HyperLogLog hll;
+    for (int i = 0; i < 200000; ++i)
+        hll.add("u_" + std::to_string(i));
+    const double err = std::abs(static_cast<double>(hll.estimate()) - 200000.0) / 200000.0;
+    EXPECT_LT(err, 3 * hll.relative_error());
+    EXPECT_EQ(hll.memory_bytes(), 4096U);
+}
+
+TEST(HyperLogLog, MergeEstimatesTheUnion)
+{
+    HyperLogLog a;
+    HyperLogLog b;
+    for (int i = 0; i < 30000; ++i)
+        a.add("u_" + std::to_string(i));
+    for (int i = 20000; i < 50000; ++i)
+        b.add("u_" + std::to_string(i));
+    a.merge(b);
+    EXPECT_NEAR(static_cast<double>(a.estimate()), 50000.0, 50000.0 * 3 * a.relative_error());
+
+    HyperLogLog other(10);
+    EXPECT_THROW(a.merge(other), std::runtime_error);
+}
+
+TEST(ActiveUsers, CountsDailyWeeklyAndMonthlyUsers)
+{
+    ActiveUsers        active;
+    const std::int64_t now = k_jan1 + 40 * k_day + 3600;
+    active.record("alice", now);
+    active.record("alice", now - 3600);
+    active.record("bob", now - 2 * k_day);
+    active.record("carol", now - 10 * k_day);
+    active.record("dave", now - 40 * k_day); // before the ring
+
+    const auto c = active.counts(now);
+    EXPECT_EQ(c.daily, 1U);
+    EXPECT_EQ(c.weekly, 2U);
+    EXPECT_EQ(c.monthly, 3U);
+
+    const auto days = active.daily(now, 7);
+    ASSERT_EQ(days.size(), 7U);
+    EXPECT_EQ(days.back().first, epoch_day(now));
+    EXPECT_EQ(days.back().second, 1U);
+    EXPECT_EQ(days[4].second, 1U); // bob
+    EXPECT_EQ(days[0].second, 0U);
+}
+
+TEST(ActiveUsers, ReusesSlotsAsDaysRollOver)
+{
+    ActiveUsers active;
+    active.record("alice", k_jan1);
+    active.record("bob", k_jan1 + 30 * k_day); // same slot, a month later
+    active.record("alice", k_jan1);            // now too old to count
+    EXPECT_EQ(active.estimate(epoch_day(k_jan1), epoch_day(k_jan1)), 0U);
+    EXPECT_EQ(active.counts(k_jan1 + 30 * k_day).monthly, 1U);
+    EXPECT_EQ(active.memory_bytes(), 30U * 4096U);
+}
+
+TEST(ActiveUsers, SeedsFromTheStoreRollups)
+{
+    InMemoryStore      store;
+    const std::int64_t now = k_jan1 + 40 * k_day;
+    store.add_event(TransitEvent("alice", "bus", 1.0, now));
+    store.add_event(TransitEvent("bob", "bus", 1.0, now - 5 * k_day));
+    store.add_event(TransitEvent("carol", "bus", 1.0, now - 35 * k_day));
+
+    ActiveUsers active;
+    active.seed(store, now);
+    const auto c = active.counts(now);
+    EXPECT_EQ(c.daily, 1U);
+    EXPECT_EQ(c.weekly, 2U);
+    EXPECT_EQ(c.monthly, 2U);
+}
+
+TEST(ActiveUsers, AttachCountsEventsFromEveryIngestionPath)
+{
+    const std::int64_t now = k_jan1 + 40 * k_day;
+    ActiveUsers        active;
+
+    InMemoryStore store;
+    active.attach(store);
+    store.add_event(TransitEvent("alice", "bus", 1.0, now));
+    store.add_events({ TransitEvent("bob", "bus", 1.0, now), TransitEvent("carol", "bus", 1.0, now - k_day) });
+
+    // A write-behind store counts events when it accepts them, not when they reach the inner store
+    WriteBehindStore buffered(std::make_unique<InMemoryStore>());
+    active.attach(buffered);
+    buffered.add_event(TransitEvent("dave", "bus", 1.0, now));
+
+    const auto c = active.counts(now);
+    EXPECT_EQ(c.daily, 3U);
+    EXPECT_EQ(c.weekly, 4U);
+}
@@ -0,0 +1,96 @@
+#include "emission_data_loader.hpp"
+#include "json_backend.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+
+// These run against whichever backend the build selected (see json_backend_name()).
+
+TEST(JsonBackend, DecodesTransitBodies)
+{
+    const auto body = decode_transit_body(R"({"mode":"car","distance_km":12.5,"ts":1700000000.9,)"
+                                          R"("fuel_type":"diesel","extra":{"nested":[1,2]},"occupancy":2})");
+    EXPECT_TRUE(body.has_mode);
+    EXPECT_TRUE(body.has_distance);
+    EXPECT_EQ(body.mode, "car");
+    EXPECT_DOUBLE_EQ(body.distance_km, 12.5);
+    EXPECT_EQ(body.ts, 1700000000); // truncated, as nlohmann::json's get<int64_t>() does
+    EXPECT_EQ(body.fuel_type, "diesel");
+    EXPECT_DOUBLE_EQ(body.occupancy, 2.0);
+
+    const auto payload = body.payload();
+    EXPECT_EQ(payload.mode, "car");
+    EXPECT_EQ(payload.ts, 1700000000);
+}
+
+TEST(JsonBackend, TransitMissingFieldsComeBeforeWrongTypes)
+{
+    auto body = decode_transit_body(R"({"mode":5})");
+    EXPECT_TRUE(body.has_mode);
+    EXPECT_FALSE(body.has_distance);
+
+    body = decode_transit_body("[1,2]");
+    EXPECT_FALSE(body.has_mode);
+    EXPECT_FALSE(body.has_distance);
+
+    EXPECT_THROW(decode_transit_body(R"({"mode":5,"distance_km":1})"), JsonShapeError);
+    EXPECT_THROW(decode_transit_body(R"({"mode":"bus","distance_km":"far"})"), JsonShapeError);
+    EXPECT_THROW(decode_transit_body(R"({"mode":"bus","distance_km":1,"ts":null})"), JsonShapeError);
+}
+
+TEST(JsonBackend, RejectsMalformedText)
+{
+    for (const char* text : { "", "not-json", "{", R"({"mode":"bus"} trailing)", R"({"mode":tru})",
+                              R"({"mode":"bus","distance_km":1.})" })
+    {
+        EXPECT_THROW(decode_transit_body(text), JsonSyntaxError) << text;
+    }
+}
+
+TEST(JsonBackend, DecodesRegisterBodies)
+{
+    EXPECT_EQ(decode_register_body(R"({"app_name":"demo"})"), "demo");
+    EXPECT_EQ(decode_register_body(R"({"app_name":42})"), std::nullopt);
+    EXPECT_EQ(decode_register_body(R"({"other":"x"})"), std::nullopt);
+    EXPECT_EQ(decode_register_body(R"("demo")"), std::nullopt);
+    EXPECT_THROW(decode_register_body("app_name=demo"), JsonSyntaxError);
+}
+
+TEST(JsonBackend, LoadsFactorFiles)
+{
+    const auto factors = EmissionDataLoader::load_from_json(
+        R"([{"mode":"car","fuel_type":"petrol","vehicle_size":"small","kg_co2_per_km":0.14,"source":"T"},)"
+        R"( {"mode":"bus","kg_co2_per_km":0.073,"updated_at":1700000000}])");
+    ASSERT_EQ(factors.size(), 2U);
+    EXPECT_EQ(factors[0].mode, "car");
+    EXPECT_EQ(factors[0].fuel_type, "petrol");
+    EXPECT_EQ(factors[0].vehicle_size, "small");
+    EXPECT_DOUBLE_EQ(factors[0].kg_co2_per_km, 0.14);
+    EXPECT_EQ(factors[0].source, "T");
+    EXPECT_EQ(factors[1].fuel_type, "");
+    EXPECT_EQ(factors[1].source, "UNKNOWN");
+    EXPECT_EQ(factors[1].updated_at, 1700000000);
+}
+
+TEST(JsonBackend, FactorFileErrors)
+{
+    auto message = [](const std::string& text)
+    {
+        try
+        {
+            EmissionDataLoader::load_from_json(text);
+        }
+        catch (const std::runtime_error& e)
+        {
+            return std::string(e.what());
+        }
+        return std::string("no error");
+    };
+    EXPECT_EQ(message(R"({"mode":"car"})"), "Expected JSON array of factors");
+    EXPECT_EQ(message("[1]"), "Each factor item must be a JSON object");
+    EXPECT_EQ(message(R"([{"mode":"car","kg_co2_per_km":0.1},{"mode":"bus"}])"),
+              "JSON parsing error: factor 1: missing 'kg_co2_per_km'");
+    EXPECT_EQ(message(R"([{"mode":"car","kg_co2_per_km":"0.1"}])"),
+              "JSON parsing error: factor 0: 'kg_co2_per_km' has the wrong type");
+    EXPECT_EQ(message("[{").rfind("JSON parsing error: ", 0), 0U);
+}
@@ -0,0 +1,159 @@
+#include "json_writer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+
+using nlohmann::json;
+
+static std::string write_double(double d)
+{
+    std::string out;
+    JsonWriter(out).value(d);
+    return out;
+}
+
+static std::string write_string(const std::string& s)
+{
+    std::string out;
+    JsonWriter(out).value(s);
+    return out;
+}
+
+TEST(JsonWriter, FixedShapesMatchDump)
+{
+    std::string out;
+    JsonWriter(out)
+        .begin_object()
+        .field("last_30d_kg_co2", 12.345)
+        .field("last_7d_kg_co2", 0.1)
+        .field("lifetime_kg_co2", 1e21)
+        .field("user_id", "u_1234abcd")
+        .end_object();
+    const json j = { { "user_id", "u_1234abcd" },
+                     { "lifetime_kg_co2", 1e21 },
+                     { "last_7d_kg_co2", 0.1 },
+                     { "last_30d_kg_co2", 12.345 } };
+    EXPECT_EQ(out, j.dump());
+
+    out.clear();
+    JsonWriter(out)
+        .begin_object()
+        .key("items")
+        .begin_array()
+        .value(std::int64_t{ -7 })
+        .value(std::uint64_t{ 18446744073709551615ULL })
+        .null()
+        .begin_object()
+        .end_object()
+        .begin_array()
+        .end_array()
+        .end_array()
+        .field("ok", true)
+        .field("time", 1700000000)
+        .end_object();
+    const json k = { { "ok", true },
+                     { "items", { -7, 18446744073709551615ULL, nullptr, json::object(), json::array() } },
+                     { "time", 1700000000 } };
+    EXPECT_EQ(out, k.dump());
+}
+
+// The bytes clients see, spelled out rather than taken from dump(), so a member written out of
+// key order or a change in number formatting fails here even if dump() changed along with it
+TEST(JsonWriter, ResponseBodiesArePinnedByteForByte)
+{
+    std::string out;
+    JsonWriter(out)
+        .begin_object()
+        .field("last_30d_kg_co2", 12.345)
+        .field("last_7d_kg_co2", 0.0)
+        .field("lifetime_kg_co2", 1e21)
+        .field("user_id", "u_1234abcd")
+        .end_object();
+    EXPECT_EQ(out, R"({"last_30d_kg_co2":12.345,"last_7d_kg_co2":0.0,)"
+                   R"("lifetime_kg_co2":1e+21,"user_id":"u_1234abcd"})");
+
+    out.clear();
+    JsonWriter(out)
+        .begin_object()
+        .field("ok", true)
+        .field("service", "charizard")
+        .field("time", 1700000000)
+        .end_object();
+    EXPECT_EQ(out, R"({"ok":true,"service":"charizard","time":1700000000})");
+
+    out.clear();
+    JsonWriter(out).begin_object().field("error", "bad \"path\"\n").end_object();
+    EXPECT_EQ(out, R"({"error":"bad \"path\"\n"})");
+}
+
+// Same layout as dump(); the digits are the shortest, closest ones that read back, which Grisu2 in
+// dump() misses for about 0.1% of values, so those are only required to round-trip
+TEST(JsonWriter, DoublesMatchDumpLayout)
+{
+    for (const double d : { 0.0, -0.0, 1.0, -2.5, 0.1, 1e-5, 1e-4, 123456789012345.0, 1e15, 1e16, 1e21,
+                            5e-324, std::numeric_limits<double>::max(), 1.0 / 3.0 })
+    {
+        EXPECT_EQ(write_double(d), json(d).dump()) << d;
+    }
+    EXPECT_EQ(write_double(55.59009), "55.59009");
+    EXPECT_EQ(write_double(-1.234e-5), "-1.234e-05");
+    EXPECT_EQ(write_double(1e100), "1e+100");
+
+    EXPECT_EQ(write_double(std::nan("")), "null");
+    EXPECT_EQ(write_double(std::numeric_limits<double>::infinity()), "null");
+}
+
+TEST(JsonWriter, DoublesRoundTrip)
+{
+    const auto round_trips = [](double d) {
+        const std::string text = write_double(d);
+        const double      back = json::parse(text).get<double>();
+        return std::memcmp(&back, &d, sizeof(d)) == 0 && text.size() <= json(d).dump().size();
+    };
+
+    // Sums of factor * distance, like the footprint fields, and arbitrary finite bit patterns
+    std::mt19937_64                        rng(42);
+    std::uniform_real_distribution<double> km(0.0, 500.0);
+    for (int i = 0; i < 20000; ++i)
+    {
+        const double sum = 0.173 * km(rng) + 0.041 * km(rng);
+        EXPECT_TRUE(round_trips(sum)) << write_double(sum);
+        double     bits;
+        const auto raw = rng();
+        std::memcpy(&bits, &raw, sizeof(bits));
+        if (std::isfinite(bits))
+        {
+            EXPECT_TRUE(round_trips(bits)) << write_double(bits);
+        }
+    }
+}
+
+TEST(JsonWriter, StringsMatchDump)
+{
+    for (const std::string& s : { std::string(), std::string("plain"), std::string("quote\" back\\slash /"),
+                                  std::string("\b\f\n\r\t"), std::string("\x01\x1f\x7f", 3),
+                                  std::string("nul\0byte", 8), std::string("caf\xc3\xa9 \xe2\x82\xac") })
+    {
+        EXPECT_EQ(write_string(s), json(s).dump()) << s;
+    }
+
+    // Invalid UTF-8 is rejected like dump() does
+    EXPECT_THROW(write_string("bad \xff"), json::type_error);
+}
+
+TEST(JsonWriter, ResponseBufferIsReusedEmpty)
+{
+    auto& buf = response_buffer();
+    buf.assign(1000, 'x');
+    const auto* data = buf.data();
+    auto&       again = response_buffer();
+    EXPECT_EQ(&again, &buf);
+    EXPECT_TRUE(again.empty());
+    EXPECT_EQ(again.data(), data);
+}
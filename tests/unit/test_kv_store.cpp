@@ -0,0 +1,369 @@
+#include "kv_engine.hpp"
+#include "kv_store.hpp"
+#include "temp_dir.hpp"
+#include "wal.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+class KvTest : public TempDirTest
+{
+  protected:
+    static std::map<std::string, std::string> dump(const KvEngine& kv, const std::string& prefix = "")
+    {
+        std::map<std::string, std::string> out;
+        kv.scan_prefix(prefix,
+                       [&out](std::string_view k, std::string_view v)
+                       {
+                           out.emplace(k, v);
+                           return true;
+                       });
+        return out;
+    }
+};
+
+} // namespace
+
+TEST_F(KvTest, PutGetEraseAcrossMemtableAndTables)
+{
+    KvEngine kv(dir_);
+    kv.put("a", "1");
+    kv.put("b", "2");
+    kv.flush();
+    kv.put("b", "3"); // newer value in the memtable shadows the table
+    kv.erase("a");    // delete shadows the table entry
+    kv.put("c", "4");
+
+    EXPECT_FALSE(kv.get("a").has_value());
+    EXPECT_EQ(kv.get("b"), "3");
+    EXPECT_EQ(kv.get("c"), "4");
+    EXPECT_FALSE(kv.get("zz").has_value());
+    EXPECT_EQ(dump(kv), (std::map<std::string, std::string>{ { "b", "3" }, { "c", "4" } }));
+}
+
+TEST_F(KvTest, ScanRespectsBoundsAndPrefix)
+{
+    KvEngine kv(dir_);
+    for (int i = 0; i < 100; ++i)
+    {
+        char key[16];
+        std::snprintf(key, sizeof key, "k%03d", i);
+        kv.put(key, std::to_string(i));
+        if (i % 30 == 0)
+            kv.flush();
+    }
+    std::vector<std::string> keys;
+    kv.scan("k010", "k015",
+            [&keys](std::string_view k, std::string_view)
+            {
+                keys.emplace_back(k);
+                return true;
+            });
+    EXPECT_EQ(keys, (std::vector<std::string>{ "k010", "k011", "k012", "k013", "k014" }));
+    EXPECT_EQ(dump(kv, "k09").size(), 10U);
+
+    int visited = 0;
+    kv.scan_prefix("k",
+                   [&visited](std::string_view, std::string_view)
+                   {
+                       ++visited;
+                       return visited < 3;
+                   });
+    EXPECT_EQ(visited, 3);
+}
+
+TEST_F(KvTest, RecoversFromTablesAndLogAfterRestart)
+{
+    {
+        KvEngine kv(dir_);
+        kv.put("flushed", "yes");
+        kv.flush();
+        kv.put("logged", "yes");
+        kv.erase("flushed");
+    }
+    KvEngine kv(dir_);
+    EXPECT_FALSE(kv.get("flushed").has_value());
+    EXPECT_EQ(kv.get("logged"), "yes");
+}
+
+TEST_F(KvTest, CompactionMergesTablesAndDropsDeletes)
+{
+    KvOptions opts;
+    opts.max_tables = 100; // compact explicitly
+    {
+        KvEngine kv(dir_, opts);
+        for (int round = 0; round < 5; ++round)
+        {
+            kv.put("key" + std::to_string(round), "v" + std::to_string(round));
+            kv.put("shared", "round" + std::to_string(round));
+            kv.flush();
+        }
+        kv.erase("key0");
+        kv.flush();
+        EXPECT_EQ(kv.table_count(), 6U);
+
+        kv.compact();
+        EXPECT_EQ(kv.table_count(), 1U);
+        EXPECT_FALSE(kv.get("key0").has_value());
+        EXPECT_EQ(kv.get("shared"), "round4");
+        EXPECT_EQ(dump(kv).size(), 5U);
+    }
+    std::size_t sst_files = 0;
+    for (const auto& e : std::filesystem::directory_iterator(dir_))
+        sst_files += e.path().extension() == ".sst" ? 1 : 0;
+    EXPECT_EQ(sst_files, 1U);
+
+    KvEngine kv(dir_, opts);
+    EXPECT_EQ(kv.get("key4"), "v4");
+    EXPECT_FALSE(kv.get("key0").has_value());
+}
+
+TEST_F(KvTest, SmallMemtableFlushesAndCompactsInBackground)
+{
+    KvOptions opts;
+    opts.memtable_bytes = 4096;
+    opts.max_tables     = 2;
+    opts.wal.sync       = false;
+    {
+        KvEngine kv(dir_, opts);
+        for (int i = 0; i < 2000; ++i)
+            kv.put("user" + std::to_string(i % 50) + "|" + std::to_string(i), std::string(40, 'x'));
+        EXPECT_GE(kv.table_count(), 1U);
+        EXPECT_EQ(dump(kv).size(), 2000U);
+    }
+    KvEngine kv(dir_, opts);
+    EXPECT_EQ(dump(kv).size(), 2000U);
+    EXPECT_EQ(dump(kv, "user7|").size(), 40U);
+}
+
+TEST_F(KvTest, WritesStayReadableWhileTheirMemtableIsFlushed)
+{
+    KvOptions opts;
+    opts.memtable_bytes = 2048;
+    opts.max_tables     = 100;
+    opts.wal.sync       = false;
+    KvEngine kv(dir_, opts);
+
+    // Each writer reads back its own keys while other writes seal and flush memtables
+    std::vector<std::thread> writers;
+    std::atomic<int>         missing{ 0 };
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.emplace_back(
+            [&kv, &missing, t]
+            {
+                for (int i = 0; i < 500; ++i)
+                {
+                    const auto key = "w" + std::to_string(t) + "|" + std::to_string(i);
+                    kv.put(key, std::string(20, 'v'));
+                    if (!kv.get(key))
+                        ++missing;
+                    if (i % 50 == 0 && dump(kv, key).empty())
+                        ++missing;
+                }
+            });
+    }
+    for (auto& w : writers)
+        w.join();
+    EXPECT_EQ(missing.load(), 0);
+    EXPECT_GE(kv.table_count(), 2U);
+    EXPECT_EQ(dump(kv).size(), 2000U);
+}
+
+TEST_F(KvTest, StoreRoundTripsAllRecordKinds)
+{
+    {
+        KvStore store(dir_);
+        EXPECT_FALSE(store.has_api_keys());
+        store.set_api_key("alice", "secret", "App");
+        TransitEvent bus("alice", "bus", 5.0, 1700000300);
+        bus.region = "US-CA";
+        store.add_event(bus);
+        store.add_event(TransitEvent("alice", "car", 2.0, 1700000100));
+        store.add_event(TransitEvent("alice", "car", 3.0, 1700000100)); // same ts, kept apart
+        store.add_event(TransitEvent("bob", "train", 10.0, -5));
+        store.store_emission_factor({ "bus", "", "", 0.08, "TEST", 1 });
+        store.append_log({ 1700000000, "GET", "/health", 200, 0.5, "127.0.0.1", "" });
+        store.append_log({ 1700000001, "POST", "/x", 201, 1.5, "127.0.0.1", "alice" });
+    }
+
+    KvStore store(dir_);
+    EXPECT_TRUE(store.has_api_keys());
+    EXPECT_TRUE(store.check_api_key("alice", "secret"));
+    EXPECT_FALSE(store.check_api_key("alice", "nope"));
+
+    auto alice = store.get_events("alice");
+    ASSERT_EQ(alice.size(), 3U);
+    EXPECT_EQ(alice[0].ts, 1700000100); // ordered by time
+    EXPECT_DOUBLE_EQ(alice[0].distance_km, 2.0);
+    EXPECT_DOUBLE_EQ(alice[1].distance_km, 3.0);
+    EXPECT_EQ(alice[2].mode, "bus");
+    EXPECT_EQ(alice[2].region, "US-CA");
+    EXPECT_EQ(alice[0].region, "");
+    EXPECT_EQ(store.get_events("bob")[0].ts, -5);
+
+    auto clients = store.get_clients();
+    EXPECT_EQ(clients, (std::vector<std::string>{ "alice", "bob" }));
+
+    ASSERT_TRUE(store.get_emission_factor("bus", "", "").has_value());
+    EXPECT_EQ(store.get_all_emission_factors().size(), 1U);
+
+    auto logs = store.get_logs(1);
+    ASSERT_EQ(logs.size(), 1U);
+    EXPECT_EQ(logs[0].path, "/x");
+
+    store.add_event(TransitEvent("carol", "walk", 1.0, 1700000400));
+    EXPECT_EQ(store.get_events("carol").size(), 1U);
+
+    store.clear_db_events();
+    EXPECT_TRUE(store.get_clients().empty());
+    EXPECT_TRUE(store.check_api_key("alice", "secret"));
+    store.clear_db();
+    EXPECT_FALSE(store.check_api_key("alice", "secret"));
+    EXPECT_TRUE(store.get_all_emission_factors().empty());
+    EXPECT_TRUE(store.get_logs().empty());
+}
+
+TEST_F(KvTest, StoreReadsEventsWrittenBeforeRegions)
+{
+    // key: e \0 user \0 ts(8, sign bit flipped) seq(8); the value ends after distance_km
+    {
+        KvEngine    kv(dir_);
+        std::string key{ 'e', '\0' };
+        key += "alice";
+        key.push_back('\0');
+        const auto put_be64 = [&key](std::uint64_t v)
+        {
+            for (int i = 7; i >= 0; --i)
+                key.push_back(static_cast<char>((v >> (8 * i)) & 0xFFU));
+        };
+        put_be64(static_cast<std::uint64_t>(1700000000) ^ (1ULL << 63));
+        put_be64(1);
+        WalEncoder value;
+        value.put_str("bus");
+        value.put_str("");
+        value.put_str("");
+        value.put_f64(1.0);
+        value.put_f64(7.5);
+        kv.put(key, value.bytes());
+    }
+
+    KvStore    store(dir_);
+    const auto alice = store.get_events("alice");
+    ASSERT_EQ(alice.size(), 1U);
+    EXPECT_EQ(alice[0].mode, "bus");
+    EXPECT_DOUBLE_EQ(alice[0].distance_km, 7.5);
+    EXPECT_EQ(alice[0].ts, 1700000000);
+    EXPECT_EQ(alice[0].region, "");
+
+    // A new event for the same user lands after it and keeps its region
+    TransitEvent train("alice", "train", 3.0, 1700000100);
+    train.region = "GB";
+    store.add_event(train);
+    const auto both = store.get_events("alice");
+    ASSERT_EQ(both.size(), 2U);
+    EXPECT_EQ(both[0].region, "");
+    EXPECT_EQ(both[1].region, "GB");
+}
+
+TEST_F(KvTest, BulkAddMatchesSingleAdds)
+{
+    std::vector<TransitEvent> evs;
+    for (int i = 0; i < 40; ++i)
+    {
+        evs.emplace_back(i % 3 == 0 ? "u1" : "u2", i % 2 == 0 ? "bus" : "car", 1.0 + i,
+                         1700000000 + i * 20000);
+        evs.back().occupancy = 1.0 + (i % 4);
+    }
+    KvStore bulk(dir_ / "bulk");
+    KvStore single(dir_ / "single");
+    bulk.add_events(evs);
+    for (const auto& ev : evs)
+        single.add_event(ev);
+    for (const char* user : { "u1", "u2" })
+    {
+        EXPECT_EQ(bulk.get_events(user).size(), single.get_events(user).size());
+        const auto a = bulk.get_rollups(user, 0, epoch_day(evs.back().ts));
+        const auto b = single.get_rollups(user, 0, epoch_day(evs.back().ts));
+        ASSERT_EQ(a.size(), b.size());
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            EXPECT_EQ(a[i].trips, b[i].trips);
+            EXPECT_DOUBLE_EQ(a[i].kg_co2, b[i].kg_co2);
+        }
+        EXPECT_DOUBLE_EQ(bulk.summarize(user).lifetime_kg_co2, single.summarize(user).lifetime_kg_co2);
+    }
+}
+
+TEST_F(KvTest, RebuiltRollupsAreThePricesOfEveryChunk)
+{
+    // More events than one pricing chunk holds, so they are priced over several
+    std::vector<TransitEvent> evs;
+    for (int i = 0; i < 9000; ++i)
+    {
+        evs.emplace_back(i % 2 == 0 ? "u1" : "u2", i % 3 == 0 ? "bus" : "car", 1.0 + (i % 50),
+                         1700000000 + i * 600);
+        evs.back().occupancy = 1.0 + (i % 4);
+    }
+    std::map<std::string, std::vector<DailyRollup>> before;
+    std::map<std::string, double>                   lifetime;
+    {
+        KvStore store(dir_);
+        store.add_events(evs);
+        for (const char* user : { "u1", "u2" })
+        {
+            before[user]   = store.get_rollups(user, 0, epoch_day(evs.back().ts));
+            lifetime[user] = store.summarize(user).lifetime_kg_co2;
+        }
+    }
+    {
+        // Dropping the rollups and their marker makes the next open rebuild them from the events
+        KvEngine kv(dir_);
+        for (const auto& [key, _] : dump(kv, std::string("r\0", 2)))
+            kv.erase(key);
+        kv.erase(std::string("m\0rollups", 9));
+    }
+
+    KvStore store(dir_);
+    for (const char* user : { "u1", "u2" })
+    {
+        const auto after = store.get_rollups(user, 0, epoch_day(evs.back().ts));
+        ASSERT_EQ(after.size(), before[user].size());
+        for (std::size_t i = 0; i < after.size(); ++i)
+        {
+            EXPECT_EQ(after[i].trips, before[user][i].trips);
+            EXPECT_DOUBLE_EQ(after[i].kg_co2, before[user][i].kg_co2);
+        }
+        EXPECT_DOUBLE_EQ(store.summarize(user).lifetime_kg_co2, lifetime[user]);
+    }
+}
+
+TEST_F(KvTest, StoreSummaryMatchesInMemoryStore)
+{
+    const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+    KvStore       kv(dir_);
+    InMemoryStore mem;
+    for (IStore* s : { static_cast<IStore*>(&kv), static_cast<IStore*>(&mem) })
+    {
+        s->add_event(TransitEvent("u1", "car", 10.0, now - 3600));
+        s->add_event(TransitEvent("u1", "bus", 4.0, now - 20 * 24 * 3600));
+        s->add_event(TransitEvent("u2", "train", 30.0, now - 60));
+    }
+    const auto a = kv.summarize("u1");
+    const auto b = mem.summarize("u1");
+    EXPECT_DOUBLE_EQ(a.lifetime_kg_co2, b.lifetime_kg_co2);
+    EXPECT_DOUBLE_EQ(a.week_kg_co2, b.week_kg_co2);
+    EXPECT_DOUBLE_EQ(a.month_kg_co2, b.month_kg_co2);
+    EXPECT_DOUBLE_EQ(kv.global_average_weekly(), mem.global_average_weekly());
+}
@@ -0,0 +1,140 @@
+#include "peer_stats.hpp"
+#include "quantile_sketch.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+TEST(TDigest, SmallSetsAreExact)
+{
+    TDigest d;
+    EXPECT_TRUE(d.empty());
+    EXPECT_DOUBLE_EQ(d.quantile(0.5), 0.0);
+    EXPECT_DOUBLE_EQ(d.cdf(1.0), 0.0);
+
+    for (double x : { 4.0, 1.0, 3.0, 2.0, 5.0 })
+        d.add(x);
+    EXPECT_DOUBLE_EQ(d.quantile(0.5), 3.0);
+    EXPECT_DOUBLE_EQ(d.quantile(0.0), 1.0);
+    EXPECT_DOUBLE_EQ(d.quantile(1.0), 5.0);
+    EXPECT_DOUBLE_EQ(d.cdf(3.0), 0.5); // mid-rank
+    EXPECT_DOUBLE_EQ(d.cdf(0.5), 0.0);
+    EXPECT_DOUBLE_EQ(d.cdf(9.0), 1.0);
+}
+
+TEST(TDigest, TiesShareTheirMidRank)
+{
+    TDigest d;
+    for (int i = 0; i < 6; ++i)
+        d.add(0.0);
+    d.add(1.0);
+    d.add(2.0);
+    EXPECT_DOUBLE_EQ(d.cdf(0.0), 3.0 / 8.0);
+}
+
+TEST(TDigest, LargeStreamsStayAccurateInBoundedMemory)
+{
+    std::mt19937                     rng(42);
+    std::uniform_real_distribution<> uniform(0.0, 1000.0);
+    TDigest                          d;
+    for (int i = 0; i < 100000; ++i)
+        d.add(uniform(rng));
+    d.compress();
+    EXPECT_LT(d.centroid_count(), 200U);
+    EXPECT_DOUBLE_EQ(d.total_weight(), 100000.0);
+    EXPECT_NEAR(d.quantile(0.5), 500.0, 10.0);
+    EXPECT_NEAR(d.quantile(0.9), 900.0, 5.0);
+    EXPECT_NEAR(d.quantile(0.99), 990.0, 2.0);
+    EXPECT_NEAR(d.cdf(250.0), 0.25, 0.01);
+}
+
+TEST(TDigest, MergedShardsMatchOneDigest)
+{
+    std::mt19937                     rng(7);
+    std::exponential_distribution<>  weekly(0.1);
+    TDigest                          whole;
+    TDigest                          shards[4];
+    for (int i = 0; i < 40000; ++i)
+    {
+        const double x = weekly(rng);
+        whole.add(x);
+        shards[i % 4].add(x);
+    }
+    TDigest merged;
+    for (const auto& s : shards)
+        merged.merge(s);
+    EXPECT_DOUBLE_EQ(merged.total_weight(), whole.total_weight());
+    EXPECT_DOUBLE_EQ(merged.max(), whole.max());
+    for (double q : { 0.1, 0.5, 0.9, 0.99 })
+        EXPECT_NEAR(merged.quantile(q), whole.quantile(q), 0.02 * whole.quantile(q) + 0.05) << q;
+}
+
+TEST(TDigest, EncodesAndDecodes)
+{
+    TDigest d(50);
+    for (int i = 0; i < 1000; ++i)
+        d.add(i * 0.5);
+    const auto copy = TDigest::decode(d.encode());
+    EXPECT_DOUBLE_EQ(copy.total_weight(), d.total_weight());
+    EXPECT_DOUBLE_EQ(copy.min(), 0.0);
+    EXPECT_NEAR(copy.quantile(0.9), d.quantile(0.9), 1e-9);
+
+    auto bytes = d.encode();
+    EXPECT_THROW(TDigest::decode(bytes.substr(0, bytes.size() - 3)), std::runtime_error);
+    bytes[0] = 9;
+    EXPECT_THROW(TDigest::decode(bytes), std::runtime_error);
+}
+
+TEST(PeerStats, PercentilesOfWeeklyTotals)
+{
+    InMemoryStore      store;
+    const std::int64_t now = 1704067200 + 3600;
+    for (int u = 1; u <= 10; ++u)
+        store.add_event(TransitEvent("user" + std::to_string(u), "car", 10.0 * u, now - 86400));
+    store.add_event(TransitEvent("idle", "car", 500.0, now - 30 * 86400)); // not active this week
+
+    PeerStats  peers(store, std::chrono::seconds(60));
+    const auto snap = peers.snapshot(now);
+    EXPECT_EQ(snap->users, 10U);
+    const double p50 = snap->weekly_kg_co2.quantile(0.5);
+    const auto   u5  = store.get_rollups("user5", 0, epoch_day(now))[0].kg_co2;
+    const auto   u6  = store.get_rollups("user6", 0, epoch_day(now))[0].kg_co2;
+    EXPECT_NEAR(p50, (u5 + u6) / 2, 1e-9);
+    EXPECT_DOUBLE_EQ(snap->weekly_kg_co2.cdf(u5), 0.45);
+    double total = 0.0;
+    for (int u = 1; u <= 10; ++u)
+        total += store.get_rollups("user" + std::to_string(u), 0, epoch_day(now))[0].kg_co2;
+    EXPECT_NEAR(snap->mean_kg_co2(), total / 10, 1e-9);
+
+    // Served from the snapshot until it is max_age old
+    store.add_event(TransitEvent("user11", "car", 1.0, now));
+    EXPECT_EQ(peers.snapshot(now + 59), snap);
+    EXPECT_EQ(peers.snapshot(now + 60)->users, 11U);
+}
+
+TEST(PeerStats, BackgroundThreadServesItsLastSnapshot)
+{
+    InMemoryStore store;
+    const auto    now = static_cast<std::int64_t>(std::time(nullptr));
+    store.add_event(TransitEvent("user1", "bus", 10.0, now));
+
+    PeerStats peers(store, std::chrono::seconds(3600));
+    peers.start();
+    std::shared_ptr<const PeerSnapshot> snap;
+    for (int i = 0; i < 400 && !snap; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        snap = peers.snapshot(now);
+    }
+    ASSERT_TRUE(snap);
+    EXPECT_EQ(snap->users, 1U);
+
+    // However stale it looks, a request never rebuilds it
+    store.add_event(TransitEvent("user2", "bus", 10.0, now));
+    EXPECT_EQ(peers.snapshot(now + 86400), snap);
+}
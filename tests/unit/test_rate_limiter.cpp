@@ -0,0 +1,117 @@
+#include "rate_limiter.hpp"
+#include "server_config.hpp"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+
+using namespace std::chrono_literals;
+
+TEST(RateLimiter, DisabledWhenRateIsZero)
+{
+    RateLimiter rl({ 0.0, 0.0 });
+    EXPECT_FALSE(rl.enabled());
+    for (int i = 0; i < 1000; ++i)
+        EXPECT_TRUE(rl.allow("u1"));
+    EXPECT_EQ(rl.tracked_keys(), 0U);
+}
+
+TEST(RateLimiter, AllowsBurstThenRejectsWithRetryAfter)
+{
+    RateLimiter rl({ 1.0, 3.0 });
+    const auto  t0 = RateLimiter::clock::now();
+    EXPECT_TRUE(rl.allow("u1", t0));
+    EXPECT_TRUE(rl.allow("u1", t0));
+    EXPECT_TRUE(rl.allow("u1", t0));
+
+    long retry_after = 0;
+    EXPECT_FALSE(rl.allow("u1", t0, &retry_after));
+    EXPECT_EQ(retry_after, 1);
+    EXPECT_EQ(rl.rejected(), 1U);
+}
+
+TEST(RateLimiter, RefillsAtConfiguredRate)
+{
+    RateLimiter rl({ 2.0, 2.0 });
+    const auto  t0 = RateLimiter::clock::now();
+    EXPECT_TRUE(rl.allow("u1", t0));
+    EXPECT_TRUE(rl.allow("u1", t0));
+    EXPECT_FALSE(rl.allow("u1", t0));
+
+    // Half a second at 2 tokens/s buys exactly one more request
+    EXPECT_TRUE(rl.allow("u1", t0 + 500ms));
+    EXPECT_FALSE(rl.allow("u1", t0 + 500ms));
+
+    // Refill is capped at the burst size
+    EXPECT_TRUE(rl.allow("u1", t0 + 60s));
+    EXPECT_TRUE(rl.allow("u1", t0 + 60s));
+    EXPECT_FALSE(rl.allow("u1", t0 + 60s));
+}
+
+TEST(RateLimiter, KeysAreIndependent)
+{
+    RateLimiter rl({ 1.0, 1.0 });
+    const auto  t0 = RateLimiter::clock::now();
+    EXPECT_TRUE(rl.allow("alice", t0));
+    EXPECT_FALSE(rl.allow("alice", t0));
+    EXPECT_TRUE(rl.allow("bob", t0));
+}
+
+TEST(RateLimiter, RefundReturnsTokenUpToBurst)
+{
+    RateLimiter rl({ 1.0, 2.0 });
+    const auto  t0 = RateLimiter::clock::now();
+    EXPECT_TRUE(rl.allow("10.0.0.1", t0));
+    EXPECT_TRUE(rl.allow("10.0.0.1", t0));
+    rl.refund("10.0.0.1");
+    EXPECT_TRUE(rl.allow("10.0.0.1", t0));
+    EXPECT_FALSE(rl.allow("10.0.0.1", t0));
+
+    // Never above the burst, and unknown keys are ignored
+    rl.refund("10.0.0.1");
+    rl.refund("10.0.0.1");
+    rl.refund("10.0.0.1");
+    EXPECT_TRUE(rl.allow("10.0.0.1", t0));
+    EXPECT_TRUE(rl.allow("10.0.0.1", t0));
+    EXPECT_FALSE(rl.allow("10.0.0.1", t0));
+    rl.refund("10.0.0.2");
+    EXPECT_EQ(rl.tracked_keys(), 1U);
+}
+
+TEST(RateLimiter, EvictsLeastRecentlySeenKeyWhenFull)
+{
+    // One shard holding two buckets
+    RateLimiter rl({ 1.0, 1.0 }, 2, 1);
+    const auto  t0 = RateLimiter::clock::now();
+    EXPECT_TRUE(rl.allow("a", t0));
+    EXPECT_TRUE(rl.allow("b", t0));
+    EXPECT_FALSE(rl.allow("a", t0)); // touches "a", making "b" the LRU entry
+    EXPECT_TRUE(rl.allow("c", t0));  // evicts "b"
+    EXPECT_EQ(rl.tracked_keys(), 2U);
+
+    EXPECT_FALSE(rl.allow("a", t0)); // "a" kept its empty bucket
+    EXPECT_TRUE(rl.allow("b", t0));  // "b" starts over with a full bucket
+}
+
+TEST(RateLimiter, MemoryStaysBoundedUnderManyKeys)
+{
+    RateLimiter rl({ 5.0, 5.0 }, 256, 16);
+    for (int i = 0; i < 10000; ++i)
+        rl.allow("10.0.0." + std::to_string(i));
+    EXPECT_LE(rl.tracked_keys(), 256U);
+}
+
+TEST(RateLimiter, RatesConfigurableFromCli)
+{
+    ServerConfig      cfg;
+    const char* const argv[] = { "charizard_api", "--user-rate=2.5", "--ip-burst=50",
+                                 "--rate-limit-max-keys=10" };
+    apply_cli_overrides(cfg, 4, argv);
+    EXPECT_DOUBLE_EQ(cfg.per_user_rate.rate_per_sec, 2.5);
+    EXPECT_DOUBLE_EQ(cfg.per_ip_rate.burst, 50.0);
+    EXPECT_EQ(cfg.rate_limit_max_keys, 10U);
+
+    const char* const bad[] = { "charizard_api", "--user-rate=-1" };
+    EXPECT_THROW(apply_cli_overrides(cfg, 2, bad), std::runtime_error);
+}
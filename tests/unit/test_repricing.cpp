@@ -0,0 +1,291 @@
+#include "factor_table.hpp"
+#include "kv_store.hpp"
+#include "repricing.hpp"
+#include "storage.hpp"
+#include "temp_dir.hpp"
+#include "write_behind_store.hpp"
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr std::int64_t k_day  = 86400;
+constexpr std::int64_t k_2024 = 1704067200; // 2024-01-01T00:00:00Z
+constexpr std::int64_t k_min  = std::numeric_limits<std::int64_t>::min();
+constexpr std::int64_t k_max  = std::numeric_limits<std::int64_t>::max();
+
+std::shared_ptr<const FactorTable> bus_table(double before_2024, double from_2024)
+{
+    return std::make_shared<const FactorTable>(
+        std::vector<EmissionFactor>{ { "bus", "", "", before_2024, "TEST", 0, "", k_min, k_2024 },
+                                     { "bus", "", "", from_2024, "TEST", 0, "", k_2024, k_max },
+                                     { "train", "", "", 0.04, "TEST", 0, "" } },
+        "test");
+}
+
+// Holds the second reprice_rollups() call until release(), so a test can act while a job runs
+// and has already re-priced one user.
+class GatedStore : public InMemoryStore
+{
+  public:
+    std::size_t reprice_rollups(const std::string& user, const FactorChangeSet& changes) override
+    {
+        {
+            std::unique_lock lk(mu_);
+            if (++calls_ == 2)
+            {
+                entered_ = true;
+                cv_.notify_all();
+                cv_.wait(lk, [this] { return released_; });
+            }
+        }
+        return InMemoryStore::reprice_rollups(user, changes);
+    }
+
+    void wait_entered()
+    {
+        std::unique_lock lk(mu_);
+        cv_.wait(lk, [this] { return entered_; });
+    }
+
+    void release()
+    {
+        std::scoped_lock lk(mu_);
+        released_ = true;
+        cv_.notify_all();
+    }
+
+  private:
+    std::mutex              mu_;
+    std::condition_variable cv_;
+    int                     calls_    = 0;
+    bool                    entered_  = false;
+    bool                    released_ = false;
+};
+
+class RepricingTest : public TempDirTest
+{
+  protected:
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        saved_ = active_factor_table();
+        set_active_factor_table(bus_table(0.10, 0.10));
+    }
+
+    void TearDown() override
+    {
+        set_active_factor_table(saved_);
+        TempDirTest::TearDown();
+    }
+
+    // A bus trip in June 2023, two bus trips and a train trip on 1 June 2024, a bus trip for bob.
+    static void add_sample_events(IStore& store)
+    {
+        store.add_event(TransitEvent("alice", "bus", 10.0, k_2024 - 214 * k_day));
+        store.add_event(TransitEvent("alice", "bus", 10.0, k_2024 + 152 * k_day + 3600));
+        store.add_event(TransitEvent("alice", "bus", 5.0, k_2024 + 152 * k_day + 7200));
+        store.add_event(TransitEvent("alice", "train", 10.0, k_2024 + 152 * k_day + 9000));
+        store.add_event(TransitEvent("bob", "bus", 2.0, k_2024 + 10 * k_day));
+    }
+
+    // Publishes the table with the 2024 bus factor corrected and re-prices `store` for it.
+    static RepriceResult correct_2024_bus(IStore& store, double kg)
+    {
+        const auto before = active_factor_table();
+        const auto after  = bus_table(0.10, kg);
+        set_active_factor_table(after);
+        return reprice_store(store, FactorChangeSet(*before, *after));
+    }
+
+    static void expect_repriced(IStore& store)
+    {
+        const auto res = correct_2024_bus(store, 0.05);
+        EXPECT_EQ(res.users, 2U);
+        EXPECT_EQ(res.rollups, 2U);
+
+        const auto alice = store.get_rollups("alice", 0, epoch_day(k_2024) + 365);
+        ASSERT_EQ(alice.size(), 3U);
+        // The 2023 trip keeps its price, 2024's are re-priced, the train rollup is untouched
+        EXPECT_DOUBLE_EQ(alice[0].kg_co2, 1.0);
+        EXPECT_EQ(alice[1].mode, "bus");
+        EXPECT_EQ(alice[1].trips, 2);
+        EXPECT_DOUBLE_EQ(alice[1].kg_co2, 0.75);
+        EXPECT_EQ(alice[2].mode, "train");
+        EXPECT_DOUBLE_EQ(alice[2].kg_co2, 0.4);
+        EXPECT_DOUBLE_EQ(store.get_rollups("bob", 0, epoch_day(k_2024) + 365)[0].kg_co2, 0.1);
+        EXPECT_DOUBLE_EQ(store.summarize("alice").lifetime_kg_co2, 2.15);
+
+        // Publishing the same factors again finds nothing to do
+        EXPECT_EQ(correct_2024_bus(store, 0.05).rollups, 0U);
+    }
+
+    std::shared_ptr<const FactorTable> saved_;
+};
+
+TEST_F(RepricingTest, RebuildsOnlyAffectedDays)
+{
+    const auto before = bus_table(0.10, 0.10);
+    const auto after  = bus_table(0.10, 0.05);
+    set_active_factor_table(after);
+    const FactorChangeSet changes(*before, *after);
+
+    const std::vector<TransitEvent> evs = { TransitEvent("alice", "bus", 10.0, k_2024 - k_day),
+                                            TransitEvent("alice", "train", 10.0, k_2024 + 3600),
+                                            TransitEvent("alice", "bus", 10.0, k_2024 + k_day),
+                                            TransitEvent("alice", "bus", 4.0, k_2024 + 3600) };
+    const auto rollups = repriced_rollups(evs, changes, 0);
+    ASSERT_EQ(rollups.size(), 2U);
+    EXPECT_EQ(rollups[0].day, epoch_day(k_2024));
+    EXPECT_EQ(rollups[0].mode, "bus");
+    EXPECT_DOUBLE_EQ(rollups[0].kg_co2, 0.2);
+    EXPECT_EQ(rollups[1].day, epoch_day(k_2024) + 1);
+
+    // Days before the horizon are left alone
+    EXPECT_EQ(repriced_rollups(evs, changes, k_2024 + k_day).size(), 1U);
+    EXPECT_TRUE(repriced_rollups(evs, FactorChangeSet(*after, *after), 0).empty());
+}
+
+TEST_F(RepricingTest, InMemoryStoreRepricesRollups)
+{
+    InMemoryStore store;
+    add_sample_events(store);
+    expect_repriced(store);
+}
+
+TEST_F(RepricingTest, KvStoreRepricesRollupsDurably)
+{
+    {
+        KvStore store(dir_.string());
+        add_sample_events(store);
+        expect_repriced(store);
+    }
+    KvStore reopened(dir_.string());
+    EXPECT_DOUBLE_EQ(reopened.get_rollups("alice", 0, epoch_day(k_2024) + 365)[1].kg_co2, 0.75);
+}
+
+TEST_F(RepricingTest, WriteBehindStoreDropsSummariesItCached)
+{
+    WriteBehindStore store(std::make_unique<InMemoryStore>());
+    add_sample_events(store);
+    EXPECT_DOUBLE_EQ(store.summarize("alice").lifetime_kg_co2, 2.9); // cached for summary_ttl
+    expect_repriced(store);
+}
+
+TEST_F(RepricingTest, RetiredDaysKeepTheirPrices)
+{
+    InMemoryStore store;
+    add_sample_events(store);
+    store.apply_retention(k_2024, 0);
+
+    // Only the 2023 trip was retired; correcting 2023 finds nothing left to re-price
+    const auto before = active_factor_table();
+    const auto after  = bus_table(0.20, 0.10);
+    set_active_factor_table(after);
+    EXPECT_EQ(reprice_store(store, FactorChangeSet(*before, *after)).rollups, 0U);
+    EXPECT_DOUBLE_EQ(store.get_rollups("alice", 0, epoch_day(k_2024))[0].kg_co2, 1.0);
+}
+
+TEST_F(RepricingTest, RecomputeJobRebuildsEveryUserInChunks)
+{
+    InMemoryStore store;
+    for (int u = 0; u < 100; ++u)
+    {
+        const auto user = "user" + std::to_string(u);
+        store.add_event(TransitEvent(user, "bus", 10.0, k_2024 - 10 * k_day));
+        store.add_event(TransitEvent(user, "bus", 10.0, k_2024 + 10 * k_day));
+        store.add_event(TransitEvent(user, "train", 10.0, k_2024 + 10 * k_day));
+    }
+    // Published without re-pricing, so the rollups are stale
+    set_active_factor_table(bus_table(0.20, 0.05));
+    const auto version = active_factor_table()->version();
+
+    RecomputeJob job(store, 4, 8);
+    EXPECT_EQ(job.status().runs, 0U);
+    ASSERT_TRUE(job.start());
+    job.wait();
+    auto st = job.status();
+    EXPECT_FALSE(st.running);
+    EXPECT_EQ(st.runs, 1U);
+    EXPECT_EQ(st.factor_version, version);
+    EXPECT_EQ(st.factor_origin, "test");
+    EXPECT_EQ(st.users_total, 100U);
+    EXPECT_EQ(st.users_done, 100U);
+    EXPECT_EQ(st.rollups, 300U);
+    EXPECT_TRUE(st.error.empty());
+    EXPECT_GE(st.users_per_second(), 0.0);
+
+    for (const auto* user : { "user0", "user57", "user99" })
+    {
+        const auto rollups = store.get_rollups(user, 0, epoch_day(k_2024) + 365);
+        ASSERT_EQ(rollups.size(), 3U) << user;
+        EXPECT_DOUBLE_EQ(rollups[0].kg_co2, 2.0);
+        EXPECT_DOUBLE_EQ(rollups[1].kg_co2, 0.5);
+        EXPECT_DOUBLE_EQ(rollups[2].kg_co2, 0.4);
+    }
+
+    // Runs again once the first has finished
+    ASSERT_TRUE(job.start());
+    job.wait();
+    EXPECT_EQ(job.status().runs, 2U);
+    EXPECT_EQ(job.status().users_done, 100U);
+}
+
+TEST_F(RepricingTest, LoadDuringARunningJobRunsItAgain)
+{
+    GatedStore store;
+    for (int u = 0; u < 4; ++u)
+        store.add_event(TransitEvent("user" + std::to_string(u), "bus", 10.0, k_2024 + 10 * k_day));
+
+    set_active_factor_table(bus_table(0.10, 0.20));
+    RecomputeJob job(store, 1, 1);
+    ASSERT_TRUE(job.start());
+    store.wait_entered();
+
+    // A second load while the first job is on its second user
+    set_active_factor_table(bus_table(0.10, 0.05));
+    const auto version = active_factor_table()->version();
+    EXPECT_FALSE(job.start());
+    auto st = job.status();
+    EXPECT_TRUE(st.running);
+    EXPECT_TRUE(st.rerun_pending);
+    EXPECT_LT(st.factor_version, version);
+
+    store.release();
+    job.wait();
+    st = job.status();
+    EXPECT_FALSE(st.running);
+    EXPECT_FALSE(st.rerun_pending);
+    EXPECT_EQ(st.runs, 2U);
+    EXPECT_EQ(st.factor_version, version);
+    EXPECT_EQ(st.latest_factor_version, version);
+    EXPECT_EQ(st.users_done, 4U);
+    for (int u = 0; u < 4; ++u)
+    {
+        const auto user = "user" + std::to_string(u);
+        EXPECT_DOUBLE_EQ(store.get_rollups(user, 0, epoch_day(k_2024) + 365)[0].kg_co2, 0.5) << user;
+    }
+}
+
+TEST_F(RepricingTest, RecomputeJobRebuildsKvStore)
+{
+    KvStore store(dir_.string());
+    add_sample_events(store);
+    RecomputeJob job(store, 2, 1);
+    ASSERT_TRUE(job.start());
+    job.wait();
+    EXPECT_EQ(job.status().users_done, 2U);
+    EXPECT_EQ(job.status().rollups, 4U);
+}
+
+} // namespace
@@ -0,0 +1,218 @@
+#include "kv_store.hpp"
+#include "retention.hpp"
+#include "storage.hpp"
+#include "temp_dir.hpp"
+#include "write_behind_store.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <string>
+
+namespace
+{
+
+constexpr std::int64_t k_day  = 86400;
+constexpr std::int64_t k_jan1 = 1704067200; // 2024-01-01T00:00:00Z
+
+class RetentionTest : public TempDirTest
+{
+  protected:
+    // Two bus trips and a car trip on 2 January, a bus trip on 20 January, one recent trip.
+    static void add_sample_events(IStore& store)
+    {
+        store.add_event(TransitEvent("alice", "bus", 10.0, k_jan1 + k_day + 3600));
+        store.add_event(TransitEvent("alice", "bus", 5.0, k_jan1 + k_day + 7200));
+        store.add_event(TransitEvent("alice", "car", 20.0, k_jan1 + k_day + 9000));
+        store.add_event(TransitEvent("alice", "bus", 4.0, k_jan1 + 19 * k_day));
+        store.add_event(TransitEvent("alice", "train", 30.0, k_jan1 + 400 * k_day));
+    }
+
+    static void expect_january_rolled_up(const IStore& store)
+    {
+        const auto rollups = store.get_rollups("alice", epoch_day(k_jan1), epoch_day(k_jan1) + 30);
+        ASSERT_EQ(rollups.size(), 3U);
+        EXPECT_EQ(rollups[0].day, epoch_day(k_jan1) + 1);
+        EXPECT_EQ(rollups[0].mode, "bus");
+        EXPECT_EQ(rollups[0].trips, 2);
+        EXPECT_DOUBLE_EQ(rollups[0].distance_km, 15.0);
+        EXPECT_EQ(rollups[1].mode, "car");
+        EXPECT_EQ(rollups[2].day, epoch_day(k_jan1) + 19);
+        EXPECT_EQ(store.get_events("alice").size(), 1U);
+    }
+};
+
+} // namespace
+
+TEST(MonthsBefore, ClampsToTheEndOfShorterMonths)
+{
+    const std::int64_t mar31 = k_jan1 + 90 * k_day;
+    EXPECT_EQ(months_before(mar31 + 3600, 1), k_jan1 + 59 * k_day); // 2024-02-29
+    EXPECT_EQ(months_before(mar31, 12), mar31 - 366 * k_day);       // 2023-03-31
+}
+
+TEST(MonthsBefore, CrossesYearBoundaries)
+{
+    const std::int64_t jan15_noon = k_jan1 + 14 * k_day + 43200;
+    EXPECT_EQ(months_before(jan15_noon, 2), 1700006400); // 2023-11-15T00:00:00Z
+    EXPECT_EQ(months_before(jan15_noon, 0), k_jan1 + 14 * k_day);
+}
+
+TEST_F(RetentionTest, InMemoryRollsUpOldEventsWithoutChangingLifetime)
+{
+    InMemoryStore store;
+    add_sample_events(store);
+    const auto before = store.summarize("alice").lifetime_kg_co2;
+    store.append_log(ApiLogRecord{ k_jan1, "GET", "/health", 200, 1.0, "127.0.0.1", "" });
+    store.append_log(ApiLogRecord{ k_jan1 + 400 * k_day, "GET", "/health", 200, 1.0, "127.0.0.1", "" });
+
+    const auto res = store.apply_retention(k_jan1 + 100 * k_day, k_jan1 + 100 * k_day);
+    EXPECT_EQ(res.events_rolled_up, 4U);
+    EXPECT_EQ(res.logs_deleted, 1U);
+    expect_january_rolled_up(store);
+    EXPECT_NEAR(store.summarize("alice").lifetime_kg_co2, before, 1e-9);
+    EXPECT_EQ(store.get_logs().size(), 1U);
+
+    // Nothing left to roll up
+    EXPECT_EQ(store.apply_retention(k_jan1 + 100 * k_day, 0).events_rolled_up, 0U);
+}
+
+TEST_F(RetentionTest, InMemoryKeepsUsersWhoseEventsWereAllRolledUp)
+{
+    InMemoryStore store;
+    store.add_event(TransitEvent("bob", "bus", 2.0, k_jan1));
+    store.apply_retention(k_jan1 + k_day, 0);
+    EXPECT_TRUE(store.get_events("bob").empty());
+    ASSERT_EQ(store.get_clients().size(), 1U);
+    EXPECT_GT(store.summarize("bob").lifetime_kg_co2, 0.0);
+    EXPECT_EQ(store.get_rollups("bob", 0, epoch_day(k_jan1)).size(), 1U);
+
+    store.clear_db_events();
+    EXPECT_TRUE(store.get_rollups("bob", 0, epoch_day(k_jan1)).empty());
+}
+
+TEST_F(RetentionTest, InMemoryRetentionSurvivesWalReplayAndSnapshots)
+{
+    const auto      wal  = (dir_ / "store.wal").string();
+    SnapshotOptions snap;
+    snap.path           = (dir_ / "store.snap").string();
+    snap.check_interval = std::chrono::hours(1);
+    double lifetime     = 0.0;
+    {
+        InMemoryStore store;
+        store.open_wal(wal, {}, snap);
+        add_sample_events(store);
+        lifetime = store.summarize("alice").lifetime_kg_co2;
+        store.apply_retention(k_jan1 + 10 * k_day, 0); // 2 January only
+        store.snapshot_now();
+        store.apply_retention(k_jan1 + 100 * k_day, 0); // the rest of January, from the WAL
+    }
+    InMemoryStore store;
+    store.open_wal(wal, {}, snap);
+    expect_january_rolled_up(store);
+    EXPECT_NEAR(store.summarize("alice").lifetime_kg_co2, lifetime, 1e-9);
+}
+
+TEST_F(RetentionTest, KvStoreRollsUpAcrossRunsAndReopens)
+{
+    const auto dir      = (dir_ / "kv").string();
+    double     lifetime = 0.0;
+    {
+        KvStore store(dir);
+        add_sample_events(store);
+        store.append_log(ApiLogRecord{ k_jan1, "GET", "/health", 200, 1.0, "127.0.0.1", "" });
+        lifetime = store.summarize("alice").lifetime_kg_co2;
+        // Retention works in whole days: a cutoff inside 2 January keeps that day
+        EXPECT_EQ(store.apply_retention(k_jan1 + k_day + 5000, 0).events_rolled_up, 0U);
+        EXPECT_EQ(store.apply_retention(k_jan1 + 2 * k_day + 5000, 0).events_rolled_up, 3U);
+        const auto res = store.apply_retention(k_jan1 + 100 * k_day, k_jan1 + k_day);
+        EXPECT_EQ(res.events_rolled_up, 1U);
+        EXPECT_EQ(res.logs_deleted, 1U);
+    }
+    KvStore store(dir);
+    expect_january_rolled_up(store);
+    EXPECT_NEAR(store.summarize("alice").lifetime_kg_co2, lifetime, 1e-9);
+    EXPECT_TRUE(store.get_logs().empty());
+
+    store.add_event(TransitEvent("bob", "walk", 1.0, k_jan1));
+    store.apply_retention(k_jan1 + k_day, 0);
+    EXPECT_EQ(store.get_clients(), (std::vector<std::string>{ "alice", "bob" }));
+}
+
+TEST_F(RetentionTest, WriteBehindFlushesBeforeRollingUp)
+{
+    WriteBehindOptions opts;
+    opts.flush_interval = std::chrono::hours(1);
+    WriteBehindStore store(std::make_unique<InMemoryStore>(), opts);
+    add_sample_events(store);
+    const auto lifetime = store.summarize("alice").lifetime_kg_co2;
+
+    EXPECT_EQ(store.apply_retention(k_jan1 + 100 * k_day, 0).events_rolled_up, 4U);
+    EXPECT_EQ(store.stats().pending, 0U);
+    expect_january_rolled_up(store);
+    EXPECT_NEAR(store.summarize("alice").lifetime_kg_co2, lifetime, 1e-9);
+}
+
+TEST_F(RetentionTest, RollupsAreMaintainedOnIngestion)
+{
+    InMemoryStore    mem;
+    KvStore          kv((dir_ / "kv").string());
+    WriteBehindStore wb(std::make_unique<InMemoryStore>(), WriteBehindOptions{});
+    for (IStore* store : std::initializer_list<IStore*>{ &mem, &kv, &wb })
+    {
+        add_sample_events(*store);
+        const auto rollups = store->get_rollups("alice", epoch_day(k_jan1), epoch_day(k_jan1) + 30);
+        ASSERT_EQ(rollups.size(), 3U);
+        EXPECT_EQ(rollups[0].trips, 2);
+        EXPECT_DOUBLE_EQ(rollups[0].distance_km, 15.0);
+        EXPECT_EQ(store->get_rollups("alice", 0, epoch_day(k_jan1) + 1000).size(), 4U);
+        EXPECT_EQ(store->get_events("alice").size(), 5U);
+        EXPECT_EQ(store->retention_horizon(), 0);
+    }
+}
+
+TEST_F(RetentionTest, BackdatedEventsBelowTheHorizonAreCountedOnce)
+{
+    InMemoryStore    mem;
+    KvStore          kv((dir_ / "kv").string());
+    WriteBehindStore wb(std::make_unique<InMemoryStore>(), WriteBehindOptions{});
+    for (IStore* store : std::initializer_list<IStore*>{ &mem, &kv, &wb })
+    {
+        add_sample_events(*store);
+        store->apply_retention(k_jan1 + 100 * k_day, 0);
+        EXPECT_EQ(store->retention_horizon(), k_jan1 + 100 * k_day);
+        const auto before = store->summarize("alice").lifetime_kg_co2;
+
+        const TransitEvent late("alice", "bus", 6.0, k_jan1 + k_day);
+        DailyRollup        expected;
+        add_to_rollup(expected, late);
+        store->add_event(late);
+        const auto after = store->summarize("alice").lifetime_kg_co2;
+        EXPECT_NEAR(after - before, expected.kg_co2, 1e-9);
+        EXPECT_EQ(store->get_rollups("alice", epoch_day(k_jan1) + 1, epoch_day(k_jan1) + 1)[0].trips, 3);
+
+        // The next pass deletes the raw copy without changing the totals
+        EXPECT_EQ(store->apply_retention(k_jan1 + 100 * k_day, 0).events_rolled_up, 1U);
+        EXPECT_NEAR(store->summarize("alice").lifetime_kg_co2, after, 1e-9);
+    }
+}
+
+TEST(RetentionJob, DerivesCutoffsFromThePolicy)
+{
+    InMemoryStore store;
+    store.add_event(TransitEvent("alice", "bus", 1.0, k_jan1));
+    store.add_event(TransitEvent("alice", "bus", 1.0, k_jan1 + 40 * k_day));
+    store.append_log(ApiLogRecord{ k_jan1 + 40 * k_day, "GET", "/health", 200, 1.0, "127.0.0.1", "" });
+
+    RetentionPolicy policy;
+    policy.event_months = 1;
+    policy.log_days     = 7;
+    RetentionJob job(store, policy);
+    const auto   res = job.run_once(k_jan1 + 45 * k_day); // 15 February: cutoff 15 January
+    EXPECT_EQ(res.events_rolled_up, 1U);
+    EXPECT_EQ(res.logs_deleted, 0U);
+
+    EXPECT_EQ(RetentionJob(store, RetentionPolicy{}).run_once(k_jan1 + 45 * k_day).events_rolled_up, 0U);
+}
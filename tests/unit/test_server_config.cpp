@@ -0,0 +1,168 @@
+#include "server_config.hpp"
+#include "task_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// ===== ServerConfig =====
+
+TEST(ServerConfig, DefaultsMatchHttplibAndUseHardwareConcurrency)
+{
+    ServerConfig const cfg;
+    EXPECT_EQ(cfg.host, "0.0.0.0");
+    EXPECT_EQ(cfg.port, 8080);
+    EXPECT_EQ(cfg.keep_alive_max_count, 5U);
+    EXPECT_EQ(cfg.read_timeout_sec, 5);
+    EXPECT_GE(cfg.effective_worker_threads(), 1U);
+}
+
+TEST(ServerConfig, ExplicitWorkerCountWins)
+{
+    ServerConfig cfg;
+    cfg.worker_threads = 32;
+    EXPECT_EQ(cfg.effective_worker_threads(), 32U);
+}
+
+TEST(ServerConfig, FromEnv_ReadsTuningVariables)
+{
+    setenv("PORT", "9001", 1);
+    setenv("HTTP_WORKER_THREADS", "12", 1);
+    setenv("HTTP_KEEP_ALIVE_TIMEOUT_SEC", "30", 1);
+    setenv("HTTP_PAYLOAD_MAX_BYTES", "1048576", 1);
+    auto cfg = server_config_from_env();
+    unsetenv("PORT");
+    unsetenv("HTTP_WORKER_THREADS");
+    unsetenv("HTTP_KEEP_ALIVE_TIMEOUT_SEC");
+    unsetenv("HTTP_PAYLOAD_MAX_BYTES");
+
+    EXPECT_EQ(cfg.port, 9001);
+    EXPECT_EQ(cfg.worker_threads, 12U);
+    EXPECT_EQ(cfg.keep_alive_timeout_sec, 30);
+    EXPECT_EQ(cfg.payload_max_bytes, 1048576U);
+}
+
+TEST(ServerConfig, FromEnv_InvalidNumberThrows)
+{
+    setenv("HTTP_WORKER_THREADS", "lots", 1);
+    EXPECT_THROW(server_config_from_env(), std::runtime_error);
+    setenv("HTTP_WORKER_THREADS", "-4", 1);
+    EXPECT_THROW(server_config_from_env(), std::runtime_error);
+    unsetenv("HTTP_WORKER_THREADS");
+}
+
+TEST(ServerConfig, ParseUnsignedNamesTheBadVariable)
+{
+    EXPECT_EQ(parse_unsigned("WRITE_BEHIND_BATCH", "500"), 500U);
+    for (const char* bad : { "", "-1", "12x", "lots", "99999999999999999999999" })
+    {
+        try
+        {
+            parse_unsigned("WRITE_BEHIND_BATCH", bad);
+            ADD_FAILURE() << "accepted '" << bad << "'";
+        }
+        catch (const std::runtime_error& e)
+        {
+            EXPECT_NE(std::string(e.what()).find("WRITE_BEHIND_BATCH"), std::string::npos) << e.what();
+        }
+    }
+}
+
+TEST(ServerConfig, CliOverridesEnv)
+{
+    ServerConfig cfg;
+    cfg.worker_threads       = 4;
+    const char* const argv[] = { "charizard_api", "--workers=16", "--read-timeout=2", "--host=127.0.0.1" };
+    apply_cli_overrides(cfg, 4, argv);
+    EXPECT_EQ(cfg.worker_threads, 16U);
+    EXPECT_EQ(cfg.read_timeout_sec, 2);
+    EXPECT_EQ(cfg.host, "127.0.0.1");
+}
+
+TEST(ServerConfig, CliRejectsUnknownOrMalformedFlags)
+{
+    ServerConfig      cfg;
+    const char* const unknown[] = { "charizard_api", "--turbo=1" };
+    EXPECT_THROW(apply_cli_overrides(cfg, 2, unknown), std::runtime_error);
+    const char* const no_value[] = { "charizard_api", "--workers" };
+    EXPECT_THROW(apply_cli_overrides(cfg, 2, no_value), std::runtime_error);
+    const char* const bad_port[] = { "charizard_api", "--port=70000" };
+    EXPECT_THROW(apply_cli_overrides(cfg, 2, bad_port), std::runtime_error);
+}
+
+// ===== WorkStealingTaskQueue =====
+
+TEST(WorkStealingTaskQueue, RunsAllJobsBeforeShutdownReturns)
+{
+    std::atomic<int>      ran{ 0 };
+    WorkStealingTaskQueue pool(3);
+    EXPECT_EQ(pool.worker_count(), 3U);
+    for (int i = 0; i < 1000; ++i)
+        EXPECT_TRUE(pool.enqueue([&ran] { ran++; }));
+    pool.shutdown();
+    EXPECT_EQ(ran.load(), 1000);
+    EXPECT_EQ(pool.queued(), 0U);
+}
+
+TEST(WorkStealingTaskQueue, IdleWorkersStealFromBusyPeer)
+{
+    // Worker 0 gets blocked on the first job; every other job would sit in its deque
+    // forever unless the second worker steals it.
+    std::mutex                   gate;
+    std::unique_lock<std::mutex> hold(gate);
+    std::atomic<int>             ran{ 0 };
+    WorkStealingTaskQueue        pool(2);
+    pool.enqueue([&gate] { std::scoped_lock lk(gate); });
+    for (int i = 0; i < 10; ++i)
+        pool.enqueue([&ran] { ran++; });
+    for (int spins = 0; ran.load() < 10 && spins < 2000; ++spins)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(ran.load(), 10);
+    hold.unlock();
+    pool.shutdown();
+}
+
+TEST(WorkStealingTaskQueue, FlagsJobsPastBoundAndRefusesPastTwiceBound)
+{
+    std::mutex                   gate;
+    std::unique_lock<std::mutex> hold(gate);
+    std::atomic<int>             shed_seen{ 0 };
+    WorkStealingTaskQueue        pool(1, 2);
+
+    // Occupy the single worker, then wait until its job has left the deque
+    pool.enqueue([&gate] { std::scoped_lock lk(gate); });
+    for (int spins = 0; pool.queued() > 0 && spins < 2000; ++spins)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // A shed job reports it to its first request only
+    auto probe = [&shed_seen]
+    {
+        if (WorkStealingTaskQueue::take_current_job_shed())
+            shed_seen++;
+        if (WorkStealingTaskQueue::take_current_job_shed())
+            shed_seen += 100;
+    };
+    EXPECT_TRUE(pool.enqueue(probe));  // depth 0
+    EXPECT_TRUE(pool.enqueue(probe));  // depth 1
+    EXPECT_TRUE(pool.enqueue(probe));  // depth 2: admitted but shed
+    EXPECT_TRUE(pool.enqueue(probe));  // depth 3: admitted but shed
+    EXPECT_FALSE(pool.enqueue(probe)); // depth 4: refused
+    EXPECT_EQ(pool.shed_count(), 3U);
+
+    hold.unlock();
+    pool.shutdown();
+    EXPECT_EQ(shed_seen.load(), 2);
+    EXPECT_FALSE(WorkStealingTaskQueue::take_current_job_shed());
+}
+
+TEST(WorkStealingTaskQueue, RejectsJobsAfterShutdown)
+{
+    WorkStealingTaskQueue pool(1);
+    pool.shutdown();
+    EXPECT_FALSE(pool.enqueue([] {}));
+}
@@ -0,0 +1,202 @@
+#include "storage.hpp"
+#include "temp_dir.hpp"
+#include "wal.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+class SnapshotTest : public TempDirTest
+{
+  protected:
+    std::string wal_path() const
+    {
+        return (dir_ / "store.wal").string();
+    }
+
+    std::string snap_path() const
+    {
+        return (dir_ / "store.snap").string();
+    }
+
+    SnapshotOptions snapshot_options() const
+    {
+        SnapshotOptions opts;
+        opts.path           = snap_path();
+        opts.check_interval = std::chrono::hours(1); // tests trigger snapshots explicitly
+        return opts;
+    }
+};
+
+InMemorySnapshot sample_snapshot()
+{
+    InMemorySnapshot snap;
+    snap.generation = 7;
+    for (int i = 0; i < 50; ++i)
+    {
+        const auto user = "user" + std::to_string(i);
+        for (int j = 0; j <= i; ++j)
+        {
+            TransitEvent ev(user, j % 2 == 0 ? "bus" : "car", 1.5 * j, 1700000000 + j);
+            if (ev.mode == "car")
+            {
+                ev.fuel_type    = "electric";
+                ev.vehicle_size = "small";
+                ev.occupancy    = 2.0;
+            }
+            if (j % 3 == 0)
+                ev.region = "US-CA";
+            snap.events[user].push_back(ev);
+        }
+    }
+    snap.api_keys["user1"]  = "hash1";
+    snap.app_names["user1"] = "App One";
+    snap.emission_factors.push_back({ "bus", "", "", 0.08, "DEFRA-2024", 42 });
+    return snap;
+}
+
+} // namespace
+
+TEST_F(SnapshotTest, RoundTripsEveryField)
+{
+    const auto snap = sample_snapshot();
+    write_store_snapshot(snap_path(), snap);
+
+    InMemorySnapshot loaded;
+    ASSERT_TRUE(read_store_snapshot(snap_path(), loaded, 4));
+    EXPECT_EQ(loaded.generation, 7U);
+    ASSERT_EQ(loaded.events.size(), snap.events.size());
+    for (const auto& [user, evs] : snap.events)
+    {
+        const auto& got = loaded.events.at(user);
+        ASSERT_EQ(got.size(), evs.size());
+        for (std::size_t i = 0; i < evs.size(); ++i)
+        {
+            EXPECT_EQ(got[i].user_id, evs[i].user_id);
+            EXPECT_EQ(got[i].mode, evs[i].mode);
+            EXPECT_EQ(got[i].fuel_type, evs[i].fuel_type);
+            EXPECT_EQ(got[i].vehicle_size, evs[i].vehicle_size);
+            EXPECT_DOUBLE_EQ(got[i].occupancy, evs[i].occupancy);
+            EXPECT_DOUBLE_EQ(got[i].distance_km, evs[i].distance_km);
+            EXPECT_EQ(got[i].ts, evs[i].ts);
+            EXPECT_EQ(got[i].region, evs[i].region);
+        }
+    }
+    EXPECT_EQ(loaded.api_keys, snap.api_keys);
+    EXPECT_EQ(loaded.app_names, snap.app_names);
+    ASSERT_EQ(loaded.emission_factors.size(), 1U);
+    EXPECT_EQ(loaded.emission_factors[0].source, "DEFRA-2024");
+    EXPECT_EQ(loaded.emission_factors[0].updated_at, 42);
+}
+
+TEST_F(SnapshotTest, MissingFileReturnsFalse)
+{
+    InMemorySnapshot loaded;
+    EXPECT_FALSE(read_store_snapshot(snap_path(), loaded));
+}
+
+TEST_F(SnapshotTest, CorruptBlockIsRejected)
+{
+    write_store_snapshot(snap_path(), sample_snapshot());
+    {
+        std::fstream f(snap_path(), std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(40); // inside the first event block
+        f.put('\x7f');
+    }
+    InMemorySnapshot loaded;
+    EXPECT_THROW(read_store_snapshot(snap_path(), loaded), std::runtime_error);
+}
+
+TEST(CowSegment, WritesInANewEpochLeaveSharedCopiesAlone)
+{
+    CowSegment<std::vector<int>> seg;
+    seg.mut(0).push_back(1);
+    const auto shared = seg.share();
+
+    seg.mut(1).push_back(2); // a snapshot started epoch 1
+    EXPECT_EQ(*shared, std::vector<int>{ 1 });
+    EXPECT_EQ(seg.get(), (std::vector<int>{ 1, 2 }));
+
+    // Within the epoch the segment is written in place
+    const auto* data = &seg.get();
+    seg.mut(1).push_back(3);
+    EXPECT_EQ(&seg.get(), data);
+}
+
+TEST_F(SnapshotTest, SnapshotCompactsWalAndRestartRestoresState)
+{
+    {
+        InMemoryStore store;
+        store.open_wal(wal_path(), {}, snapshot_options());
+        store.set_api_key("alice", "alice-key");
+        store.add_event(TransitEvent("alice", "bus", 10.0, 1700000000));
+        store.store_emission_factor({ "bus", "", "", 0.09, "TEST", 1 });
+
+        EXPECT_EQ(store.snapshot_now(), 1U);
+        EXPECT_TRUE(list_wal_segments(wal_path()).empty());
+
+        // Writes after the snapshot only live in the new log
+        store.add_event(TransitEvent("alice", "train", 20.0, 1700000100));
+        store.add_event(TransitEvent("bob", "walk", 1.0, 1700000200));
+    }
+
+    InMemoryStore store;
+    store.open_wal(wal_path(), {}, snapshot_options());
+    EXPECT_EQ(store.recovery().snapshot_generation, 1U);
+    EXPECT_EQ(store.recovery().snapshot_events, 1U);
+    EXPECT_EQ(store.recovery().wal_records, 2U);
+    EXPECT_EQ(store.get_events("alice").size(), 2U);
+    EXPECT_EQ(store.get_events("bob").size(), 1U);
+    EXPECT_TRUE(store.check_api_key("alice", "alice-key"));
+    EXPECT_EQ(store.get_all_emission_factors().size(), 1U);
+}
+
+TEST_F(SnapshotTest, RecoversWhenCompactionWasInterrupted)
+{
+    {
+        InMemoryStore store;
+        store.open_wal(wal_path(), {}, snapshot_options());
+        store.add_event(TransitEvent("alice", "bus", 10.0, 1700000000));
+        store.snapshot_now(); // generation 1
+        store.add_event(TransitEvent("alice", "bus", 11.0, 1700000001));
+    }
+    // Simulate a crash right after the log was sealed for generation 2 but before its snapshot
+    // was written: the sealed segment must be replayed on top of snapshot 1.
+    std::filesystem::rename(wal_path(), wal_segment_path(wal_path(), 2));
+    // ... and a stale segment that snapshot 1 already covers must not be applied twice
+    {
+        WriteAheadLog stale(wal_segment_path(wal_path(), 1), {}, [](std::uint8_t, std::string_view) {});
+        WalEncoder    enc;
+        enc.put_str("alice");
+        stale.append(static_cast<std::uint8_t>(StoreWalRecord::ClearEvents), enc.bytes());
+    }
+
+    InMemoryStore store;
+    store.open_wal(wal_path(), {}, snapshot_options());
+    EXPECT_EQ(store.get_events("alice").size(), 2U);
+    EXPECT_EQ(list_wal_segments(wal_path()).size(), 1U);
+
+    // The next snapshot takes a newer generation and removes every covered segment
+    EXPECT_EQ(store.snapshot_now(), 3U);
+    EXPECT_TRUE(list_wal_segments(wal_path()).empty());
+}
+
+TEST_F(SnapshotTest, BackgroundThreadSnapshotsOnceWalIsLargeEnough)
+{
+    auto opts           = snapshot_options();
+    opts.check_interval = std::chrono::milliseconds(5);
+    opts.min_wal_bytes  = 1;
+
+    InMemoryStore store;
+    store.open_wal(wal_path(), {}, opts);
+    store.add_event(TransitEvent("alice", "bus", 10.0, 1700000000));
+    for (int i = 0; i < 400 && !std::filesystem::exists(snap_path()); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_TRUE(std::filesystem::exists(snap_path()));
+}
@@ -3,6 +3,8 @@
 #include <gtest/gtest.h>
 #include <nlohmann/json.hpp>
 
+#include <limits>
+
 using nlohmann::json;
 
 TEST(TransitLogic, MissingFieldsThrows)
@@ -29,6 +31,19 @@ TEST(TransitLogic, NegativeDistanceThrows)
     EXPECT_THROW(make_transit_event_from_json("alice", j, 123), std::runtime_error);
 }
 
+TEST(TransitLogic, NonFiniteDistanceOrOccupancyThrows)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (const double bad : { inf, nan })
+    {
+        const json occupancy = { { "mode", "bus" }, { "distance_km", 1.0 }, { "occupancy", bad } };
+        EXPECT_THROW(make_transit_event_from_json("alice", occupancy, 123), std::runtime_error);
+        const json distance = { { "mode", "bus" }, { "distance_km", bad } };
+        EXPECT_THROW(make_transit_event_from_json("alice", distance, 123), std::runtime_error);
+    }
+}
+
 TEST(TransitLogic, InvalidModeThrows)
 {
     const json j = { { "mode", "rocket" }, { "distance_km", 1.0 } };
@@ -0,0 +1,122 @@
+#include "transit_logic.hpp"
+#include "transit_parser.hpp"
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <string>
+
+TEST(TransitParser, ParsesAllKnownFields)
+{
+    const std::string body = R"({"mode":"car","distance_km":12.5,"ts":1700000000,"fuel_type":"diesel",)"
+                             R"("vehicle_size":"large","occupancy":2})";
+    TransitPayload    p;
+    ASSERT_TRUE(parse_transit_payload(body, p));
+    EXPECT_EQ(p.mode, "car");
+    EXPECT_DOUBLE_EQ(p.distance_km, 12.5);
+    EXPECT_EQ(p.ts, 1700000000);
+    EXPECT_EQ(p.fuel_type, "diesel");
+    EXPECT_EQ(p.vehicle_size, "large");
+    EXPECT_DOUBLE_EQ(p.occupancy, 2.0);
+
+    // The strings are views into the body, not copies
+    EXPECT_GE(p.mode.data(), body.data());
+    EXPECT_LT(p.mode.data(), body.data() + body.size());
+}
+
+TEST(TransitParser, OptionalFieldsDefault)
+{
+    TransitPayload p;
+    ASSERT_TRUE(parse_transit_payload(" {\n\t\"distance_km\" : 3 , \"mode\" : \"bus\" }\r\n", p));
+    EXPECT_EQ(p.mode, "bus");
+    EXPECT_DOUBLE_EQ(p.distance_km, 3.0);
+    EXPECT_EQ(p.ts, 0);
+    EXPECT_TRUE(p.fuel_type.empty());
+    EXPECT_TRUE(p.vehicle_size.empty());
+    EXPECT_DOUBLE_EQ(p.occupancy, 1.0);
+    EXPECT_TRUE(p.region.empty());
+}
+
+TEST(TransitParser, SkipsUnknownScalarKeysAndKeepsLastDuplicate)
+{
+    TransitPayload p;
+    ASSERT_TRUE(parse_transit_payload(
+        R"({"mode":"bus","note":"x","ok":true,"n":null,"k":-1.5e3,"distance_km":1,"distance_km":2})", p));
+    EXPECT_DOUBLE_EQ(p.distance_km, 2.0);
+}
+
+TEST(TransitParser, DefersEverythingElseToTheGenericPath)
+{
+    for (const char* body : {
+             "",
+             "{}",
+             "[]",
+             R"({"mode":"bus"})",
+             R"({"distance_km":1})",
+             R"({"mode":"bus","distance_km":1)",
+             R"({"mode":"bus","distance_km":1} x)",
+             R"({"mode":"bus","distance_km":1,})",
+             R"({"mode":"bus" "distance_km":1})",
+             R"({"mode":"b\u0075s","distance_km":1})",
+             "{\"mode\":\"bus\xc3\xa9\",\"distance_km\":1}",
+             R"({"mode":5,"distance_km":1})",
+             R"({"mode":"bus","distance_km":"1"})",
+             R"({"mode":"bus","distance_km":01})",
+             R"({"mode":"bus","distance_km":1.})",
+             R"({"mode":"bus","distance_km":1e999})",
+             R"({"mode":"bus","distance_km":1,"ts":1.5})",
+             R"({"mode":"bus","distance_km":1,"ts":null})",
+             R"({"mode":"bus","distance_km":1,"extra":{"a":1}})",
+             R"({"mode":"bus","distance_km":1,"extra":[1]})",
+             R"({"mode":"bus","distance_km":1,"extra":nul})",
+         })
+    {
+        TransitPayload p;
+        EXPECT_FALSE(parse_transit_payload(body, p)) << body;
+    }
+}
+
+TEST(TransitParser, AgreesWithTheGenericPath)
+{
+    for (const char* body : {
+             R"({"mode":"car","distance_km":7.25,"ts":1690000000,"fuel_type":"petrol","occupancy":3})",
+             R"({"mode":"taxi","distance_km":0.1,"vehicle_size":"small","region":"us-ca"})",
+             R"({"mode":"train","distance_km":-0,"ts":-5})",
+             R"({"mode":"walk","distance_km":123456789012345678})",
+             R"({"mode":"bike","distance_km":2.5E-1,"ts":0})",
+         })
+    {
+        TransitPayload p;
+        ASSERT_TRUE(parse_transit_payload(body, p)) << body;
+        const auto fast    = make_transit_event("alice", p, 1600000000);
+        const auto generic = make_transit_event_from_json("alice", nlohmann::json::parse(body), 1600000000);
+        EXPECT_EQ(fast.mode, generic.mode) << body;
+        EXPECT_EQ(std::memcmp(&fast.distance_km, &generic.distance_km, sizeof(double)), 0) << body;
+        EXPECT_EQ(fast.fuel_type, generic.fuel_type) << body;
+        EXPECT_EQ(fast.vehicle_size, generic.vehicle_size) << body;
+        EXPECT_DOUBLE_EQ(fast.occupancy, generic.occupancy) << body;
+        EXPECT_EQ(fast.region, generic.region) << body;
+        if (p.ts != 0)
+        {
+            EXPECT_EQ(fast.ts, generic.ts) << body;
+        }
+    }
+}
+
+TEST(TransitParser, EventValidationMatchesTheGenericPath)
+{
+    TransitPayload p;
+    ASSERT_TRUE(parse_transit_payload(R"({"mode":"rocket","distance_km":1})", p));
+    EXPECT_THROW(make_transit_event("alice", p, 1), std::runtime_error);
+    ASSERT_TRUE(parse_transit_payload(R"({"mode":"car","distance_km":-1})", p));
+    EXPECT_THROW(make_transit_event("alice", p, 1), std::runtime_error);
+    ASSERT_TRUE(parse_transit_payload(R"({"mode":"car","distance_km":1,"occupancy":0.5})", p));
+    EXPECT_THROW(make_transit_event("alice", p, 1), std::runtime_error);
+    const auto body = nlohmann::json::parse(R"({"mode":"car","distance_km":1,"occupancy":0.5})");
+    EXPECT_THROW(make_transit_event_from_json("alice", body, 1), std::runtime_error);
+
+    ASSERT_TRUE(parse_transit_payload(R"({"mode":"bus","distance_km":1,"region":"gb"})", p));
+    EXPECT_EQ(make_transit_event("alice", p, 1).region, "GB");
+    ASSERT_TRUE(parse_transit_payload(R"({"mode":"bus","distance_km":1,"region":"g b"})", p));
+    EXPECT_THROW(make_transit_event("alice", p, 1), std::runtime_error);
+}
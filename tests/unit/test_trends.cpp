@@ -0,0 +1,98 @@
+#include "trends.hpp"
+
+#include <gtest/gtest.h>
+
+namespace
+{
+
+constexpr std::int64_t k_today = 19730;
+
+DailyRollup rollup(std::int64_t day, const std::string& mode, double km, double kg_per_km)
+{
+    DailyRollup r;
+    r.user_id     = "alice";
+    r.day         = day;
+    r.mode        = mode;
+    r.trips       = 1;
+    r.distance_km = km;
+    r.kg_co2      = km * kg_per_km;
+    return r;
+}
+
+} // namespace
+
+TEST(Trends, SplitsTheTwoWeeksPerMode)
+{
+    const std::vector<DailyRollup> rollups = {
+        rollup(k_today, "bus", 10.0, 0.1),
+        rollup(k_today - 6, "bus", 5.0, 0.1),
+        rollup(k_today - 7, "car", 20.0, 0.2),
+        rollup(k_today - 14, "car", 99.0, 0.2), // too old
+        rollup(k_today + 1, "car", 99.0, 0.2),  // tomorrow
+    };
+    const auto t = weekly_trends(rollups, k_today);
+    EXPECT_EQ(t.this_week.trips, 2);
+    EXPECT_DOUBLE_EQ(t.this_week.distance_km, 15.0);
+    EXPECT_DOUBLE_EQ(t.last_week.kg_co2, 4.0);
+    ASSERT_EQ(t.modes.size(), 2U);
+    EXPECT_EQ(t.modes[0].mode, "bus");
+    EXPECT_DOUBLE_EQ(t.modes[1].last_week.distance_km, 20.0);
+    EXPECT_DOUBLE_EQ(t.kg_co2_delta(), 1.5 - 4.0);
+}
+
+TEST(Trends, DetectsAShiftToADirtierMode)
+{
+    // 40 km of subway last week, 30 km of it by taxi this week
+    const std::vector<DailyRollup> rollups = {
+        rollup(k_today - 10, "subway", 40.0, 0.03),
+        rollup(k_today - 2, "subway", 10.0, 0.03),
+        rollup(k_today - 1, "taxi", 30.0, 0.2),
+    };
+    const auto t = weekly_trends(rollups, k_today);
+    ASSERT_EQ(t.shifts.size(), 1U);
+    EXPECT_EQ(t.shifts[0].from_mode, "subway");
+    EXPECT_EQ(t.shifts[0].to_mode, "taxi");
+    EXPECT_DOUBLE_EQ(t.shifts[0].distance_km, 30.0);
+    EXPECT_NEAR(t.shifts[0].kg_co2_delta, 30.0 * (0.2 - 0.03), 1e-9);
+
+    const auto tips = trend_suggestions(t);
+    ASSERT_EQ(tips.size(), 1U);
+    EXPECT_NE(tips[0].find("from subway to taxi"), std::string::npos);
+}
+
+TEST(Trends, IgnoresSmallChangesAndMissingBaselines)
+{
+    // Nothing last week: no baseline, so no shifts and no tips
+    auto t = weekly_trends({ rollup(k_today, "taxi", 50.0, 0.2) }, k_today);
+    EXPECT_TRUE(t.shifts.empty());
+    EXPECT_TRUE(trend_suggestions(t).empty());
+
+    // 0.5 km moved out of 100 km is noise
+    t = weekly_trends({ rollup(k_today - 8, "bus", 100.0, 0.1), rollup(k_today, "bus", 99.5, 0.1),
+                        rollup(k_today, "walk", 0.5, 0.0) },
+                      k_today);
+    EXPECT_TRUE(t.shifts.empty());
+    EXPECT_TRUE(trend_suggestions(t).empty());
+}
+
+TEST(Trends, ReportsARiseWithoutAShift)
+{
+    const auto t = weekly_trends({ rollup(k_today - 9, "car", 10.0, 0.2), rollup(k_today, "car", 30.0, 0.2) },
+                                 k_today);
+    EXPECT_TRUE(t.shifts.empty());
+    const auto tips = trend_suggestions(t);
+    ASSERT_EQ(tips.size(), 1U);
+    EXPECT_EQ(tips[0], "Your footprint is up 200% on last week, mostly from car trips.");
+}
+
+TEST(Trends, ReadsTheLastTwoWeeksFromTheStore)
+{
+    InMemoryStore      store;
+    const std::int64_t now = k_today * 86400 + 3600;
+    store.add_event(TransitEvent("alice", "bus", 10.0, now - 9 * 86400));
+    store.add_event(TransitEvent("alice", "bus", 4.0, now));
+    store.add_event(TransitEvent("alice", "bus", 50.0, now - 30 * 86400));
+    const auto t = weekly_trends(store, "alice", now);
+    EXPECT_DOUBLE_EQ(t.this_week.distance_km, 4.0);
+    EXPECT_DOUBLE_EQ(t.last_week.distance_km, 10.0);
+}
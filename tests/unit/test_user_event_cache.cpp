@@ -0,0 +1,87 @@
+#include "user_event_cache.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::vector<TransitEvent> events_for(const std::string& user, int n)
+{
+    std::vector<TransitEvent> out;
+    out.reserve(static_cast<std::size_t>(n));
+    for (int i = 0; i < n; ++i)
+        out.emplace_back(user, "bus", 1.0, 1700000000 + i);
+    return out;
+}
+
+} // namespace
+
+TEST(UserEventCache, FindReturnsInsertedEvents)
+{
+    UserEventCache cache;
+    EXPECT_EQ(cache.find("alice"), nullptr);
+    cache.insert("alice", events_for("alice", 3));
+    ASSERT_NE(cache.find("alice"), nullptr);
+    EXPECT_EQ(cache.find("alice")->size(), 3U);
+    EXPECT_EQ(cache.size(), 1U);
+    EXPECT_GT(cache.bytes(), 3 * sizeof(TransitEvent));
+}
+
+TEST(UserEventCache, AppendOnlyTouchesCachedUsers)
+{
+    UserEventCache cache;
+    cache.insert("alice", events_for("alice", 1));
+    const auto bytes = cache.bytes();
+    cache.append(TransitEvent("alice", "train", 2.0, 1700000100));
+    cache.append(TransitEvent("bob", "train", 2.0, 1700000100));
+    EXPECT_EQ(cache.find("alice")->size(), 2U);
+    EXPECT_FALSE(cache.contains("bob"));
+    EXPECT_GT(cache.bytes(), bytes);
+}
+
+TEST(UserEventCache, EvictsLeastRecentlyUsedOverBudget)
+{
+    const std::size_t per_user = 10 * sizeof(TransitEvent) + 256;
+    UserEventCache    cache(2 * per_user);
+    cache.insert("a", events_for("a", 10));
+    cache.insert("b", events_for("b", 10));
+    cache.find("a");
+    cache.insert("c", events_for("c", 10));
+
+    EXPECT_TRUE(cache.contains("a"));
+    EXPECT_FALSE(cache.contains("b"));
+    EXPECT_TRUE(cache.contains("c"));
+    EXPECT_EQ(cache.evictions(), 1U);
+    EXPECT_LE(cache.bytes(), cache.budget_bytes());
+}
+
+TEST(UserEventCache, OversizedEntryIsKeptUntilTheNextInsert)
+{
+    UserEventCache cache(64);
+    cache.insert("a", events_for("a", 10));
+    EXPECT_TRUE(cache.contains("a"));
+    cache.insert("b", events_for("b", 10));
+    EXPECT_FALSE(cache.contains("a"));
+    EXPECT_TRUE(cache.contains("b"));
+}
+
+TEST(UserEventCache, SummaryExpiresAndIsDroppedOnAppend)
+{
+    using Clock = UserEventCache::Clock;
+    UserEventCache cache;
+    cache.insert("alice", events_for("alice", 1));
+    const auto       t0 = Clock::now();
+    FootprintSummary s;
+    s.lifetime_kg_co2 = 1.5;
+    cache.set_summary("alice", s, t0);
+
+    ASSERT_TRUE(cache.summary("alice", t0 + std::chrono::seconds(10), std::chrono::seconds(60)));
+    EXPECT_DOUBLE_EQ(cache.summary("alice", t0, std::chrono::seconds(60))->lifetime_kg_co2, 1.5);
+    EXPECT_FALSE(cache.summary("alice", t0 + std::chrono::seconds(61), std::chrono::seconds(60)));
+
+    cache.append(TransitEvent("alice", "bus", 1.0, 1700000100));
+    EXPECT_FALSE(cache.summary("alice", t0, std::chrono::seconds(60)));
+}
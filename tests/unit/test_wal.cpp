@@ -0,0 +1,275 @@
+#include "wal.hpp"
+#include "storage.hpp"
+#include "temp_dir.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+class WalTest : public TempDirTest
+{
+  protected:
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        path_ = (dir_ / "store.wal").string();
+    }
+
+    using Records = std::vector<std::pair<std::uint8_t, std::string>>;
+
+    Records replay(std::uint64_t* replayed = nullptr) const
+    {
+        Records       out;
+        WriteAheadLog wal(path_, {}, [&](std::uint8_t type, std::string_view payload)
+                          { out.emplace_back(type, std::string(payload)); });
+        if (replayed)
+            *replayed = wal.replayed_records();
+        return out;
+    }
+
+    std::uintmax_t file_size() const
+    {
+        return std::filesystem::file_size(path_);
+    }
+
+    std::string path_;
+};
+
+} // namespace
+
+TEST(WalCodec, RoundTripsAllFieldTypes)
+{
+    WalEncoder enc;
+    enc.put_u8(7);
+    enc.put_u32(123456789U);
+    enc.put_i64(-42);
+    enc.put_f64(3.25);
+    enc.put_str("hello");
+    enc.put_str("");
+
+    WalDecoder dec(enc.bytes());
+    EXPECT_EQ(dec.u8(), 7);
+    EXPECT_EQ(dec.u32(), 123456789U);
+    EXPECT_EQ(dec.i64(), -42);
+    EXPECT_DOUBLE_EQ(dec.f64(), 3.25);
+    EXPECT_EQ(dec.str(), "hello");
+    EXPECT_EQ(dec.str(), "");
+    EXPECT_TRUE(dec.at_end());
+    EXPECT_THROW(dec.u8(), std::runtime_error);
+}
+
+TEST(WalCodec, Crc32MatchesReferenceValue)
+{
+    EXPECT_EQ(wal_crc32("123456789"), 0xCBF43926U);
+}
+
+TEST_F(WalTest, AppendedRecordsReplayInOrder)
+{
+    {
+        WriteAheadLog wal(path_, {}, [](std::uint8_t, std::string_view) { FAIL() << "log should be new"; });
+        const auto    a = wal.append(1, "first");
+        const auto    b = wal.append(2, "second");
+        EXPECT_EQ(a, 1U);
+        EXPECT_EQ(b, 2U);
+        wal.wait_durable(b);
+        wal.append(3, std::string(1000, 'x'));
+    } // destructor drains the last record
+
+    std::uint64_t replayed = 0;
+    auto          records  = replay(&replayed);
+    ASSERT_EQ(records.size(), 3U);
+    EXPECT_EQ(replayed, 3U);
+    EXPECT_EQ(records[0], std::make_pair(std::uint8_t{ 1 }, std::string("first")));
+    EXPECT_EQ(records[1], std::make_pair(std::uint8_t{ 2 }, std::string("second")));
+    EXPECT_EQ(records[2].second.size(), 1000U);
+}
+
+TEST_F(WalTest, TornTailIsTruncatedAndLogStaysAppendable)
+{
+    {
+        WriteAheadLog wal(path_, {}, [](std::uint8_t, std::string_view) {});
+        wal.append(1, "kept");
+        wal.append(1, "torn");
+        wal.flush();
+    }
+    const auto full = file_size();
+    std::filesystem::resize_file(path_, full - 2);
+
+    EXPECT_EQ(replay().size(), 1U);
+    EXPECT_LT(file_size(), full - 2);
+
+    {
+        WriteAheadLog wal(path_, {}, [](std::uint8_t, std::string_view) {});
+        wal.append(1, "after");
+    }
+    auto records = replay();
+    ASSERT_EQ(records.size(), 2U);
+    EXPECT_EQ(records[1].second, "after");
+}
+
+TEST_F(WalTest, CorruptRecordStopsReplay)
+{
+    {
+        WriteAheadLog wal(path_, {}, [](std::uint8_t, std::string_view) {});
+        wal.append(1, "good");
+        wal.append(1, "flipped");
+        wal.append(1, "unreachable");
+    }
+    {
+        // Flip a payload byte of the second record: magic(8) + header(9) + "good"(4) + header(9)
+        std::fstream f(path_, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(8 + 9 + 4 + 9);
+        f.put('F');
+    }
+    auto records = replay();
+    ASSERT_EQ(records.size(), 1U);
+    EXPECT_EQ(records[0].second, "good");
+}
+
+TEST_F(WalTest, RejectsFileWithoutMagic)
+{
+    {
+        std::ofstream f(path_, std::ios::binary);
+        f << "definitely not a log";
+    }
+    EXPECT_THROW(replay(), std::runtime_error);
+}
+
+TEST_F(WalTest, TornHeaderIsTreatedAsEmptyLog)
+{
+    {
+        std::ofstream f(path_, std::ios::binary);
+        f << "CHZW";
+    }
+    EXPECT_TRUE(replay().empty());
+    EXPECT_EQ(file_size(), 8U);
+
+    {
+        WriteAheadLog wal(path_, {}, [](std::uint8_t, std::string_view) {});
+        wal.append(1, "after");
+    }
+    auto records = replay();
+    ASSERT_EQ(records.size(), 1U);
+    EXPECT_EQ(records[0].second, "after");
+}
+
+TEST_F(WalTest, UnsyncedModeStillPersistsOnClose)
+{
+    WalOptions opts;
+    opts.sync = false;
+    {
+        WriteAheadLog wal(path_, opts, [](std::uint8_t, std::string_view) {});
+        wal.wait_durable(wal.append(9, "lazy"));
+    }
+    EXPECT_EQ(replay().size(), 1U);
+}
+
+TEST_F(WalTest, InMemoryStoreRecoversStateAfterRestart)
+{
+    {
+        InMemoryStore store;
+        store.open_wal(path_);
+        store.set_api_key("alice", "alice-key", "Alice App");
+        store.add_event(TransitEvent("alice", "bus", 12.5, 1700000000));
+        store.add_event(TransitEvent("alice", "car", 3.0, 1700000100));
+        store.store_emission_factor({ "car", "diesel", "large", 0.27, "TEST", 5 });
+        store.store_emission_factor({ "car", "diesel", "large", 0.31, "TEST", 6 });
+        store.store_emission_factor({ "bus", "", "", 0.09, "TEST", 7 });
+        store.clear_db_events();
+        TransitEvent train("bob", "train", 40.0, 1700000200);
+        train.region = "GB";
+        store.add_event(train);
+    }
+
+    InMemoryStore store;
+    store.open_wal(path_);
+    EXPECT_EQ(store.wal()->replayed_records(), 8U);
+
+    EXPECT_TRUE(store.get_events("alice").empty());
+    auto bob = store.get_events("bob");
+    ASSERT_EQ(bob.size(), 1U);
+    EXPECT_EQ(bob[0].mode, "train");
+    EXPECT_DOUBLE_EQ(bob[0].distance_km, 40.0);
+    EXPECT_EQ(bob[0].ts, 1700000200);
+    EXPECT_EQ(bob[0].region, "GB");
+
+    EXPECT_TRUE(store.check_api_key("alice", "alice-key"));
+    EXPECT_FALSE(store.check_api_key("alice", "wrong"));
+
+    auto factors = store.get_all_emission_factors();
+    ASSERT_EQ(factors.size(), 2U);
+    EXPECT_DOUBLE_EQ(factors[0].kg_co2_per_km, 0.31);
+
+    // A full clear is also durable
+    store.clear_db();
+    InMemoryStore reopened;
+    reopened.open_wal(path_);
+    EXPECT_TRUE(reopened.get_events("bob").empty());
+    EXPECT_TRUE(reopened.get_all_emission_factors().empty());
+    EXPECT_FALSE(reopened.check_api_key("alice", "alice-key"));
+}
+
+TEST_F(WalTest, InMemoryStoreReplaysRecordsLoggedBeforeRegions)
+{
+    // An AddEvent record as logged before events carried a region, then a factor record
+    {
+        WriteAheadLog wal(path_, {}, [](std::uint8_t, std::string_view) {});
+        WalEncoder    ev;
+        ev.put_str("alice");
+        ev.put_str("car");
+        ev.put_str("diesel");
+        ev.put_str("large");
+        ev.put_f64(2.0);
+        ev.put_f64(12.5);
+        ev.put_i64(1700000000);
+        wal.append(static_cast<std::uint8_t>(StoreWalRecord::AddEvent), ev.bytes());
+        WalEncoder factor;
+        factor.put_str("bus");
+        factor.put_str("");
+        factor.put_str("");
+        factor.put_f64(0.09);
+        factor.put_str("TEST");
+        factor.put_i64(7);
+        const auto seq =
+            wal.append(static_cast<std::uint8_t>(StoreWalRecord::StoreEmissionFactor), factor.bytes());
+        wal.wait_durable(seq);
+    }
+
+    InMemoryStore store;
+    store.open_wal(path_);
+    const auto alice = store.get_events("alice");
+    ASSERT_EQ(alice.size(), 1U);
+    EXPECT_EQ(alice[0].fuel_type, "diesel");
+    EXPECT_EQ(alice[0].vehicle_size, "large");
+    EXPECT_DOUBLE_EQ(alice[0].occupancy, 2.0);
+    EXPECT_DOUBLE_EQ(alice[0].distance_km, 12.5);
+    EXPECT_EQ(alice[0].ts, 1700000000);
+    EXPECT_EQ(alice[0].region, "");
+    EXPECT_EQ(store.get_rollups("alice", 0, epoch_day(1700000000)).size(), 1U);
+
+    const auto factor = store.get_emission_factor("bus", "", "");
+    ASSERT_TRUE(factor.has_value());
+    EXPECT_DOUBLE_EQ(factor->kg_co2_per_km, 0.09);
+    EXPECT_EQ(factor->updated_at, 7);
+    EXPECT_EQ(factor->region, "");
+}
+
+TEST_F(WalTest, LogNeverContainsPlaintextApiKey)
+{
+    {
+        InMemoryStore store;
+        store.open_wal(path_);
+        store.set_api_key("carol", "super-secret-plaintext");
+    }
+    std::ifstream in(path_, std::ios::binary);
+    std::string   contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents.find("super-secret-plaintext"), std::string::npos);
+}
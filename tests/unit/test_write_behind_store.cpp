@@ -0,0 +1,236 @@
+#include "storage.hpp"
+#include "write_behind_store.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+
+struct InnerCounters
+{
+    std::atomic<int>  event_reads{ 0 };
+    std::atomic<int>  batches{ 0 };
+    std::atomic<int>  largest_batch{ 0 };
+    std::atomic<bool> fail{ false };
+};
+
+// InMemoryStore that counts what the decorator asks of it and can be told to reject batches.
+class RecordingStore : public InMemoryStore
+{
+  public:
+    explicit RecordingStore(std::shared_ptr<InnerCounters> counters) : counters_(std::move(counters))
+    {
+    }
+
+    void add_events(const std::vector<TransitEvent>& evs) override
+    {
+        if (counters_->fail)
+            throw std::runtime_error("store unavailable");
+        ++counters_->batches;
+        counters_->largest_batch = std::max(counters_->largest_batch.load(), static_cast<int>(evs.size()));
+        InMemoryStore::add_events(evs);
+    }
+
+    std::vector<TransitEvent> get_events(const std::string& user) const override
+    {
+        ++counters_->event_reads;
+        return InMemoryStore::get_events(user);
+    }
+
+  private:
+    std::shared_ptr<InnerCounters> counters_;
+};
+
+WriteBehindOptions manual_flush(std::size_t batch_size)
+{
+    WriteBehindOptions opts;
+    opts.batch_size     = batch_size;
+    opts.max_pending    = 1000;
+    opts.flush_interval = std::chrono::hours(1);
+    return opts;
+}
+
+} // namespace
+
+TEST(WriteBehindStore, BuffersWritesAndFlushesInBatches)
+{
+    auto             counters = std::make_shared<InnerCounters>();
+    auto             inner    = std::make_unique<RecordingStore>(counters);
+    auto*            raw      = inner.get();
+    WriteBehindStore store(std::move(inner), manual_flush(10));
+
+    for (int i = 0; i < 25; ++i)
+        store.add_event(TransitEvent("alice", "bus", 1.0 + i, 1700000000 + i));
+    // Acknowledged writes are readable before they reach the wrapped store
+    EXPECT_EQ(store.get_events("alice").size(), 25U);
+
+    store.flush();
+    EXPECT_EQ(raw->InMemoryStore::get_events("alice").size(), 25U);
+    EXPECT_GE(counters->batches.load(), 3);
+    EXPECT_LE(counters->largest_batch.load(), 10);
+    EXPECT_EQ(store.stats().pending, 0U);
+    EXPECT_EQ(store.stats().flushed, 25U);
+}
+
+TEST(WriteBehindStore, ServesReadsFromCacheAfterFirstLoad)
+{
+    auto counters = std::make_shared<InnerCounters>();
+    auto inner    = std::make_unique<RecordingStore>(counters);
+    inner->add_event(TransitEvent("alice", "train", 12.0, 1700000000));
+    WriteBehindStore store(std::move(inner), manual_flush(10));
+
+    EXPECT_EQ(store.get_events("alice").size(), 1U);
+    store.add_event(TransitEvent("alice", "bus", 3.0, 1700000100));
+    EXPECT_EQ(store.get_events("alice").size(), 2U);
+    EXPECT_GT(store.summarize("alice").lifetime_kg_co2, 0.0);
+    EXPECT_EQ(counters->event_reads.load(), 1);
+    EXPECT_EQ(store.stats().cached_users, 1U);
+}
+
+TEST(WriteBehindStore, LoadIncludesEventsStillBuffered)
+{
+    auto             counters = std::make_shared<InnerCounters>();
+    WriteBehindStore store(std::make_unique<RecordingStore>(counters), manual_flush(10));
+
+    // bob is not cached yet, so his event only exists in the buffer when he is first read
+    store.add_event(TransitEvent("bob", "walk", 2.0, 1700000000));
+    EXPECT_EQ(store.get_events("bob").size(), 1U);
+    store.flush();
+    EXPECT_EQ(store.get_events("bob").size(), 1U);
+}
+
+TEST(WriteBehindStore, WriteThroughReachesInnerStoreBeforeReturning)
+{
+    auto counters = std::make_shared<InnerCounters>();
+    auto inner    = std::make_unique<RecordingStore>(counters);
+    auto opts     = manual_flush(10);
+    opts.mode     = WriteMode::WriteThrough;
+    auto*            raw = inner.get();
+    WriteBehindStore store(std::move(inner), opts);
+
+    store.add_event(TransitEvent("alice", "bus", 5.0, 1700000000));
+    EXPECT_EQ(raw->InMemoryStore::get_events("alice").size(), 1U);
+    EXPECT_EQ(store.stats().pending, 0U);
+}
+
+TEST(WriteBehindStore, RejectedBatchIsRetried)
+{
+    auto             counters = std::make_shared<InnerCounters>();
+    auto             inner    = std::make_unique<RecordingStore>(counters);
+    auto*            raw      = inner.get();
+    WriteBehindStore store(std::move(inner), manual_flush(10));
+
+    store.add_event(TransitEvent("alice", "bus", 5.0, 1700000000));
+    counters->fail = true;
+    EXPECT_THROW(store.flush(), std::runtime_error);
+    EXPECT_EQ(store.stats().pending, 1U);
+    EXPECT_EQ(store.stats().failed_batches, 1U);
+
+    counters->fail = false;
+    store.flush();
+    EXPECT_EQ(raw->InMemoryStore::get_events("alice").size(), 1U);
+}
+
+TEST(WriteBehindStore, FullBufferBlocksWriters)
+{
+    auto counters  = std::make_shared<InnerCounters>();
+    counters->fail = true;
+    WriteBehindOptions opts;
+    opts.batch_size     = 4;
+    opts.max_pending    = 4;
+    opts.flush_interval = std::chrono::milliseconds(1);
+    WriteBehindStore store(std::make_unique<RecordingStore>(counters), opts);
+
+    std::atomic<bool> done{ false };
+    std::thread       writer(
+        [&]
+        {
+            for (int i = 0; i < 5; ++i)
+                store.add_event(TransitEvent("alice", "bus", 1.0, 1700000000 + i));
+            done = true;
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(done.load());
+    EXPECT_EQ(store.stats().pending, 4U);
+
+    counters->fail = false; // the store recovers and the flusher makes room
+    writer.join();
+    store.flush();
+    EXPECT_EQ(store.get_events("alice").size(), 5U);
+}
+
+TEST(WriteBehindStore, DestructorFlushesBufferedWrites)
+{
+    auto counters = std::make_shared<InnerCounters>();
+    {
+        WriteBehindStore store(std::make_unique<RecordingStore>(counters), manual_flush(100));
+        store.add_event(TransitEvent("alice", "bus", 5.0, 1700000000));
+        store.append_log(ApiLogRecord{ 1700000000, "POST", "/transit", 200, 1.0, "127.0.0.1", "alice" });
+        EXPECT_EQ(counters->batches.load(), 0);
+    }
+    EXPECT_EQ(counters->batches.load(), 1);
+}
+
+TEST(WriteBehindStore, ClearDropsBufferedEvents)
+{
+    auto             counters = std::make_shared<InnerCounters>();
+    WriteBehindStore store(std::make_unique<RecordingStore>(counters), manual_flush(10));
+
+    store.add_event(TransitEvent("alice", "bus", 5.0, 1700000000));
+    store.clear_db_events();
+    EXPECT_TRUE(store.get_events("alice").empty());
+    store.flush();
+    EXPECT_EQ(counters->batches.load(), 0);
+}
+
+TEST(WriteBehindStore, CountsHitsAndMisses)
+{
+    auto counters = std::make_shared<InnerCounters>();
+    auto inner    = std::make_unique<RecordingStore>(counters);
+    inner->add_event(TransitEvent("alice", "bus", 4.0, 1700000000));
+    WriteBehindStore store(std::move(inner), manual_flush(10));
+
+    store.get_events("alice"); // miss: loaded
+    store.get_events("alice"); // hit
+    store.summarize("alice");  // hit, summary computed
+    store.summarize("alice");  // hit, summary reused
+    store.add_event(TransitEvent("alice", "bus", 4.0, 1700000100));
+    const auto before = store.stats().summary_hits;
+    store.summarize("alice"); // the new event dropped the cached summary
+    const auto st = store.stats();
+    EXPECT_EQ(st.summary_hits, before);
+    EXPECT_EQ(st.misses, 1U);
+    EXPECT_EQ(st.hits, 4U);
+    EXPECT_DOUBLE_EQ(st.hit_ratio(), 0.8);
+    EXPECT_EQ(counters->event_reads.load(), 1);
+}
+
+TEST(WriteBehindStore, EvictsLeastRecentlyReadUsersOverBudget)
+{
+    auto counters = std::make_shared<InnerCounters>();
+    auto inner    = std::make_unique<RecordingStore>(counters);
+    for (int u = 0; u < 3; ++u)
+        for (int i = 0; i < 20; ++i)
+            inner->add_event(TransitEvent("user" + std::to_string(u), "bus", 1.0, 1700000000 + i));
+    auto opts        = manual_flush(10);
+    opts.cache_bytes = 2 * (20 * sizeof(TransitEvent) + 512); // room for two users
+    WriteBehindStore store(std::move(inner), opts);
+
+    store.get_events("user0");
+    store.get_events("user1");
+    store.get_events("user0"); // user1 is now the least recently read
+    store.get_events("user2");
+    EXPECT_EQ(store.stats().evictions, 1U);
+    EXPECT_LE(store.stats().cache_bytes, opts.cache_bytes);
+
+    const auto reads = counters->event_reads.load();
+    store.get_events("user0");
+    EXPECT_EQ(counters->event_reads.load(), reads);
+    store.get_events("user1");
+    EXPECT_EQ(counters->event_reads.load(), reads + 1);
+}